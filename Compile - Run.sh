@@ -1,11 +1,64 @@
 #!/bin/sh
+if [ "$(uname -s)" = "Linux" ]; then
+	LIBS="-lglut -lGLU -lGL -lEGL -lpthread -lrt -lm"
+else
+	LIBS="-lglut32cu -lglu32 -lopengl32 -lpthread"
+fi
+
 gcc -o engine.o -c engine.c
 gcc -o camera.o -c camera.c
 gcc -o input.o -c input.c
 gcc -o rollercoaster.o -c rollercoaster.c
+gcc -o snapshot.o -c snapshot.c
+gcc -o encoding.o -c encoding.c
+gcc -o replay.o -c replay.c
+gcc -o telemetry.o -c telemetry.c
+gcc -o stats.o -c stats.c
+gcc -o bvh.o -c bvh.c
+gcc -o threadpool.o -c threadpool.c
+gcc -o clearance.o -c clearance.c
+gcc -o controlpoints.o -c controlpoints.c
+gcc -o history.o -c history.c
+gcc -o track.o -c track.c
+gcc -o analytics.o -c analytics.c
+gcc -o trackfile.o -c trackfile.c
+gcc -o evaluate.o -c evaluate.c
+gcc -o procedural.o -c procedural.c
+gcc -o park.o -c park.c
+gcc -o operation.o -c operation.c
+gcc -o heightmap.o -c heightmap.c
+gcc -o terrain.o -c terrain.c
+gcc -o gpu.o -c gpu.c
+gcc -o sceneryfile.o -c sceneryfile.c
+gcc -o scenery.o -c scenery.c
+gcc -o offscreen.o -c offscreen.c
+gcc -o capture.o -c capture.c
+gcc -o rendertimer.o -c rendertimer.c
+gcc -o trackshader.o -c trackshader.c
+gcc -o railmesh.o -c railmesh.c
+
+gcc -Wall -o rollercoaster engine.o camera.o input.o rollercoaster.o snapshot.o encoding.o replay.o telemetry.o stats.o bvh.o threadpool.o clearance.o controlpoints.o history.o track.o analytics.o trackfile.o procedural.o park.o operation.o heightmap.o terrain.o gpu.o sceneryfile.o scenery.o offscreen.o capture.o rendertimer.o trackshader.o railmesh.o main.c $LIBS
+gcc -Wall -o telemetrydump encoding.o telemetry.o telemetrydump.c -lpthread -lm
+gcc -Wall -o statsreader stats.o statsreader.c $LIBS
+gcc -Wall -o trackeval engine.o encoding.o bvh.o threadpool.o clearance.o track.o trackfile.o evaluate.o trackeval.c $LIBS
+gcc -Wall -o trackopt engine.o encoding.o bvh.o threadpool.o clearance.o track.o analytics.o trackfile.o evaluate.o trackopt.c $LIBS
+gcc -Wall -o trackgen engine.o encoding.o bvh.o threadpool.o clearance.o track.o trackfile.o procedural.o trackgen.c $LIBS
+gcc -Wall -o capacity engine.o encoding.o bvh.o threadpool.o clearance.o track.o trackfile.o operation.o capacity.c $LIBS
+gcc -Wall -o terraingen engine.o encoding.o heightmap.o terraingen.c $LIBS
+gcc -Wall -o scenerygen engine.o encoding.o heightmap.o sceneryfile.o scenerygen.c $LIBS
+
+#The simulation library, built position independent and without GL so it can go into a static or shared library
+gcc -fPIC -DENGINE_NO_GL -o engine.pic.o -c engine.c
+gcc -fPIC -o bvh.pic.o -c bvh.c
+gcc -fPIC -o threadpool.pic.o -c threadpool.c
+gcc -fPIC -o clearance.pic.o -c clearance.c
+gcc -fPIC -o track.pic.o -c track.c
+gcc -fPIC -o coastersim.pic.o -c coastersim.c
 
-gcc -Wall -o rollercoaster engine.o camera.o input.o rollercoaster.o main.c -lglut32cu -lglu32 -lopengl32
+ar rcs libcoastersim.a engine.pic.o bvh.pic.o threadpool.pic.o clearance.pic.o track.pic.o coastersim.pic.o
+gcc -shared -o libcoastersim.so engine.pic.o bvh.pic.o threadpool.pic.o clearance.pic.o track.pic.o coastersim.pic.o -lpthread -lm
 
-rm engine.o camera.o input.o rollercoaster.o
+rm engine.pic.o bvh.pic.o threadpool.pic.o clearance.pic.o track.pic.o coastersim.pic.o
+rm engine.o camera.o input.o rollercoaster.o snapshot.o encoding.o replay.o telemetry.o stats.o bvh.o threadpool.o clearance.o controlpoints.o history.o track.o analytics.o trackfile.o evaluate.o procedural.o park.o operation.o heightmap.o terrain.o gpu.o sceneryfile.o scenery.o offscreen.o capture.o rendertimer.o trackshader.o railmesh.o
 
 ./rollercoaster
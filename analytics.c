@@ -0,0 +1,389 @@
+/*	Analytics.c
+ *	This module works out what a ride feels like: curvature, g-forces, jerk and airtime along the whole track
+ *
+ *	The train's speed at each subsection comes from the energy it gains and loses along each one, under the same
+ *	gravity, friction and chain lift the simulation uses, rather than from ticking a train round a whole lap.
+ *	Everything else is worked out per subsection from its neighbours, so the track is copied into
+ *	one array per component and the kernels run four subsections at a time using GCC vector types, split across the
+ *	thread pool. Only the ends of each chunk, where neighbours wrap around the loop, are done one at a time.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "analytics.h"
+#include "threadpool.h"
+
+#define ANALYTICS_GRAIN 4096
+
+#define GRAVITY_STRENGTH 9.81f
+
+//Speed used for timing when the train is crawling, so jerk doesn't blow up where it stalls
+#define MIN_ANALYTICS_SPEED 0.1f
+
+
+typedef float Float4 __attribute__((vector_size(16)));
+
+/*	The track and intermediate results, one array per component */
+typedef struct {
+	const Track* track;
+	int count;
+	float* length;
+	float* rise;
+	float* tangentX, * tangentY, * tangentZ;
+	float* normalX, * normalY, * normalZ;
+	float* binormalX, * binormalY, * binormalZ;
+
+	//Seconds per metre at each subsection
+	float* pace;
+
+	RideAnalytics* analytics;
+} AnalyticsJob;
+
+static void recordVelocityProfile(AnalyticsJob* job, float* velocity);
+static void copyTrack(int start, int end, int worker, void* context);
+static void forceKernel(int start, int end, int worker, void* context);
+static void jerkKernel(int start, int end, int worker, void* context);
+static void forceSample(AnalyticsJob* job, int i);
+static void jerkSample(AnalyticsJob* job, int i);
+static Float4 load4(const float* address);
+static void store4(float* address, Float4 value);
+static void findAirtime(RideAnalytics* analytics);
+static float* allocateSamples(int count);
+
+
+/* Analyzes one lap of the track, starting from a standstill at the station the same way the simulation does */
+RideAnalytics* analyzeRide(const Track* track)
+{
+	double startTime = getTimeSeconds();
+
+	RideAnalytics* analytics = calloc(1, sizeof(RideAnalytics));
+	int count = getNumberOfSubSections(track);
+	analytics->numberOfSamples = count;
+
+	analytics->distance = allocateSamples(count);
+	analytics->velocity = allocateSamples(count);
+	analytics->curvature = allocateSamples(count);
+	analytics->verticalG = allocateSamples(count);
+	analytics->lateralG = allocateSamples(count);
+	analytics->jerk = allocateSamples(count);
+
+	AnalyticsJob job;
+	job.track = track;
+	job.count = count;
+	job.analytics = analytics;
+
+	float** arrays[] = { &job.length, &job.rise, &job.tangentX, &job.tangentY, &job.tangentZ, &job.normalX, &job.normalY, &job.normalZ,
+		&job.binormalX, &job.binormalY, &job.binormalZ, &job.pace };
+	int numberOfArrays = sizeof(arrays) / sizeof(arrays[0]);
+	for(int a = 0; a < numberOfArrays; a++)
+		*arrays[a] = allocateSamples(count);
+
+	parallelFor(count, ANALYTICS_GRAIN, copyTrack, &job);
+
+	double distance = 0;
+	for(int i = 0; i < count; i++)
+	{
+		analytics->distance[i] = distance;
+		distance += job.length[i];
+	}
+
+	recordVelocityProfile(&job, analytics->velocity);
+
+	parallelFor(count, ANALYTICS_GRAIN, forceKernel, &job);
+	parallelFor(count, ANALYTICS_GRAIN, jerkKernel, &job);
+
+	analytics->minVerticalG = INFINITY;
+	analytics->maxVerticalG = -INFINITY;
+	for(int i = 0; i < count; i++)
+	{
+		analytics->minVerticalG = fminf(analytics->minVerticalG, analytics->verticalG[i]);
+		analytics->maxVerticalG = fmaxf(analytics->maxVerticalG, analytics->verticalG[i]);
+		analytics->maxLateralG = fmaxf(analytics->maxLateralG, fabsf(analytics->lateralG[i]));
+		analytics->maxJerk = fmaxf(analytics->maxJerk, analytics->jerk[i]);
+	}
+
+	findAirtime(analytics);
+
+	for(int a = 0; a < numberOfArrays; a++)
+		free(*arrays[a]);
+
+	analytics->seconds = getTimeSeconds() - startTime;
+	return analytics;
+}
+
+void freeRideAnalytics(RideAnalytics* analytics)
+{
+	if(analytics == NULL)
+		return;
+
+	free(analytics->distance);
+	free(analytics->velocity);
+	free(analytics->curvature);
+	free(analytics->verticalG);
+	free(analytics->lateralG);
+	free(analytics->jerk);
+	free(analytics->airtimeRegions);
+	free(analytics);
+}
+
+/* Writes one row per subsection, returns 0 if the file couldn't be written */
+int writeRideAnalytics(const RideAnalytics* analytics, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if(file == NULL) {
+		printf("Could not open %s for ride analytics\n", path);
+		return 0;
+	}
+
+	fprintf(file, "subsection,section,distance,velocity,curvature,vertical_g,lateral_g,jerk,airtime\n");
+
+	for(int i = 0; i < analytics->numberOfSamples; i++)
+	{
+		fprintf(file, "%d,%d,%.4f,%.4f,%.5f,%.4f,%.4f,%.4f,%d\n", i, i / NUMBER_OF_SUB_SECTIONS, analytics->distance[i],
+			analytics->velocity[i], analytics->curvature[i], analytics->verticalG[i], analytics->lateralG[i],
+			analytics->jerk[i], analytics->verticalG[i] < 0);
+	}
+
+	fclose(file);
+	return 1;
+}
+
+
+//==============VELOCITY PROFILE==============
+
+/*	Follows the train's speed from the station once around the track, subsection by subsection
+ *	Gravity changes its kinetic energy by the height each subsection climbs or drops, friction takes off the
+ *	same fraction a tick the simulation does for as many ticks as the subsection takes, and a chain lift holds
+ *	it up to lift speed. Subsections it never reaches because it stalled are left at 0
+ */
+static void recordVelocityProfile(AnalyticsJob* job, float* velocity)
+{
+	const float frictionPerTick = logf(1 - FRICTION_COEFFICIENT);
+
+	float speed = COASTER_START_SPEED;
+	velocity[0] = speed;
+
+	for(int i = 0; i < job->count - 1; i++)
+	{
+		int isChain = job->track->sections[i / NUMBER_OF_SUB_SECTIONS].isChain;
+		if(isChain)
+			speed = fmaxf(speed, CHAIN_LIFT_SPEED);
+
+		float entrySpeed = speed;
+		float squared = (speed * speed) + (2 * GRAVITY * job->rise[i]);
+		speed = squared > 0 ? sqrtf(squared) : 0;
+
+		if(isChain)
+			speed = fmaxf(speed, CHAIN_LIFT_SPEED);
+
+		//Without a chain lift under it, a train that has stopped can only roll back
+		if(speed <= 0)
+			break;
+
+		float ticks = job->length[i] / (((entrySpeed + speed) / 2) * TRAIN_TICK_LENGTH);
+		speed *= expf(frictionPerTick * ticks);
+
+		velocity[i + 1] = speed;
+	}
+}
+
+
+//==============KERNELS=======================
+
+static void copyTrack(int start, int end, int worker, void* context)
+{
+	AnalyticsJob* job = context;
+
+	for(int i = start; i < end; i++)
+	{
+		const TrackSubSection* subSection = getSubSection(job->track, i);
+		Vector3 binormal = getFrameBinormal(&(subSection->frame));
+
+		job->length[i] = subSection->subSectionLength;
+		job->rise[i] = subSection->subSectionEnd.y - subSection->subSectionStart.y;
+		job->tangentX[i] = subSection->frame.tangent.x;
+		job->tangentY[i] = subSection->frame.tangent.y;
+		job->tangentZ[i] = subSection->frame.tangent.z;
+		job->normalX[i] = subSection->frame.normal.x;
+		job->normalY[i] = subSection->frame.normal.y;
+		job->normalZ[i] = subSection->frame.normal.z;
+		job->binormalX[i] = binormal.x;
+		job->binormalY[i] = binormal.y;
+		job->binormalZ[i] = binormal.z;
+	}
+}
+
+/*	Curvature is how fast the tangent turns per metre, the curvature vector times speed squared is the train's
+ *	acceleration. What the riders feel is that acceleration plus the seat holding them up against gravity.
+ */
+static void forceKernel(int start, int end, int worker, void* context)
+{
+	AnalyticsJob* job = context;
+	RideAnalytics* analytics = job->analytics;
+
+	//The first subsection's previous one wraps around the loop
+	int i = start;
+	if(i == 0)
+		forceSample(job, i++);
+
+	const Float4 half = { 0.5f, 0.5f, 0.5f, 0.5f };
+	const Float4 epsilon = { 1e-6f, 1e-6f, 1e-6f, 1e-6f };
+	const Float4 gravity = { GRAVITY_STRENGTH, GRAVITY_STRENGTH, GRAVITY_STRENGTH, GRAVITY_STRENGTH };
+
+	for(; i + 4 <= end; i += 4)
+	{
+		Float4 spacing = (load4(&job->length[i - 1]) + load4(&job->length[i])) * half + epsilon;
+
+		Float4 curveX = (load4(&job->tangentX[i]) - load4(&job->tangentX[i - 1])) / spacing;
+		Float4 curveY = (load4(&job->tangentY[i]) - load4(&job->tangentY[i - 1])) / spacing;
+		Float4 curveZ = (load4(&job->tangentZ[i]) - load4(&job->tangentZ[i - 1])) / spacing;
+
+		Float4 velocity = load4(&analytics->velocity[i]);
+		Float4 speedSquared = velocity * velocity;
+
+		Float4 forceX = speedSquared * curveX;
+		Float4 forceY = speedSquared * curveY + gravity;
+		Float4 forceZ = speedSquared * curveZ;
+
+		Float4 vertical = (forceX * load4(&job->normalX[i]) + forceY * load4(&job->normalY[i]) + forceZ * load4(&job->normalZ[i])) / gravity;
+		Float4 lateral = (forceX * load4(&job->binormalX[i]) + forceY * load4(&job->binormalY[i]) + forceZ * load4(&job->binormalZ[i])) / gravity;
+		Float4 curvatureSquared = curveX * curveX + curveY * curveY + curveZ * curveZ;
+
+		store4(&analytics->verticalG[i], vertical);
+		store4(&analytics->lateralG[i], lateral);
+
+		for(int lane = 0; lane < 4; lane++)
+		{
+			analytics->curvature[i + lane] = sqrtf(curvatureSquared[lane]);
+			job->pace[i + lane] = 1.0f / fmaxf(velocity[lane], MIN_ANALYTICS_SPEED);
+		}
+	}
+
+	for(; i < end; i++)
+		forceSample(job, i);
+}
+
+/* Jerk is the change in g-force between the subsections either side, over the time it takes to get between them */
+static void jerkKernel(int start, int end, int worker, void* context)
+{
+	AnalyticsJob* job = context;
+	RideAnalytics* analytics = job->analytics;
+
+	//Both ends of the track have a neighbour on the other side of the loop
+	int i = start;
+	if(i == 0)
+		jerkSample(job, i++);
+
+	int last = end < job->count ? end : job->count - 1;
+
+	for(; i + 4 <= last; i += 4)
+	{
+		Float4 vertical = load4(&analytics->verticalG[i + 1]) - load4(&analytics->verticalG[i - 1]);
+		Float4 lateral = load4(&analytics->lateralG[i + 1]) - load4(&analytics->lateralG[i - 1]);
+		Float4 changeSquared = vertical * vertical + lateral * lateral;
+
+		Float4 time = (load4(&job->length[i - 1]) + load4(&job->length[i])) * load4(&job->pace[i]);
+
+		for(int lane = 0; lane < 4; lane++)
+			analytics->jerk[i + lane] = sqrtf(changeSquared[lane]) / time[lane];
+	}
+
+	for(; i < end; i++)
+		jerkSample(job, i);
+}
+
+static void forceSample(AnalyticsJob* job, int i)
+{
+	RideAnalytics* analytics = job->analytics;
+	int previous = (i + job->count - 1) % job->count;
+
+	float spacing = (job->length[previous] + job->length[i]) * 0.5f + 1e-6f;
+
+	float curveX = (job->tangentX[i] - job->tangentX[previous]) / spacing;
+	float curveY = (job->tangentY[i] - job->tangentY[previous]) / spacing;
+	float curveZ = (job->tangentZ[i] - job->tangentZ[previous]) / spacing;
+
+	float velocity = analytics->velocity[i];
+	float speedSquared = velocity * velocity;
+
+	float forceX = speedSquared * curveX;
+	float forceY = speedSquared * curveY + GRAVITY_STRENGTH;
+	float forceZ = speedSquared * curveZ;
+
+	analytics->verticalG[i] = (forceX * job->normalX[i] + forceY * job->normalY[i] + forceZ * job->normalZ[i]) / GRAVITY_STRENGTH;
+	analytics->lateralG[i] = (forceX * job->binormalX[i] + forceY * job->binormalY[i] + forceZ * job->binormalZ[i]) / GRAVITY_STRENGTH;
+	analytics->curvature[i] = sqrtf(curveX * curveX + curveY * curveY + curveZ * curveZ);
+	job->pace[i] = 1.0f / fmaxf(velocity, MIN_ANALYTICS_SPEED);
+}
+
+static void jerkSample(AnalyticsJob* job, int i)
+{
+	RideAnalytics* analytics = job->analytics;
+	int previous = (i + job->count - 1) % job->count;
+	int next = (i + 1) % job->count;
+
+	float vertical = analytics->verticalG[next] - analytics->verticalG[previous];
+	float lateral = analytics->lateralG[next] - analytics->lateralG[previous];
+	float time = (job->length[previous] + job->length[i]) * job->pace[i];
+
+	analytics->jerk[i] = sqrtf(vertical * vertical + lateral * lateral) / time;
+}
+
+static Float4 load4(const float* address)
+{
+	Float4 value;
+	memcpy(&value, address, sizeof(value));
+	return value;
+}
+
+static void store4(float* address, Float4 value)
+{
+	memcpy(address, &value, sizeof(value));
+}
+
+
+//==============AIRTIME=======================
+
+/* Collects the runs of negative vertical g into regions */
+static void findAirtime(RideAnalytics* analytics)
+{
+	int allocated = 0;
+
+	for(int i = 0; i < analytics->numberOfSamples; i++)
+	{
+		if(analytics->verticalG[i] >= 0)
+			continue;
+
+		AirtimeRegion region;
+		region.start = i;
+		region.length = 0;
+		region.duration = 0;
+		region.minVerticalG = 0;
+
+		for(; i < analytics->numberOfSamples && analytics->verticalG[i] < 0; i++)
+		{
+			float length = (i + 1 < analytics->numberOfSamples ? analytics->distance[i + 1] : analytics->distance[i]) - analytics->distance[i];
+
+			region.length += length;
+			region.duration += length / fmaxf(analytics->velocity[i], MIN_ANALYTICS_SPEED);
+			region.minVerticalG = fminf(region.minVerticalG, analytics->verticalG[i]);
+		}
+		region.count = i - region.start;
+
+		if(analytics->numberOfAirtimeRegions == allocated)
+		{
+			allocated = allocated ? allocated * 2 : 16;
+			analytics->airtimeRegions = realloc(analytics->airtimeRegions, allocated * sizeof(AirtimeRegion));
+		}
+
+		analytics->airtimeRegions[analytics->numberOfAirtimeRegions++] = region;
+		analytics->airtime += region.duration;
+	}
+}
+
+/* Sample arrays are padded by a vector so loads of the next sample never run off the end */
+static float* allocateSamples(int count)
+{
+	return calloc(count + 4, sizeof(float));
+}
@@ -0,0 +1,44 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include "track.h"
+
+/*	A run of subsections where the riders are pulled out of their seats */
+typedef struct {
+	int start;
+	int count;
+	float length;
+	float duration;
+	float minVerticalG;
+} AirtimeRegion;
+
+/*	What a rider feels at the start of every subsection, one array per quantity
+ *	G-forces are in multiples of gravity, positive vertical g pushes riders into their seats and positive lateral g
+ *	pushes them to the right. Jerk is how fast the g-forces change, in g per second.
+ */
+typedef struct {
+	int numberOfSamples;
+
+	float* distance;
+	float* velocity;
+	float* curvature;
+	float* verticalG;
+	float* lateralG;
+	float* jerk;
+
+	AirtimeRegion* airtimeRegions;
+	int numberOfAirtimeRegions;
+
+	float minVerticalG, maxVerticalG;
+	float maxLateralG;
+	float maxJerk;
+	float airtime;
+
+	double seconds;
+} RideAnalytics;
+
+RideAnalytics* analyzeRide(const Track* track);
+int writeRideAnalytics(const RideAnalytics* analytics, const char* path);
+void freeRideAnalytics(RideAnalytics* analytics);
+
+#endif
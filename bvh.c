@@ -0,0 +1,534 @@
+/*	Bvh.c
+ *	This module implements a bounding volume hierarchy over line segments, for spatial queries along the track
+ *
+ *	The tree is built top down, splitting each node at the median centroid along its longest axis, so it stays
+ *	balanced and queries are O(log n). Nodes live in one array with siblings side by side.
+ *	Moving a primitive refits its leaf and the boxes above it, without rebuilding the tree.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include "bvh.h"
+
+#define PRIMITIVES_PER_LEAF 4
+#define MAX_DEPTH 128
+
+static void buildNode(Bvh* bvh, int node, int first, int count, const Vector3* centroids);
+static BoundingBox primitiveBounds(const Bvh* bvh, int primitive);
+static BoundingBox leafBounds(const Bvh* bvh, const BvhNode* leaf);
+static BoundingBox unionBounds(const BoundingBox* a, const BoundingBox* b);
+static float boxDistanceSquared(const BoundingBox* box, const Vector3* point);
+static int rayHitsBox(const BoundingBox* box, const Vector3* origin, const Vector3* inverseDirection, float maxDistance);
+static float raySegmentHit(const Vector3* origin, const Vector3* direction, const Vector3* start, const Vector3* end, float radius);
+
+Bvh* buildBvh(const Vector3* starts, const Vector3* ends, int count, float radius)
+{
+	Bvh* bvh = malloc(sizeof(Bvh));
+
+	bvh->numberOfPrimitives = count;
+	bvh->radius = radius;
+	bvh->starts = malloc(count * sizeof(Vector3));
+	bvh->ends = malloc(count * sizeof(Vector3));
+	memcpy(bvh->starts, starts, count * sizeof(Vector3));
+	memcpy(bvh->ends, ends, count * sizeof(Vector3));
+
+	bvh->order = malloc(count * sizeof(int));
+	bvh->leafOf = malloc(count * sizeof(int));
+	bvh->nodes = malloc((count > 0 ? 2 * count : 1) * sizeof(BvhNode));
+	bvh->numberOfNodes = 1;
+
+	Vector3* centroids = malloc(count * sizeof(Vector3));
+	for(int i = 0; i < count; i++)
+	{
+		bvh->order[i] = i;
+		centroids[i] = lerpVector3(&starts[i], &ends[i], 0.5);
+	}
+
+	bvh->nodes[0].parent = -1;
+	buildNode(bvh, 0, 0, count, centroids);
+
+	free(centroids);
+
+	return bvh;
+}
+
+void freeBvh(Bvh* bvh)
+{
+	if(bvh == NULL)
+		return;
+
+	free(bvh->nodes);
+	free(bvh->order);
+	free(bvh->leafOf);
+	free(bvh->starts);
+	free(bvh->ends);
+	free(bvh);
+}
+
+static float axisOf(const Vector3* vector, int axis)
+{
+	if(axis == 0)
+		return vector->x;
+	if(axis == 1)
+		return vector->y;
+	return vector->z;
+}
+
+/* Partially sorts order[first, first + count) so the middle element is the median along the axis */
+static void selectMedian(int* order, int first, int count, int axis, const Vector3* centroids)
+{
+	int low = first;
+	int high = first + count - 1;
+	int middle = first + count / 2;
+
+	while(low < high)
+	{
+		float pivot = axisOf(&centroids[order[(low + high) / 2]], axis);
+		int i = low;
+		int j = high;
+
+		while(i <= j)
+		{
+			while(axisOf(&centroids[order[i]], axis) < pivot)
+				i++;
+			while(axisOf(&centroids[order[j]], axis) > pivot)
+				j--;
+
+			if(i <= j) {
+				int swap = order[i];
+				order[i] = order[j];
+				order[j] = swap;
+				i++;
+				j--;
+			}
+		}
+
+		if(middle <= j)
+			high = j;
+		else if(middle >= i)
+			low = i;
+		else
+			break;
+	}
+}
+
+static void buildNode(Bvh* bvh, int node, int first, int count, const Vector3* centroids)
+{
+	BvhNode* current = &(bvh->nodes[node]);
+
+	if(count <= PRIMITIVES_PER_LEAF)
+	{
+		current->first = first;
+		current->count = count;
+		current->bounds = leafBounds(bvh, current);
+
+		for(int i = first; i < first + count; i++)
+			bvh->leafOf[bvh->order[i]] = node;
+
+		return;
+	}
+
+	//Split along the longest axis of the centroids
+	Vector3 min = centroids[bvh->order[first]];
+	Vector3 max = min;
+	for(int i = first + 1; i < first + count; i++)
+	{
+		const Vector3* centroid = &centroids[bvh->order[i]];
+		min.x = fminf(min.x, centroid->x);
+		min.y = fminf(min.y, centroid->y);
+		min.z = fminf(min.z, centroid->z);
+		max.x = fmaxf(max.x, centroid->x);
+		max.y = fmaxf(max.y, centroid->y);
+		max.z = fmaxf(max.z, centroid->z);
+	}
+
+	Vector3 extent = minusVector3(&max, &min);
+	int axis = 0;
+	if(extent.y > extent.x && extent.y >= extent.z)
+		axis = 1;
+	else if(extent.z > extent.x && extent.z > extent.y)
+		axis = 2;
+
+	selectMedian(bvh->order, first, count, axis, centroids);
+
+	int left = bvh->numberOfNodes;
+	bvh->numberOfNodes += 2;
+
+	current->first = left;
+	current->count = 0;
+	bvh->nodes[left].parent = node;
+	bvh->nodes[left + 1].parent = node;
+
+	buildNode(bvh, left, first, count / 2, centroids);
+	buildNode(bvh, left + 1, first + count / 2, count - count / 2, centroids);
+
+	current->bounds = unionBounds(&(bvh->nodes[left].bounds), &(bvh->nodes[left + 1].bounds));
+}
+
+/* Moves one primitive and grows or shrinks the boxes above it to match */
+void refitBvhPrimitive(Bvh* bvh, int primitive, const Vector3* start, const Vector3* end)
+{
+	bvh->starts[primitive] = *start;
+	bvh->ends[primitive] = *end;
+
+	int node = bvh->leafOf[primitive];
+	bvh->nodes[node].bounds = leafBounds(bvh, &(bvh->nodes[node]));
+
+	node = bvh->nodes[node].parent;
+	while(node != -1)
+	{
+		BvhNode* current = &(bvh->nodes[node]);
+		current->bounds = unionBounds(&(bvh->nodes[current->first].bounds), &(bvh->nodes[current->first + 1].bounds));
+		node = current->parent;
+	}
+}
+
+
+//==============QUERIES=======================
+
+/* Returns the primitive closest to the point within maxDistance, or -1 if there is none */
+int bvhClosestPoint(const Bvh* bvh, const Vector3* point, float maxDistance, Vector3* closest, float* distance)
+{
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	int best = -1;
+	float bestDistanceSquared = maxDistance * maxDistance;
+
+	if(bvh->numberOfPrimitives == 0)
+		return -1;
+
+	stack[stackSize++] = 0;
+	while(stackSize > 0)
+	{
+		const BvhNode* node = &(bvh->nodes[stack[--stackSize]]);
+
+		if(boxDistanceSquared(&(node->bounds), point) > bestDistanceSquared)
+			continue;
+
+		if(node->count > 0)
+		{
+			for(int i = node->first; i < node->first + node->count; i++)
+			{
+				int primitive = bvh->order[i];
+				Vector3 candidate = closestPointOnSegment(point, &(bvh->starts[primitive]), &(bvh->ends[primitive]));
+				Vector3 difference = minusVector3(&candidate, point);
+				float distanceSquared = dotProductVector3(&difference, &difference);
+
+				if(distanceSquared < bestDistanceSquared) {
+					bestDistanceSquared = distanceSquared;
+					best = primitive;
+					if(closest != NULL)
+						*closest = candidate;
+				}
+			}
+		}
+		else
+		{
+			//Visit the nearer child first so the search radius shrinks sooner
+			float leftDistance = boxDistanceSquared(&(bvh->nodes[node->first].bounds), point);
+			float rightDistance = boxDistanceSquared(&(bvh->nodes[node->first + 1].bounds), point);
+
+			if(leftDistance < rightDistance) {
+				stack[stackSize++] = node->first + 1;
+				stack[stackSize++] = node->first;
+			}
+			else {
+				stack[stackSize++] = node->first;
+				stack[stackSize++] = node->first + 1;
+			}
+		}
+	}
+
+	if(best != -1 && distance != NULL)
+		*distance = sqrt(bestDistanceSquared);
+
+	return best;
+}
+
+/* Returns the first primitive the ray passes within radius of, or -1. The direction must be unit length */
+int bvhRaycast(const Bvh* bvh, const Vector3* origin, const Vector3* direction, float maxDistance, float* hitDistance)
+{
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	int best = -1;
+	float bestDistance = maxDistance;
+
+	if(bvh->numberOfPrimitives == 0)
+		return -1;
+
+	Vector3 inverseDirection;
+	inverseDirection.x = 1.0f / direction->x;
+	inverseDirection.y = 1.0f / direction->y;
+	inverseDirection.z = 1.0f / direction->z;
+
+	stack[stackSize++] = 0;
+	while(stackSize > 0)
+	{
+		const BvhNode* node = &(bvh->nodes[stack[--stackSize]]);
+
+		if(!rayHitsBox(&(node->bounds), origin, &inverseDirection, bestDistance))
+			continue;
+
+		if(node->count > 0)
+		{
+			for(int i = node->first; i < node->first + node->count; i++)
+			{
+				int primitive = bvh->order[i];
+				float hit = raySegmentHit(origin, direction, &(bvh->starts[primitive]), &(bvh->ends[primitive]), bvh->radius);
+
+				if(hit >= 0 && hit < bestDistance) {
+					bestDistance = hit;
+					best = primitive;
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node->first;
+			stack[stackSize++] = node->first + 1;
+		}
+	}
+
+	if(best != -1 && hitDistance != NULL)
+		*hitDistance = bestDistance;
+
+	return best;
+}
+
+/* Finds every primitive within radius of the center, writing up to maxResults of them
+ * Returns how many there are in total, which may be more than were written
+ */
+int bvhRadiusQuery(const Bvh* bvh, const Vector3* center, float radius, int* results, int maxResults)
+{
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	int found = 0;
+	float radiusSquared = (radius + bvh->radius) * (radius + bvh->radius);
+
+	if(bvh->numberOfPrimitives == 0)
+		return 0;
+
+	stack[stackSize++] = 0;
+	while(stackSize > 0)
+	{
+		const BvhNode* node = &(bvh->nodes[stack[--stackSize]]);
+
+		if(boxDistanceSquared(&(node->bounds), center) > radius * radius)
+			continue;
+
+		if(node->count > 0)
+		{
+			for(int i = node->first; i < node->first + node->count; i++)
+			{
+				int primitive = bvh->order[i];
+				Vector3 closest = closestPointOnSegment(center, &(bvh->starts[primitive]), &(bvh->ends[primitive]));
+				Vector3 difference = minusVector3(&closest, center);
+
+				if(dotProductVector3(&difference, &difference) <= radiusSquared) {
+					if(found < maxResults)
+						results[found] = primitive;
+					found++;
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node->first;
+			stack[stackSize++] = node->first + 1;
+		}
+	}
+
+	return found;
+}
+
+/*	Finds every primitive on the inner side of all the planes, a point p is inside a plane when dot(normal, p) + distance >= 0
+ *	Handy for frustums and selection boxes. Returns the total found, which may be more than maxResults
+ */
+int bvhPlanesQuery(const Bvh* bvh, const Vector3* normals, const float* distances, int numberOfPlanes, int* results, int maxResults)
+{
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	int found = 0;
+
+	if(bvh->numberOfPrimitives == 0)
+		return 0;
+
+	stack[stackSize++] = 0;
+	while(stackSize > 0)
+	{
+		const BvhNode* node = &(bvh->nodes[stack[--stackSize]]);
+
+		//Skip the node if its corner furthest along any plane's normal is still outside that plane
+		int outside = 0;
+		for(int p = 0; p < numberOfPlanes && !outside; p++)
+		{
+			Vector3 corner;
+			corner.x = normals[p].x >= 0 ? node->bounds.max.x : node->bounds.min.x;
+			corner.y = normals[p].y >= 0 ? node->bounds.max.y : node->bounds.min.y;
+			corner.z = normals[p].z >= 0 ? node->bounds.max.z : node->bounds.min.z;
+
+			if(dotProductVector3(&normals[p], &corner) + distances[p] < 0)
+				outside = 1;
+		}
+		if(outside)
+			continue;
+
+		if(node->count > 0)
+		{
+			for(int i = node->first; i < node->first + node->count; i++)
+			{
+				int primitive = bvh->order[i];
+				int inside = 1;
+
+				for(int p = 0; p < numberOfPlanes && inside; p++)
+				{
+					float start = dotProductVector3(&normals[p], &(bvh->starts[primitive]));
+					float end = dotProductVector3(&normals[p], &(bvh->ends[primitive]));
+
+					if(fmaxf(start, end) + distances[p] < -bvh->radius)
+						inside = 0;
+				}
+
+				if(inside) {
+					if(found < maxResults)
+						results[found] = primitive;
+					found++;
+				}
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node->first;
+			stack[stackSize++] = node->first + 1;
+		}
+	}
+
+	return found;
+}
+
+
+//==============GEOMETRY======================
+
+Vector3 closestPointOnSegment(const Vector3* point, const Vector3* start, const Vector3* end)
+{
+	Vector3 segment = minusVector3(end, start);
+	float lengthSquared = dotProductVector3(&segment, &segment);
+
+	if(lengthSquared <= 0)
+		return *start;
+
+	Vector3 toPoint = minusVector3(point, start);
+	float t = dotProductVector3(&toPoint, &segment) / lengthSquared;
+
+	return lerpVector3(start, end, t);
+}
+
+static BoundingBox primitiveBounds(const Bvh* bvh, int primitive)
+{
+	const Vector3* start = &(bvh->starts[primitive]);
+	const Vector3* end = &(bvh->ends[primitive]);
+	float radius = bvh->radius;
+
+	BoundingBox box;
+	box.min.x = fminf(start->x, end->x) - radius;
+	box.min.y = fminf(start->y, end->y) - radius;
+	box.min.z = fminf(start->z, end->z) - radius;
+	box.max.x = fmaxf(start->x, end->x) + radius;
+	box.max.y = fmaxf(start->y, end->y) + radius;
+	box.max.z = fmaxf(start->z, end->z) + radius;
+
+	return box;
+}
+
+static BoundingBox leafBounds(const Bvh* bvh, const BvhNode* leaf)
+{
+	BoundingBox box;
+	box.min.x = box.min.y = box.min.z = FLT_MAX;
+	box.max.x = box.max.y = box.max.z = -FLT_MAX;
+
+	for(int i = leaf->first; i < leaf->first + leaf->count; i++)
+	{
+		BoundingBox primitive = primitiveBounds(bvh, bvh->order[i]);
+		box = unionBounds(&box, &primitive);
+	}
+
+	return box;
+}
+
+static BoundingBox unionBounds(const BoundingBox* a, const BoundingBox* b)
+{
+	BoundingBox box;
+	box.min.x = fminf(a->min.x, b->min.x);
+	box.min.y = fminf(a->min.y, b->min.y);
+	box.min.z = fminf(a->min.z, b->min.z);
+	box.max.x = fmaxf(a->max.x, b->max.x);
+	box.max.y = fmaxf(a->max.y, b->max.y);
+	box.max.z = fmaxf(a->max.z, b->max.z);
+
+	return box;
+}
+
+static float boxDistanceSquared(const BoundingBox* box, const Vector3* point)
+{
+	float dx = fmaxf(fmaxf(box->min.x - point->x, 0), point->x - box->max.x);
+	float dy = fmaxf(fmaxf(box->min.y - point->y, 0), point->y - box->max.y);
+	float dz = fmaxf(fmaxf(box->min.z - point->z, 0), point->z - box->max.z);
+
+	return (dx * dx) + (dy * dy) + (dz * dz);
+}
+
+/* Slab test, true if the ray enters the box before maxDistance */
+static int rayHitsBox(const BoundingBox* box, const Vector3* origin, const Vector3* inverseDirection, float maxDistance)
+{
+	float tx1 = (box->min.x - origin->x) * inverseDirection->x;
+	float tx2 = (box->max.x - origin->x) * inverseDirection->x;
+	float ty1 = (box->min.y - origin->y) * inverseDirection->y;
+	float ty2 = (box->max.y - origin->y) * inverseDirection->y;
+	float tz1 = (box->min.z - origin->z) * inverseDirection->z;
+	float tz2 = (box->max.z - origin->z) * inverseDirection->z;
+
+	float near = fmaxf(fmaxf(fminf(tx1, tx2), fminf(ty1, ty2)), fminf(tz1, tz2));
+	float far = fminf(fminf(fmaxf(tx1, tx2), fmaxf(ty1, ty2)), fmaxf(tz1, tz2));
+
+	return far >= fmaxf(near, 0) && near <= maxDistance;
+}
+
+/* Distance along the ray where it comes within radius of the segment, or -1 if it never does */
+static float raySegmentHit(const Vector3* origin, const Vector3* direction, const Vector3* start, const Vector3* end, float radius)
+{
+	//Closest approach between the ray and the segment's line
+	Vector3 segment = minusVector3(end, start);
+	Vector3 offset = minusVector3(origin, start);
+
+	float a = dotProductVector3(&segment, &segment);
+	float b = dotProductVector3(&segment, direction);
+	float c = dotProductVector3(&segment, &offset);
+	float e = dotProductVector3(direction, &offset);
+	float denominator = a - (b * b);
+
+	float s = 0;
+	if(a > 0 && denominator > 1e-6f * a)
+		s = ((c - (b * e)) / denominator);
+	if(s < 0)
+		s = 0;
+	if(s > 1)
+		s = 1;
+
+	//Treat the nearest point on the segment as a sphere and intersect the ray with it
+	Vector3 along = multiplyVector3(&segment, s);
+	Vector3 center = addVector3(start, &along);
+	Vector3 toCenter = minusVector3(&center, origin);
+
+	float projection = dotProductVector3(&toCenter, direction);
+	float distanceSquared = dotProductVector3(&toCenter, &toCenter) - (projection * projection);
+
+	if(distanceSquared > radius * radius)
+		return -1;
+
+	float hit = projection - sqrt(radius * radius - distanceSquared);
+	if(hit < 0)
+		hit = projection;
+
+	return hit >= 0 ? hit : -1;
+}
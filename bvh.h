@@ -0,0 +1,49 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "engine.h"
+
+typedef struct {
+	Vector3 min;
+	Vector3 max;
+} BoundingBox;
+
+/*	Internal nodes have count 0 and their children at first and first + 1
+ *	Leaves hold count primitives starting at first in the primitive order
+ */
+typedef struct {
+	BoundingBox bounds;
+	int first;
+	int count;
+	int parent;
+} BvhNode;
+
+/*	A bounding volume hierarchy over line segments thickened by radius
+ *	Points are stored as segments that start and end in the same place
+ */
+typedef struct {
+	BvhNode* nodes;
+	int numberOfNodes;
+
+	int* order;
+	int* leafOf;
+
+	Vector3* starts;
+	Vector3* ends;
+	int numberOfPrimitives;
+
+	float radius;
+} Bvh;
+
+Bvh* buildBvh(const Vector3* starts, const Vector3* ends, int count, float radius);
+void freeBvh(Bvh* bvh);
+void refitBvhPrimitive(Bvh* bvh, int primitive, const Vector3* start, const Vector3* end);
+
+int bvhClosestPoint(const Bvh* bvh, const Vector3* point, float maxDistance, Vector3* closest, float* distance);
+int bvhRaycast(const Bvh* bvh, const Vector3* origin, const Vector3* direction, float maxDistance, float* hitDistance);
+int bvhRadiusQuery(const Bvh* bvh, const Vector3* center, float radius, int* results, int maxResults);
+int bvhPlanesQuery(const Bvh* bvh, const Vector3* normals, const float* distances, int numberOfPlanes, int* results, int maxResults);
+
+Vector3 closestPointOnSegment(const Vector3* point, const Vector3* start, const Vector3* end);
+
+#endif
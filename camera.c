@@ -2,16 +2,17 @@
  *	This module controls the camera
  *	There are 3 modes for the camera:
  *		OrbitingCamera	-	The camera rotates around the Roller Coaster
- *		CoasterCamera	-	The camera rides the Roller Coaster, you can look around with right mouse
+ *		CoasterCamera	-	The camera rides the Roller Coaster along the track's frame, you can look around with right mouse
  *		FreeCamera 		-	The camera can be freely controlled using WASD and right mouse  
  */
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <GL/glut.h>
 #include "engine.h"
 #include "camera.h"
 #include "input.h"
-#include "rollercoaster.h"
+#include "park.h"
 
 #define CAMERA_SPEED 0.15
 #define CAMERA_ROTATION_SPEED 2.5
@@ -60,7 +61,7 @@ void updateCamera()
 {
 	if(input[Camera])
 	{
-		input[Camera] = 0;
+		input[Camera]--;
 
 		cameraMode++;
 		if(cameraMode >= 3)
@@ -163,27 +164,136 @@ static void updateOrbitCamera()
 	orbitTheta += ORBIT_SPEED;
 }
 
-void applyCamera()
+/*	Computes where the camera is looking, called from the simulation thread */
+void snapshotCamera(CameraSnapshot* snapshot)
 {
+	snapshot->up = *Vector3Up;
+
 	if(cameraMode == OrbitingCamera)
 	{
-		lookAt(cameraOrbitPosition, cameraOrbitTarget, Vector3Up);
+		snapshot->eye = *cameraOrbitPosition;
+		snapshot->target = *cameraOrbitTarget;
 	}
 	else if(cameraMode == FreeCamera)
 	{
 		Vector3 myForward = TransformToForward(freeCameraTransform);
-		myForward = addVector3(&(freeCameraTransform->position), &myForward);
 
-		lookAt(&(freeCameraTransform->position), &myForward, Vector3Up);
+		snapshot->eye = freeCameraTransform->position;
+		snapshot->target = addVector3(&(freeCameraTransform->position), &myForward);
 	}
 	else if(cameraMode == CoasterCamera)
 	{
-		coasterCamTransform->position = getCoasterPosition();
-		coasterCamTransform->position.y += 1;
+		//The rider looks around relative to the track's frame, so the view follows the track through loops
+		TrackFrame frame = getCoasterFrame(getActiveCoaster());
+		Vector3 right = getFrameBinormal(&frame);
+
+		coasterCamTransform->position = getCoasterPosition(getActiveCoaster());
+		Vector3 headHeight = multiplyVector3(&(frame.normal), 1);
+		coasterCamTransform->position = addVector3(&(coasterCamTransform->position), &headHeight);
+
+		//Local forward is -z, so map x, y, -z onto right, normal, tangent
+		Vector3 look = TransformToForward(coasterCamTransform);
+		Vector3 lookRight = multiplyVector3(&right, look.x);
+		Vector3 lookUp = multiplyVector3(&(frame.normal), look.y);
+		Vector3 lookForward = multiplyVector3(&(frame.tangent), -look.z);
+
+		Vector3 myForward = addVector3(&lookRight, &lookUp);
+		myForward = addVector3(&myForward, &lookForward);
+
+		snapshot->eye = coasterCamTransform->position;
+		snapshot->target = addVector3(&(coasterCamTransform->position), &myForward);
+		snapshot->up = frame.normal;
+	}
+}
+
+/*	Loads a camera snapshot into the modelview matrix, called from the render thread */
+void applyCamera(const CameraSnapshot* snapshot)
+{
+	lookAt(&(snapshot->eye), &(snapshot->target), &(snapshot->up));
+}
+
+/*	Returns the direction of the ray through a pixel of the view, and its origin
+ *	Uses the camera as the simulation sees it now, so it matches the view the input was given against
+ */
+Vector3 getCameraRay(float x, float y, int width, int height, Vector3* origin)
+{
+	CameraSnapshot view;
+	snapshotCamera(&view);
+
+	Vector3 forward = minusVector3(&(view.target), &(view.eye));
+	forward = NormalizeVector3(&forward);
+	Vector3 right = crossProductVector3(&forward, &(view.up));
+	right = NormalizeVector3(&right);
+	Vector3 up = crossProductVector3(&right, &forward);
+
+	//Pixel to normalized device coordinates, then scaled out to the edges of the view
+	float tanHalfFov = tan((FOV / 2.0) * (M_PI / 180.0));
+	float aspect = width / (float) (height > 0 ? height : 1);
+	float ndcX = ((2.0f * x) / width) - 1.0f;
+	float ndcY = 1.0f - ((2.0f * y) / height);
+
+	right = multiplyVector3(&right, ndcX * tanHalfFov * aspect);
+	up = multiplyVector3(&up, ndcY * tanHalfFov);
+
+	Vector3 direction = addVector3(&forward, &right);
+	direction = addVector3(&direction, &up);
+
+	*origin = view.eye;
+	return NormalizeVector3(&direction);
+}
+
+/*	Pulls the view frustum out of the current projection and modelview matrices, called from the render thread
+ *	Each plane is a row of the combined matrix added to or taken from its last row
+ */
+void getViewFrustum(Frustum* frustum)
+{
+	GLfloat projection[16], modelView[16], clip[16];
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelView);
+
+	//Both are column major, clip = projection * modelView
+	for(int column = 0; column < 4; column++)
+		for(int row = 0; row < 4; row++)
+		{
+			clip[(column * 4) + row] = 0;
+			for(int k = 0; k < 4; k++)
+				clip[(column * 4) + row] += projection[(k * 4) + row] * modelView[(column * 4) + k];
+		}
 
-		Vector3 myForward = TransformToForward(coasterCamTransform);
-		myForward = addVector3(&(coasterCamTransform->position), &myForward);
+	for(int i = 0; i < 6; i++)
+	{
+		int row = i / 2;
+		float sign = (i % 2 == 0) ? 1 : -1;
+
+		Vector3 normal = {
+			clip[3] + (sign * clip[row]),
+			clip[7] + (sign * clip[4 + row]),
+			clip[11] + (sign * clip[8 + row])
+		};
+		float distance = clip[15] + (sign * clip[12 + row]);
+
+		float length = magnitudeVector3(&normal);
+		frustum->normals[i] = multiplyVector3(&normal, 1 / length);
+		frustum->distances[i] = distance / length;
+	}
+}
 
-		lookAt(&(coasterCamTransform->position), &myForward, Vector3Up);
+/* Returns 0 only if the box is entirely outside one of the planes, boxes near the corners may still pass */
+int isBoxInFrustum(const Frustum* frustum, const Vector3* min, const Vector3* max)
+{
+	for(int i = 0; i < 6; i++)
+	{
+		//The corner furthest along the plane's normal
+		const Vector3* normal = &(frustum->normals[i]);
+		Vector3 corner = {
+			normal->x >= 0 ? max->x : min->x,
+			normal->y >= 0 ? max->y : min->y,
+			normal->z >= 0 ? max->z : min->z
+		};
+
+		if(dotProductVector3(normal, &corner) + frustum->distances[i] < 0)
+			return 0;
 	}
-}
\ No newline at end of file
+
+	return 1;
+}
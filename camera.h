@@ -1,6 +1,34 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "engine.h"
+
+#define FOV 85
+#define NEAR_PLANE 0.1f
+#define FAR_PLANE 100.0f
+
+/*	The view computed by the simulation thread, applied by the render thread */
+typedef struct {
+	Vector3 eye;
+	Vector3 target;
+	Vector3 up;
+} CameraSnapshot;
+
+/*	The planes around everything the camera can see, their normals point inwards */
+typedef struct {
+	Vector3 normals[6];
+	float distances[6];
+} Frustum;
+
 void initCamera(void);
 void updateCamera(void);
-void applyCamera(void);
+void snapshotCamera(CameraSnapshot* snapshot);
+void applyCamera(const CameraSnapshot* snapshot);
 void rotateCamera(Transform* transform, int x, int y);
+Vector3 getCameraRay(float x, float y, int width, int height, Vector3* origin);
+void getViewFrustum(Frustum* frustum);
+int isBoxInFrustum(const Frustum* frustum, const Vector3* min, const Vector3* max);
+
+Transform* getFreeCameraTransform(void);
 
-Transform* getFreeCameraTransform(void);
\ No newline at end of file
+#endif
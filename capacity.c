@@ -0,0 +1,142 @@
+/*	Capacity.c
+ *	Works out how many riders an hour a track can take with several trains running on it
+ *
+ *	Usage: capacity [--trains n] [--cars n] [--hours h] [--dwell s] [--dwell-variation s] [--blocks a,b,c]
+ *	                [--seed n] [--ticks] [track.rctk]
+ *	Runs the trains headlessly as a discrete event simulation, or one tick at a time with --ticks.
+ *	Uses the default track when no track file is given. Block starts are section numbers.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "engine.h"
+#include "trackfile.h"
+#include "operation.h"
+
+#define DEFAULT_HOURS 1.0
+
+/* Reads a comma separated list of section numbers, returns how many there were */
+static int parseBlocks(char* list, int** blocks)
+{
+	int count = 1;
+	for(char* c = list; *c != '\0'; c++)
+		if(*c == ',')
+			count++;
+
+	*blocks = malloc(count * sizeof(int));
+
+	int i = 0;
+	for(char* block = strtok(list, ","); block != NULL; block = strtok(NULL, ","))
+		(*blocks)[i++] = atoi(block);
+
+	return i;
+}
+
+int main(int argc, char *argv[])
+{
+	OperationSettings settings;
+	getDefaultOperationSettings(&settings);
+
+	double hours = DEFAULT_HOURS;
+	int ticks = 0;
+	int* blocks = NULL;
+	int usage = 0;
+	const char* trackPath = NULL;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--trains") == 0 && i + 1 < argc)
+			settings.numberOfTrains = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--cars") == 0 && i + 1 < argc)
+			settings.numberOfCars = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--hours") == 0 && i + 1 < argc)
+			hours = atof(argv[++i]);
+		else if(strcmp(argv[i], "--dwell") == 0 && i + 1 < argc)
+			settings.dwell = atof(argv[++i]);
+		else if(strcmp(argv[i], "--dwell-variation") == 0 && i + 1 < argc)
+			settings.dwellVariation = atof(argv[++i]);
+		else if(strcmp(argv[i], "--blocks") == 0 && i + 1 < argc)
+			settings.numberOfBlocks = parseBlocks(argv[++i], &blocks);
+		else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			settings.seed = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "--ticks") == 0)
+			ticks = 1;
+		else if(trackPath == NULL)
+			trackPath = argv[i];
+		else
+			usage = 1;
+	}
+
+	if(usage || hours <= 0 || settings.numberOfTrains < 1 || settings.numberOfTrains > MAX_OPERATED_TRAINS
+		|| settings.dwell < 0 || settings.dwellVariation < 0)
+	{
+		printf("Usage: %s [--trains n] [--cars n] [--hours h] [--dwell s] [--dwell-variation s] [--blocks a,b,c] [--seed n] [--ticks] [track%s]\n",
+			argv[0], TRACK_FILE_EXTENSION);
+		printf("Up to %d trains\n", MAX_OPERATED_TRAINS);
+		return 1;
+	}
+	settings.blockStarts = blocks;
+
+	int numberOfPoints = DEFAULT_COASTER_POINTS;
+	ControlPoint* points;
+
+	if(trackPath != NULL)
+	{
+		points = loadTrackFile(trackPath, &numberOfPoints);
+		if(points == NULL) {
+			printf("Could not load %s\n", trackPath);
+			return 1;
+		}
+	}
+	else
+	{
+		points = malloc(numberOfPoints * sizeof(ControlPoint));
+		getDefaultCoaster(points);
+	}
+
+	Track track;
+	memset(&track, 0, sizeof(Track));
+	generateTrack(&track, points, numberOfPoints);
+
+	Operation operation;
+	if(!initOperation(&operation, &track, &settings)) {
+		printf("Block starts must be sections between 0 and %d\n", numberOfPoints - 1);
+		return 1;
+	}
+
+	double seconds = hours * 3600;
+	double startTime = getTimeSeconds();
+
+	if(ticks)
+	{
+		long numberOfTicks = (long) (seconds / TRAIN_TICK_LENGTH);
+		for(long i = 0; i < numberOfTicks; i++)
+			stepOperation(&operation, 0);
+	}
+	else
+		runOperationEvents(&operation, seconds);
+
+	double runSeconds = getTimeSeconds() - startTime;
+	const OperationStats* stats = &(operation.stats);
+
+	if(stats->stalled)
+		printf("A train stalled between brakes after %.1f s, results are up to then\n", stats->time);
+
+	printf("Simulated %.2f h with %d trains of %d cars on %d blocks in %.3f s\n",
+		stats->time / 3600, operation.numberOfTrains, settings.numberOfCars, operation.numberOfBlocks, runSeconds);
+	printf("Dispatches: %d (%.1f trains per hour)\n", stats->dispatches, stats->dispatches / (stats->time / 3600));
+	printf("Holds at block brakes: %d, average %.1f s, longest %.1f s\n",
+		stats->holds, stats->holds > 0 ? stats->holdTime / stats->holds : 0, stats->maxHoldTime);
+	printf("Station dispatch delay: average %.1f s\n", stats->dispatches > 0 ? stats->dispatchDelay / stats->dispatches : 0);
+
+	printf("Block  Start section  Utilisation\n");
+	for(int i = 0; i < operation.numberOfBlocks; i++)
+		printf("%5d  %13d  %10.1f%%\n", i, operation.blockStarts[i], getBlockUtilisation(&operation, i) * 100);
+
+	freeOperation(&operation);
+	freeTrack(&track);
+	free(points);
+	free(blocks);
+
+	return stats->stalled;
+}
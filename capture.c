@@ -0,0 +1,372 @@
+/*	Capture.c
+ *	This module records rendered frames as video, to a file or piped into another program
+ *
+ *	Frames are read back into two pixel pack buffers in turn, so the copy out of the framebuffer runs while the
+ *	next frame is drawn and is only waited on a frame later. The render thread then just copies the pixels into
+ *	a ring of slots, and a writer thread converts and writes them out. Unlike telemetry, frames are never dropped:
+ *	if the writer falls a whole ring behind the renderer waits for it, so every frame rendered is in the video.
+ *
+ *	Paths starting with | are run as a command that reads the video on its standard input. Files ending in .ppm
+ *	get a stream of binary PPM images, everything else YUV4MPEG2 with 4:2:0 chroma, which most encoders read as is.
+ */
+#include "gpu.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+#include "engine.h"
+#include "capture.h"
+
+typedef enum { CaptureY4m, CapturePpm } CaptureFormat;
+
+static void queuePackBuffer(unsigned int buffer);
+static unsigned char* claimSlot(void);
+static void queueSlot(void);
+static void* writerLoop(void* arg);
+static int encodeY4mFrame(const unsigned char* pixels, unsigned char* buffer);
+static int encodePpmFrame(const unsigned char* pixels, unsigned char* buffer);
+static unsigned long greatestCommonDivisor(unsigned long a, unsigned long b);
+
+static FILE* captureFile = NULL;
+static int capturePiped = 0;
+static CaptureFormat captureFormat;
+static int captureWidth, captureHeight;
+
+//Bottom up RGBA frames, filled by the render thread and written by the writer thread, both only ever count up
+static unsigned char* slots[CAPTURE_SLOTS];
+static unsigned char* encodeBuffer = NULL;
+static unsigned long filledFrames = 0;
+static unsigned long writtenFrames = 0;
+static int writeFailed = 0;
+
+static atomic_int active = 0;
+static int stopping = 0;
+
+static pthread_t writerThread;
+static pthread_mutex_t captureLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writerWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t slotFreed = PTHREAD_COND_INITIALIZER;
+
+//Frames read into the pack buffers so far, the newest is still being copied
+static int usePackBuffers = 0;
+static unsigned int packBuffers[2];
+static unsigned long readFrames = 0;
+
+//Render thread time spent capturing, to show what it costs a frame
+static double captureTime = 0;
+
+
+/*	Starts capturing width by height frames from the bottom left of the framebuffer
+ *	Returns 0, after printing why, if the output couldn't be opened
+ */
+int startCapture(const char* path, int width, int height, double framesPerSecond)
+{
+	if(path[0] == '|')
+	{
+#ifndef _WIN32
+		//Find out the program has gone from the failed writes rather than being killed
+		signal(SIGPIPE, SIG_IGN);
+		captureFile = popen(path + 1, "w");
+		capturePiped = 1;
+#endif
+		captureFormat = CaptureY4m;
+	}
+	else
+	{
+		captureFile = fopen(path, "wb");
+		size_t length = strlen(path);
+		size_t extensionLength = strlen(CAPTURE_PPM_EXTENSION);
+		captureFormat = (length >= extensionLength && strcmp(path + length - extensionLength, CAPTURE_PPM_EXTENSION) == 0)
+			? CapturePpm : CaptureY4m;
+	}
+
+	if(captureFile == NULL) {
+		printf("Could not open %s for capture\n", path);
+		return 0;
+	}
+
+	//Chroma is shared by each 2x2 block of pixels, so the video must be an even size
+	if(captureFormat == CaptureY4m) {
+		width &= ~1;
+		height &= ~1;
+	}
+
+	captureWidth = width;
+	captureHeight = height;
+
+	if(captureFormat == CaptureY4m)
+	{
+		//The rate as an exact fraction, so 62.5 frames a second is 125:2
+		unsigned long numerator = (unsigned long) (framesPerSecond * 1000 + 0.5);
+		unsigned long denominator = 1000;
+		unsigned long divisor = greatestCommonDivisor(numerator, denominator);
+
+		fprintf(captureFile, "YUV4MPEG2 W%d H%d F%lu:%lu Ip A1:1 C420jpeg\n", width, height, numerator / divisor, denominator / divisor);
+	}
+
+	for(int i = 0; i < CAPTURE_SLOTS; i++)
+		slots[i] = malloc(width * height * 4);
+	encodeBuffer = malloc(width * height * 3 + 64);
+
+#ifdef GPU_EXTENSIONS
+	usePackBuffers = hasGlVersion(2, 1);
+	if(usePackBuffers)
+	{
+		glGenBuffers(2, packBuffers);
+		for(int i = 0; i < 2; i++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+#endif
+
+	filledFrames = 0;
+	writtenFrames = 0;
+	writeFailed = 0;
+	readFrames = 0;
+	captureTime = 0;
+	stopping = 0;
+
+	atomic_store(&active, 1);
+	pthread_create(&writerThread, NULL, writerLoop, NULL);
+
+	return 1;
+}
+
+int isCapturing()
+{
+	return atomic_load(&active);
+}
+
+/* Starts reading back the frame just drawn, call before swapping buffers */
+void captureFrame()
+{
+	if(!atomic_load(&active))
+		return;
+
+	double start = getTimeSeconds();
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+#ifdef GPU_EXTENSIONS
+	if(usePackBuffers)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffers[readFrames % 2]);
+		glReadPixels(0, 0, captureWidth, captureHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*) 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		readFrames++;
+
+		//The other buffer's copy was started a frame ago and has most likely finished by now
+		if(readFrames > 1)
+			queuePackBuffer(packBuffers[readFrames % 2]);
+
+		captureTime += getTimeSeconds() - start;
+		return;
+	}
+#endif
+
+	unsigned char* slot = claimSlot();
+	glReadPixels(0, 0, captureWidth, captureHeight, GL_RGBA, GL_UNSIGNED_BYTE, slot);
+	queueSlot();
+
+	captureTime += getTimeSeconds() - start;
+}
+
+/* Collects the frame still being read back, so the last frame drawn makes it into the video before stopping */
+void finishCapture()
+{
+	if(!atomic_load(&active))
+		return;
+
+#ifdef GPU_EXTENSIONS
+	if(usePackBuffers)
+	{
+		if(readFrames > 0)
+			queuePackBuffer(packBuffers[(readFrames - 1) % 2]);
+
+		glDeleteBuffers(2, packBuffers);
+		usePackBuffers = 0;
+		readFrames = 0;
+	}
+#endif
+}
+
+/*	Waits for every queued frame to be written and closes the output, safe from any thread
+ *	Without finishCapture() first the frame still being read back is lost
+ */
+void stopCapture()
+{
+	if(!atomic_exchange(&active, 0))
+		return;
+
+	pthread_mutex_lock(&captureLock);
+	stopping = 1;
+	pthread_cond_signal(&writerWake);
+	pthread_mutex_unlock(&captureLock);
+	pthread_join(writerThread, NULL);
+
+	if(writeFailed)
+		printf("Capture stopped early, the output couldn't keep being written\n");
+	else
+		printf("Captured %lu frames, %.2fms a frame on the render thread\n", writtenFrames,
+			filledFrames > 0 ? (captureTime * 1000) / filledFrames : 0);
+
+#ifndef _WIN32
+	if(capturePiped)
+		pclose(captureFile);
+	else
+#endif
+		fclose(captureFile);
+	captureFile = NULL;
+
+	//The slots are left for the exit, a windowed render thread may still be in captureFrame()
+}
+
+static void queuePackBuffer(unsigned int buffer)
+{
+#ifdef GPU_EXTENSIONS
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+	const unsigned char* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+
+	if(pixels != NULL)
+	{
+		memcpy(claimSlot(), pixels, captureWidth * captureHeight * 4);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		queueSlot();
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+#endif
+}
+
+/* Waits for a free slot if the writer has fallen behind */
+static unsigned char* claimSlot()
+{
+	pthread_mutex_lock(&captureLock);
+	while(filledFrames - writtenFrames == CAPTURE_SLOTS)
+		pthread_cond_wait(&slotFreed, &captureLock);
+	unsigned char* slot = slots[filledFrames % CAPTURE_SLOTS];
+	pthread_mutex_unlock(&captureLock);
+
+	return slot;
+}
+
+static void queueSlot()
+{
+	pthread_mutex_lock(&captureLock);
+	filledFrames++;
+	pthread_cond_signal(&writerWake);
+	pthread_mutex_unlock(&captureLock);
+}
+
+//==============WRITING=======================
+
+static void* writerLoop(void* arg)
+{
+	for(;;)
+	{
+		pthread_mutex_lock(&captureLock);
+		while(writtenFrames == filledFrames && !stopping)
+			pthread_cond_wait(&writerWake, &captureLock);
+
+		if(writtenFrames == filledFrames) {
+			pthread_mutex_unlock(&captureLock);
+			break;
+		}
+
+		const unsigned char* pixels = slots[writtenFrames % CAPTURE_SLOTS];
+		pthread_mutex_unlock(&captureLock);
+
+		//Once the output has gone frames are still taken off the ring, so the renderer never waits forever
+		if(!writeFailed)
+		{
+			int length = (captureFormat == CaptureY4m) ? encodeY4mFrame(pixels, encodeBuffer) : encodePpmFrame(pixels, encodeBuffer);
+			if(fwrite(encodeBuffer, 1, length, captureFile) != (size_t) length)
+				writeFailed = 1;
+		}
+
+		pthread_mutex_lock(&captureLock);
+		writtenFrames++;
+		pthread_cond_signal(&slotFreed);
+		pthread_mutex_unlock(&captureLock);
+	}
+
+	fflush(captureFile);
+
+	return NULL;
+}
+
+/* Converts to limited range BT.601, with each chroma sample the average of a 2x2 block */
+static int encodeY4mFrame(const unsigned char* pixels, unsigned char* buffer)
+{
+	int length = sprintf((char*) buffer, "FRAME\n");
+	unsigned char* luma = buffer + length;
+	unsigned char* blue = luma + (captureWidth * captureHeight);
+	unsigned char* red = blue + ((captureWidth / 2) * (captureHeight / 2));
+
+	for(int y = 0; y < captureHeight; y += 2)
+	{
+		//Frames are read bottom row first, video goes top row first
+		const unsigned char* rows[2] = {
+			pixels + ((captureHeight - 1 - y) * captureWidth * 4),
+			pixels + ((captureHeight - 2 - y) * captureWidth * 4)
+		};
+
+		for(int x = 0; x < captureWidth; x += 2)
+		{
+			int sums[3] = { 0, 0, 0 };
+
+			for(int i = 0; i < 4; i++)
+			{
+				const unsigned char* pixel = rows[i / 2] + ((x + (i % 2)) * 4);
+				luma[((y + (i / 2)) * captureWidth) + x + (i % 2)] =
+					(unsigned char) ((((66 * pixel[0]) + (129 * pixel[1]) + (25 * pixel[2]) + 128) >> 8) + 16);
+
+				sums[0] += pixel[0];
+				sums[1] += pixel[1];
+				sums[2] += pixel[2];
+			}
+
+			int chroma = ((y / 2) * (captureWidth / 2)) + (x / 2);
+			blue[chroma] = (unsigned char) ((((-38 * sums[0]) - (74 * sums[1]) + (112 * sums[2]) + 512) >> 10) + 128);
+			red[chroma] = (unsigned char) ((((112 * sums[0]) - (94 * sums[1]) - (18 * sums[2]) + 512) >> 10) + 128);
+		}
+	}
+
+	return length + ((captureWidth * captureHeight * 3) / 2);
+}
+
+static int encodePpmFrame(const unsigned char* pixels, unsigned char* buffer)
+{
+	int length = sprintf((char*) buffer, "P6\n%d %d\n255\n", captureWidth, captureHeight);
+
+	for(int y = 0; y < captureHeight; y++)
+	{
+		const unsigned char* row = pixels + ((captureHeight - 1 - y) * captureWidth * 4);
+		for(int x = 0; x < captureWidth; x++)
+		{
+			memcpy(buffer + length, row + (x * 4), 3);
+			length += 3;
+		}
+	}
+
+	return length;
+}
+
+static unsigned long greatestCommonDivisor(unsigned long a, unsigned long b)
+{
+	while(b != 0)
+	{
+		unsigned long remainder = a % b;
+		a = b;
+		b = remainder;
+	}
+
+	return a;
+}
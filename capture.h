@@ -0,0 +1,16 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#define CAPTURE_PPM_EXTENSION ".ppm"
+
+//Frames waiting for the writer before the renderer has to wait for it
+#define CAPTURE_SLOTS 4
+
+//All but stopCapture() from the render thread, with the context current
+int startCapture(const char* path, int width, int height, double framesPerSecond);
+int isCapturing(void);
+void captureFrame(void);
+void finishCapture(void);
+void stopCapture(void);
+
+#endif
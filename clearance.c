@@ -0,0 +1,321 @@
+/*	Clearance.c
+ *	This module finds parts of a closed track that pass closer to each other than a clearance distance
+ *
+ *	Segments are bucketed by their midpoints into a uniform spatial hash, with cells big enough that any two segments
+ *	within the clearance have midpoints in neighbouring cells. The hash is built with a counting sort into one flat
+ *	array, then every segment checks the 27 cells around it in parallel, each worker collecting its own pairs.
+ *
+ *	Segments that follow on from each other along the track are always close, so pairs less than neighbourLength
+ *	apart along the track are skipped.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "clearance.h"
+#include "threadpool.h"
+
+#define CLEARANCE_GRAIN 4096
+
+typedef struct {
+	int x, y, z;
+} Cell;
+
+typedef struct {
+	const Vector3* starts;
+	const Vector3* ends;
+	int count;
+	float clearance;
+	float neighbourLength;
+
+	float cellSize;
+	Vector3 origin;
+	Cell* cells;
+	unsigned int tableMask;
+	int* bucketStarts;
+	int* items;
+	double* distances;
+
+	ClearancePair** workerPairs;
+	int* workerCounts;
+	int* workerAllocated;
+} ClearanceJob;
+
+static void findCells(int start, int end, int worker, void* context);
+static void findPairs(int start, int end, int worker, void* context);
+static int lowerBound(const double* distances, int low, int high, double value);
+static int lowerBoundItem(const int* items, int low, int high, int value);
+static unsigned int hashCell(const Cell* cell, unsigned int mask);
+static float segmentDistance(const Vector3* p1, const Vector3* q1, const Vector3* p2, const Vector3* q2);
+static int comparePairs(const void* a, const void* b);
+
+
+/* Checks every pair of segments, the track is treated as a loop with segment count - 1 joining back to 0 */
+ClearanceReport* checkClearance(const Vector3* starts, const Vector3* ends, int count, float clearance, float neighbourLength)
+{
+	double startTime = getTimeSeconds();
+
+	ClearanceReport* report = calloc(1, sizeof(ClearanceReport));
+	if(count <= 0)
+		return report;
+
+	ClearanceJob job;
+	memset(&job, 0, sizeof(job));
+	job.starts = starts;
+	job.ends = ends;
+	job.count = count;
+	job.clearance = clearance;
+	job.neighbourLength = neighbourLength;
+
+	//Distance along the track to the start of each segment, the extra entry is the whole loop
+	job.distances = malloc((count + 1) * sizeof(double));
+	job.distances[0] = 0;
+
+	float longest = 0;
+	job.origin = starts[0];
+	for(int i = 0; i < count; i++)
+	{
+		Vector3 along = minusVector3(&ends[i], &starts[i]);
+		float length = magnitudeVector3(&along);
+
+		job.distances[i + 1] = job.distances[i] + length;
+		if(length > longest)
+			longest = length;
+	}
+
+	job.cellSize = clearance + longest;
+	if(job.cellSize <= 0)
+		job.cellSize = 1;
+
+	unsigned int tableSize = 1;
+	while(tableSize < (unsigned int) count * 2)
+		tableSize <<= 1;
+	job.tableMask = tableSize - 1;
+
+	job.cells = malloc(count * sizeof(Cell));
+	parallelFor(count, CLEARANCE_GRAIN, findCells, &job);
+
+	//Counting sort the segments into their buckets, which leaves each bucket in track order
+	job.bucketStarts = calloc(tableSize + 1, sizeof(int));
+	for(int i = 0; i < count; i++)
+		job.bucketStarts[hashCell(&job.cells[i], job.tableMask) + 1]++;
+
+	for(unsigned int b = 0; b < tableSize; b++)
+		job.bucketStarts[b + 1] += job.bucketStarts[b];
+
+	int* fill = malloc(tableSize * sizeof(int));
+	memcpy(fill, job.bucketStarts, tableSize * sizeof(int));
+
+	job.items = malloc(count * sizeof(int));
+	for(int i = 0; i < count; i++)
+		job.items[fill[hashCell(&job.cells[i], job.tableMask)]++] = i;
+	free(fill);
+
+	int workers = getNumberOfWorkers();
+	job.workerPairs = calloc(workers, sizeof(ClearancePair*));
+	job.workerCounts = calloc(workers, sizeof(int));
+	job.workerAllocated = calloc(workers, sizeof(int));
+
+	parallelFor(count, CLEARANCE_GRAIN, findPairs, &job);
+
+	//Gather every worker's pairs into one sorted list
+	int total = 0;
+	for(int w = 0; w < workers; w++)
+		total += job.workerCounts[w];
+
+	report->pairs = malloc((total > 0 ? total : 1) * sizeof(ClearancePair));
+	for(int w = 0; w < workers; w++)
+	{
+		if(job.workerCounts[w] > 0)
+			memcpy(report->pairs + report->numberOfPairs, job.workerPairs[w], job.workerCounts[w] * sizeof(ClearancePair));
+		report->numberOfPairs += job.workerCounts[w];
+		free(job.workerPairs[w]);
+	}
+	qsort(report->pairs, report->numberOfPairs, sizeof(ClearancePair), comparePairs);
+
+	free(job.workerPairs);
+	free(job.workerCounts);
+	free(job.workerAllocated);
+	free(job.items);
+	free(job.bucketStarts);
+	free(job.cells);
+	free(job.distances);
+
+	report->seconds = getTimeSeconds() - startTime;
+	return report;
+}
+
+void freeClearanceReport(ClearanceReport* report)
+{
+	if(report == NULL)
+		return;
+
+	free(report->pairs);
+	free(report);
+}
+
+static void findCells(int start, int end, int worker, void* context)
+{
+	ClearanceJob* job = context;
+
+	for(int i = start; i < end; i++)
+	{
+		Vector3 middle = lerpVector3(&job->starts[i], &job->ends[i], 0.5);
+		job->cells[i].x = (int) floorf((middle.x - job->origin.x) / job->cellSize);
+		job->cells[i].y = (int) floorf((middle.y - job->origin.y) / job->cellSize);
+		job->cells[i].z = (int) floorf((middle.z - job->origin.z) / job->cellSize);
+	}
+}
+
+static void findPairs(int start, int end, int worker, void* context)
+{
+	ClearanceJob* job = context;
+	double loopLength = job->distances[job->count];
+
+	for(int i = start; i < end; i++)
+	{
+		const Cell* cell = &job->cells[i];
+
+		//Only segments far enough along the track from this one, either way around the loop, are worth checking
+		int first = lowerBound(job->distances, i + 1, job->count + 1, job->distances[i + 1] + job->neighbourLength);
+		int last = lowerBound(job->distances, first, job->count + 1, loopLength + job->distances[i] - job->neighbourLength) - 1;
+
+		if(first >= last)
+			continue;
+
+		for(int dx = -1; dx <= 1; dx++)
+		for(int dy = -1; dy <= 1; dy++)
+		for(int dz = -1; dz <= 1; dz++)
+		{
+			Cell neighbour = { cell->x + dx, cell->y + dy, cell->z + dz };
+			unsigned int bucket = hashCell(&neighbour, job->tableMask);
+
+			//Buckets are in track order, so the range of segments to check is found by a binary search
+			int bucketEnd = job->bucketStarts[bucket + 1];
+			for(int k = lowerBoundItem(job->items, job->bucketStarts[bucket], bucketEnd, first); k < bucketEnd; k++)
+			{
+				int j = job->items[k];
+				if(j >= last)
+					break;
+
+				//Buckets can hold cells that only share a hash
+				if(job->cells[j].x != neighbour.x || job->cells[j].y != neighbour.y || job->cells[j].z != neighbour.z)
+					continue;
+
+				float distance = segmentDistance(&job->starts[i], &job->ends[i], &job->starts[j], &job->ends[j]);
+				if(distance >= job->clearance)
+					continue;
+
+				if(job->workerCounts[worker] == job->workerAllocated[worker])
+				{
+					job->workerAllocated[worker] = job->workerAllocated[worker] ? job->workerAllocated[worker] * 2 : 64;
+					job->workerPairs[worker] = realloc(job->workerPairs[worker], job->workerAllocated[worker] * sizeof(ClearancePair));
+				}
+
+				ClearancePair* pair = &job->workerPairs[worker][job->workerCounts[worker]++];
+				pair->first = i;
+				pair->second = j;
+				pair->distance = distance;
+			}
+		}
+	}
+}
+
+/* Returns the first index in [low, high) whose distance is at least value, or high */
+static int lowerBound(const double* distances, int low, int high, double value)
+{
+	while(low < high)
+	{
+		int middle = low + (high - low) / 2;
+		if(distances[middle] < value)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+static int lowerBoundItem(const int* items, int low, int high, int value)
+{
+	while(low < high)
+	{
+		int middle = low + (high - low) / 2;
+		if(items[middle] < value)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+static unsigned int hashCell(const Cell* cell, unsigned int mask)
+{
+	return (((unsigned int) cell->x * 73856093u) ^ ((unsigned int) cell->y * 19349663u) ^ ((unsigned int) cell->z * 83492791u)) & mask;
+}
+
+/* Shortest distance between two segments, clamping the closest points of the two lines onto them */
+static float segmentDistance(const Vector3* p1, const Vector3* q1, const Vector3* p2, const Vector3* q2)
+{
+	Vector3 d1 = minusVector3(q1, p1);
+	Vector3 d2 = minusVector3(q2, p2);
+	Vector3 r = minusVector3(p1, p2);
+
+	float a = dotProductVector3(&d1, &d1);
+	float e = dotProductVector3(&d2, &d2);
+	float f = dotProductVector3(&d2, &r);
+	float s = 0, u = 0;
+
+	if(a <= 1e-12f && e <= 1e-12f)
+		return magnitudeVector3(&r);
+
+	if(a <= 1e-12f)
+		u = fminf(fmaxf(f / e, 0), 1);
+	else
+	{
+		float c = dotProductVector3(&d1, &r);
+
+		if(e <= 1e-12f)
+			s = fminf(fmaxf(-c / a, 0), 1);
+		else
+		{
+			float b = dotProductVector3(&d1, &d2);
+			float denominator = a * e - b * b;
+
+			//Parallel segments can use any s, the clamping below sorts out u
+			if(denominator > 1e-12f)
+				s = fminf(fmaxf((b * f - c * e) / denominator, 0), 1);
+
+			u = (b * s + f) / e;
+
+			if(u < 0) {
+				u = 0;
+				s = fminf(fmaxf(-c / a, 0), 1);
+			}
+			else if(u > 1) {
+				u = 1;
+				s = fminf(fmaxf((b - c) / a, 0), 1);
+			}
+		}
+	}
+
+	Vector3 closest1 = multiplyVector3(&d1, s);
+	closest1 = addVector3(p1, &closest1);
+	Vector3 closest2 = multiplyVector3(&d2, u);
+	closest2 = addVector3(p2, &closest2);
+
+	Vector3 difference = minusVector3(&closest1, &closest2);
+	return magnitudeVector3(&difference);
+}
+
+static int comparePairs(const void* a, const void* b)
+{
+	const ClearancePair* first = a;
+	const ClearancePair* second = b;
+
+	if(first->first != second->first)
+		return first->first < second->first ? -1 : 1;
+	if(first->second != second->second)
+		return first->second < second->second ? -1 : 1;
+	return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef CLEARANCE_H
+#define CLEARANCE_H
+
+#include "engine.h"
+
+/*	Two segments closer than the clearance, first < second */
+typedef struct {
+	int first;
+	int second;
+	float distance;
+} ClearancePair;
+
+typedef struct {
+	ClearancePair* pairs;
+	int numberOfPairs;
+	double seconds;
+} ClearanceReport;
+
+ClearanceReport* checkClearance(const Vector3* starts, const Vector3* ends, int count, float clearance, float neighbourLength);
+void freeClearanceReport(ClearanceReport* report);
+
+#endif
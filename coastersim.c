@@ -0,0 +1,165 @@
+/*	CoasterSim.c
+ *	This module is the simulation library, the track and train physics behind a handle with no GL anywhere
+ *
+ *	Everything a handle needs is allocated when it is created, stepping and querying only write into the handle
+ *	and the caller's arrays. Nothing is shared between handles, so each thread can drive its own.
+ */
+#include <stdlib.h>
+#include <math.h>
+#include "coastersim.h"
+
+struct CoasterSim {
+	Track track;
+	Train train;
+	int numberOfCars;
+	unsigned long tick;
+
+	//Distance along the track to the start of each subsection, with the full length on the end
+	double* subSectionDistances;
+};
+
+static int findSubSection(const CoasterSim* sim, double distance);
+
+
+/*	Generates the track from a copy of the points and puts a train of numberOfCars on it
+ *	Returns NULL if there are too few points to make a track
+ */
+CoasterSim* createCoasterSim(const ControlPoint* points, int numberOfPoints, int numberOfCars)
+{
+	if(points == NULL || numberOfPoints < COASTER_SIM_MIN_POINTS)
+		return NULL;
+
+	CoasterSim* sim = calloc(1, sizeof(CoasterSim));
+	generateTrack(&(sim->track), points, numberOfPoints);
+	sim->numberOfCars = numberOfCars;
+
+	int numberOfSubSections = getNumberOfSubSections(&(sim->track));
+	sim->subSectionDistances = malloc((numberOfSubSections + 1) * sizeof(double));
+
+	sim->subSectionDistances[0] = 0;
+	for(int i = 0; i < numberOfSubSections; i++)
+		sim->subSectionDistances[i + 1] = sim->subSectionDistances[i] + getSubSection(&(sim->track), i)->subSectionLength;
+
+	resetCoasterSim(sim);
+	return sim;
+}
+
+void freeCoasterSim(CoasterSim* sim)
+{
+	if(sim == NULL)
+		return;
+
+	freeTrack(&(sim->track));
+	free(sim->subSectionDistances);
+	free(sim);
+}
+
+/* Puts the train back in the station at the starting speed */
+void resetCoasterSim(CoasterSim* sim)
+{
+	resetTrain(&(sim->train), &(sim->track), sim->numberOfCars);
+	sim->tick = 0;
+}
+
+/*	Runs the train for a number of ticks, holding boost down the whole time if it is set
+ *	The train's position and speed after each tick are written out to any of the arrays that aren't NULL,
+ *	which must have room for ticks entries
+ */
+void stepCoasterSim(CoasterSim* sim, int ticks, int boost, Vector3* positions, float* velocities)
+{
+	for(int i = 0; i < ticks; i++)
+	{
+		stepTrain(&(sim->train), &(sim->track), boost);
+
+		if(positions != NULL)
+			positions[i] = sim->train.position;
+		if(velocities != NULL)
+			velocities[i] = sim->train.velocity;
+	}
+
+	sim->tick += ticks;
+}
+
+/*	Copies out where every car of the train is, lead car first. Either array may be NULL, both must have room
+ *	for MAX_TRAIN_CARS entries. Returns the number of cars
+ */
+int getCoasterSimCars(const CoasterSim* sim, Vector3* positions, TrackFrame* frames)
+{
+	for(int i = 0; i < sim->train.numberOfCars; i++)
+	{
+		if(positions != NULL)
+			positions[i] = sim->train.cars[i].position;
+		if(frames != NULL)
+			frames[i] = sim->train.cars[i].frame;
+	}
+
+	return sim->train.numberOfCars;
+}
+
+/*	Looks up the points at each distance along the track, wrapping around past the end
+ *	Either output array may be NULL, both must have room for count entries
+ */
+void getCoasterSimFrames(const CoasterSim* sim, const double* distances, int count, Vector3* positions, TrackFrame* frames)
+{
+	const Track* track = &(sim->track);
+	double length = getCoasterSimLength(sim);
+
+	for(int i = 0; i < count; i++)
+	{
+		double distance = distances[i] - (length * floor(distances[i] / length));
+
+		int index = findSubSection(sim, distance);
+		int sectionIndex = index / NUMBER_OF_SUB_SECTIONS;
+		int subSectionIndex = index % NUMBER_OF_SUB_SECTIONS;
+		float t = (distance - sim->subSectionDistances[index]) / getSubSection(track, index)->subSectionLength;
+
+		//Matches how the train places itself along the spline
+		if(positions != NULL)
+		{
+			float u = (t + subSectionIndex) / NUMBER_OF_SUB_SECTIONS;
+			positions[i] = qFunction(track->points, track->numberOfPoints, u, sectionIndex);
+		}
+
+		if(frames != NULL)
+			frames[i] = interpolateTrackFrame(track, sectionIndex, subSectionIndex, t);
+	}
+}
+
+/* Returns the subsection a distance between 0 and the track's length falls in */
+static int findSubSection(const CoasterSim* sim, double distance)
+{
+	//The last subsection whose start is at or before the distance
+	int low = 0;
+	int high = getNumberOfSubSections(&(sim->track)) - 1;
+	while(low < high)
+	{
+		int middle = (low + high + 1) / 2;
+
+		if(sim->subSectionDistances[middle] <= distance)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	return low;
+}
+
+unsigned long getCoasterSimTick(const CoasterSim* sim)
+{
+	return sim->tick;
+}
+
+const Train* getCoasterSimTrain(const CoasterSim* sim)
+{
+	return &(sim->train);
+}
+
+const Track* getCoasterSimTrack(const CoasterSim* sim)
+{
+	return &(sim->track);
+}
+
+double getCoasterSimLength(const CoasterSim* sim)
+{
+	return sim->subSectionDistances[getNumberOfSubSections(&(sim->track))];
+}
@@ -0,0 +1,26 @@
+#ifndef COASTERSIM_H
+#define COASTERSIM_H
+
+#include "track.h"
+
+/*	The simulation library's handle, a generated track and the train running on it
+ *	Handles share nothing, so separate handles can be used from separate threads without any locking
+ */
+typedef struct CoasterSim CoasterSim;
+
+#define COASTER_SIM_MIN_POINTS 3
+
+CoasterSim* createCoasterSim(const ControlPoint* points, int numberOfPoints, int numberOfCars);
+void freeCoasterSim(CoasterSim* sim);
+void resetCoasterSim(CoasterSim* sim);
+
+void stepCoasterSim(CoasterSim* sim, int ticks, int boost, Vector3* positions, float* velocities);
+int getCoasterSimCars(const CoasterSim* sim, Vector3* positions, TrackFrame* frames);
+void getCoasterSimFrames(const CoasterSim* sim, const double* distances, int count, Vector3* positions, TrackFrame* frames);
+
+unsigned long getCoasterSimTick(const CoasterSim* sim);
+const Train* getCoasterSimTrain(const CoasterSim* sim);
+const Track* getCoasterSimTrack(const CoasterSim* sim);
+double getCoasterSimLength(const CoasterSim* sim);
+
+#endif
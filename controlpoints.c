@@ -0,0 +1,149 @@
+/*	ControlPoints.c
+ *	This module stores the control points in a gap buffer
+ *
+ *	The free space is kept as a gap in the middle of the array that follows the edits around. Inserting or removing
+ *	next to the last edit only touches the gap, and moving the gap costs the distance it moves, so editing around the
+ *	selected point is O(1) however long the track is. Code that wants a plain array calls compactControlPoints(),
+ *	which moves the gap to the end once and leaves it there until the next edit.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "controlpoints.h"
+
+static void moveGap(ControlPointBuffer* buffer, int index);
+static void growGap(ControlPointBuffer* buffer, int needed);
+
+
+void initControlPointBuffer(ControlPointBuffer* buffer, int capacity)
+{
+	buffer->points = calloc(capacity, sizeof(ControlPoint));
+	buffer->capacity = capacity;
+	buffer->gapStart = 0;
+	buffer->gapEnd = capacity;
+}
+
+void freeControlPointBuffer(ControlPointBuffer* buffer)
+{
+	free(buffer->points);
+	buffer->points = NULL;
+	buffer->capacity = 0;
+	buffer->gapStart = 0;
+	buffer->gapEnd = 0;
+}
+
+int countControlPoints(const ControlPointBuffer* buffer)
+{
+	return buffer->capacity - (buffer->gapEnd - buffer->gapStart);
+}
+
+ControlPoint* getControlPoint(const ControlPointBuffer* buffer, int index)
+{
+	if(index < buffer->gapStart)
+		return &(buffer->points[index]);
+
+	return &(buffer->points[index + (buffer->gapEnd - buffer->gapStart)]);
+}
+
+/* Inserts a copy of point so that it ends up at index */
+void insertControlPoint(ControlPointBuffer* buffer, int index, const ControlPoint* point)
+{
+	//The point may live in the buffer, and growing moves it
+	ControlPoint copy = *point;
+
+	growGap(buffer, 1);
+	moveGap(buffer, index);
+
+	buffer->points[buffer->gapStart++] = copy;
+}
+
+void removeControlPoint(ControlPointBuffer* buffer, int index)
+{
+	moveGap(buffer, index);
+	buffer->gapEnd++;
+}
+
+/* Adds count zeroed points to the end and returns them, they stay contiguous until the next edit */
+ControlPoint* appendControlPoints(ControlPointBuffer* buffer, int count)
+{
+	growGap(buffer, count);
+	moveGap(buffer, countControlPoints(buffer));
+
+	ControlPoint* appended = &(buffer->points[buffer->gapStart]);
+	memset(appended, 0, count * sizeof(ControlPoint));
+	buffer->gapStart += count;
+
+	return appended;
+}
+
+/* Replaces removeCount points at index with insertCount uninitialised ones and returns them to be filled in */
+ControlPoint* spliceControlPoints(ControlPointBuffer* buffer, int index, int removeCount, int insertCount)
+{
+	moveGap(buffer, index);
+	buffer->gapEnd += removeCount;
+
+	growGap(buffer, insertCount);
+
+	ControlPoint* inserted = &(buffer->points[buffer->gapStart]);
+	buffer->gapStart += insertCount;
+
+	return inserted;
+}
+
+/* Moves the gap to the end so the points can be read as a plain array, valid until the next edit */
+const ControlPoint* compactControlPoints(ControlPointBuffer* buffer)
+{
+	moveGap(buffer, countControlPoints(buffer));
+	return buffer->points;
+}
+
+/* Copies the points in [start, end) out to the same indexes of destination, which must hold countControlPoints() points */
+void copyControlPoints(const ControlPointBuffer* buffer, int start, int end, ControlPoint* destination)
+{
+	int beforeEnd = end < buffer->gapStart ? end : buffer->gapStart;
+	if(start < beforeEnd)
+		memcpy(destination + start, buffer->points + start, (beforeEnd - start) * sizeof(ControlPoint));
+
+	int afterStart = start > buffer->gapStart ? start : buffer->gapStart;
+	if(afterStart < end)
+		memcpy(destination + afterStart, buffer->points + buffer->gapEnd + (afterStart - buffer->gapStart), (end - afterStart) * sizeof(ControlPoint));
+}
+
+/* Slides the points between the gap and index across it, so the gap starts at index */
+static void moveGap(ControlPointBuffer* buffer, int index)
+{
+	int gapSize = buffer->gapEnd - buffer->gapStart;
+
+	if(index < buffer->gapStart)
+	{
+		int moving = buffer->gapStart - index;
+		memmove(buffer->points + buffer->gapEnd - moving, buffer->points + index, moving * sizeof(ControlPoint));
+	}
+	else if(index > buffer->gapStart)
+	{
+		int moving = index - buffer->gapStart;
+		memmove(buffer->points + buffer->gapStart, buffer->points + buffer->gapEnd, moving * sizeof(ControlPoint));
+	}
+
+	buffer->gapStart = index;
+	buffer->gapEnd = index + gapSize;
+}
+
+/* Makes the gap at least needed points long, growing the buffer by half each time like the old array did */
+static void growGap(ControlPointBuffer* buffer, int needed)
+{
+	if(buffer->gapEnd - buffer->gapStart >= needed)
+		return;
+
+	int newCapacity = buffer->capacity > 2 ? buffer->capacity * 1.5 : 4;
+	while(newCapacity - countControlPoints(buffer) < needed)
+		newCapacity = newCapacity * 1.5;
+
+	int after = buffer->capacity - buffer->gapEnd;
+	buffer->points = realloc(buffer->points, newCapacity * sizeof(ControlPoint));
+
+	//Keep the points after the gap at the end of the bigger buffer
+	memmove(buffer->points + newCapacity - after, buffer->points + buffer->gapEnd, after * sizeof(ControlPoint));
+
+	buffer->gapEnd = newCapacity - after;
+	buffer->capacity = newCapacity;
+}
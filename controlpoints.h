@@ -0,0 +1,30 @@
+#ifndef CONTROLPOINTS_H
+#define CONTROLPOINTS_H
+
+#include "track.h"
+
+/*	Control points stored in a gap buffer, the unused space sits at [gapStart, gapEnd) wherever the last edit was
+ *	Indexes passed to these functions skip over the gap, so they are the same as in a plain array
+ */
+typedef struct {
+	ControlPoint* points;
+	int capacity;
+	int gapStart;
+	int gapEnd;
+} ControlPointBuffer;
+
+void initControlPointBuffer(ControlPointBuffer* buffer, int capacity);
+void freeControlPointBuffer(ControlPointBuffer* buffer);
+
+int countControlPoints(const ControlPointBuffer* buffer);
+ControlPoint* getControlPoint(const ControlPointBuffer* buffer, int index);
+
+void insertControlPoint(ControlPointBuffer* buffer, int index, const ControlPoint* point);
+void removeControlPoint(ControlPointBuffer* buffer, int index);
+ControlPoint* appendControlPoints(ControlPointBuffer* buffer, int count);
+ControlPoint* spliceControlPoints(ControlPointBuffer* buffer, int index, int removeCount, int insertCount);
+
+const ControlPoint* compactControlPoints(ControlPointBuffer* buffer);
+void copyControlPoints(const ControlPointBuffer* buffer, int start, int end, ControlPoint* destination);
+
+#endif
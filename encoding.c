@@ -0,0 +1,91 @@
+/*	Encoding.c
+ *	This module implements the compact encodings used by the binary file formats
+ *
+ *	Varints store 7 bits per byte with the high bit flagging that more bytes follow, so small numbers take one byte
+ *	Zigzag maps signed numbers onto unsigned ones so small negative numbers stay small too
+ *	Floats are stored as their exact bits in little endian order, so they load back exactly as they were saved
+ *	hashBytes is 64 bit FNV-1a, used to fingerprint simulation state
+ */
+#include <string.h>
+#include "encoding.h"
+
+/* Writes a varint into the buffer and returns how many bytes it took */
+int writeVarint(unsigned char* buffer, uint64_t value)
+{
+	int length = 0;
+
+	while(value >= 0x80)
+	{
+		buffer[length++] = (unsigned char) (value | 0x80);
+		value >>= 7;
+	}
+	buffer[length++] = (unsigned char) value;
+
+	return length;
+}
+
+/* Reads a varint and advances the cursor past it, stopping at end on truncated input */
+uint64_t readVarint(const unsigned char** cursor, const unsigned char* end)
+{
+	uint64_t value = 0;
+	int shift = 0;
+
+	while(*cursor < end && shift < 64)
+	{
+		unsigned char byte = **cursor;
+		(*cursor)++;
+
+		value |= (uint64_t) (byte & 0x7f) << shift;
+		if((byte & 0x80) == 0)
+			break;
+
+		shift += 7;
+	}
+
+	return value;
+}
+
+uint64_t zigzagEncode(int64_t value)
+{
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+int64_t zigzagDecode(uint64_t value)
+{
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+void writeFloat(unsigned char* buffer, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	for(int i = 0; i < 4; i++)
+		buffer[i] = (unsigned char) (bits >> (i * 8));
+}
+
+float readFloat(const unsigned char* buffer)
+{
+	uint32_t bits = 0;
+	for(int i = 0; i < 4; i++)
+		bits |= (uint32_t) buffer[i] << (i * 8);
+
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+
+	return value;
+}
+
+/* Folds the bytes into the hash, start with HASH_SEED */
+uint64_t hashBytes(uint64_t hash, const void* data, unsigned long size)
+{
+	const unsigned char* bytes = data;
+
+	for(unsigned long i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
@@ -0,0 +1,21 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include <stdint.h>
+
+//The most bytes a single varint can take
+#define MAX_VARINT_BYTES 10
+
+int writeVarint(unsigned char* buffer, uint64_t value);
+uint64_t readVarint(const unsigned char** cursor, const unsigned char* end);
+
+uint64_t zigzagEncode(int64_t value);
+int64_t zigzagDecode(uint64_t value);
+
+void writeFloat(unsigned char* buffer, float value);
+float readFloat(const unsigned char* buffer);
+
+#define HASH_SEED 14695981039346656037ULL
+uint64_t hashBytes(uint64_t hash, const void* data, unsigned long size);
+
+#endif
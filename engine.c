@@ -7,9 +7,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
-#include <GL/glut.h>
+#include <time.h>
 #include "engine.h"
 
+//The simulation library is built with ENGINE_NO_GL so it needs nothing but the C library
+#ifndef ENGINE_NO_GL
+#include <GL/glut.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -78,7 +83,7 @@ Vector3 TransformToUp(Transform* transform)
 	return direction;
 }
 
-Vector3 NormalizeVector3(Vector3* vector)
+Vector3 NormalizeVector3(const Vector3* vector)
 {
 	float magnitude = magnitudeVector3(vector);
 
@@ -98,7 +103,7 @@ Vector3* createVector3(float x, float y, float z)
 }
 
 
-Vector3 addVector3(Vector3* v1, Vector3* v2)
+Vector3 addVector3(const Vector3* v1, const Vector3* v2)
 {
 	Vector3 newVector;
 	newVector.x = v1->x + v2->x;
@@ -108,7 +113,7 @@ Vector3 addVector3(Vector3* v1, Vector3* v2)
 	return newVector;
 }
 
-Vector3 minusVector3(Vector3* v1, Vector3* v2)
+Vector3 minusVector3(const Vector3* v1, const Vector3* v2)
 {
 	Vector3 newVector;
 	newVector.x = v1->x - v2->x;
@@ -118,7 +123,7 @@ Vector3 minusVector3(Vector3* v1, Vector3* v2)
 	return newVector;
 }
 
-Vector3 multiplyVector3(Vector3* v1, float multiplier)
+Vector3 multiplyVector3(const Vector3* v1, float multiplier)
 {
 	Vector3 newVector;
 	newVector.x = v1->x * multiplier;
@@ -128,7 +133,7 @@ Vector3 multiplyVector3(Vector3* v1, float multiplier)
 	return newVector;
 } 
 
-Vector3 lerpVector3(Vector3* startPos, Vector3* endPos, float t)
+Vector3 lerpVector3(const Vector3* startPos, const Vector3* endPos, float t)
 {
 	if(t < 0)
 		t = 0;
@@ -141,13 +146,13 @@ Vector3 lerpVector3(Vector3* startPos, Vector3* endPos, float t)
 	return addVector3(startPos, &difference);
 }
 
-float magnitudeVector3(Vector3* vector)
+float magnitudeVector3(const Vector3* vector)
 {
 	return sqrt(	pow(vector->x, 2) + pow(vector->y, 2) + pow(vector->z, 2)	);
 }
 
 
-Vector2 minusVector2(Vector2* v1, Vector2* v2)
+Vector2 minusVector2(const Vector2* v1, const Vector2* v2)
 {
 	Vector2 newVector;
 	newVector.x = v1->x - v2->x;
@@ -156,14 +161,14 @@ Vector2 minusVector2(Vector2* v1, Vector2* v2)
 	return newVector;
 }
 
-float magnitudeVector2(Vector2* vector)
+float magnitudeVector2(const Vector2* vector)
 {
 	return sqrt(	pow(vector->x, 2) + pow(vector->y, 2)	);
 }
 
 
 
-Vector3 crossProductVector3(Vector3* v1, Vector3* v2)
+Vector3 crossProductVector3(const Vector3* v1, const Vector3* v2)
 {
 	Vector3 cross;
 
@@ -174,11 +179,35 @@ Vector3 crossProductVector3(Vector3* v1, Vector3* v2)
 	return cross;
 }
 
+float dotProductVector3(const Vector3* v1, const Vector3* v2)
+{
+	return (v1->x * v2->x) + (v1->y * v2->y) + (v1->z * v2->z);
+}
+
+/*	Rotates the vector around a unit length axis, by angle radians */
+Vector3 rotateVector3(const Vector3* vector, const Vector3* axis, float angle)
+{
+	float cosine = cos(angle);
+	float sine = sin(angle);
+
+	Vector3 cross = crossProductVector3(axis, vector);
+	float dot = dotProductVector3(axis, vector);
+
+	Vector3 rotated;
+	rotated.x = (vector->x * cosine) + (cross.x * sine) + (axis->x * dot * (1 - cosine));
+	rotated.y = (vector->y * cosine) + (cross.y * sine) + (axis->y * dot * (1 - cosine));
+	rotated.z = (vector->z * cosine) + (cross.z * sine) + (axis->z * dot * (1 - cosine));
+
+	return rotated;
+}
+
 
 
 //========== Wrapper functions to allow calls using Vector3s
 
-void glTranslateVector3(Vector3* vector)
+#ifndef ENGINE_NO_GL
+
+void glTranslateVector3(const Vector3* vector)
 {
 	glTranslated(vector->x, vector->y, vector->z);
 }
@@ -190,26 +219,113 @@ void glRotateVector3(Vector3* vector)
 	glRotatef(vector->z * RAD2DEG, 0, 0, 1);
 }
 
-void glVertexVector3(Vector3* vector)
+void glVertexVector3(const Vector3* vector)
 {
 	glVertex3f(vector->x, vector->y, vector->z);
 }
 
-void lookAt(Vector3* eyes, Vector3* target, Vector3* up)
+void lookAt(const Vector3* eyes, const Vector3* target, const Vector3* up)
 {
 	gluLookAt(eyes->x, eyes->y,  eyes->z, target->x, target->y, target->z, up->x, up->y, up->z);
 }
 
+/* A cube of side 1 around the origin, for when there's no GLUT to draw glutSolidCube() */
+void drawUnitCube()
+{
+	static const GLfloat normals[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+	glBegin(GL_QUADS);
+	for(int i = 0; i < 6; i++)
+	{
+		//Two axes across the face, ordered so the corners go anticlockwise seen from outside
+		int axis = i / 2;
+		int sign = (i % 2 == 0) ? 1 : -1;
+		int first = (axis + (sign > 0 ? 1 : 2)) % 3;
+		int second = (axis + (sign > 0 ? 2 : 1)) % 3;
+		static const int corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+		glNormal3fv(normals[i]);
+		for(int j = 0; j < 4; j++)
+		{
+			GLfloat vertex[3];
+			vertex[axis] = 0.5f * sign;
+			vertex[first] = 0.5f * corners[j][0];
+			vertex[second] = 0.5f * corners[j][1];
+			glVertex3fv(vertex);
+		}
+	}
+	glEnd();
+}
+
+#endif
+
 //==========
 
 
 
-double myRandom(double min, double max)
+/*	Spreads the seed over the whole state with splitmix64, so similar seeds still give unrelated sequences */
+void seedRandom(Random* random, uint64_t seed)
+{
+	for(int i = 0; i < 4; i++)
+	{
+		seed += 0x9e3779b97f4a7c15ULL;
+
+		uint64_t z = seed;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		random->state[i] = z ^ (z >> 31);
+	}
+}
+
+static uint64_t rotateLeft(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t nextRandom(Random* random)
+{
+	uint64_t* s = random->state;
+	uint64_t result = rotateLeft(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotateLeft(s[3], 45);
+
+	return result;
+}
+
+/* Uniform in [min,max), using the top 53 bits so every double step is reachable */
+double randomRange(Random* random, double min, double max)
+{
+	return min + (max - min) * ((nextRandom(random) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+
+//========== Timing
+
+/*	Returns a monotonic time in seconds, only useful for measuring differences */
+double getTimeSeconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+/*	Sleeps the calling thread until getTimeSeconds() reaches the given time */
+void sleepUntil(double time)
 {
-	double	d;
-	
-	/* return a random number uniformly draw from [min,max] */
-	d = min+(max-min)*(rand()%0x7fff)/32767.0;
-	
-	return d;
-}
\ No newline at end of file
+	double remaining = time - getTimeSeconds();
+	if(remaining <= 0)
+		return;
+
+	struct timespec duration;
+	duration.tv_sec = (time_t) remaining;
+	duration.tv_nsec = (long) ((remaining - duration.tv_sec) * 1000000000.0);
+
+	nanosleep(&duration, NULL);
+}
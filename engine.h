@@ -1,3 +1,8 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+
 typedef struct {
 	float x, y;
 } Vector2;
@@ -6,6 +11,11 @@ typedef struct {
 	float x, y, z;
 } Vector3;
 
+/*	A xoshiro256** random number generator, each thread should own its own */
+typedef struct {
+	uint64_t state[4];
+} Random;
+
 typedef struct Transform Transform;
 struct Transform {
 	Transform* parent;
@@ -17,25 +27,38 @@ Transform* createTransform(Transform* parent);
 
 Vector3* createVector3(float x, float y, float z);
 
-Vector3 addVector3(Vector3* v1, Vector3* v2);
-Vector3 minusVector3(Vector3* v1, Vector3* v2);
-Vector3 multiplyVector3(Vector3* v1, float multiplier);
-Vector3 lerpVector3(Vector3* startPos, Vector3* endPos, float time);
-float magnitudeVector3(Vector3* vector);
+Vector3 addVector3(const Vector3* v1, const Vector3* v2);
+Vector3 minusVector3(const Vector3* v1, const Vector3* v2);
+Vector3 multiplyVector3(const Vector3* v1, float multiplier);
+Vector3 lerpVector3(const Vector3* startPos, const Vector3* endPos, float time);
+float magnitudeVector3(const Vector3* vector);
 
-Vector2 minusVector2(Vector2* v1, Vector2* v2);
-float magnitudeVector2(Vector2* vector);
+Vector2 minusVector2(const Vector2* v1, const Vector2* v2);
+float magnitudeVector2(const Vector2* vector);
 
 Vector3 TransformToForward(Transform* transform);
 Vector3 TransformToRight(Transform* transform);
 Vector3 TransformToUp(Transform* transform);
 
-Vector3 NormalizeVector3(Vector3* vector);
+Vector3 NormalizeVector3(const Vector3* vector);
 
-Vector3 crossProductVector3(Vector3* v1, Vector3* v2);
+Vector3 crossProductVector3(const Vector3* v1, const Vector3* v2);
+float dotProductVector3(const Vector3* v1, const Vector3* v2);
+Vector3 rotateVector3(const Vector3* vector, const Vector3* axis, float angle);
 
-void glTranslateVector3(Vector3* vector);
+#ifndef ENGINE_NO_GL
+void glTranslateVector3(const Vector3* vector);
 void glRotateVector3(Vector3* vector);
-void glVertexVector3(Vector3* vector);
-void lookAt(Vector3* eyes, Vector3* target, Vector3* up);
-double myRandom(double min, double max);
\ No newline at end of file
+void glVertexVector3(const Vector3* vector);
+void lookAt(const Vector3* eyes, const Vector3* target, const Vector3* up);
+void drawUnitCube(void);
+#endif
+
+void seedRandom(Random* random, uint64_t seed);
+uint64_t nextRandom(Random* random);
+double randomRange(Random* random, double min, double max);
+
+double getTimeSeconds(void);
+void sleepUntil(double time);
+
+#endif
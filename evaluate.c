@@ -0,0 +1,93 @@
+/*	Evaluate.c
+ *	This module runs a track headlessly and measures how the train gets around it
+ *
+ *	The train starts from the station exactly as it does in the game and nobody presses boost, so a track that
+ *	needs the player's help to get around shows up as a stall.
+ */
+#include <string.h>
+#include <math.h>
+#include "engine.h"
+#include "evaluate.h"
+
+//A lap taking more ticks than this per subsection is given up on
+#define LAP_TICK_LIMIT_PER_SUB_SECTION 1000
+
+
+/* Generates the track, times the generation and simulates it */
+void evaluateTrack(const ControlPoint* points, int numberOfPoints, int laps, TrackEvaluation* evaluation)
+{
+	Track track;
+	memset(&track, 0, sizeof(Track));
+
+	double startTime = getTimeSeconds();
+	generateTrack(&track, points, numberOfPoints);
+	double generationSeconds = getTimeSeconds() - startTime;
+
+	simulateLaps(&track, laps, evaluation);
+	evaluation->generationSeconds = generationSeconds;
+
+	freeTrack(&track);
+}
+
+/* Runs the train around an already generated track until it completes the laps or stalls */
+void simulateLaps(const Track* track, int laps, TrackEvaluation* evaluation)
+{
+	double startTime = getTimeSeconds();
+
+	memset(evaluation, 0, sizeof(TrackEvaluation));
+	evaluation->numberOfPoints = track->numberOfPoints;
+
+	int numberOfSubSections = getNumberOfSubSections(track);
+	for(int i = 0; i < numberOfSubSections; i++)
+		evaluation->length += getSubSection(track, i)->subSectionLength;
+
+	Train train;
+	resetTrain(&train, track, 1);
+
+	evaluation->maxSpeed = train.velocity;
+	evaluation->minSpeed = train.velocity;
+
+	long tickLimit = (long) numberOfSubSections * LAP_TICK_LIMIT_PER_SUB_SECTION;
+	long lapTicks = 0;
+	long firstLapTicks = 0;
+	long totalTicks = 0;
+	int previous = (train.sectionIndex * NUMBER_OF_SUB_SECTIONS) + train.subSectionIndex;
+
+	while(evaluation->lapsCompleted < laps && lapTicks < tickLimit)
+	{
+		stepTrain(&train, track, 0);
+		lapTicks++;
+
+		evaluation->maxSpeed = fmaxf(evaluation->maxSpeed, train.velocity);
+		evaluation->minSpeed = fminf(evaluation->minSpeed, train.velocity);
+
+		if(train.velocity <= 0 && !track->sections[train.sectionIndex].isChain)
+		{
+			evaluation->stalled = 1;
+			evaluation->stallSection = train.sectionIndex;
+			evaluation->stallDistance = train.distance;
+			break;
+		}
+
+		//Moving forwards onto an earlier subsection means the train went past the station
+		int current = (train.sectionIndex * NUMBER_OF_SUB_SECTIONS) + train.subSectionIndex;
+		if(current < previous)
+		{
+			if(evaluation->lapsCompleted == 0)
+				firstLapTicks = lapTicks;
+
+			evaluation->lapsCompleted++;
+			totalTicks += lapTicks;
+			lapTicks = 0;
+		}
+		previous = current;
+	}
+
+	if(evaluation->lapsCompleted > 0)
+	{
+		evaluation->firstLapTime = firstLapTicks * TRAIN_TICK_LENGTH;
+		evaluation->averageLapTime = (totalTicks * TRAIN_TICK_LENGTH) / evaluation->lapsCompleted;
+	}
+
+	evaluation->simulationSeconds = getTimeSeconds() - startTime;
+}
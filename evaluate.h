@@ -0,0 +1,30 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include "track.h"
+
+/*	How a track did over a number of headless laps
+ *	Speeds are in metres per second and times in seconds, lap times are only valid for completed laps
+ */
+typedef struct {
+	int numberOfPoints;
+	float length;
+
+	int lapsCompleted;
+	float firstLapTime;
+	float averageLapTime;
+	float maxSpeed, minSpeed;
+
+	//Set when the train came to a stop outside a chain lift, which ends the run
+	int stalled;
+	int stallSection;
+	double stallDistance;
+
+	double generationSeconds;
+	double simulationSeconds;
+} TrackEvaluation;
+
+void evaluateTrack(const ControlPoint* points, int numberOfPoints, int laps, TrackEvaluation* evaluation);
+void simulateLaps(const Track* track, int laps, TrackEvaluation* evaluation);
+
+#endif
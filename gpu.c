@@ -0,0 +1,95 @@
+/*	Gpu.c
+ *	This module checks for and sets up the GL features newer than what the rest of the renderer draws with
+ *
+ *	Everything that uses them keeps a fixed function path for drivers, or builds, that don't have them.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include "gpu.h"
+
+/* Whether the current context is at least the given GL version, must be called with a context current */
+int hasGlVersion(int major, int minor)
+{
+	const char* version = (const char*) glGetString(GL_VERSION);
+	if(version == NULL)
+		return 0;
+
+	int contextMajor = 0;
+	int contextMinor = 0;
+	if(sscanf(version, "%d.%d", &contextMajor, &contextMinor) != 2)
+		return 0;
+
+	return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+#ifdef GPU_EXTENSIONS
+static GLuint compileShader(const char* name, GLenum type, const char* source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint compiled;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if(!compiled)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("Could not compile the %s %s shader: %s\n", name, type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+#endif
+
+/*	Compiles and links a shader program, binding each attribute to its index in attributes
+ *	Returns 0, after printing why, if it can't be built
+ */
+unsigned int buildShaderProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+	const char* const* attributes, int numberOfAttributes)
+{
+#ifdef GPU_EXTENSIONS
+	if(!hasGlVersion(2, 0))
+		return 0;
+
+	GLuint vertexShader = compileShader(name, GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = compileShader(name, GL_FRAGMENT_SHADER, fragmentSource);
+	if(vertexShader == 0 || fragmentShader == 0) {
+		glDeleteShader(vertexShader);
+		glDeleteShader(fragmentShader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+
+	for(int i = 0; i < numberOfAttributes; i++)
+		glBindAttribLocation(program, i, attributes[i]);
+
+	glLinkProgram(program);
+
+	//The program keeps the shaders alive for as long as it needs them
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint linked;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if(!linked)
+	{
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("Could not link the %s shaders: %s\n", name, log);
+
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+#else
+	return 0;
+#endif
+}
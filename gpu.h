@@ -0,0 +1,17 @@
+#ifndef GPU_H
+#define GPU_H
+
+//Entry points newer than GL 1.1 are linked straight from the GL library where it exports them, elsewhere they aren't used
+#ifndef _WIN32
+#define GL_GLEXT_PROTOTYPES
+#define GPU_EXTENSIONS 1
+#endif
+
+#include <GL/glut.h>
+#include <GL/glext.h>
+
+int hasGlVersion(int major, int minor);
+unsigned int buildShaderProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+	const char* const* attributes, int numberOfAttributes);
+
+#endif
@@ -0,0 +1,171 @@
+/*	Heightmap.c
+ *	This module maps heightmap files and samples the ground height from them
+ *
+ *	The file is mapped rather than read, so only the tiles that get looked at are ever paged in, and since nothing
+ *	is ever loaded any part of it can be sampled at any time from any thread.
+ *
+ *	File layout, after the "RCHM" magic and a version byte, is a header padded out to HEIGHTMAP_HEADER_SIZE:
+ *		tilesX, tilesZ as little endian 32 bit ints, then spacing, baseHeight, heightScale, minHeight,
+ *		maxHeight, originX, originZ as little endian 32 bit floats
+ *	followed by the tiles row by row, each HEIGHTMAP_TILE_SAMPLES squared little endian 16 bit samples row by row.
+ *	A sample's height is baseHeight + sample * heightScale.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "encoding.h"
+#include "heightmap.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define HEIGHTMAP_FILE_MAGIC "RCHM"
+#define HEIGHTMAP_FILE_VERSION 1
+
+static void writeInt(unsigned char* buffer, uint32_t value);
+static uint32_t readInt(const unsigned char* buffer);
+
+
+/* Maps a heightmap file, returns NULL if it isn't one */
+Heightmap* openHeightmap(const char* path)
+{
+#ifndef _WIN32
+	int descriptor = open(path, O_RDONLY);
+	if(descriptor < 0)
+		return NULL;
+
+	struct stat status;
+	if(fstat(descriptor, &status) != 0 || status.st_size < HEIGHTMAP_HEADER_SIZE) {
+		close(descriptor);
+		return NULL;
+	}
+
+	const unsigned char* data = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	close(descriptor);
+	if(data == MAP_FAILED)
+		return NULL;
+
+	int tilesX = readInt(data + 5);
+	int tilesZ = readInt(data + 9);
+	float spacing = readFloat(data + 13);
+	size_t expected = HEIGHTMAP_HEADER_SIZE + ((size_t) tilesX * tilesZ * HEIGHTMAP_TILE_BYTES);
+
+	//Sampling divides by the spacing
+	if(memcmp(data, HEIGHTMAP_FILE_MAGIC, 4) != 0 || data[4] != HEIGHTMAP_FILE_VERSION || tilesX < 1 || tilesZ < 1
+		|| !isfinite(spacing) || spacing <= 0 || (size_t) status.st_size < expected)
+	{
+		munmap((void*) data, status.st_size);
+		return NULL;
+	}
+
+	//Reads jump around the file as the camera moves
+	madvise((void*) data, status.st_size, MADV_RANDOM);
+
+	Heightmap* heightmap = malloc(sizeof(Heightmap));
+	heightmap->data = data;
+	heightmap->size = status.st_size;
+	heightmap->samples = data + HEIGHTMAP_HEADER_SIZE;
+	heightmap->tilesX = tilesX;
+	heightmap->tilesZ = tilesZ;
+	heightmap->spacing = spacing;
+	heightmap->baseHeight = readFloat(data + 17);
+	heightmap->heightScale = readFloat(data + 21);
+	heightmap->minHeight = readFloat(data + 25);
+	heightmap->maxHeight = readFloat(data + 29);
+	heightmap->originX = readFloat(data + 33);
+	heightmap->originZ = readFloat(data + 37);
+
+	return heightmap;
+#else
+	return NULL;
+#endif
+}
+
+void closeHeightmap(Heightmap* heightmap)
+{
+#ifndef _WIN32
+	munmap((void*) heightmap->data, heightmap->size);
+	free(heightmap);
+#endif
+}
+
+/* The height of one sample, samples off the edge of the map take the height of the edge */
+float getHeightmapSample(const Heightmap* heightmap, int x, int z)
+{
+	int width = heightmap->tilesX * HEIGHTMAP_TILE_SAMPLES;
+	int depth = heightmap->tilesZ * HEIGHTMAP_TILE_SAMPLES;
+
+	x = x < 0 ? 0 : (x >= width ? width - 1 : x);
+	z = z < 0 ? 0 : (z >= depth ? depth - 1 : z);
+
+	size_t tile = ((size_t) (z / HEIGHTMAP_TILE_SAMPLES) * heightmap->tilesX) + (x / HEIGHTMAP_TILE_SAMPLES);
+	size_t offset = (tile * HEIGHTMAP_TILE_BYTES) + ((((z % HEIGHTMAP_TILE_SAMPLES) * HEIGHTMAP_TILE_SAMPLES) + (x % HEIGHTMAP_TILE_SAMPLES)) * 2);
+
+	const unsigned char* sample = heightmap->samples + offset;
+	return heightmap->baseHeight + ((sample[0] | (sample[1] << 8)) * heightmap->heightScale);
+}
+
+/* The ground height under a point in park space, blended between the four samples around it */
+float getHeightmapHeight(const Heightmap* heightmap, float x, float z)
+{
+	float sampleX = (x - heightmap->originX) / heightmap->spacing;
+	float sampleZ = (z - heightmap->originZ) / heightmap->spacing;
+
+	int x0 = (int) floorf(sampleX);
+	int z0 = (int) floorf(sampleZ);
+	float tx = sampleX - x0;
+	float tz = sampleZ - z0;
+
+	float front = getHeightmapSample(heightmap, x0, z0) + ((getHeightmapSample(heightmap, x0 + 1, z0) - getHeightmapSample(heightmap, x0, z0)) * tx);
+	float back = getHeightmapSample(heightmap, x0, z0 + 1) + ((getHeightmapSample(heightmap, x0 + 1, z0 + 1) - getHeightmapSample(heightmap, x0, z0 + 1)) * tx);
+
+	return front + ((back - front) * tz);
+}
+
+/* Tells the system a tile is about to be read, or that its pages can go until it is next read */
+void adviseHeightmapTile(const Heightmap* heightmap, int tileX, int tileZ, int needed)
+{
+#ifndef _WIN32
+	size_t tile = ((size_t) tileZ * heightmap->tilesX) + tileX;
+	madvise((void*) (heightmap->samples + (tile * HEIGHTMAP_TILE_BYTES)), HEIGHTMAP_TILE_BYTES, needed ? MADV_WILLNEED : MADV_DONTNEED);
+#endif
+}
+
+/* Fills in the header for a heightmap file described by heightmap, returns its length */
+int writeHeightmapHeader(unsigned char* header, const Heightmap* heightmap)
+{
+	memset(header, 0, HEIGHTMAP_HEADER_SIZE);
+	memcpy(header, HEIGHTMAP_FILE_MAGIC, 4);
+	header[4] = HEIGHTMAP_FILE_VERSION;
+
+	writeInt(header + 5, heightmap->tilesX);
+	writeInt(header + 9, heightmap->tilesZ);
+	writeFloat(header + 13, heightmap->spacing);
+	writeFloat(header + 17, heightmap->baseHeight);
+	writeFloat(header + 21, heightmap->heightScale);
+	writeFloat(header + 25, heightmap->minHeight);
+	writeFloat(header + 29, heightmap->maxHeight);
+	writeFloat(header + 33, heightmap->originX);
+	writeFloat(header + 37, heightmap->originZ);
+
+	return HEIGHTMAP_HEADER_SIZE;
+}
+
+
+//==============ENCODING======================
+
+static void writeInt(unsigned char* buffer, uint32_t value)
+{
+	for(int i = 0; i < 4; i++)
+		buffer[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint32_t readInt(const unsigned char* buffer)
+{
+	return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t) buffer[3] << 24);
+}
@@ -0,0 +1,39 @@
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <stddef.h>
+
+#define HEIGHTMAP_FILE_EXTENSION ".rchm"
+
+//Tiles start on a page boundary so each can be paged in and out on its own
+#define HEIGHTMAP_HEADER_SIZE 4096
+
+//Samples along each side of a tile, a tile's samples are stored together
+#define HEIGHTMAP_TILE_SAMPLES 64
+#define HEIGHTMAP_TILE_BYTES (HEIGHTMAP_TILE_SAMPLES * HEIGHTMAP_TILE_SAMPLES * 2)
+
+/*	A heightmap file mapped into memory, read only so it can be sampled from any thread
+ *	Positions are in park space, sample (0, 0) sits at (originX, originZ) and samples are spacing apart
+ */
+typedef struct {
+	const unsigned char* data;
+	size_t size;
+	const unsigned char* samples;
+
+	int tilesX, tilesZ;
+	float spacing;
+	float baseHeight, heightScale;
+	float minHeight, maxHeight;
+	float originX, originZ;
+} Heightmap;
+
+Heightmap* openHeightmap(const char* path);
+void closeHeightmap(Heightmap* heightmap);
+
+float getHeightmapSample(const Heightmap* heightmap, int x, int z);
+float getHeightmapHeight(const Heightmap* heightmap, float x, float z);
+void adviseHeightmapTile(const Heightmap* heightmap, int tileX, int tileZ, int needed);
+
+int writeHeightmapHeader(unsigned char* header, const Heightmap* heightmap);
+
+#endif
@@ -0,0 +1,365 @@
+/*	History.c
+ *	This module keeps undo and redo history for the control points
+ *
+ *	Each version of the points is a table of pointers to reference counted chunks of a few hundred points. Versions
+ *	share every chunk they have in common, and a chunk is only copied when an edit touches one that an older version
+ *	still uses, so an edit costs the chunks it touched plus a table of pointers rather than a copy of the whole track.
+ *	Chunks vary in size, inserting splits a chunk once it gets too big and removing drops it once it is empty,
+ *	so adding or removing a point never shifts the chunks after it.
+ *
+ *	Undo and redo compare the two tables, skip the chunks they share at either end and rewrite only the points in
+ *	between, reporting that range so the caller only has to refresh what changed.
+ *	Once the history goes over its memory limit the oldest undo states are dropped.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+
+#define HISTORY_CHUNK_SIZE 256
+#define MAX_CHUNK_SIZE (HISTORY_CHUNK_SIZE * 2)
+
+struct HistoryChunk {
+	int references;
+	int count;
+	ControlPoint points[MAX_CHUNK_SIZE];
+};
+
+static HistoryChunk* createChunk(History* history);
+static void releaseChunk(History* history, HistoryChunk* chunk);
+static HistoryChunk* ownChunk(History* history, int chunkIndex);
+static int findChunk(History* history, int index);
+static void insertChunk(History* history, int chunkIndex, HistoryChunk* chunk);
+static void removeChunk(History* history, int chunkIndex);
+static void copyState(History* history, HistoryState* destination, const HistoryState* source);
+static void freeState(History* history, HistoryState* state);
+static void pushState(History* history, HistoryState** stack, int* count, int* allocated, const HistoryState* state);
+static void restoreState(History* history, ControlPointBuffer* points, const HistoryState* target, HistoryChange* change);
+static void clearRedo(History* history);
+static void trimHistory(History* history);
+
+
+void initHistory(History* history, const ControlPointBuffer* points, int selectedPoint, size_t memoryLimit)
+{
+	memset(history, 0, sizeof(History));
+	history->memoryLimit = memoryLimit;
+
+	int numberOfPoints = countControlPoints(points);
+	for(int first = 0; first < numberOfPoints; first += HISTORY_CHUNK_SIZE)
+	{
+		HistoryChunk* chunk = createChunk(history);
+		chunk->count = numberOfPoints - first < HISTORY_CHUNK_SIZE ? numberOfPoints - first : HISTORY_CHUNK_SIZE;
+
+		for(int i = 0; i < chunk->count; i++)
+			chunk->points[i] = *getControlPoint(points, first + i);
+
+		insertChunk(history, history->working.numberOfChunks, chunk);
+	}
+
+	history->working.numberOfPoints = numberOfPoints;
+	commitHistory(history, selectedPoint);
+}
+
+void freeHistory(History* history)
+{
+	clearRedo(history);
+
+	for(int i = 0; i < history->numberOfUndo; i++)
+		freeState(history, &(history->undo[i]));
+	freeState(history, &(history->working));
+
+	free(history->undo);
+	free(history->redo);
+	memset(history, 0, sizeof(History));
+}
+
+
+//==============EDITING=======================
+
+void historySetPoint(History* history, int index, const ControlPoint* point)
+{
+	int chunkIndex = findChunk(history, index);
+	HistoryChunk* chunk = ownChunk(history, chunkIndex);
+
+	chunk->points[index - history->cursorFirst] = *point;
+}
+
+void historyInsertPoint(History* history, int index, const ControlPoint* point)
+{
+	//Appending goes on the end of the last chunk
+	int chunkIndex = history->working.numberOfChunks == 0 ? -1 : findChunk(history, index < history->working.numberOfPoints ? index : index - 1);
+
+	if(chunkIndex == -1) {
+		insertChunk(history, 0, createChunk(history));
+		chunkIndex = 0;
+		history->cursorChunk = 0;
+		history->cursorFirst = 0;
+	}
+
+	HistoryChunk* chunk = ownChunk(history, chunkIndex);
+	int offset = index - history->cursorFirst;
+
+	memmove(&(chunk->points[offset + 1]), &(chunk->points[offset]), (chunk->count - offset) * sizeof(ControlPoint));
+	chunk->points[offset] = *point;
+	chunk->count++;
+	history->working.numberOfPoints++;
+
+	//Split full chunks in half
+	if(chunk->count == MAX_CHUNK_SIZE)
+	{
+		HistoryChunk* second = createChunk(history);
+		second->count = MAX_CHUNK_SIZE - HISTORY_CHUNK_SIZE;
+		memcpy(second->points, &(chunk->points[HISTORY_CHUNK_SIZE]), second->count * sizeof(ControlPoint));
+		chunk->count = HISTORY_CHUNK_SIZE;
+
+		insertChunk(history, chunkIndex + 1, second);
+	}
+}
+
+void historyRemovePoint(History* history, int index)
+{
+	int chunkIndex = findChunk(history, index);
+	HistoryChunk* chunk = ownChunk(history, chunkIndex);
+	int offset = index - history->cursorFirst;
+
+	memmove(&(chunk->points[offset]), &(chunk->points[offset + 1]), (chunk->count - offset - 1) * sizeof(ControlPoint));
+	chunk->count--;
+	history->working.numberOfPoints--;
+
+	if(chunk->count == 0)
+		removeChunk(history, chunkIndex);
+}
+
+/* Saves the edits made since the last commit as a new undo state, dropping anything that could have been redone */
+void commitHistory(History* history, int selectedPoint)
+{
+	clearRedo(history);
+
+	history->working.selectedPoint = selectedPoint;
+	pushState(history, &(history->undo), &(history->numberOfUndo), &(history->allocatedUndo), &(history->working));
+
+	trimHistory(history);
+}
+
+
+//==============UNDO AND REDO=================
+
+/* Steps the points back to the previous state, returns 0 if there's nothing to undo */
+int undoHistory(History* history, ControlPointBuffer* points, HistoryChange* change)
+{
+	if(history->numberOfUndo < 2)
+		return 0;
+
+	//The newest undo state is the current one, it moves over to the redo stack
+	HistoryState* current = &(history->undo[--history->numberOfUndo]);
+	if(history->numberOfRedo == history->allocatedRedo)
+	{
+		history->allocatedRedo = history->allocatedRedo ? history->allocatedRedo * 2 : 16;
+		history->redo = realloc(history->redo, history->allocatedRedo * sizeof(HistoryState));
+	}
+	history->redo[history->numberOfRedo++] = *current;
+
+	restoreState(history, points, &(history->undo[history->numberOfUndo - 1]), change);
+	return 1;
+}
+
+/* Reapplies the last undone state, returns 0 if there's nothing to redo */
+int redoHistory(History* history, ControlPointBuffer* points, HistoryChange* change)
+{
+	if(history->numberOfRedo == 0)
+		return 0;
+
+	HistoryState* next = &(history->redo[--history->numberOfRedo]);
+	if(history->numberOfUndo == history->allocatedUndo)
+	{
+		history->allocatedUndo = history->allocatedUndo ? history->allocatedUndo * 2 : 16;
+		history->undo = realloc(history->undo, history->allocatedUndo * sizeof(HistoryState));
+	}
+	history->undo[history->numberOfUndo++] = *next;
+
+	restoreState(history, points, &(history->undo[history->numberOfUndo - 1]), change);
+	return 1;
+}
+
+/* Rewrites the points that differ between the working state and target, then makes target the working state */
+static void restoreState(History* history, ControlPointBuffer* points, const HistoryState* target, HistoryChange* change)
+{
+	const HistoryState* working = &(history->working);
+
+	int shortest = working->numberOfChunks < target->numberOfChunks ? working->numberOfChunks : target->numberOfChunks;
+
+	int same = 0;
+	int start = 0;
+	while(same < shortest && working->chunks[same] == target->chunks[same])
+		start += working->chunks[same++]->count;
+
+	int sameAfter = 0;
+	int pointsAfter = 0;
+	while(sameAfter < shortest - same && working->chunks[working->numberOfChunks - 1 - sameAfter] == target->chunks[target->numberOfChunks - 1 - sameAfter])
+		pointsAfter += working->chunks[working->numberOfChunks - 1 - sameAfter++]->count;
+
+	change->start = start;
+	change->oldEnd = working->numberOfPoints - pointsAfter;
+	change->newEnd = target->numberOfPoints - pointsAfter;
+	change->selectedPoint = target->selectedPoint;
+
+	ControlPoint* replaced = spliceControlPoints(points, start, change->oldEnd - start, change->newEnd - start);
+	for(int i = same; i < target->numberOfChunks - sameAfter; i++)
+	{
+		memcpy(replaced, target->chunks[i]->points, target->chunks[i]->count * sizeof(ControlPoint));
+		replaced += target->chunks[i]->count;
+	}
+
+	HistoryState copy;
+	copyState(history, &copy, target);
+	freeState(history, &(history->working));
+	history->working = copy;
+
+	history->cursorChunk = 0;
+	history->cursorFirst = 0;
+}
+
+
+//==============CHUNKS========================
+
+static HistoryChunk* createChunk(History* history)
+{
+	HistoryChunk* chunk = malloc(sizeof(HistoryChunk));
+	chunk->references = 1;
+	chunk->count = 0;
+
+	history->memoryUsed += sizeof(HistoryChunk);
+	return chunk;
+}
+
+static void releaseChunk(History* history, HistoryChunk* chunk)
+{
+	if(--chunk->references > 0)
+		return;
+
+	history->memoryUsed -= sizeof(HistoryChunk);
+	free(chunk);
+}
+
+/* Returns the working state's chunk, copying it first if any saved state shares it */
+static HistoryChunk* ownChunk(History* history, int chunkIndex)
+{
+	HistoryChunk* chunk = history->working.chunks[chunkIndex];
+	if(chunk->references == 1)
+		return chunk;
+
+	HistoryChunk* copy = createChunk(history);
+	copy->count = chunk->count;
+	memcpy(copy->points, chunk->points, chunk->count * sizeof(ControlPoint));
+
+	releaseChunk(history, chunk);
+	history->working.chunks[chunkIndex] = copy;
+
+	return copy;
+}
+
+/*	Finds the working chunk holding index, walking from the last chunk found since edits tend to stay close together
+ *	Leaves the index of its first point in cursorFirst
+ */
+static int findChunk(History* history, int index)
+{
+	HistoryChunk** chunks = history->working.chunks;
+	int chunk = history->cursorChunk;
+	int first = history->cursorFirst;
+
+	if(chunk >= history->working.numberOfChunks) {
+		chunk = 0;
+		first = 0;
+	}
+
+	while(index < first)
+		first -= chunks[--chunk]->count;
+
+	while(index >= first + chunks[chunk]->count && chunk < history->working.numberOfChunks - 1)
+		first += chunks[chunk++]->count;
+
+	history->cursorChunk = chunk;
+	history->cursorFirst = first;
+	return chunk;
+}
+
+static void insertChunk(History* history, int chunkIndex, HistoryChunk* chunk)
+{
+	HistoryState* working = &(history->working);
+
+	working->chunks = realloc(working->chunks, (working->numberOfChunks + 1) * sizeof(HistoryChunk*));
+	memmove(&(working->chunks[chunkIndex + 1]), &(working->chunks[chunkIndex]), (working->numberOfChunks - chunkIndex) * sizeof(HistoryChunk*));
+	working->chunks[chunkIndex] = chunk;
+	working->numberOfChunks++;
+}
+
+static void removeChunk(History* history, int chunkIndex)
+{
+	HistoryState* working = &(history->working);
+
+	releaseChunk(history, working->chunks[chunkIndex]);
+	memmove(&(working->chunks[chunkIndex]), &(working->chunks[chunkIndex + 1]), (working->numberOfChunks - chunkIndex - 1) * sizeof(HistoryChunk*));
+	working->numberOfChunks--;
+
+	history->cursorChunk = 0;
+	history->cursorFirst = 0;
+}
+
+
+//==============STATES========================
+
+/* Copies the chunk table, sharing the chunks */
+static void copyState(History* history, HistoryState* destination, const HistoryState* source)
+{
+	*destination = *source;
+	destination->chunks = malloc((source->numberOfChunks > 0 ? source->numberOfChunks : 1) * sizeof(HistoryChunk*));
+	memcpy(destination->chunks, source->chunks, source->numberOfChunks * sizeof(HistoryChunk*));
+
+	for(int i = 0; i < source->numberOfChunks; i++)
+		source->chunks[i]->references++;
+
+	history->memoryUsed += source->numberOfChunks * sizeof(HistoryChunk*);
+}
+
+static void freeState(History* history, HistoryState* state)
+{
+	for(int i = 0; i < state->numberOfChunks; i++)
+		releaseChunk(history, state->chunks[i]);
+
+	history->memoryUsed -= state->numberOfChunks * sizeof(HistoryChunk*);
+	free(state->chunks);
+	state->chunks = NULL;
+	state->numberOfChunks = 0;
+}
+
+static void pushState(History* history, HistoryState** stack, int* count, int* allocated, const HistoryState* state)
+{
+	if(*count == *allocated)
+	{
+		*allocated = *allocated ? *allocated * 2 : 16;
+		*stack = realloc(*stack, *allocated * sizeof(HistoryState));
+	}
+
+	copyState(history, &((*stack)[(*count)++]), state);
+}
+
+static void clearRedo(History* history)
+{
+	for(int i = 0; i < history->numberOfRedo; i++)
+		freeState(history, &(history->redo[i]));
+
+	history->numberOfRedo = 0;
+}
+
+/* Drops the oldest undo states until the history fits in its memory limit, always keeping the current state */
+static void trimHistory(History* history)
+{
+	int dropped = 0;
+	while(history->memoryUsed > history->memoryLimit && dropped < history->numberOfUndo - 1)
+		freeState(history, &(history->undo[dropped++]));
+
+	if(dropped == 0)
+		return;
+
+	memmove(history->undo, &(history->undo[dropped]), (history->numberOfUndo - dropped) * sizeof(HistoryState));
+	history->numberOfUndo -= dropped;
+}
@@ -0,0 +1,56 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include "controlpoints.h"
+
+typedef struct HistoryChunk HistoryChunk;
+
+/*	One version of the control points, as a table of chunks shared with every other version they didn't change in */
+typedef struct {
+	HistoryChunk** chunks;
+	int numberOfChunks;
+	int numberOfPoints;
+	int selectedPoint;
+} HistoryState;
+
+/*	The range of points an undo or redo replaced, [start, oldEnd) became [start, newEnd) */
+typedef struct {
+	int start;
+	int oldEnd;
+	int newEnd;
+	int selectedPoint;
+} HistoryChange;
+
+/*	Undo and redo for the control points
+ *	working mirrors the live points as they are edited, commitHistory() makes it the newest undo state
+ */
+typedef struct {
+	HistoryState working;
+	int cursorChunk;
+	int cursorFirst;
+
+	HistoryState* undo;
+	int numberOfUndo;
+	int allocatedUndo;
+
+	HistoryState* redo;
+	int numberOfRedo;
+	int allocatedRedo;
+
+	size_t memoryUsed;
+	size_t memoryLimit;
+} History;
+
+void initHistory(History* history, const ControlPointBuffer* points, int selectedPoint, size_t memoryLimit);
+void freeHistory(History* history);
+
+void historySetPoint(History* history, int index, const ControlPoint* point);
+void historyInsertPoint(History* history, int index, const ControlPoint* point);
+void historyRemovePoint(History* history, int index);
+void commitHistory(History* history, int selectedPoint);
+
+int undoHistory(History* history, ControlPointBuffer* points, HistoryChange* change);
+int redoHistory(History* history, ControlPointBuffer* points, HistoryChange* change);
+
+#endif
@@ -1,75 +1,220 @@
 /*  Input.c
  *  This module handles taking all input from the user, both keyboard and mouse
+ *
+ *  The GLUT callbacks never touch input[] directly, they push timestamped events into a single producer,
+ *  single consumer ring buffer. The simulation thread drains it once per tick, so every press is seen
+ *  exactly once no matter how short it was.
+ *
+ *  Applied events are passed to the replay module, which can record them or substitute recorded ones.
  */
 #include "input.h"
+#include "engine.h"
+#include "replay.h"
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
-#include <stdio.h>
+#include <stdatomic.h>
 #include <GL/glut.h>
 
+//Must be a power of 2
+#define INPUT_QUEUE_SIZE 256
 
+static void pushInput(int label, InputEventType type, int value);
+static void applyInputEvent(const InputEvent* event);
 
-//==============KEYBOARD======================
+int input[NUMBER_OF_INPUTS];
+
+//Held inputs stay in input[] for the tick they were released in, so short taps aren't lost
+static int held[NUMBER_OF_INPUTS];
+static const int isHeldInput[NUMBER_OF_INPUTS] = {
+    [Up] = 1, [Down] = 1, [Left] = 1, [Right] = 1, [FlyUp] = 1, [FlyDown] = 1,
+    [Click] = 1, [AltClick] = 1, [Boost] = 1
+};
+
+//One shot inputs only count presses from the tick they arrived in, so presses nobody was ready for don't pile up
+static const int isOneShotInput[NUMBER_OF_INPUTS] = {
+    [Camera] = 1, [Next] = 1, [Prev] = 1, [Add] = 1, [Remove] = 1, [Height] = 1, [Pause] = 1, [FinishTrack] = 1,
+    [ChainLift] = 1, [Undo] = 1, [Redo] = 1, [Overlay] = 1, [NextCoaster] = 1
+};
+
+static InputEvent inputQueue[INPUT_QUEUE_SIZE];
+static atomic_uint queueHead = 0;
+static atomic_uint queueTail = 0;
+static atomic_uint droppedInputs = 0;
+
+//Counts every drain, paused or not, so recorded events line up with the same drain on replay
+static unsigned long inputTick = 0;
+
+
+//==============QUEUE=========================
 
 void initInput()
 {
     memset(&input, 0, sizeof(input));
+    memset(&held, 0, sizeof(held));
+}
+
+/* Called from the GLUT thread, drops the event if the simulation has fallen a full queue behind */
+static void pushInput(int label, InputEventType type, int value)
+{
+    unsigned int head = atomic_load_explicit(&queueHead, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queueTail, memory_order_acquire);
+
+    if(head - tail >= INPUT_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&droppedInputs, 1, memory_order_relaxed);
+        return;
+    }
+
+    InputEvent* event = &inputQueue[head & (INPUT_QUEUE_SIZE - 1)];
+    event->time = getTimeSeconds();
+    event->label = label;
+    event->type = type;
+    event->value = value;
+
+    atomic_store_explicit(&queueHead, head + 1, memory_order_release);
+}
+
+/* Called from the simulation thread once per tick, applies every event queued since the last tick */
+void drainInput()
+{
+    //Releases from last tick take effect now, and one shot presses and mouse movement are per tick
+    for(int i = 0; i < NUMBER_OF_INPUTS; i++) {
+        if(isHeldInput[i])
+            input[i] = held[i];
+        else if(isOneShotInput[i])
+            input[i] = 0;
+    }
+
+    consumeMouseInput();
+
+    unsigned int tail = atomic_load_explicit(&queueTail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queueHead, memory_order_acquire);
+
+    //Live input is still drained during a replay, it just doesn't get applied
+    while(tail != head)
+    {
+        InputEvent* event = &inputQueue[tail & (INPUT_QUEUE_SIZE - 1)];
+        if(!isReplaying()) {
+            recordInputEvent(inputTick, event);
+            applyInputEvent(event);
+        }
+        tail++;
+    }
+
+    atomic_store_explicit(&queueTail, tail, memory_order_release);
+
+    InputEvent recordedEvent;
+    while(nextReplayEvent(inputTick, &recordedEvent))
+        applyInputEvent(&recordedEvent);
+
+    inputTick++;
+}
+
+unsigned long getInputTick()
+{
+    return inputTick;
 }
 
+static void applyInputEvent(const InputEvent* event)
+{
+    int label = event->label;
+
+    switch(event->type)
+    {
+        case InputPress:
+            if(isHeldInput[label]) {
+                held[label] = 1;
+                input[label] = 1;
+            }
+            else
+                input[label]++;
+            break;
+
+        case InputRelease:
+            held[label] = 0;
+            break;
+
+        case InputDelta:
+            input[label] += event->value;
+            break;
+
+        case InputSet:
+            input[label] = event->value;
+            break;
+    }
+}
+
+
+//==============KEYBOARD======================
+
 void keyPress(unsigned char key, int x, int y)
 {
     key = tolower(key);
 	switch (key)
 	{
         case 'w':
-            input[Up] = 1;
+            pushInput(Up, InputPress, 0);
             break;
         case 'a':
-            input[Left] = 1;
+            pushInput(Left, InputPress, 0);
             break;
         case 's':
-            input[Down] = 1;
+            pushInput(Down, InputPress, 0);
             break;
         case 'd':
-            input[Right] = 1;
+            pushInput(Right, InputPress, 0);
             break;
         case 'q':
-            input[FlyUp] = 1;
+            pushInput(FlyUp, InputPress, 0);
             break;
         case 'e':
-            input[FlyDown] = 1;
+            pushInput(FlyDown, InputPress, 0);
             break;
 
 		case 'p':
-            if(input[Pause])
-                input[Pause] = 0;
-            else
-                input[Pause] = 1;
+            pushInput(Pause, InputPress, 0);
 			break;
 
         case '=':
-            input[Add] = 1;
+            pushInput(Add, InputPress, 0);
             break;
 
         case '-':
-            input[Remove] = 1;
+            pushInput(Remove, InputPress, 0);
             break;
 
         case 'b':
-            input[Boost] = 1;
+            pushInput(Boost, InputPress, 0);
             break;
 
         case 'c':
-            input[ChainLift] = 1;
+            pushInput(ChainLift, InputPress, 0);
             break;
 
         case 'v':
-            input[Camera] = 1;
+            pushInput(Camera, InputPress, 0);
+            break;
+
+        case 'z':
+            pushInput(Undo, InputPress, 0);
+            break;
+
+        case 'y':
+            pushInput(Redo, InputPress, 0);
+            break;
+
+        case 'g':
+            pushInput(Overlay, InputPress, 0);
+            break;
+
+        //Tab
+        case 9:
+            pushInput(NextCoaster, InputPress, 0);
             break;
 
         //Enter
         case 13:
-            input[FinishTrack] = 1;
+            pushInput(FinishTrack, InputPress, 0);
             break;
 	}
 }
@@ -80,26 +225,26 @@ void keyRelease(unsigned char key, int x, int y)
     switch(key)
     {
         case 'w':
-            input[Up] = 0;
+            pushInput(Up, InputRelease, 0);
             break;
         case 'a':
-            input[Left] = 0;
+            pushInput(Left, InputRelease, 0);
             break;
         case 's':
-            input[Down] = 0;
+            pushInput(Down, InputRelease, 0);
             break;
         case 'd':
-            input[Right] = 0;
+            pushInput(Right, InputRelease, 0);
             break;
         case 'q':
-            input[FlyUp] = 0;
+            pushInput(FlyUp, InputRelease, 0);
             break;
         case 'e':
-            input[FlyDown] = 0;
+            pushInput(FlyDown, InputRelease, 0);
             break;
 
         case 'b':
-            input[Boost] = 0;
+            pushInput(Boost, InputRelease, 0);
             break;
     }
 }
@@ -110,22 +255,22 @@ void specialKeyPress(int key, int x, int y)
     {
         //Right
         case 102:
-            input[Next] = 1;
+            pushInput(Next, InputPress, 0);
             break;
 
         //Left
         case 100:
-            input[Prev] = 1;
+            pushInput(Prev, InputPress, 0);
             break;
 
         //Up
         case 101:
-            input[Height] = 1;
+            pushInput(Height, InputDelta, 1);
             break;
         
         //Down
         case 103:
-            input[Height] = -1;
+            pushInput(Height, InputDelta, -1);
             break;
     }
 }
@@ -144,14 +289,17 @@ void specialKeyRelease(int key, int x, int y)
 int prevX = 0, prevY = 0;
 void mouseMovement(int x, int y)
 {
+    pushInput(CursorX, InputSet, x);
+    pushInput(CursorY, InputSet, y);
+
     if(prevX == 0 && prevY == 0) {
         prevX = x;
         prevY = y;
         return;
     }
 
-    input[MouseX] = x - prevX;
-    input[MouseY] = y - prevY;
+    pushInput(MouseX, InputDelta, x - prevX);
+    pushInput(MouseY, InputDelta, y - prevY);
 
     prevX = x;
     prevY = y;
@@ -160,26 +308,29 @@ void mouseMovement(int x, int y)
 /* Flags the proper mouse button's state and resets tracked mouse movement on button release */
 void mouseClick(int button, int state, int x, int y)
 {
+    pushInput(CursorX, InputSet, x);
+    pushInput(CursorY, InputSet, y);
+
     if (button == 0)
     {
         if (state == GLUT_UP) {
-            input[Click] = 0;
+            pushInput(Click, InputRelease, 0);
             prevY = 0;
             prevX = 0;
         }
         else
-            input[Click] = 1;
+            pushInput(Click, InputPress, 0);
     }
 
     else if (button == 2)
     {
         if (state == GLUT_UP) {
-            input[AltClick] = 0;
+            pushInput(AltClick, InputRelease, 0);
             prevY = 0;
             prevX = 0;
         }
         else
-            input[AltClick] = 1;
+            pushInput(AltClick, InputPress, 0);
     }
 }
 
@@ -188,4 +339,11 @@ void consumeMouseInput()
 {
     input[MouseX] = 0;
     input[MouseY] = 0;
+}
+
+/* The window size goes through the queue too, so picking is done against the view size the click was made in */
+void reshapeInput(int width, int height)
+{
+    pushInput(ViewWidth, InputSet, width);
+    pushInput(ViewHeight, InputSet, height);
 }
\ No newline at end of file
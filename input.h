@@ -1,7 +1,26 @@
-int input[25];
-enum InputLabels { Up, Down, Left, Right, Camera, FlyUp, FlyDown, Next, Prev, Add, Remove, Height, Pause, MouseX, MouseY, Click, AltClick, FinishTrack, Boost, ChainLift };
+#ifndef INPUT_H
+#define INPUT_H
+
+#define NUMBER_OF_INPUTS 28
+
+extern int input[NUMBER_OF_INPUTS];
+enum InputLabels { Up, Down, Left, Right, Camera, FlyUp, FlyDown, Next, Prev, Add, Remove, Height, Pause, MouseX, MouseY, Click, AltClick, FinishTrack, Boost, ChainLift, CursorX, CursorY, ViewWidth, ViewHeight, Undo, Redo, Overlay, NextCoaster };
+
+/*	Press sets a held input or counts a one shot input, Release clears a held input, Delta is added to the input
+ *	and Set overwrites it
+ */
+typedef enum { InputPress, InputRelease, InputDelta, InputSet } InputEventType;
+
+typedef struct {
+	double time;
+	unsigned char label;
+	unsigned char type;
+	int value;
+} InputEvent;
 
 void initInput(void);
+void drainInput(void);
+unsigned long getInputTick(void);
 
 void	keyPress(unsigned char key, int x, int y);
 void	keyRelease(unsigned char key, int x, int y);
@@ -10,3 +29,6 @@ void	specialKeyRelease(int key, int x, int y);
 void	mouseMovement(int x, int y);
 void	mouseClick(int button, int state, int x, int y);
 void	consumeMouseInput(void);
+void	reshapeInput(int width, int height);
+
+#endif
@@ -5,8 +5,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stdatomic.h>
 #include <GL/glut.h>
 
 #include "main.h"
@@ -14,38 +16,109 @@
 #include "camera.h"
 #include "input.h"
 #include "rollercoaster.h"
+#include "park.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "telemetry.h"
+#include "stats.h"
+#include "terrain.h"
+#include "scenery.h"
+#include "offscreen.h"
+#include "capture.h"
+#include "rendertimer.h"
+#include "trackshader.h"
+#include "railmesh.h"
 
 
 #define FRAME_TIME 0.016
 #define FRAME_TIME_MS 16
 
-#define FOV 85
+#define WINDOW_WIDTH 500
+#define WINDOW_HEIGHT 500
 
+//Frames rendered offscreen when neither --frames nor a replay says how many
+#define DEFAULT_OFFSCREEN_FRAMES 600
 
+
+static void parseArguments(int argc, char *argv[]);
+static int hasOffscreenArgument(int argc, char *argv[]);
+static void initRendering(void);
 static void init(void);
-static void onUpdate(int value);
+static void runOffscreen(void);
+static void* simulationLoop(void* arg);
+static void updateSimulation(void);
+static void publishSimulationState(void);
+static void finishReplay(void);
+static void reportReplay(void);
+static void onRedisplayTimer(int value);
 static void onDisplay(void);
+static const SimSnapshot* drawFrame(void);
+static void publishFrameStats(const SimSnapshot* snapshot, double frameTime);
+static void printPassTimes(void);
 static void onReshape(int w, int h);
-static void drawWorld();
+static void drawWorld(const CameraSnapshot* camera);
+
+//How every coaster starts out, filled in from the command line
+CoasterSettings coasterSettings;
+int parkCoasters = 1;
+
+//Ground the park stands on, flat when no heightmap was given
+Terrain* terrain = NULL;
+
+//Objects around the park, loaded before there is a context to build their meshes in
+SceneryPlacement* sceneryPlacements = NULL;
+int numberOfSceneryPlacements = 0;
+Scenery* scenery = NULL;
+
+//Rendering without a window, one simulation tick a frame so every run draws the same frames
+int offscreenWidth = 0;
+int offscreenHeight = 0;
+unsigned long offscreenFrames = 0;
+const char* capturePath = NULL;
 
 int paused = 0;
+unsigned long simulationTick = 0;
+double replayStartTime;
+
+//Set by the simulation thread once a replay ends, the GLUT thread reports it between frames and exits
+atomic_int replayFinished = 0;
+unsigned long replayTicks;
+double replayElapsed;
+unsigned long long replayChecksum;
+
+//Frame statistics, owned by the render thread
+unsigned long long frameCount = 0;
+double averageFrameTime = 0;
+double maxFrameTime = 0;
+double statsWindowStart = 0;
+unsigned long statsWindowTick = 0;
+double simulationRate = 0;
+uint64_t residentBytes = 0;
+uint64_t peakResidentBytes = 0;
 
 int main(int argc, char *argv[])
 {
-    srand((unsigned int) time(NULL));
+    selectRailProfile(DEFAULT_RAIL_PROFILE);
+
+    //There may be no display for GLUT to open offscreen, so it never sees the command line
+    if(!hasOffscreenArgument(argc, argv))
+        glutInit(&argc, argv);
+    parseArguments(argc, argv);
+
+    if(offscreenWidth > 0) {
+        runOffscreen();
+        return 0;
+    }
 
-    glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE|GLUT_RGB);
     
     //Window
-    glutInitWindowSize(500, 500);
+    glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
     glutCreateWindow("Rollercoaster");
 	glutReshapeFunc(onReshape);
     glutDisplayFunc(onDisplay);
 
-	glClearColor(0.2, 0.9, 1, 1.0);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    glEnable(GL_DEPTH_TEST);
+    initRendering();
 
     //Keyboard
     glutIgnoreKeyRepeat(1);
@@ -59,41 +132,299 @@ int main(int argc, char *argv[])
     glutMotionFunc(mouseMovement);
 
 
-    glutTimerFunc(FRAME_TIME_MS, onUpdate, 0);
+    glutTimerFunc(FRAME_TIME_MS, onRedisplayTimer, 0);
 
     init();
+
+    //The simulation runs on its own thread and only talks to the renderer through snapshots
+    pthread_t simulationThread;
+    pthread_create(&simulationThread, NULL, simulationLoop, NULL);
+
     glutMainLoop();
 
     return 0;
 }
 
+/* Handles the options left over once GLUT has taken its own */
+static void parseArguments(int argc, char *argv[])
+{
+    getDefaultCoasterSettings(&coasterSettings);
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            if(startRecording(argv[++i]))
+                atexit(stopRecording);
+        }
+        else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            startReplay(argv[++i], 1);
+        }
+        else if(strcmp(argv[i], "--replay-fast") == 0 && i + 1 < argc) {
+            startReplay(argv[++i], 0);
+        }
+        else if(strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            if(startTelemetry(argv[++i]))
+                atexit(stopTelemetry);
+        }
+        else if(strcmp(argv[i], "--stats") == 0) {
+            if(startStats(STATS_DEFAULT_NAME))
+                atexit(stopStats);
+        }
+        else if(strcmp(argv[i], "--stats-name") == 0 && i + 1 < argc) {
+            if(startStats(argv[++i]))
+                atexit(stopStats);
+        }
+        else if(strcmp(argv[i], "--undo-memory") == 0 && i + 1 < argc) {
+            coasterSettings.undoMemoryLimit = (size_t) atol(argv[++i]) * 1024 * 1024;
+        }
+        else if(strcmp(argv[i], "--analytics") == 0 && i + 1 < argc) {
+            coasterSettings.analyticsPath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--track") == 0 && i + 1 < argc) {
+            coasterSettings.trackPath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--generate") == 0 && i + 1 < argc) {
+            coasterSettings.proceduralPoints = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            coasterSettings.proceduralSeed = strtoull(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--cars") == 0 && i + 1 < argc) {
+            coasterSettings.numberOfCars = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--terrain") == 0 && i + 1 < argc) {
+            coasterSettings.heightmap = openHeightmap(argv[++i]);
+            if(coasterSettings.heightmap == NULL)
+                printf("Could not open %s, using flat ground\n", argv[i]);
+        }
+        else if(strcmp(argv[i], "--scenery") == 0 && i + 1 < argc) {
+            sceneryPlacements = loadSceneryFile(argv[++i], &numberOfSceneryPlacements);
+            if(sceneryPlacements == NULL)
+                printf("Could not load %s, the park will be empty\n", argv[i]);
+        }
+        else if(strcmp(argv[i], "--rails") == 0 && i + 1 < argc) {
+            if(!selectRailProfile(argv[++i]))
+                printf("Unknown rail profile %s, expected %s\n", argv[i], RAIL_PROFILE_NAMES);
+        }
+        else if(strcmp(argv[i], "--offscreen") == 0 && i + 1 < argc) {
+            if(sscanf(argv[++i], "%dx%d", &offscreenWidth, &offscreenHeight) != 2 || offscreenWidth < 1 || offscreenHeight < 1) {
+                printf("--offscreen takes a size like 1280x720\n");
+                exit(1);
+            }
+        }
+        else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            offscreenFrames = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capturePath = argv[++i];
+        }
+        else if(strcmp(argv[i], "--trains") == 0 && i + 1 < argc) {
+            coasterSettings.numberOfTrains = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--coasters") == 0 && i + 1 < argc) {
+            parkCoasters = atoi(argv[++i]);
+            if(parkCoasters < 1)
+                parkCoasters = 1;
+        }
+        else {
+            printf("Usage: %s [--record file] [--replay file] [--replay-fast file] [--telemetry file] [--stats] [--stats-name name] [--undo-memory megabytes] [--analytics file] [--track file] [--generate points] [--seed n] [--coasters n] [--cars n] [--trains n] [--terrain file] [--scenery file] [--rails " RAIL_PROFILE_NAMES "] [--offscreen WxH] [--frames n] [--capture file|\"|command\"]\n", argv[0]);
+            exit(1);
+        }
+    }
+}
+
+/* Whether to render without a window, checked before anything else looks at the command line */
+static int hasOffscreenArgument(int argc, char *argv[])
+{
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--offscreen") == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* GL state that stays the same all run, once there is a context */
+static void initRendering()
+{
+	glClearColor(0.2, 0.9, 1, 1.0);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glEnable(GL_DEPTH_TEST);
+
+    initRenderTimer();
+    initTrackShaders();
+}
+
 static void init()
 {
     initInput();
 	initCamera();
-	initRollerCoaster();
+	initPark(&coasterSettings, parkCoasters);
+
+    if(coasterSettings.heightmap != NULL)
+        terrain = createTerrain(coasterSettings.heightmap);
+
+    if(sceneryPlacements != NULL) {
+        scenery = createScenery(sceneryPlacements, numberOfSceneryPlacements);
+        free(sceneryPlacements);
+        sceneryPlacements = NULL;
+    }
+
+    if(capturePath != NULL)
+    {
+        int width = offscreenWidth > 0 ? offscreenWidth : WINDOW_WIDTH;
+        int height = offscreenHeight > 0 ? offscreenHeight : WINDOW_HEIGHT;
+
+        if(startCapture(capturePath, width, height, 1 / FRAME_TIME) && offscreenWidth == 0)
+            atexit(stopCapture);
+    }
+
+    //Give the renderer something to draw before the first tick
+    publishSimulationState();
+}
+
+/*	Renders to an offscreen surface on this thread, ticking the simulation once before each frame
+ *	Nothing waits on the clock, so the frames come out as fast as they can be drawn and the same every run
+ */
+static void runOffscreen()
+{
+    if(!createOffscreenContext(offscreenWidth, offscreenHeight))
+        exit(1);
+
+    initRendering();
+    onReshape(offscreenWidth, offscreenHeight);
+    init();
+
+    unsigned long frames = offscreenFrames;
+    if(frames == 0)
+        frames = isReplaying() ? ULONG_MAX : DEFAULT_OFFSCREEN_FRAMES;
+
+    replayStartTime = getTimeSeconds();
+
+    for(unsigned long frame = 0; frame < frames; frame++)
+    {
+        double frameStart = getTimeSeconds();
+
+        updateSimulation();
+        const SimSnapshot* snapshot = drawFrame();
+        captureFrame();
+
+        publishFrameStats(snapshot, getTimeSeconds() - frameStart);
+
+        if(isReplayFinished(getInputTick()))
+            break;
+    }
+
+    finishCapture();
+    stopCapture();
+
+    printf("Rendered %llu frames in %.3f seconds\n", frameCount, getTimeSeconds() - replayStartTime);
+    printPassTimes();
+
+    if(isReplayFinished(getInputTick())) {
+        finishReplay();
+        reportReplay();
+    }
+
+    destroyOffscreenContext();
+}
+
+/* Runs the simulation at a fixed tick rate, independent of how long frames take to draw */
+static void* simulationLoop(void* arg)
+{
+    double nextTick = getTimeSeconds();
+    replayStartTime = nextTick;
+
+    for(;;)
+    {
+        updateSimulation();
+
+        if(isReplayFinished(getInputTick())) {
+            finishReplay();
+            return NULL;
+        }
+
+        //Fast replays don't wait for the clock at all
+        if(isReplaying() && !isReplayRealtime())
+            continue;
+
+        //If a tick ran long, don't try to catch up with a burst of ticks
+        nextTick += FRAME_TIME;
+        if(nextTick < getTimeSeconds() - FRAME_TIME)
+            nextTick = getTimeSeconds();
+
+        sleepUntil(nextTick);
+    }
+
+    return NULL;
 }
 
-static void onUpdate(int value)
+static void updateSimulation()
 {
+    drainInput();
+
     if(input[Pause])
     {
-        input[Pause] = 0;
+        input[Pause]--;
         if(paused)
             paused = 0;
         else
             paused = 1;
     }
 
-    glutTimerFunc(16, onUpdate, value);
-
-    //Return now if paused
-    if(paused)
+    //Return now if paused, still letting the renderer know
+    if(paused) {
+        publishSimulationState();
         return;
+    }
 
     //Update state of program
 	updateCamera();
-	updateRollerCoaster();
+	updatePark();
+    simulationTick++;
+
+    publishSimulationState();
+}
+
+/* Copies the simulation state into a snapshot for the renderer */
+static void publishSimulationState()
+{
+    SimSnapshot* snapshot = beginSnapshotWrite();
+
+    snapshot->tick = simulationTick;
+    snapshot->paused = paused;
+    snapshotCamera(&(snapshot->camera));
+    snapshotPark(&(snapshot->park));
+
+    publishSnapshot();
+}
+
+/* Notes how long the replay took and a checksum of the end state, from the thread that owns the simulation */
+static void finishReplay()
+{
+    replayElapsed = getTimeSeconds() - replayStartTime;
+    replayTicks = getInputTick();
+    replayChecksum = checksumPark();
+
+    atomic_store(&replayFinished, 1);
+}
+
+/*	Prints the result to compare against other runs and exits
+ *	Must be called from the rendering thread between frames, exiting tears down the stats and capture it draws into
+ */
+static void reportReplay()
+{
+    printf("Replayed %lu ticks in %.3f seconds, state checksum %016llx\n", replayTicks, replayElapsed, replayChecksum);
+    exit(0);
+}
+
+static void onRedisplayTimer(int value)
+{
+    if(atomic_load(&replayFinished))
+        reportReplay();
+
+    glutTimerFunc(FRAME_TIME_MS, onRedisplayTimer, value);
 
 	//Render frame
     glutPostRedisplay();
@@ -101,17 +432,119 @@ static void onUpdate(int value)
 
 
 static void onDisplay()
+{
+    double frameStart = getTimeSeconds();
+
+    const SimSnapshot* snapshot = drawFrame();
+    captureFrame();
+
+    glutSwapBuffers();
+
+    publishFrameStats(snapshot, getTimeSeconds() - frameStart);
+}
+
+/* Draws the newest snapshot into the back buffer */
+static const SimSnapshot* drawFrame()
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
 
+    const SimSnapshot* snapshot = acquireSnapshot();
 
-    applyCamera();
-    drawWorld();
-    drawRollerCoaster();
-    
+    applyCamera(&(snapshot->camera));
 
-    glutSwapBuffers();
+    beginRenderPass(PassWorld);
+    drawWorld(&(snapshot->camera));
+    endRenderPass();
+
+    drawPark(&(snapshot->park));
+
+    finishRenderFrame();
+
+    return snapshot;
+}
+
+/* Updates the shared memory stats, the expensive numbers are only refreshed once a second */
+static void publishFrameStats(const SimSnapshot* snapshot, double frameTime)
+{
+    frameCount++;
+    averageFrameTime += (frameTime - averageFrameTime) * 0.05;
+    if(frameTime > maxFrameTime)
+        maxFrameTime = frameTime;
+
+    LiveStats* stats = beginStatsUpdate();
+    if(stats == NULL)
+        return;
+
+    double now = getTimeSeconds();
+    int newWindow = now - statsWindowStart >= 1.0;
+    if(newWindow)
+    {
+        simulationRate = (snapshot->tick - statsWindowTick) / (now - statsWindowStart);
+        readMemoryUsage(&residentBytes, &peakResidentBytes);
+
+        statsWindowStart = now;
+        statsWindowTick = snapshot->tick;
+    }
+
+    int trainCount = 0;
+    int controlPoints = 0;
+    int trackSubSections = 0;
+    for(int i = 0; i < snapshot->park.numberOfCoasters; i++)
+    {
+        const CoasterSnapshot* coaster = &(snapshot->park.coasters[i]);
+
+        controlPoints += coaster->numberOfControlPoints;
+        if(coaster->trackState == Ready) {
+            trainCount++;
+            trackSubSections += coaster->numberOfControlPoints * NUMBER_OF_SUB_SECTIONS;
+        }
+    }
+
+    stats->frame = frameCount;
+    stats->frameTime = frameTime;
+    stats->averageFrameTime = averageFrameTime;
+    stats->maxFrameTime = maxFrameTime;
+    stats->simulationTick = snapshot->tick;
+    stats->simulationRate = simulationRate;
+    stats->paused = snapshot->paused;
+    stats->trainCount = trainCount;
+    stats->controlPoints = controlPoints;
+    stats->trackSubSections = trackSubSections;
+    stats->residentBytes = residentBytes;
+    stats->peakResidentBytes = peakResidentBytes;
+
+    RenderPassTimes passTimes;
+    getLatestPassTimes(&passTimes);
+    for(int i = 0; i < NUMBER_OF_RENDER_PASSES; i++)
+    {
+        stats->passCpuTimes[i] = passTimes.cpu[i];
+        stats->passGpuTimes[i] = passTimes.gpu[i];
+    }
+    stats->passGpuTimed = passTimes.gpuTimed;
+
+    endStatsUpdate();
+
+    //The max is over the last window
+    if(newWindow)
+        maxFrameTime = 0;
+}
+
+/* Average time each pass took to submit and to draw, to tell whether the frames were CPU or GPU bound */
+static void printPassTimes()
+{
+    static const char* const passNames[] = RENDER_PASS_NAMES;
+
+    RenderPassTimes passTimes;
+    getAveragePassTimes(&passTimes);
+
+    for(int i = 0; i < NUMBER_OF_RENDER_PASSES; i++)
+    {
+        if(passTimes.gpuTimed)
+            printf("  %-8s cpu %7.3fms  gpu %7.3fms\n", passNames[i], passTimes.cpu[i] * 1000, passTimes.gpu[i] * 1000);
+        else
+            printf("  %-8s cpu %7.3fms\n", passNames[i], passTimes.cpu[i] * 1000);
+    }
 }
 
 
@@ -123,21 +556,37 @@ static void onReshape(int w, int h)
 
     float aspect = w/(float)h;
 
-    gluPerspective(FOV, aspect, 0.1f, 100.0f);
+    gluPerspective(FOV, aspect, NEAR_PLANE, FAR_PLANE);
+
+    reshapeInput(w, h);
 
     glMatrixMode(GL_MODELVIEW);
 }
 
 
-static void drawWorld()
+static void drawWorld(const CameraSnapshot* camera)
 {
-	glColor3f(0.3f, 0.9f, 0.3f);
-
-	float groundSize = 500.0f;
-	glBegin(GL_POLYGON);
-		glVertex3f(-0.5f * groundSize, 0, 0.5f * groundSize);
-		glVertex3f(0.5f * groundSize, 0, 0.5f * groundSize);
-		glVertex3f(0.5f * groundSize, 0, -0.5f * groundSize);
-		glVertex3f(-0.5f * groundSize, 0, -0.5f * groundSize);
-	glEnd();
+	Frustum frustum;
+	getViewFrustum(&frustum);
+
+	if(terrain != NULL)
+	{
+		updateTerrain(terrain, &(camera->eye));
+		drawTerrain(terrain, &frustum);
+	}
+	else
+	{
+		glColor3f(0.3f, 0.9f, 0.3f);
+
+		float groundSize = 500.0f;
+		glBegin(GL_POLYGON);
+			glVertex3f(-0.5f * groundSize, 0, 0.5f * groundSize);
+			glVertex3f(0.5f * groundSize, 0, 0.5f * groundSize);
+			glVertex3f(0.5f * groundSize, 0, -0.5f * groundSize);
+			glVertex3f(-0.5f * groundSize, 0, -0.5f * groundSize);
+		glEnd();
+	}
+
+	if(scenery != NULL)
+		drawScenery(scenery, &frustum);
 }
\ No newline at end of file
@@ -0,0 +1,118 @@
+/*	Offscreen.c
+ *	This module gives the renderer a GL context with no window, for rendering on machines without a display
+ *
+ *	Mesa's EGL can make a desktop GL context on a pbuffer without any display server, on the GPU where there is
+ *	one and on its software rasterizer where there isn't.
+ */
+#include <stdio.h>
+#include "offscreen.h"
+
+#ifndef _WIN32
+#include <stdlib.h>
+#include <string.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLSurface surface = EGL_NO_SURFACE;
+static EGLContext context = EGL_NO_CONTEXT;
+
+static EGLDisplay openDisplay(void);
+#endif
+
+
+/*	Makes a width by height context current on the calling thread, which must do all the drawing
+ *	Returns 0, after printing why, if there's no way of making one
+ */
+int createOffscreenContext(int width, int height)
+{
+#ifndef _WIN32
+	display = openDisplay();
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+		printf("Could not open an EGL display for offscreen rendering\n");
+		return 0;
+	}
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	const EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+
+	EGLConfig config;
+	EGLint numberOfConfigs = 0;
+	if(!eglChooseConfig(display, configAttributes, &config, 1, &numberOfConfigs) || numberOfConfigs == 0) {
+		printf("No EGL config can render desktop GL to a pbuffer\n");
+		destroyOffscreenContext();
+		return 0;
+	}
+
+	surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+	if(surface == EGL_NO_SURFACE || !eglBindAPI(EGL_OPENGL_API)) {
+		printf("Could not create a %dx%d pbuffer\n", width, height);
+		destroyOffscreenContext();
+		return 0;
+	}
+
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+		printf("Could not create an offscreen GL context\n");
+		destroyOffscreenContext();
+		return 0;
+	}
+
+	return 1;
+#else
+	printf("Offscreen rendering needs EGL, which this build doesn't have\n");
+	return 0;
+#endif
+}
+
+void destroyOffscreenContext()
+{
+#ifndef _WIN32
+	if(display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if(context != EGL_NO_CONTEXT)
+		eglDestroyContext(display, context);
+	if(surface != EGL_NO_SURFACE)
+		eglDestroySurface(display, surface);
+	eglTerminate(display);
+
+	display = EGL_NO_DISPLAY;
+	surface = EGL_NO_SURFACE;
+	context = EGL_NO_CONTEXT;
+#endif
+}
+
+#ifndef _WIN32
+/*	Asks for Mesa's surfaceless platform, which needs no display server, before falling back to the default one
+ *	EGL_PLATFORM in the environment still picks another platform if it's set
+ */
+static EGLDisplay openDisplay()
+{
+	const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+	if(extensions != NULL && strstr(extensions, "EGL_MESA_platform_surfaceless") != NULL && getenv("EGL_PLATFORM") == NULL)
+	{
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+		if(getPlatformDisplay != NULL)
+		{
+			EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+			if(surfaceless != EGL_NO_DISPLAY)
+				return surfaceless;
+		}
+	}
+
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+#endif
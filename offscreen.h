@@ -0,0 +1,7 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+int createOffscreenContext(int width, int height);
+void destroyOffscreenContext(void);
+
+#endif
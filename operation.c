@@ -0,0 +1,590 @@
+/*	Operation.c
+ *	This module runs several trains on one track at once, kept apart by block sections, with a loading station
+ *
+ *	It can be stepped one tick at a time alongside the rest of the game, or run headlessly as a discrete event
+ *	simulation. Between two brakes a train's run never depends on anything but where it was let go, so each
+ *	brake's run is simulated once and recorded as a list of events. Event mode then only has to play those
+ *	back, jumping straight from one event to the next instead of ticking through the time between them.
+ *	Each train has at most one pending event, so the queue is just the earliest of them.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "operation.h"
+
+//A run taking more ticks than this per subsection is treated as stalled
+#define RUN_TICK_LIMIT_PER_SUB_SECTION 1000
+
+static void findBlocks(Operation* operation, const OperationSettings* settings);
+static int getBrakeIndex(const Operation* operation, int boundary);
+static int getLeadIndex(const Train* train);
+static int hasCrossed(const Operation* operation, int previous, int current, int target);
+static int getRearBlock(const Operation* operation, const Train* train);
+static void placeAtBrake(Operation* operation, Train* train, int boundary, float velocity);
+
+static int isBlockFree(const Operation* operation, int block, int trainIndex);
+static void reserveBlock(Operation* operation, int block, int trainIndex);
+static void releaseBlock(Operation* operation, int block);
+static void moveRear(Operation* operation, int trainIndex, int rearBlock);
+static int placeStoredTrain(Operation* operation, int trainIndex);
+static void depart(Operation* operation, int trainIndex, float velocity);
+static int reachBrake(Operation* operation, int trainIndex);
+static float nextDwell(Operation* operation);
+
+static void stepTrainInOperation(Operation* operation, int trainIndex, int boost);
+static void wakeWaitingTrains(Operation* operation, int releasedBy);
+static void startRun(Operation* operation, int trainIndex);
+static const RunProfile* getRun(Operation* operation, int boundary);
+static double getNextEventTime(const Operation* operation, int trainIndex);
+
+
+void getDefaultOperationSettings(OperationSettings* settings)
+{
+	memset(settings, 0, sizeof(OperationSettings));
+	settings->numberOfTrains = 2;
+	settings->numberOfCars = 1;
+	settings->dwell = DEFAULT_STATION_DWELL;
+	settings->dwellVariation = DEFAULT_STATION_DWELL_VARIATION;
+	settings->seed = 1;
+}
+
+/*	Splits the track into blocks and puts the first train in the station, the rest wait to be added behind it
+ *	Returns 0 if the blocks given don't fit the track
+ */
+int initOperation(Operation* operation, const Track* track, const OperationSettings* settings)
+{
+	memset(operation, 0, sizeof(Operation));
+	operation->track = track;
+
+	findBlocks(operation, settings);
+	if(operation->numberOfBlocks == 0)
+		return 0;
+
+	operation->blockOwner = malloc(operation->numberOfBlocks * sizeof(int));
+	operation->blockReservedAt = calloc(operation->numberOfBlocks, sizeof(double));
+	operation->stats.blockBusyTime = calloc(operation->numberOfBlocks, sizeof(double));
+	operation->runs = calloc(operation->numberOfBlocks, sizeof(RunProfile));
+
+	for(int i = 0; i < operation->numberOfBlocks; i++)
+		operation->blockOwner[i] = -1;
+
+	operation->numberOfTrains = settings->numberOfTrains;
+	if(operation->numberOfTrains < 1)
+		operation->numberOfTrains = 1;
+	else if(operation->numberOfTrains > MAX_OPERATED_TRAINS)
+		operation->numberOfTrains = MAX_OPERATED_TRAINS;
+
+	operation->dwell = settings->dwell;
+	operation->dwellVariation = settings->dwellVariation;
+	seedRandom(&(operation->random), settings->seed);
+
+	for(int i = 0; i < operation->numberOfTrains; i++)
+	{
+		OperatedTrain* operated = &(operation->trains[i]);
+		resetTrain(&(operated->train), track, settings->numberOfCars);
+		operated->status = TrainStored;
+	}
+
+	placeStoredTrain(operation, 0);
+	return 1;
+}
+
+void freeOperation(Operation* operation)
+{
+	for(int i = 0; i < operation->numberOfBlocks && operation->runs != NULL; i++)
+		free(operation->runs[i].events);
+
+	free(operation->blockStarts);
+	free(operation->blockOfSection);
+	free(operation->blockOwner);
+	free(operation->blockReservedAt);
+	free(operation->stats.blockBusyTime);
+	free(operation->runs);
+}
+
+/* Takes the block starts given, or puts them at the start of the track and at both ends of every chain lift */
+static void findBlocks(Operation* operation, const OperationSettings* settings)
+{
+	const Track* track = operation->track;
+	int numberOfPoints = track->numberOfPoints;
+
+	operation->blockStarts = malloc(numberOfPoints * sizeof(int));
+	operation->blockOfSection = malloc(numberOfPoints * sizeof(int));
+
+	//Mark the sections blocks start at, so the starts come out sorted without duplicates
+	memset(operation->blockOfSection, 0, numberOfPoints * sizeof(int));
+	operation->blockOfSection[0] = 1;
+
+	if(settings->blockStarts != NULL)
+	{
+		for(int i = 0; i < settings->numberOfBlocks; i++)
+		{
+			if(settings->blockStarts[i] < 0 || settings->blockStarts[i] >= numberOfPoints)
+				return;
+			operation->blockOfSection[settings->blockStarts[i]] = 1;
+		}
+	}
+	else
+	{
+		for(int i = 1; i < numberOfPoints; i++)
+			if(track->sections[i].isChain != track->sections[i - 1].isChain)
+				operation->blockOfSection[i] = 1;
+	}
+
+	int block = -1;
+	for(int i = 0; i < numberOfPoints; i++)
+	{
+		if(operation->blockOfSection[i])
+			operation->blockStarts[++block] = i;
+		operation->blockOfSection[i] = block;
+	}
+
+	operation->numberOfBlocks = block + 1;
+}
+
+
+//==============TRACK POSITIONS===============
+
+/* The subsection just before a boundary, counting subsections from the start of the track */
+static int getBrakeIndex(const Operation* operation, int boundary)
+{
+	int numberOfSubSections = getNumberOfSubSections(operation->track);
+	int start = operation->blockStarts[boundary] * NUMBER_OF_SUB_SECTIONS;
+
+	return (start - 1 + numberOfSubSections) % numberOfSubSections;
+}
+
+static int getLeadIndex(const Train* train)
+{
+	return (train->sectionIndex * NUMBER_OF_SUB_SECTIONS) + train->subSectionIndex;
+}
+
+/* Whether moving forward from one subsection to another passed the start of target, trains rolling back never do */
+static int hasCrossed(const Operation* operation, int previous, int current, int target)
+{
+	int numberOfSubSections = getNumberOfSubSections(operation->track);
+	int moved = (current - previous + numberOfSubSections) % numberOfSubSections;
+	int distance = (target - previous + numberOfSubSections) % numberOfSubSections;
+
+	if(moved > numberOfSubSections / 2)
+		return 0;
+
+	return distance != 0 && distance <= moved;
+}
+
+static int getRearBlock(const Operation* operation, const Train* train)
+{
+	return operation->blockOfSection[train->cars[train->numberOfCars - 1].sectionIndex];
+}
+
+/* Stops the train with its lead car at the start of the brake before a boundary */
+static void placeAtBrake(Operation* operation, Train* train, int boundary, float velocity)
+{
+	int brake = getBrakeIndex(operation, boundary);
+	placeTrain(train, operation->track, brake / NUMBER_OF_SUB_SECTIONS, brake % NUMBER_OF_SUB_SECTIONS, velocity);
+}
+
+
+//==============BLOCKS========================
+
+static int isBlockFree(const Operation* operation, int block, int trainIndex)
+{
+	return operation->blockOwner[block] == -1 || operation->blockOwner[block] == trainIndex;
+}
+
+static void reserveBlock(Operation* operation, int block, int trainIndex)
+{
+	if(operation->blockOwner[block] == trainIndex)
+		return;
+
+	operation->blockOwner[block] = trainIndex;
+	operation->blockReservedAt[block] = operation->stats.time;
+}
+
+static void releaseBlock(Operation* operation, int block)
+{
+	operation->stats.blockBusyTime[block] += operation->stats.time - operation->blockReservedAt[block];
+	operation->blockOwner[block] = -1;
+}
+
+/* Releases the blocks the rear car has left, ignoring it rolling back or anywhere it has no reservation */
+static void moveRear(Operation* operation, int trainIndex, int rearBlock)
+{
+	OperatedTrain* operated = &(operation->trains[trainIndex]);
+	int numberOfBlocks = operation->numberOfBlocks;
+
+	int frontBlock = (operated->nextBoundary - 1 + numberOfBlocks) % numberOfBlocks;
+	int reserved = (frontBlock - operated->rearBlock + numberOfBlocks) % numberOfBlocks;
+	int moved = (rearBlock - operated->rearBlock + numberOfBlocks) % numberOfBlocks;
+
+	if(moved == 0 || moved > reserved)
+		return;
+
+	for(int block = operated->rearBlock; block != rearBlock; block = (block + 1) % numberOfBlocks)
+		releaseBlock(operation, block);
+
+	operated->rearBlock = rearBlock;
+}
+
+/*	Puts a stored train in the station if every block it would sit in is clear, returns 0 if not
+ *	There must always be a free block for the trains to move into, so a track runs one train less than it has blocks
+ */
+static int placeStoredTrain(Operation* operation, int trainIndex)
+{
+	OperatedTrain* operated = &(operation->trains[trainIndex]);
+	int lastBlock = operation->numberOfBlocks - 1;
+
+	int inService = 0;
+	for(int i = 0; i < operation->numberOfTrains; i++)
+		if(operation->trains[i].status != TrainStored)
+			inService++;
+
+	if(inService > 0 && inService >= operation->numberOfBlocks - 1)
+		return 0;
+
+	placeAtBrake(operation, &(operated->train), 0, 0);
+	int rearBlock = getRearBlock(operation, &(operated->train));
+
+	//Trains already out on the track go first
+	for(int block = rearBlock; ; block = (block + 1) % operation->numberOfBlocks)
+	{
+		if(!isBlockFree(operation, block, trainIndex))
+			return 0;
+
+		for(int i = 0; i < operation->numberOfTrains; i++)
+			if(operation->trains[i].status == TrainHeld && operation->trains[i].nextBoundary == block)
+				return 0;
+
+		if(block == lastBlock)
+			break;
+	}
+
+	for(int block = rearBlock; ; block = (block + 1) % operation->numberOfBlocks)
+	{
+		reserveBlock(operation, block, trainIndex);
+		if(block == lastBlock)
+			break;
+	}
+
+	operated->status = TrainDwelling;
+	operated->nextBoundary = 0;
+	operated->rearBlock = rearBlock;
+	operated->dwellEnd = operation->stats.time + nextDwell(operation);
+
+	return 1;
+}
+
+/* Lets a train go from its brake into the block ahead, which must already be free */
+static void depart(Operation* operation, int trainIndex, float velocity)
+{
+	OperatedTrain* operated = &(operation->trains[trainIndex]);
+
+	if(operated->status == TrainDwelling) {
+		operated->loaded = 0;
+		operation->stats.dispatches++;
+		operation->stats.dispatchDelay += operation->stats.time - operated->dwellEnd;
+	}
+	else if(operated->status == TrainHeld)
+	{
+		double held = operation->stats.time - operated->waitStart;
+		operation->stats.holdTime += held;
+		if(held > operation->stats.maxHoldTime)
+			operation->stats.maxHoldTime = held;
+	}
+
+	reserveBlock(operation, operated->nextBoundary, trainIndex);
+	operated->nextBoundary = (operated->nextBoundary + 1) % operation->numberOfBlocks;
+	operated->train.velocity = velocity;
+	operated->status = TrainRunning;
+}
+
+/*	The lead car has reached the next brake. The train carries on if the block ahead is free, otherwise it
+ *	stops there, and it always stops in the station. Returns 1 if the train stopped
+ */
+static int reachBrake(Operation* operation, int trainIndex)
+{
+	OperatedTrain* operated = &(operation->trains[trainIndex]);
+	int boundary = operated->nextBoundary;
+
+	if(boundary != 0 && isBlockFree(operation, boundary, trainIndex))
+	{
+		reserveBlock(operation, boundary, trainIndex);
+		operated->nextBoundary = (boundary + 1) % operation->numberOfBlocks;
+		return 0;
+	}
+
+	if(boundary == 0)
+	{
+		operated->status = TrainDwelling;
+		operated->dwellEnd = operation->stats.time + nextDwell(operation);
+		operation->stats.arrivals++;
+	}
+	else
+	{
+		operated->status = TrainHeld;
+		operated->waitStart = operation->stats.time;
+		operation->stats.holds++;
+	}
+
+	return 1;
+}
+
+static float nextDwell(Operation* operation)
+{
+	return operation->dwell + randomRange(&(operation->random), 0, operation->dwellVariation);
+}
+
+/* The share of the time so far the block has been reserved */
+double getBlockUtilisation(const Operation* operation, int block)
+{
+	if(operation->stats.time <= 0)
+		return 0;
+
+	double busy = operation->stats.blockBusyTime[block];
+	if(operation->blockOwner[block] != -1)
+		busy += operation->stats.time - operation->blockReservedAt[block];
+
+	return busy / operation->stats.time;
+}
+
+
+//==============TICKS=========================
+
+/* Moves every train on by one tick, boost only pushes the first train */
+void stepOperation(Operation* operation, int boost)
+{
+	for(int i = 0; i < operation->numberOfTrains; i++)
+		stepTrainInOperation(operation, i, boost && i == 0);
+
+	operation->stats.time += TRAIN_TICK_LENGTH;
+}
+
+static void stepTrainInOperation(Operation* operation, int trainIndex, int boost)
+{
+	OperatedTrain* operated = &(operation->trains[trainIndex]);
+
+	switch(operated->status)
+	{
+		case TrainStored:
+			placeStoredTrain(operation, trainIndex);
+			break;
+
+		case TrainDwelling:
+			if(operation->stats.time >= operated->dwellEnd && isBlockFree(operation, operated->nextBoundary, trainIndex))
+				depart(operation, trainIndex, COASTER_START_SPEED);
+			break;
+
+		case TrainHeld:
+			if(isBlockFree(operation, operated->nextBoundary, trainIndex))
+				depart(operation, trainIndex, BLOCK_RELEASE_SPEED);
+			break;
+
+		case TrainRunning:
+		{
+			int previous = getLeadIndex(&(operated->train));
+			stepTrain(&(operated->train), operation->track, boost);
+
+			int brake = getBrakeIndex(operation, operated->nextBoundary);
+			if(hasCrossed(operation, previous, getLeadIndex(&(operated->train)), brake) && reachBrake(operation, trainIndex))
+				placeAtBrake(operation, &(operated->train), (operated->nextBoundary), 0);
+
+			//Only once the train has stopped where it will stay, so the rear can't slip back into a released block
+			moveRear(operation, trainIndex, getRearBlock(operation, &(operated->train)));
+			break;
+		}
+	}
+}
+
+
+//==============EVENTS========================
+
+/* Runs the trains for a length of time by playing back each brake's run, returns 0 if a train stalls */
+int runOperationEvents(Operation* operation, double seconds)
+{
+	double endTime = operation->stats.time + seconds;
+
+	for(int i = 0; i < operation->numberOfTrains; i++)
+		if(operation->trains[i].status == TrainRunning && operation->trains[i].run == NULL)
+			startRun(operation, i);
+
+	for(;;)
+	{
+		int next = -1;
+		double nextTime = endTime;
+
+		for(int i = 0; i < operation->numberOfTrains; i++)
+		{
+			double time = getNextEventTime(operation, i);
+			if(time < nextTime) {
+				next = i;
+				nextTime = time;
+			}
+		}
+
+		operation->stats.time = nextTime;
+		if(next == -1)
+			return 1;
+
+		OperatedTrain* operated = &(operation->trains[next]);
+
+		if(operated->status == TrainDwelling)
+		{
+			//Loaded, the train goes as soon as the first block is clear
+			operated->loaded = 1;
+			if(isBlockFree(operation, 0, next)) {
+				depart(operation, next, COASTER_START_SPEED);
+				startRun(operation, next);
+			}
+		}
+		else
+		{
+			if(operated->run->stalled) {
+				operation->stats.stalled = 1;
+				return 0;
+			}
+
+			const RunEvent* event = &(operated->run->events[operated->nextRunEvent++]);
+
+			//A train that stops is put at the brake, which is the only time its position is kept in event mode
+			if(event->type == LeadReachesBrake)
+			{
+				if(!reachBrake(operation, next))
+					continue;
+
+				placeAtBrake(operation, &(operated->train), operated->nextBoundary, 0);
+				moveRear(operation, next, getRearBlock(operation, &(operated->train)));
+			}
+			else
+				moveRear(operation, next, event->index);
+
+			wakeWaitingTrains(operation, next);
+		}
+	}
+}
+
+/* When the next thing happens to a train, or never if it is waiting on a block */
+static double getNextEventTime(const Operation* operation, int trainIndex)
+{
+	const OperatedTrain* operated = &(operation->trains[trainIndex]);
+
+	if(operated->status == TrainDwelling && !operated->loaded)
+		return operated->dwellEnd;
+
+	if(operated->status == TrainRunning)
+	{
+		if(operated->run->stalled)
+			return operated->runStart;
+		return operated->runStart + operated->run->events[operated->nextRunEvent].time;
+	}
+
+	return 1e300;
+}
+
+/*	Gives every train waiting on a block another go now that something has been released
+ *	Starting with the train after the one that released it, the same order ticking through the trains gives
+ */
+static void wakeWaitingTrains(Operation* operation, int releasedBy)
+{
+	for(int n = 1; n <= operation->numberOfTrains; n++)
+	{
+		int i = (releasedBy + n) % operation->numberOfTrains;
+		OperatedTrain* operated = &(operation->trains[i]);
+
+		if(operated->status == TrainStored)
+			placeStoredTrain(operation, i);
+
+		else if(operated->status == TrainDwelling && operated->loaded && isBlockFree(operation, 0, i))
+		{
+			depart(operation, i, COASTER_START_SPEED);
+			startRun(operation, i);
+		}
+
+		else if(operated->status == TrainHeld && isBlockFree(operation, operated->nextBoundary, i))
+		{
+			depart(operation, i, BLOCK_RELEASE_SPEED);
+			startRun(operation, i);
+		}
+	}
+}
+
+/* Starts playing back the run from the brake the train just left */
+static void startRun(Operation* operation, int trainIndex)
+{
+	OperatedTrain* operated = &(operation->trains[trainIndex]);
+	int boundary = (operated->nextBoundary - 1 + operation->numberOfBlocks) % operation->numberOfBlocks;
+
+	operated->run = getRun(operation, boundary);
+	operated->nextRunEvent = 0;
+	operated->runStart = operation->stats.time;
+}
+
+/* Simulates a lone train from a brake to the station, once per brake */
+static const RunProfile* getRun(Operation* operation, int boundary)
+{
+	RunProfile* run = &(operation->runs[boundary]);
+	if(run->computed)
+		return run;
+
+	run->computed = 1;
+
+	const Track* track = operation->track;
+	Train train = operation->trains[0].train;
+	placeAtBrake(operation, &train, boundary, boundary == 0 ? COASTER_START_SPEED : BLOCK_RELEASE_SPEED);
+
+	int allocated = 2 * operation->numberOfBlocks + 2;
+	run->events = malloc(allocated * sizeof(RunEvent));
+	run->startRearBlock = getRearBlock(operation, &train);
+
+	int nextBoundary = (boundary + 1) % operation->numberOfBlocks;
+	int rearBlock = run->startRearBlock;
+	int lead = getLeadIndex(&train);
+	long tickLimit = (long) getNumberOfSubSections(track) * RUN_TICK_LIMIT_PER_SUB_SECTION;
+
+	for(long tick = 1; tick <= tickLimit; tick++)
+	{
+		stepTrain(&train, track, 0);
+
+		if(train.velocity <= 0 && !track->sections[train.sectionIndex].isChain)
+			break;
+
+		if(run->numberOfEvents + 2 > allocated) {
+			allocated *= 2;
+			run->events = realloc(run->events, allocated * sizeof(RunEvent));
+		}
+
+		double time = tick * TRAIN_TICK_LENGTH;
+		int previous = lead;
+		lead = getLeadIndex(&train);
+
+		int reachedStation = 0;
+		if(hasCrossed(operation, previous, lead, getBrakeIndex(operation, nextBoundary)))
+		{
+			RunEvent* event = &(run->events[run->numberOfEvents++]);
+			event->time = time;
+			event->type = LeadReachesBrake;
+			event->index = nextBoundary;
+
+			reachedStation = nextBoundary == 0;
+			nextBoundary = (nextBoundary + 1) % operation->numberOfBlocks;
+		}
+
+		//Stopping in the station puts the train back at the brake, the rear car included
+		if(reachedStation)
+			placeAtBrake(operation, &train, 0, 0);
+
+		int rear = getRearBlock(operation, &train);
+		if(rear != rearBlock)
+		{
+			RunEvent* event = &(run->events[run->numberOfEvents++]);
+			event->time = time;
+			event->type = RearEntersBlock;
+			event->index = rear;
+			rearBlock = rear;
+		}
+
+		if(reachedStation)
+			return run;
+	}
+
+	run->stalled = 1;
+	return run;
+}
@@ -0,0 +1,122 @@
+#ifndef OPERATION_H
+#define OPERATION_H
+
+#include "engine.h"
+#include "track.h"
+
+#define MAX_OPERATED_TRAINS 8
+
+//Speed a train leaves a block brake at once the block ahead is clear
+#define BLOCK_RELEASE_SPEED 2.0f
+
+//Seconds a train spends unloading and loading in the station, plus up to the variation more
+#define DEFAULT_STATION_DWELL 30.0f
+#define DEFAULT_STATION_DWELL_VARIATION 15.0f
+
+typedef enum { TrainStored, TrainRunning, TrainHeld, TrainDwelling } TrainStatus;
+
+/*	What a train does on a run from a brake, relative to when it was let go
+ *	Lead events are the lead car reaching a boundary's brake, rear events the rear car moving into a new block
+ */
+typedef enum { LeadReachesBrake, RearEntersBlock } RunEventType;
+
+typedef struct {
+	double time;
+	RunEventType type;
+	int index;
+} RunEvent;
+
+typedef struct {
+	int computed;
+	int stalled;
+
+	int startRearBlock;
+	int numberOfEvents;
+	RunEvent* events;
+} RunProfile;
+
+typedef struct {
+	Train train;
+	TrainStatus status;
+
+	//The boundary whose brake the train reaches next, every block from rearBlock up to the one before it is reserved
+	int nextBoundary;
+	int rearBlock;
+
+	double waitStart;
+	double dwellEnd;
+
+	//Event mode only, the run the train is on and the next event of it, and whether it has finished loading
+	const RunProfile* run;
+	int nextRunEvent;
+	double runStart;
+	int loaded;
+} OperatedTrain;
+
+typedef struct {
+	double time;
+	int dispatches;
+	int arrivals;
+
+	//Trains stopped at a block brake because the block ahead was still occupied
+	int holds;
+	double holdTime;
+	double maxHoldTime;
+
+	//Time trains sat loaded in the station waiting for the first block to clear
+	double dispatchDelay;
+
+	double* blockBusyTime;
+
+	//Set if a train stalled between brakes, which ends an event mode run
+	int stalled;
+} OperationStats;
+
+typedef struct {
+	int numberOfTrains;
+	int numberOfCars;
+	float dwell;
+	float dwellVariation;
+	uint64_t seed;
+
+	//Sections the blocks start at, when NULL a block starts at section 0 and at both ends of every chain lift
+	const int* blockStarts;
+	int numberOfBlocks;
+} OperationSettings;
+
+/*	Several trains sharing one track, kept apart by block sections
+ *	Block i runs from section blockStarts[i] up to the start of the next block, the first starts at section 0.
+ *	The last block holds the station. Each boundary has a brake in the subsection just before it where trains
+ *	wait until they can reserve the block ahead, and a block stays reserved until the train's rear car leaves it.
+ */
+typedef struct {
+	const Track* track;
+
+	int numberOfBlocks;
+	int* blockStarts;
+	int* blockOfSection;
+	int* blockOwner;
+	double* blockReservedAt;
+
+	int numberOfTrains;
+	OperatedTrain trains[MAX_OPERATED_TRAINS];
+
+	float dwell;
+	float dwellVariation;
+	Random random;
+
+	OperationStats stats;
+
+	//One run per boundary, from its brake, worked out the first time a train is let go there
+	RunProfile* runs;
+} Operation;
+
+void getDefaultOperationSettings(OperationSettings* settings);
+int initOperation(Operation* operation, const Track* track, const OperationSettings* settings);
+void freeOperation(Operation* operation);
+
+void stepOperation(Operation* operation, int boost);
+int runOperationEvents(Operation* operation, double seconds);
+double getBlockUtilisation(const Operation* operation, int block);
+
+#endif
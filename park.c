@@ -0,0 +1,143 @@
+/*	Park.c
+ *	This module holds every coaster in the scene
+ *
+ *	Coasters share nothing with each other, so they are created and stepped in parallel. Only the active coaster
+ *	takes input and carries the coaster camera, the rest build their tracks straight away and run on their own.
+ *	The coasters are laid out in a row along x, the first one where its track puts it.
+ */
+#include <stdlib.h>
+#include "park.h"
+#include "input.h"
+#include "encoding.h"
+#include "threadpool.h"
+#include "procedural.h"
+
+//Gap left between neighbouring coasters
+#define PARK_SPACING 10.0f
+
+//Size of the generated coasters added alongside the first, unless a size was asked for
+#define PARK_COASTER_POINTS 500
+
+static void createCoasters(int start, int end, int worker, void* context);
+static void updateCoasters(int start, int end, int worker, void* context);
+
+Coaster** coasters = NULL;
+int numberOfCoasters = 0;
+int activeCoaster = 0;
+
+//Set by a switch pressed while dragging
+static int switchPending = 0;
+
+
+/*	The first coaster is made from the given settings, the rest are generated from its seed onwards
+ *	Must be called before the renderer starts, the coasters stay put from then on
+ */
+void initPark(const CoasterSettings* settings, int count)
+{
+	numberOfCoasters = count;
+	coasters = malloc(numberOfCoasters * sizeof(Coaster*));
+
+	CoasterSettings* coasterSettings = malloc(numberOfCoasters * sizeof(CoasterSettings));
+	coasterSettings[0] = *settings;
+
+	for(int i = 1; i < numberOfCoasters; i++)
+	{
+		coasterSettings[i] = *settings;
+		coasterSettings[i].analyticsPath = NULL;
+		coasterSettings[i].trackPath = NULL;
+		coasterSettings[i].proceduralSeed = settings->proceduralSeed + i;
+		coasterSettings[i].startFinished = 1;
+
+		if(settings->proceduralPoints < MIN_PROCEDURAL_POINTS)
+			coasterSettings[i].proceduralPoints = PARK_COASTER_POINTS;
+	}
+
+	parallelFor(numberOfCoasters, 1, createCoasters, coasterSettings);
+	free(coasterSettings);
+
+	Vector3 min, max;
+	getCoasterBounds(coasters[0], &min, &max);
+	float edge = max.x;
+
+	for(int i = 1; i < numberOfCoasters; i++)
+	{
+		getCoasterBounds(coasters[i], &min, &max);
+
+		Vector3 origin = {edge + PARK_SPACING - min.x, 0, 0};
+		setCoasterOrigin(coasters[i], &origin);
+
+		edge = origin.x + max.x;
+	}
+}
+
+static void createCoasters(int start, int end, int worker, void* context)
+{
+	const CoasterSettings* coasterSettings = context;
+
+	for(int i = start; i < end; i++)
+		coasters[i] = createCoaster(&coasterSettings[i]);
+}
+
+void updatePark()
+{
+	parallelFor(numberOfCoasters, 1, updateCoasters, NULL);
+
+	//One shot presses only last a tick, so a press made mid drag is held here until the mouse is let go
+	if(input[NextCoaster])
+	{
+		input[NextCoaster]--;
+		switchPending = 1;
+	}
+
+	//Switching waits for the mouse to be let go so a drag never ends up split between two coasters
+	if(switchPending && !input[Click])
+	{
+		switchPending = 0;
+		activeCoaster = (activeCoaster + 1) % numberOfCoasters;
+	}
+}
+
+static void updateCoasters(int start, int end, int worker, void* context)
+{
+	for(int i = start; i < end; i++)
+		updateRollerCoaster(coasters[i], i == activeCoaster);
+}
+
+/* Copies every coaster's state for the renderer, called from the simulation thread */
+void snapshotPark(ParkSnapshot* snapshot)
+{
+	if(snapshot->coasters == NULL)
+		snapshot->coasters = calloc(numberOfCoasters, sizeof(CoasterSnapshot));
+
+	snapshot->activeCoaster = activeCoaster;
+	snapshot->numberOfCoasters = numberOfCoasters;
+
+	for(int i = 0; i < numberOfCoasters; i++)
+		snapshotRollerCoaster(coasters[i], &(snapshot->coasters[i]));
+}
+
+/* Draws every coaster the camera can see, called from the render thread after the camera is applied */
+void drawPark(const ParkSnapshot* snapshot)
+{
+	Frustum frustum;
+	getViewFrustum(&frustum);
+
+	for(int i = 0; i < snapshot->numberOfCoasters; i++)
+		drawRollerCoaster(coasters[i], &(snapshot->coasters[i]), &frustum);
+}
+
+Coaster* getActiveCoaster()
+{
+	return coasters[activeCoaster];
+}
+
+/* Fingerprints every coaster in order, a park of one coaster checksums the same as that coaster alone */
+unsigned long long checksumPark()
+{
+	unsigned long long hash = HASH_SEED;
+
+	for(int i = 0; i < numberOfCoasters; i++)
+		hash = checksumRollerCoaster(coasters[i], hash);
+
+	return hash;
+}
@@ -0,0 +1,21 @@
+#ifndef PARK_H
+#define PARK_H
+
+#include "rollercoaster.h"
+
+/*	Every coaster's snapshot for one frame, the array is allocated on first use and reused after that */
+typedef struct {
+	int activeCoaster;
+	int numberOfCoasters;
+	CoasterSnapshot* coasters;
+} ParkSnapshot;
+
+void initPark(const CoasterSettings* settings, int numberOfCoasters);
+void updatePark(void);
+void snapshotPark(ParkSnapshot* snapshot);
+void drawPark(const ParkSnapshot* snapshot);
+
+Coaster* getActiveCoaster(void);
+unsigned long long checksumPark(void);
+
+#endif
@@ -0,0 +1,508 @@
+/*	Procedural.c
+ *	This module generates large closed tracks from a seed, for measuring everything else against realistic inputs
+ *
+ *	The layout is a serpentine: rows running back and forth joined by half circles, with a return leg down the side
+ *	back to the station. Rows are far enough apart that nothing can come close to a neighbouring row, and some rows
+ *	have helices coiling off to one side, stacked a whole clearance apart per turn.
+ *
+ *	Heights are planned along the layout one point at a time while estimating the train's speed with the same
+ *	gravity and friction it runs on. Chain lifts take it up, then it drops and rolls over hills that are only as
+ *	high as its speed can carry it, and a new lift starts when it gets slow. The last stretch is a powered station
+ *	run back down to the start, so the track always closes and the train never stalls on it.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "engine.h"
+#include "procedural.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+//Layout
+#define POINT_SPACING 3.0
+#define ROW_SPACING 40.0
+#define MIN_ROWS 4
+#define MIN_ROW_LENGTH 120.0
+
+//Helices coil off towards the next row, a whole clearance above or below the turn before
+#define HELIX_RADIUS 12.0
+#define HELIX_PITCH 4.0
+#define MAX_HELIX_TURNS 3
+#define HELIX_MARGIN 10.0
+#define HELIX_CHANCE 0.25
+
+//Heights, MIN_HEIGHT keeps the track clear of the ground
+#define MIN_HEIGHT 2.0
+#define MAX_HEIGHT 45.0
+#define MIN_LIFT_HEIGHT 15.0
+#define MAX_VALLEY_HEIGHT 4.0
+#define MIN_HILL_HEIGHT 2.0
+#define LIFT_SLOPE 0.35
+#define MAX_SLOPE 0.6
+#define MIN_SEGMENT_LENGTH 20.0
+
+//A lift starts once the estimated speed in a valley falls below LIFT_SPEED, and no hill may slow the train below MIN_CREST_SPEED
+#define LIFT_SPEED 6.0
+#define MIN_CREST_SPEED 3.0
+#define MAX_HILL_ATTEMPTS 4
+
+//The powered station run at the end is long enough to come down from any height
+#define FINAL_APPROACH_LENGTH 300.0
+
+#define MAX_BANK 1.0
+
+//Points along the curve per control point used to work out how far the frames lean
+#define LEAN_SAMPLES 4
+
+typedef enum { Line, Arc, Helix } PieceType;
+
+/*	One piece of the layout seen from above, headings are angles in the x-z plane */
+typedef struct {
+	PieceType type;
+	double startX, startZ;
+	double heading;
+	double length;
+
+	//Arcs and helices turn towards the side direction points to, 1 for increasing heading
+	double radius;
+	int direction;
+	int turns;
+} PathPiece;
+
+typedef struct {
+	PathPiece* pieces;
+	int numberOfPieces;
+	int allocatedPieces;
+	double length;
+
+	//The last row has no helices, so it's where any rolls go
+	double lastRowStart;
+	double lastRowLength;
+} Layout;
+
+typedef enum { Lift, Drop, Hill, HelixDown, HelixUp, Station } SegmentType;
+
+/*	Plans heights along the layout while estimating how fast the train will be going */
+typedef struct {
+	double height;
+	double speed;
+
+	SegmentType type;
+	double start;
+	double length;
+	double fromHeight, toHeight;
+} HeightPlanner;
+
+static void buildLayout(Layout* layout, int numberOfRows, double rowLength, Random* random);
+static PathPiece* addPiece(Layout* layout, PieceType type, double x, double z, double heading, double length, double radius, int direction);
+static void addRow(Layout* layout, double x, double z, double heading, double rowLength, int helices, Random* random);
+static void evaluatePiece(const PathPiece* piece, double distance, double* x, double* z);
+static void planNextSegment(HeightPlanner* planner, double distance, double totalLength, Random* random);
+static double segmentHeight(const HeightPlanner* planner, double distance);
+static double estimateSpeed(double speed, double fromHeight, double toHeight, double step, int isChain);
+static int isHillPossible(const HeightPlanner* planner, double crest, double length, double step);
+static void levelFrames(ControlPoint* points, int numberOfPoints, int rollStart, int rollEnd);
+static double wrapAngle(double angle);
+
+
+/*	Fills points with a closed track, returns 0 if there are too few points to lay one out
+ *	The same seed and number of points always give the same track
+ */
+int generateProceduralTrack(ControlPoint* points, int numberOfPoints, uint64_t seed)
+{
+	if(numberOfPoints < MIN_PROCEDURAL_POINTS)
+		return 0;
+
+	Random random;
+	seedRandom(&random, seed);
+
+	//Helices add length to the rows, this is how much on average per metre of row
+	double helixSpacing = (2 * HELIX_RADIUS) + HELIX_MARGIN;
+	double expectedStep = (HELIX_CHANCE * helixSpacing) + ((1 - HELIX_CHANCE) * helixSpacing / 2);
+	double expectedHelix = HELIX_CHANCE * ((MAX_HELIX_TURNS + 1) / 2.0) * 2 * M_PI * HELIX_RADIUS;
+	double rowStretch = 1 + (expectedHelix / expectedStep);
+
+	//Roughly square, with an even number of rows so the last one ends beside the return leg
+	double targetLength = numberOfPoints * POINT_SPACING;
+	int numberOfRows = 2 * (int) (sqrt(targetLength / (ROW_SPACING * rowStretch)) / 2);
+	if(numberOfRows < MIN_ROWS)
+		numberOfRows = MIN_ROWS;
+
+	double turnLength = M_PI * ROW_SPACING / 2;
+	double fixedLength = (numberOfRows - 1) * turnLength + (2 * turnLength) + ((numberOfRows - 3) * ROW_SPACING);
+	double rowLength = fmax(MIN_ROW_LENGTH, (targetLength - fixedLength) / (numberOfRows * rowStretch));
+
+	Layout layout;
+	memset(&layout, 0, sizeof(Layout));
+	buildLayout(&layout, numberOfRows, rowLength, &random);
+
+	double spacing = layout.length / numberOfPoints;
+
+	HeightPlanner planner;
+	memset(&planner, 0, sizeof(HeightPlanner));
+	planner.height = MIN_HEIGHT;
+	planner.speed = CHAIN_LIFT_SPEED;
+	planner.type = Station;
+
+	int piece = 0;
+	double pieceStart = 0;
+
+	for(int i = 0; i < numberOfPoints; i++)
+	{
+		double distance = i * spacing;
+
+		while(distance >= pieceStart + layout.pieces[piece].length && piece + 1 < layout.numberOfPieces)
+			pieceStart += layout.pieces[piece++].length;
+
+		const PathPiece* current = &(layout.pieces[piece]);
+		double x, z;
+		evaluatePiece(current, distance - pieceStart, &x, &z);
+
+		if(current->type == Helix)
+		{
+			//Coil down if there's room underneath, otherwise lift up the coil
+			if(planner.type != HelixDown && planner.type != HelixUp)
+			{
+				double drop = current->turns * HELIX_PITCH;
+
+				planner.type = planner.height - drop >= MIN_HEIGHT ? HelixDown : HelixUp;
+				planner.start = pieceStart;
+				planner.length = current->length;
+				planner.fromHeight = planner.height;
+				planner.toHeight = planner.height + (planner.type == HelixDown ? -drop : drop);
+			}
+		}
+		else if(planner.type == HelixDown || planner.type == HelixUp || distance >= planner.start + planner.length)
+			planNextSegment(&planner, distance, layout.length, &random);
+
+		double height = segmentHeight(&planner, distance);
+		int isChain = planner.type == Lift || planner.type == HelixUp || planner.type == Station;
+
+		if(i > 0)
+			planner.speed = estimateSpeed(planner.speed, planner.height, height, spacing, isChain);
+		planner.height = height;
+
+		points[i].position.x = x;
+		points[i].position.y = height;
+		points[i].position.z = z;
+		points[i].isChain = isChain;
+		points[i].bank = 0;
+
+		//Bank into turns just enough to cancel the sideways pull at the expected speed
+		if(current->type != Line)
+		{
+			double bank = atan((planner.speed * planner.speed) / (-GRAVITY * current->radius));
+			points[i].bank = current->direction * fmin(bank, MAX_BANK);
+		}
+	}
+
+	//Any whole rolls go in the middle half of the last row
+	int rollStart = (int) ((layout.lastRowStart + (layout.lastRowLength / 4)) / spacing);
+	int rollEnd = (int) ((layout.lastRowStart + (3 * layout.lastRowLength / 4)) / spacing);
+	levelFrames(points, numberOfPoints, rollStart, rollEnd);
+
+	free(layout.pieces);
+
+	return 1;
+}
+
+
+//==============LAYOUT========================
+
+static void buildLayout(Layout* layout, int numberOfRows, double rowLength, Random* random)
+{
+	double turnRadius = ROW_SPACING / 2;
+
+	for(int row = 0; row < numberOfRows; row++)
+	{
+		double z = row * ROW_SPACING;
+		int forwards = row % 2 == 0;
+
+		if(row + 1 == numberOfRows) {
+			layout->lastRowStart = layout->length;
+			layout->lastRowLength = rowLength;
+		}
+
+		//The last row leads into the station run, which has to stay clear of helices
+		addRow(layout, forwards ? 0 : rowLength, z, forwards ? 0 : M_PI, rowLength, row + 1 < numberOfRows, random);
+
+		if(row + 1 < numberOfRows)
+			addPiece(layout, Arc, forwards ? rowLength : 0, z, forwards ? 0 : M_PI, M_PI * turnRadius, turnRadius, forwards ? 1 : -1);
+	}
+
+	//Return leg down the side, wide enough to clear the half circles at the ends of the odd rows
+	double lastZ = (numberOfRows - 1) * ROW_SPACING;
+	addPiece(layout, Arc, 0, lastZ, M_PI, M_PI * ROW_SPACING / 2, ROW_SPACING, 1);
+	addPiece(layout, Line, -ROW_SPACING, lastZ - ROW_SPACING, 1.5 * M_PI, (numberOfRows - 3) * ROW_SPACING, 0, 0);
+	addPiece(layout, Arc, -ROW_SPACING, ROW_SPACING, 1.5 * M_PI, M_PI * ROW_SPACING / 2, ROW_SPACING, 1);
+}
+
+/* Adds a row with helices dropped in at random, keeping them clear of each other and the turns at either end */
+static void addRow(Layout* layout, double x, double z, double heading, double rowLength, int helices, Random* random)
+{
+	double edge = HELIX_RADIUS + HELIX_MARGIN;
+	double helixSpacing = (2 * HELIX_RADIUS) + HELIX_MARGIN;
+	double directionX = cos(heading);
+
+	//Helices always coil towards the next row
+	int towardsNextRow = directionX > 0 ? 1 : -1;
+
+	double lineStart = 0;
+	double position = edge;
+
+	while(helices && position <= rowLength - edge)
+	{
+		if(randomRange(random, 0, 1) < HELIX_CHANCE)
+		{
+			addPiece(layout, Line, x + (directionX * lineStart), z, heading, position - lineStart, 0, 0);
+
+			int turns = 1 + (int) (nextRandom(random) % MAX_HELIX_TURNS);
+			PathPiece* helix = addPiece(layout, Helix, x + (directionX * position), z, heading, turns * 2 * M_PI * HELIX_RADIUS, HELIX_RADIUS, towardsNextRow);
+			helix->turns = turns;
+
+			lineStart = position;
+			position += helixSpacing;
+		}
+		else
+			position += helixSpacing / 2;
+	}
+
+	addPiece(layout, Line, x + (directionX * lineStart), z, heading, rowLength - lineStart, 0, 0);
+}
+
+static PathPiece* addPiece(Layout* layout, PieceType type, double x, double z, double heading, double length, double radius, int direction)
+{
+	if(layout->numberOfPieces == layout->allocatedPieces)
+	{
+		layout->allocatedPieces = layout->allocatedPieces == 0 ? 64 : layout->allocatedPieces * 2;
+		layout->pieces = realloc(layout->pieces, layout->allocatedPieces * sizeof(PathPiece));
+	}
+
+	PathPiece* piece = &(layout->pieces[layout->numberOfPieces++]);
+	piece->type = type;
+	piece->startX = x;
+	piece->startZ = z;
+	piece->heading = heading;
+	piece->length = length;
+	piece->radius = radius;
+	piece->direction = direction;
+	piece->turns = 0;
+
+	layout->length += length;
+
+	return piece;
+}
+
+/* Finds the point a distance along a piece, arcs and helices turn around a centre off to the piece's side */
+static void evaluatePiece(const PathPiece* piece, double distance, double* x, double* z)
+{
+	if(piece->type == Line)
+	{
+		*x = piece->startX + (cos(piece->heading) * distance);
+		*z = piece->startZ + (sin(piece->heading) * distance);
+		return;
+	}
+
+	double sideX = -sin(piece->heading) * piece->direction;
+	double sideZ = cos(piece->heading) * piece->direction;
+	double centreX = piece->startX + (sideX * piece->radius);
+	double centreZ = piece->startZ + (sideZ * piece->radius);
+
+	double heading = piece->heading + (piece->direction * distance / piece->radius);
+
+	*x = centreX + (sin(heading) * piece->direction * piece->radius);
+	*z = centreZ - (cos(heading) * piece->direction * piece->radius);
+}
+
+
+//==============HEIGHTS=======================
+
+static void planNextSegment(HeightPlanner* planner, double distance, double totalLength, Random* random)
+{
+	SegmentType previous = planner->type;
+	double remaining = totalLength - distance;
+
+	planner->start = distance;
+	planner->fromHeight = planner->height;
+
+	//Powered run back down to the station to close the loop
+	if(remaining < FINAL_APPROACH_LENGTH)
+	{
+		planner->type = Station;
+		planner->toHeight = MIN_HEIGHT;
+		planner->length = remaining;
+		return;
+	}
+
+	//Whatever went up comes down into a valley, never climbing on the way
+	if(previous != Drop && previous != Station)
+	{
+		planner->type = Drop;
+		planner->toHeight = fmin(randomRange(random, MIN_HEIGHT, MAX_VALLEY_HEIGHT), planner->height);
+		planner->length = fmax(MIN_SEGMENT_LENGTH, (planner->height - planner->toHeight) * M_PI / (2 * MAX_SLOPE));
+		return;
+	}
+
+	//In a valley, climb a hill as high as the speed allows or lift the train if it's too slow for one
+	double step = POINT_SPACING;
+	double energyHeight = planner->height + ((planner->speed * planner->speed) / (-2 * GRAVITY));
+	double crest = MIN_HEIGHT + (randomRange(random, 0.4, 0.7) * (energyHeight - MIN_HEIGHT));
+
+	planner->type = Lift;
+
+	for(int attempt = 0; attempt < MAX_HILL_ATTEMPTS && previous == Drop && planner->speed >= LIFT_SPEED; attempt++)
+	{
+		double length = fmax(MIN_SEGMENT_LENGTH, fabs(crest - planner->height) * M_PI / (2 * MAX_SLOPE));
+
+		if(crest - planner->height < MIN_HILL_HEIGHT)
+			break;
+
+		if(isHillPossible(planner, fmin(crest, MAX_HEIGHT), length, step))
+		{
+			planner->type = Hill;
+			planner->toHeight = fmin(crest, MAX_HEIGHT);
+			planner->length = length;
+			return;
+		}
+
+		crest = planner->height + ((crest - planner->height) * 0.7);
+	}
+
+	planner->toHeight = randomRange(random, fmax(MIN_LIFT_HEIGHT, planner->height + MIN_HILL_HEIGHT), MAX_HEIGHT);
+	planner->length = fmax(MIN_SEGMENT_LENGTH, (planner->toHeight - planner->height) / LIFT_SLOPE);
+}
+
+/* Hills, drops and the station ease in and out, lifts and helices are a constant slope */
+static double segmentHeight(const HeightPlanner* planner, double distance)
+{
+	double progress = (distance - planner->start) / planner->length;
+	progress = fmin(fmax(progress, 0), 1);
+
+	if(planner->type == Lift || planner->type == HelixDown || planner->type == HelixUp)
+		return planner->fromHeight + ((planner->toHeight - planner->fromHeight) * progress);
+
+	double eased = (1 - cos(progress * M_PI)) / 2;
+
+	return planner->fromHeight + ((planner->toHeight - planner->fromHeight) * eased);
+}
+
+/* Runs the train's physics over a step of track at once, returns 0 when it would stop */
+static double estimateSpeed(double speed, double fromHeight, double toHeight, double step, int isChain)
+{
+	if(isChain && speed < CHAIN_LIFT_SPEED)
+		speed = CHAIN_LIFT_SPEED;
+
+	double speedSquared = (speed * speed) + (2 * GRAVITY * (toHeight - fromHeight));
+	if(speedSquared <= 0)
+		return isChain ? CHAIN_LIFT_SPEED : 0;
+
+	speed = sqrt(speedSquared);
+
+	double ticks = step / (speed * TRAIN_TICK_LENGTH);
+	speed *= pow(1 - FRICTION_COEFFICIENT, ticks);
+
+	return isChain && speed < CHAIN_LIFT_SPEED ? CHAIN_LIFT_SPEED : speed;
+}
+
+/* Checks the train makes it over a hill with speed to spare, friction included */
+static int isHillPossible(const HeightPlanner* planner, double crest, double length, double step)
+{
+	HeightPlanner hill = *planner;
+	hill.type = Hill;
+	hill.fromHeight = planner->height;
+	hill.toHeight = crest;
+	hill.length = length;
+
+	double speed = planner->speed;
+	double height = planner->height;
+
+	//Only the climb matters, the way down from the crest is the next segment
+	for(double distance = step; distance <= length; distance += step)
+	{
+		double next = segmentHeight(&hill, planner->start + distance);
+		speed = estimateSpeed(speed, height, next, step, 0);
+		height = next;
+
+		if(speed < MIN_CREST_SPEED)
+			return 0;
+	}
+
+	return 1;
+}
+
+
+//==============FRAMES========================
+
+/*	Banks the track so it stays upright
+ *	Rotation minimizing frames turn relative to the world's up by the sine of the slope for every radian the track
+ *	turns, so sloped turns like helices leave the track leaning. Generation spreads whatever lean is left when the
+ *	track closes evenly over the whole track, so the bank undoes the lean as it builds up and adds back that even
+ *	spread. That only adds up if the lean left over is under half a turn, each whole turn beyond it is taken out with
+ *	a roll between rollStart and rollEnd instead.
+ */
+static void levelFrames(ControlPoint* points, int numberOfPoints, int rollStart, int rollEnd)
+{
+	double lean = 0;
+	double previousHeading = 0;
+	double previousSlope = 0;
+	double* leans = malloc(numberOfPoints * sizeof(double));
+
+	//Sampled along the curve the track will follow rather than between the points, which cuts corners
+	Vector3 previous = qFunction(points, numberOfPoints, (LEAN_SAMPLES - 1) / (float) LEAN_SAMPLES, numberOfPoints - 1);
+	Vector3 current = qFunction(points, numberOfPoints, 0, 0);
+
+	for(int i = 0; i <= numberOfPoints * LEAN_SAMPLES; i++)
+	{
+		int sample = (i + 1) % (numberOfPoints * LEAN_SAMPLES);
+		Vector3 next = qFunction(points, numberOfPoints, (sample % LEAN_SAMPLES) / (float) LEAN_SAMPLES, sample / LEAN_SAMPLES);
+
+		double x = next.x - previous.x;
+		double y = next.y - previous.y;
+		double z = next.z - previous.z;
+
+		double heading = atan2(z, x);
+		double slope = y / sqrt((x * x) + (y * y) + (z * z));
+
+		if(i > 0)
+			lean += ((slope + previousSlope) / 2) * wrapAngle(heading - previousHeading);
+
+		if(i % LEAN_SAMPLES == 0 && i < numberOfPoints * LEAN_SAMPLES)
+			leans[i / LEAN_SAMPLES] = lean;
+
+		previousHeading = heading;
+		previousSlope = slope;
+		previous = current;
+		current = next;
+	}
+
+	double closingLean = wrapAngle(lean);
+	double rolls = (closingLean - lean) / (2 * M_PI);
+
+	for(int i = 0; i < numberOfPoints; i++)
+	{
+		double roll = 0;
+		if(i >= rollEnd)
+			roll = 1;
+		else if(i > rollStart)
+			roll = (i - rollStart) / (double) (rollEnd - rollStart);
+
+		points[i].bank += -leans[i] + (closingLean * i / numberOfPoints) + (2 * M_PI * rolls * roll);
+	}
+
+	free(leans);
+}
+
+/* Brings an angle into (-pi, pi] */
+static double wrapAngle(double angle)
+{
+	angle = fmod(angle, 2 * M_PI);
+
+	if(angle > M_PI)
+		angle -= 2 * M_PI;
+	else if(angle <= -M_PI)
+		angle += 2 * M_PI;
+
+	return angle;
+}
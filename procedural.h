@@ -0,0 +1,12 @@
+#ifndef PROCEDURAL_H
+#define PROCEDURAL_H
+
+#include <stdint.h>
+#include "track.h"
+
+//Fewer points than this can't fit the layout without stretching every section out of shape
+#define MIN_PROCEDURAL_POINTS 100
+
+int generateProceduralTrack(ControlPoint* points, int numberOfPoints, uint64_t seed);
+
+#endif
@@ -0,0 +1,271 @@
+/*	RailMesh.c
+ *	This module builds the rails by sweeping a 2D cross-section along the track
+ *
+ *	Each sample gets one ring of the profile's points, and every face of the profile joins the same two points
+ *	on neighbouring rings, so a point is transformed once however many faces use it. Faces are swept in bands
+ *	narrow enough that two rings of a band fit in the post-transform cache, walking each band the whole length
+ *	before starting the next, so every ring but the first is already cached when the faces behind it are drawn.
+ *
+ *	Without shaders the track is swept a stretch of RAIL_MESH_SUBSECTIONS at a time into the same space, so the
+ *	only thing kept per subsection is its sample. Neighbouring stretches share a ring, the one sample in
+ *	RAIL_MESH_SUBSECTIONS that is transformed twice, and the last stretch ends on the sample that closes the loop.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "railmesh.h"
+
+//Rails sit either side of the centerline, and hang down from it
+#define RAIL_OFFSET 0.25f
+#define RAIL_HALF_WIDTH 0.05f
+#define RAIL_DEPTH 0.1f
+
+//Sides of each tube, and how much lighter its top is than its bottom
+#define TUBE_SIDES 8
+#define TUBE_TOP_SHADE 0.8f
+#define TUBE_BOTTOM_SHADE 0.45f
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static void boxProfile(RailProfile* profile);
+static void tubeProfile(RailProfile* profile);
+static int addProfilePoint(RailProfile* profile, float across, float up, float shade);
+static void addProfileFace(RailProfile* profile, int start, int end);
+static int findBandEnd(const RailProfile* profile, int start);
+
+static RailProfile activeProfile;
+
+
+/* Picks the profile every track is built with from RAIL_PROFILE_NAMES, returns 0 if there is no such profile */
+int selectRailProfile(const char* name)
+{
+	if(strcmp(name, "box") == 0)
+		boxProfile(&activeProfile);
+	else if(strcmp(name, "tube") == 0)
+		tubeProfile(&activeProfile);
+	else
+		return 0;
+
+	return 1;
+}
+
+const RailProfile* getRailProfile()
+{
+	return &activeProfile;
+}
+
+int getRailIndexCount(const RailProfile* profile, int numberOfRings)
+{
+	return profile->numberOfFaces * (numberOfRings - 1) * 6;
+}
+
+/*	Fills in the triangles joining numberOfRings rings of the profile's points, numbered ring by ring
+ *	Returns how many indices at the start cover the top faces
+ */
+int buildRailIndices(const RailProfile* profile, int numberOfRings, unsigned int* indices)
+{
+	int length = 0;
+	int numberOfTopIndices = 0;
+
+	for(int bandStart = 0; bandStart < profile->numberOfFaces; )
+	{
+		int bandEnd = findBandEnd(profile, bandStart);
+
+		for(int ring = 0; ring < numberOfRings - 1; ring++)
+		{
+			unsigned int near = ring * profile->numberOfPoints;
+			unsigned int far = (ring + 1) * profile->numberOfPoints;
+
+			for(int face = bandStart; face < bandEnd; face++)
+			{
+				unsigned int start = profile->faces[face][0];
+				unsigned int end = profile->faces[face][1];
+
+				indices[length++] = near + start;
+				indices[length++] = near + end;
+				indices[length++] = far + end;
+
+				indices[length++] = near + start;
+				indices[length++] = far + end;
+				indices[length++] = far + start;
+			}
+		}
+
+		bandStart = bandEnd;
+		if(bandStart == profile->numberOfTopFaces)
+			numberOfTopIndices = length;
+	}
+
+	return numberOfTopIndices;
+}
+
+/* Makes room for the longest stretch of rails the profile sweeps */
+void initRailMesh(RailMesh* mesh, const RailProfile* profile)
+{
+	int numberOfVertices = (RAIL_MESH_SUBSECTIONS + 1) * profile->numberOfPoints;
+	mesh->positions = malloc(numberOfVertices * sizeof(Vector3));
+	mesh->colours = malloc(numberOfVertices * sizeof(Vector3));
+	mesh->indices = malloc(getRailIndexCount(profile, RAIL_MESH_SUBSECTIONS + 1) * sizeof(unsigned int));
+	mesh->numberOfRings = 0;
+}
+
+/*	Sweeps the profile along up to RAIL_MESH_SUBSECTIONS subsections, reading the sample past the last one too
+ *	The rails are shaded by the profile, or with overlay coloured by each sample's g-force colour
+ */
+void sweepRails(RailMesh* mesh, const RailProfile* profile, const RailSample* samples, int numberOfSubSections, int overlay)
+{
+	int numberOfRings = numberOfSubSections + 1;
+
+	for(int i = 0; i < numberOfRings; i++)
+	{
+		const RailSample* sample = &(samples[i]);
+		Vector3 binormal = crossProductVector3(&(sample->tangent), &(sample->normal));
+
+		for(int j = 0; j < profile->numberOfPoints; j++)
+		{
+			const ProfilePoint* point = &(profile->points[j]);
+			int vertex = (i * profile->numberOfPoints) + j;
+
+			Vector3 across = multiplyVector3(&binormal, point->across);
+			Vector3 up = multiplyVector3(&(sample->normal), point->up);
+			mesh->positions[vertex] = addVector3(&(sample->position), &across);
+			mesh->positions[vertex] = addVector3(&(mesh->positions[vertex]), &up);
+
+			if(overlay)
+				mesh->colours[vertex] = sample->overlayColour;
+			else
+				mesh->colours[vertex] = (Vector3) { point->shade, point->shade, point->shade };
+		}
+	}
+
+	//Every full stretch shares the same indices, only a shorter last one needs its own
+	if(mesh->numberOfRings != numberOfRings)
+	{
+		mesh->numberOfRings = numberOfRings;
+		mesh->numberOfIndices = getRailIndexCount(profile, numberOfRings);
+		mesh->numberOfTopIndices = buildRailIndices(profile, numberOfRings, mesh->indices);
+	}
+}
+
+void freeRailMesh(RailMesh* mesh)
+{
+	free(mesh->positions);
+	free(mesh->colours);
+	free(mesh->indices);
+
+	memset(mesh, 0, sizeof(RailMesh));
+}
+
+
+/* Flat rails shaded by which way each face points, every face has its own corners */
+static void boxProfile(RailProfile* profile)
+{
+	memset(profile, 0, sizeof(RailProfile));
+
+	for(int side = -1; side <= 1; side += 2)
+	{
+		float left = (side * RAIL_OFFSET) - RAIL_HALF_WIDTH;
+		float right = (side * RAIL_OFFSET) + RAIL_HALF_WIDTH;
+		addProfileFace(profile, addProfilePoint(profile, left, 0, 0.8f), addProfilePoint(profile, right, 0, 0.8f));
+	}
+	profile->numberOfTopFaces = profile->numberOfFaces;
+
+	for(int side = -1; side <= 1; side += 2)
+	{
+		float left = (side * RAIL_OFFSET) - RAIL_HALF_WIDTH;
+		float right = (side * RAIL_OFFSET) + RAIL_HALF_WIDTH;
+		addProfileFace(profile, addProfilePoint(profile, right, -RAIL_DEPTH, 0.45f), addProfilePoint(profile, left, -RAIL_DEPTH, 0.45f));
+	}
+
+	for(int side = -1; side <= 1; side += 2)
+	{
+		float left = (side * RAIL_OFFSET) - RAIL_HALF_WIDTH;
+		float right = (side * RAIL_OFFSET) + RAIL_HALF_WIDTH;
+		addProfileFace(profile, addProfilePoint(profile, left, -RAIL_DEPTH, 0.65f), addProfilePoint(profile, left, 0, 0.65f));
+		addProfileFace(profile, addProfilePoint(profile, right, 0, 0.65f), addProfilePoint(profile, right, -RAIL_DEPTH, 0.65f));
+	}
+
+	profile->supportAcross = RAIL_OFFSET - RAIL_HALF_WIDTH;
+	profile->supportUp = 0;
+}
+
+/*	Round rails the same size as the box ones, smoothly shaded so neighbouring faces share their points
+ *	Twice the faces of the box from the same number of points
+ */
+static void tubeProfile(RailProfile* profile)
+{
+	memset(profile, 0, sizeof(RailProfile));
+
+	//Points run anticlockwise from the outer side, over the top and back underneath
+	for(int side = -1; side <= 1; side += 2)
+	{
+		for(int i = 0; i < TUBE_SIDES; i++)
+		{
+			float angle = (2 * M_PI * i) / TUBE_SIDES;
+			float shade = (TUBE_TOP_SHADE + TUBE_BOTTOM_SHADE + ((TUBE_TOP_SHADE - TUBE_BOTTOM_SHADE) * sinf(angle))) / 2;
+			addProfilePoint(profile, (side * RAIL_OFFSET) + (side * RAIL_HALF_WIDTH * cosf(angle)),
+				(RAIL_HALF_WIDTH * sinf(angle)) - RAIL_HALF_WIDTH, shade);
+		}
+	}
+
+	for(int half = 0; half < 2; half++)
+	{
+		for(int rail = 0; rail < 2; rail++)
+		{
+			for(int i = half * TUBE_SIDES / 2; i < (half + 1) * TUBE_SIDES / 2; i++)
+				addProfileFace(profile, (rail * TUBE_SIDES) + i, (rail * TUBE_SIDES) + ((i + 1) % TUBE_SIDES));
+		}
+
+		if(half == 0)
+			profile->numberOfTopFaces = profile->numberOfFaces;
+	}
+
+	//The inner point on the upper slope
+	float angle = (2 * M_PI * 3) / TUBE_SIDES;
+	profile->supportAcross = RAIL_OFFSET + (RAIL_HALF_WIDTH * cosf(angle));
+	profile->supportUp = (RAIL_HALF_WIDTH * sinf(angle)) - RAIL_HALF_WIDTH;
+}
+
+static int addProfilePoint(RailProfile* profile, float across, float up, float shade)
+{
+	profile->points[profile->numberOfPoints] = (ProfilePoint) { across, up, shade };
+	return profile->numberOfPoints++;
+}
+
+static void addProfileFace(RailProfile* profile, int start, int end)
+{
+	profile->faces[profile->numberOfFaces][0] = start;
+	profile->faces[profile->numberOfFaces][1] = end;
+	profile->numberOfFaces++;
+}
+
+/*	Finds where the band of faces beginning at start ends, so two rings of its points fit in the vertex cache
+ *	Top faces never share a band with the rest, so the overlay can draw them on their own
+ */
+static int findBandEnd(const RailProfile* profile, int start)
+{
+	unsigned char used[MAX_PROFILE_POINTS] = { 0 };
+	int points = 0;
+	int top = start < profile->numberOfTopFaces;
+
+	int end = start;
+	for(; end < profile->numberOfFaces; end++)
+	{
+		if((end < profile->numberOfTopFaces) != top)
+			break;
+
+		int first = profile->faces[end][0];
+		int second = profile->faces[end][1];
+		int newPoints = !used[first] + !used[second];
+		if(end > start && (points + newPoints) * 2 > RAIL_VERTEX_CACHE_SIZE)
+			break;
+
+		used[first] = 1;
+		used[second] = 1;
+		points += newPoints;
+	}
+
+	return end;
+}
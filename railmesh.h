@@ -0,0 +1,68 @@
+#ifndef RAILMESH_H
+#define RAILMESH_H
+
+#include "engine.h"
+#include "trackshader.h"
+
+#define MAX_PROFILE_POINTS 32
+#define MAX_PROFILE_FACES 32
+
+//Vertices the post-transform cache is assumed to hold, small enough for old hardware to still hit
+#define RAIL_VERTEX_CACHE_SIZE 16
+
+#define RAIL_PROFILE_NAMES "box|tube"
+#define DEFAULT_RAIL_PROFILE "box"
+
+/*	A point of the cross-section, across along the binormal and up along the normal from the centerline
+ *	Faces sharing a point share its vertex, so a hard edge is two points in the same place with different shades
+ */
+typedef struct {
+	float across;
+	float up;
+	float shade;
+} ProfilePoint;
+
+/*	The cross-section of both rails, swept along the track to build them
+ *	The first numberOfTopFaces faces are the tops the g-force overlay is drawn over
+ */
+typedef struct {
+	int numberOfPoints;
+	ProfilePoint points[MAX_PROFILE_POINTS];
+
+	int numberOfFaces;
+	int numberOfTopFaces;
+	unsigned char faces[MAX_PROFILE_FACES][2];
+
+	//Where each support's struts meet the rails, mirrored for the left rail
+	float supportAcross;
+	float supportUp;
+} RailProfile;
+
+//Subsections swept at a time without shaders, space for one stretch is all that is held
+#define RAIL_MESH_SUBSECTIONS 1024
+
+/*	A stretch of both rails as one indexed triangle mesh, a ring of the profile's points per sample
+ *	Reused stretch after stretch, the overlay draws the first numberOfTopIndices indices
+ */
+typedef struct {
+	int numberOfRings;
+	Vector3* positions;
+	Vector3* colours;
+
+	int numberOfIndices;
+	int numberOfTopIndices;
+	unsigned int* indices;
+} RailMesh;
+
+//Chosen before any track is built
+int selectRailProfile(const char* name);
+const RailProfile* getRailProfile(void);
+
+int getRailIndexCount(const RailProfile* profile, int numberOfRings);
+int buildRailIndices(const RailProfile* profile, int numberOfRings, unsigned int* indices);
+
+void initRailMesh(RailMesh* mesh, const RailProfile* profile);
+void sweepRails(RailMesh* mesh, const RailProfile* profile, const RailSample* samples, int numberOfSubSections, int overlay);
+void freeRailMesh(RailMesh* mesh);
+
+#endif
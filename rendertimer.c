@@ -0,0 +1,159 @@
+/*	RenderTimer.c
+ *	This module times each pass of a frame, both how long the CPU took to submit it and how long the GPU took to draw it
+ *
+ *	A frame whose CPU time is mostly submission is limited by the driver calls, one whose GPU time dominates is
+ *	limited by rasterization. GPU times come from GL_TIME_ELAPSED queries. Each frame gets its own set, and sets are
+ *	reused round a ring of three, so results are read two frames after they were asked for, when they are almost
+ *	always back. A frame whose results still aren't back by the time its set is needed again is skipped rather
+ *	than waited for.
+ */
+#include "gpu.h"
+#include <string.h>
+#include "engine.h"
+#include "rendertimer.h"
+
+typedef struct {
+	unsigned int queries[RENDER_TIMER_QUERIES];
+	unsigned char passes[RENDER_TIMER_QUERIES];
+	int used;
+} TimerFrame;
+
+static void collectFrame(TimerFrame* frame);
+
+static int gpuTiming = 0;
+static TimerFrame frames[RENDER_TIMER_FRAMES];
+static unsigned long frameIndex = 0;
+
+//The pass being drawn, passes don't nest
+static int activePass = -1;
+static int activeQuery = 0;
+static double passStart;
+
+//This frame's CPU times so far, and the last complete figures
+static double frameCpuTimes[NUMBER_OF_RENDER_PASSES];
+static RenderPassTimes latestTimes;
+
+static RenderPassTimes totalTimes;
+static unsigned long cpuFrames = 0;
+static unsigned long gpuFrames = 0;
+
+
+/* Sets up the queries if the driver can time passes, CPU times are always measured */
+void initRenderTimer()
+{
+#ifdef GPU_EXTENSIONS
+	gpuTiming = hasGlVersion(3, 3);
+	if(gpuTiming)
+	{
+		for(int i = 0; i < RENDER_TIMER_FRAMES; i++)
+			glGenQueries(RENDER_TIMER_QUERIES, frames[i].queries);
+	}
+#endif
+}
+
+void beginRenderPass(RenderPass pass)
+{
+	if(activePass != -1)
+		return;
+
+	activePass = pass;
+	passStart = getTimeSeconds();
+
+#ifdef GPU_EXTENSIONS
+	TimerFrame* frame = &frames[frameIndex % RENDER_TIMER_FRAMES];
+	activeQuery = gpuTiming && frame->used < RENDER_TIMER_QUERIES;
+	if(activeQuery)
+	{
+		frame->passes[frame->used] = pass;
+		glBeginQuery(GL_TIME_ELAPSED, frame->queries[frame->used]);
+	}
+#endif
+}
+
+void endRenderPass()
+{
+	if(activePass == -1)
+		return;
+
+#ifdef GPU_EXTENSIONS
+	if(activeQuery)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		frames[frameIndex % RENDER_TIMER_FRAMES].used++;
+	}
+#endif
+
+	frameCpuTimes[activePass] += getTimeSeconds() - passStart;
+	activePass = -1;
+}
+
+/* Closes off the frame's times and picks up the GPU times of the frame two before it */
+void finishRenderFrame()
+{
+	for(int i = 0; i < NUMBER_OF_RENDER_PASSES; i++)
+	{
+		latestTimes.cpu[i] = frameCpuTimes[i];
+		totalTimes.cpu[i] += frameCpuTimes[i];
+		frameCpuTimes[i] = 0;
+	}
+	cpuFrames++;
+
+	if(!gpuTiming)
+		return;
+
+	//The oldest set is the one the next frame reuses, so this is the last chance to read it
+	frameIndex++;
+	TimerFrame* oldest = &frames[frameIndex % RENDER_TIMER_FRAMES];
+	if(oldest->used > 0)
+		collectFrame(oldest);
+	oldest->used = 0;
+}
+
+static void collectFrame(TimerFrame* frame)
+{
+#ifdef GPU_EXTENSIONS
+	//Results arrive in order, so once the last is back they all are
+	GLuint available = 0;
+	glGetQueryObjectuiv(frame->queries[frame->used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if(!available)
+		return;
+
+	double times[NUMBER_OF_RENDER_PASSES] = { 0 };
+	for(int i = 0; i < frame->used; i++)
+	{
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(frame->queries[i], GL_QUERY_RESULT, &elapsed);
+		times[frame->passes[i]] += elapsed * 1e-9;
+	}
+
+	for(int i = 0; i < NUMBER_OF_RENDER_PASSES; i++)
+	{
+		latestTimes.gpu[i] = times[i];
+		totalTimes.gpu[i] += times[i];
+	}
+	latestTimes.gpuTimed = 1;
+	gpuFrames++;
+#endif
+}
+
+/* The CPU times of the last frame finished and the GPU times of the newest frame whose results are back */
+void getLatestPassTimes(RenderPassTimes* times)
+{
+	*times = latestTimes;
+}
+
+/* Averages over every frame timed so far */
+void getAveragePassTimes(RenderPassTimes* times)
+{
+	memset(times, 0, sizeof(RenderPassTimes));
+
+	for(int i = 0; i < NUMBER_OF_RENDER_PASSES; i++)
+	{
+		if(cpuFrames > 0)
+			times->cpu[i] = totalTimes.cpu[i] / cpuFrames;
+		if(gpuFrames > 0)
+			times->gpu[i] = totalTimes.gpu[i] / gpuFrames;
+	}
+
+	times->gpuTimed = gpuFrames > 0;
+}
@@ -0,0 +1,31 @@
+#ifndef RENDERTIMER_H
+#define RENDERTIMER_H
+
+typedef enum { PassWorld, PassTrack, PassTrain, PassPreview, PassHud, NUMBER_OF_RENDER_PASSES } RenderPass;
+#define RENDER_PASS_NAMES { "world", "track", "train", "preview", "hud" }
+
+//Frames of GPU queries in flight, results are read this many frames minus one after they were issued
+#define RENDER_TIMER_FRAMES 3
+
+//Timed stretches a frame can have in all, a pass can be timed in several pieces, one per coaster say
+#define RENDER_TIMER_QUERIES 256
+
+/*	Seconds spent on each pass in a frame, submitting on the CPU and executing on the GPU
+ *	gpuTimed is 0 when the driver can't time passes, or no frame's results have come back yet
+ */
+typedef struct {
+	double cpu[NUMBER_OF_RENDER_PASSES];
+	double gpu[NUMBER_OF_RENDER_PASSES];
+	int gpuTimed;
+} RenderPassTimes;
+
+//From the render thread, with the context current
+void initRenderTimer(void);
+void beginRenderPass(RenderPass pass);
+void endRenderPass(void);
+void finishRenderFrame(void);
+
+void getLatestPassTimes(RenderPassTimes* times);
+void getAveragePassTimes(RenderPassTimes* times);
+
+#endif
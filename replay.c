@@ -0,0 +1,199 @@
+/*	Replay.c
+ *	This module records input events to a file and plays them back
+ *
+ *	Every event is stamped with the input tick it was applied on, so a replay feeds the exact same events into the
+ *	exact same ticks. Since the simulation runs on a fixed time step, a replay ends in a bit-identical state.
+ *
+ *	File layout, after the "RCRP" magic and a version byte, is one record per event:
+ *		varint tick delta, label byte, type byte, zigzag varint value
+ *	A record with the label END_OF_RECORDING marks the final tick of the recording.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "encoding.h"
+#include "replay.h"
+
+#define REPLAY_MAGIC "RCRP"
+#define REPLAY_VERSION 1
+#define END_OF_RECORDING 0xff
+
+static int readNextRecord(void);
+
+//Recording
+static FILE* recordingFile = NULL;
+static unsigned long lastRecordedTick = 0;
+static pthread_mutex_t recordingLock = PTHREAD_MUTEX_INITIALIZER;
+
+//Replaying
+static unsigned char* replayData = NULL;
+static const unsigned char* replayCursor;
+static const unsigned char* replayEnd;
+static int replaying = 0;
+static int replayRealtime = 0;
+
+static unsigned long nextTick = 0;
+static int nextIsEnd = 0;
+static InputEvent nextEvent;
+
+
+//==============RECORDING=====================
+
+int startRecording(const char* path)
+{
+	recordingFile = fopen(path, "wb");
+	if(recordingFile == NULL) {
+		printf("Could not open %s for recording\n", path);
+		return 0;
+	}
+
+	fwrite(REPLAY_MAGIC, 1, 4, recordingFile);
+	fputc(REPLAY_VERSION, recordingFile);
+	lastRecordedTick = 0;
+
+	return 1;
+}
+
+static void writeRecord(unsigned long tick, int label, int type, int value)
+{
+	unsigned char record[2 * MAX_VARINT_BYTES + 2];
+	int length = 0;
+
+	length += writeVarint(record + length, tick - lastRecordedTick);
+	record[length++] = (unsigned char) label;
+	record[length++] = (unsigned char) type;
+	length += writeVarint(record + length, zigzagEncode(value));
+
+	fwrite(record, 1, length, recordingFile);
+	lastRecordedTick = tick;
+}
+
+/* Called from the simulation thread for every event it applies */
+void recordInputEvent(unsigned long tick, const InputEvent* event)
+{
+	pthread_mutex_lock(&recordingLock);
+
+	if(recordingFile != NULL)
+		writeRecord(tick, event->label, event->type, event->value);
+
+	pthread_mutex_unlock(&recordingLock);
+}
+
+/* Marks the end of the recording and closes it, safe to call from any thread */
+void stopRecording()
+{
+	pthread_mutex_lock(&recordingLock);
+
+	if(recordingFile != NULL)
+	{
+		writeRecord(getInputTick(), END_OF_RECORDING, 0, 0);
+		fclose(recordingFile);
+		recordingFile = NULL;
+	}
+
+	pthread_mutex_unlock(&recordingLock);
+}
+
+
+//==============REPLAYING=====================
+
+int startReplay(const char* path, int realtime)
+{
+	FILE* file = fopen(path, "rb");
+	if(file == NULL) {
+		printf("Could not open %s for replay\n", path);
+		return 0;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	replayData = malloc(size > 0 ? size : 1);
+	long read = fread(replayData, 1, size, file);
+	fclose(file);
+
+	if(read != size || size < 5 || memcmp(replayData, REPLAY_MAGIC, 4) != 0 || replayData[4] != REPLAY_VERSION) {
+		printf("%s is not a replay file\n", path);
+		free(replayData);
+		replayData = NULL;
+		return 0;
+	}
+
+	replayCursor = replayData + 5;
+	replayEnd = replayData + size;
+	replaying = 1;
+	replayRealtime = realtime;
+
+	nextTick = 0;
+	readNextRecord();
+
+	return 1;
+}
+
+int isReplaying()
+{
+	return replaying;
+}
+
+int isReplayRealtime()
+{
+	return replayRealtime;
+}
+
+/*	Decodes the record under the cursor, a truncated file ends where it stops
+ *	So does a record that isn't a valid event, it would only index past the inputs
+ */
+static int readNextRecord()
+{
+	if(replayCursor >= replayEnd) {
+		nextIsEnd = 1;
+		return 0;
+	}
+
+	nextTick += readVarint(&replayCursor, replayEnd);
+
+	if(replayCursor + 2 > replayEnd) {
+		nextIsEnd = 1;
+		return 0;
+	}
+
+	int label = *replayCursor++;
+	int type = *replayCursor++;
+
+	//A varint whose last byte still flags more to come was cut off
+	const unsigned char* valueStart = replayCursor;
+	int value = (int) zigzagDecode(readVarint(&replayCursor, replayEnd));
+
+	if(label == END_OF_RECORDING || replayCursor == valueStart || (replayCursor[-1] & 0x80)
+		|| label >= NUMBER_OF_INPUTS || type < InputPress || type > InputSet)
+	{
+		nextIsEnd = 1;
+		return 0;
+	}
+
+	nextEvent.time = 0;
+	nextEvent.label = label;
+	nextEvent.type = type;
+	nextEvent.value = value;
+
+	return 1;
+}
+
+/* Returns the next recorded event for this tick, or 0 once every event for the tick has been returned */
+int nextReplayEvent(unsigned long tick, InputEvent* event)
+{
+	if(!replaying || nextIsEnd || nextTick > tick)
+		return 0;
+
+	*event = nextEvent;
+	readNextRecord();
+
+	return 1;
+}
+
+int isReplayFinished(unsigned long tick)
+{
+	return replaying && nextIsEnd && tick >= nextTick;
+}
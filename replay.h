@@ -0,0 +1,16 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "input.h"
+
+int startRecording(const char* path);
+void recordInputEvent(unsigned long tick, const InputEvent* event);
+void stopRecording(void);
+
+int startReplay(const char* path, int realtime);
+int isReplaying(void);
+int isReplayRealtime(void);
+int nextReplayEvent(unsigned long tick, InputEvent* event);
+int isReplayFinished(unsigned long tick);
+
+#endif
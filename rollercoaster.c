@@ -1,521 +1,830 @@
 /*	Rollercoaster.c
  *	This module implements the Roller Coaster, the track, track render, and track editing
+ *	All of a coaster's state lives in its Coaster, so a park can run any number of them side by side
  */
 #include "engine.h"
 #include "rollercoaster.h"
 #include "primatives.c"
 #include "input.h"
 #include "camera.h"
+#include "encoding.h"
+#include "telemetry.h"
+#include "track.h"
+#include "controlpoints.h"
+#include "history.h"
+#include "analytics.h"
+#include "trackfile.h"
+#include "procedural.h"
+#include "rendertimer.h"
+#include "trackshader.h"
+#include "railmesh.h"
 #include <GL/glut.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdatomic.h>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 #define DEFAULT_NUMBER_OF_POINTS 15
-#define NUMBER_OF_SUB_SECTIONS 10
 
 #define CONTROL_POINT_MOVEMENT_SPEED 0.1
 #define CONTROL_POINT_HEIGHT_STEP 0.25
 
-#define GRAVITY -9.81
-#define FRICTION_COEFFICIENT 0.001
+//Boxes smaller than this many pixels are treated as a plain click
+#define MIN_BOX_SELECT_SIZE 4
 
-#define COASTER_START_SPEED 2.5
-#define BOOST_STRENGTH 0.25
-#define CHAIN_LIFT_SPEED 1.5
+//Radius used for spatial queries against the control points
+#define CONTROL_POINT_QUERY_RADIUS 0.25
 
-typedef struct {
-	Vector3 position;
-	int isChain;	
-} ControlPoint;
-
-typedef struct {
-	float subSectionLength;
+#define MAX_REPORTED_CLEARANCE_PAIRS 10
 
-	Vector3 subSectionStart;
-	Vector3 subSectionEnd;
-} TrackSubSection;
+//Edits to the control points remembered for snapshots that are behind, older than this and they copy every point
+#define POINT_EDIT_LOG_SIZE 64
 
-typedef struct {
-	TrackSubSection subSections[NUMBER_OF_SUB_SECTIONS];
-	int isChain;
-} TrackSection;
-
-typedef struct {
-	Vector3* topVerts;
-	Vector3* bottomVerts;
-} RailVerts;
+#define DEFAULT_UNDO_MEMORY (64 * 1024 * 1024)
 
-//Init
-static void generateControlPoints(void);
-static void defaultCoaster(void);
+//Vertical g where the overlay turns fully red
+#define OVERLAY_MAX_G 4.0
 
-//Update
-static void takeInput(void);
-static void generateTrack(void);
-static void generateTrackDisplayList(void);
-static void calculateSubSectionLength(TrackSubSection* subSection);
-static void moveCoaster(void);
+//Length of each car drawn, shorter than CAR_SPACING to leave room for the couplings
+#define CAR_LENGTH 0.8f
 
-//Drawing
-static void drawControlPoints(void);
-static void drawFinishedTrack(void);
-static void drawTrain(void);
+//How far the rails and the train reach outside the control points, and how far down the supports go
+#define TRACK_BOUNDS_MARGIN 1.0
+#define SUPPORT_BOTTOM -1
 
-//Construction
-static void selectionInput(void);
-static void editControlPoint(void);
-static void addPoint(void);
-static void removePoint(void);
-static void allocateMoreControlPoints(void);
+/*	Everything needed to build the track display list
+ *	Built by the simulation thread and handed to the render thread, which frees it once compiled
+ */
+typedef struct {
+	int numberOfSections;
+	int* isChain;
+	Vector3* centerline;
 
-static Vector3 qFunction(float u, int i);
+	//Height each section's support reaches down to
+	float* supportBottoms;
 
+	//Set for subsections that pass too close to another part of the track
+	unsigned char* tooClose;
 
-static RailVerts leftRail;
-static RailVerts rightRail;
+	//Per subsection colour of the g-force overlay
+	Vector3* overlayColours;
 
-typedef enum { Constructing, Generating, Ready } TrackState;
-TrackState trackState = Constructing;
+	//One sample per subsection, extruded by the shaders or swept on the CPU while compiling without them
+	RailSample* railSamples;
+} TrackMesh;
 
-ControlPoint* controlPoints = NULL;
-int numberOfControlPoints;
-int allocatedControlPoints;
-int selectedPoint = -1;
+//Init
+static void generateControlPoints(Coaster* coaster);
+static void defaultCoaster(Coaster* coaster);
+static int loadCoaster(Coaster* coaster);
+static int proceduralCoaster(Coaster* coaster);
 
-TrackSection* trackSections = NULL;
+//Update
+static void takeInput(Coaster* coaster);
+static void finishTrack(Coaster* coaster);
+static TrackMesh* generateTrackMesh(Coaster* coaster);
+static void freeTrackMesh(TrackMesh* mesh);
+static void generateTrackDisplayList(Coaster* coaster, TrackMesh* mesh);
+static void reportClearance(Coaster* coaster);
+static void reportRideAnalytics(Coaster* coaster);
+static Vector3 gForceColour(float verticalG);
+static void moveCoaster(Coaster* coaster, int takesInput);
+static void recordCoasterTelemetry(Coaster* coaster, int boost);
 
+//Drawing
+static void drawControlPoints(const CoasterSnapshot* snapshot);
+static void drawSelectionBox(const CoasterSnapshot* snapshot);
+static void drawFinishedTrack(const TrackMesh* mesh);
+static void drawRails(const TrackMesh* mesh);
+static void drawOverlay(const TrackMesh* mesh);
+static void drawRailStretches(const TrackMesh* mesh, int overlay);
+static void drawTrain(const CoasterSnapshot* snapshot, int trainIndex);
+static void drawCar(const Vector3* position, const TrackFrame* frame);
 
-int trackList;
+//Construction
+static void selectionInput(Coaster* coaster);
+static void pickInput(Coaster* coaster);
+static void beginPick(Coaster* coaster);
+static void finishBoxSelection(Coaster* coaster);
+static void selectSingle(Coaster* coaster, int index);
+static int isSelected(Coaster* coaster, int index);
+static void editControlPoint(Coaster* coaster);
+static void addPoint(Coaster* coaster);
+static void removePoint(Coaster* coaster);
+static Bvh* getControlPointBvh(Coaster* coaster);
+static void refitControlPoint(Coaster* coaster, int index);
+static void invalidateControlPointBvh(Coaster* coaster);
+static void controlPointChanged(Coaster* coaster, int index);
+static void logPointEdit(Coaster* coaster, int start, int end);
+static void widenCoasterBounds(Coaster* coaster, int start, int end);
+static void measureCoasterBounds(Coaster* coaster);
+static void historyInput(Coaster* coaster);
+static void applyHistoryChange(Coaster* coaster, const HistoryChange* change);
+
+
+struct Coaster {
+	CoasterSettings settings;
+	TrackState trackState;
+
+	//Where the coaster sits in the park, the track and everything on it is relative to this
+	Vector3 origin;
+
+	ControlPointBuffer controlPoints;
+	int numberOfControlPoints;
+
+	//Undo history, edits are saved to it as one step once the mouse button is let go
+	History history;
+	int historyPending;
+	int selectedPoint;
+
+	//Bumped whenever the control points or the selection change so snapshots know to recopy them
+	unsigned int editVersion;
+
+	//The points each recent edit touched, by pointVersion, so snapshots only recopy those
+	unsigned int pointVersion;
+	int editedStarts[POINT_EDIT_LOG_SIZE];
+	int editedEnds[POINT_EDIT_LOG_SIZE];
+
+	//Box around the control points, only measured afresh for a new track, edits just widen it
+	Vector3 boundsMin;
+	Vector3 boundsMax;
+
+	//Mouse picking, the selection always contains selectedPoint once anything is selected
+	int* selection;
+	int selectionCount;
+	int allocatedSelection;
+	int wasClicking;
+	int boxSelecting;
+	int boxStartX, boxStartY;
+
+	Track track;
+
+	//Rebuilt lazily after points are added or removed
+	Bvh* controlPointBvh;
+
+	ClearanceReport* clearanceReport;
+	RideAnalytics* rideAnalytics;
+
+	//Colours the track by vertical g when set
+	int showOverlay;
+
+	Train train;
+
+	//Runs every train on the track instead of just the one when there are several
+	Operation operation;
+	int operated;
+
+	//Owned by the render thread, the rails and supports are in the track buffers instead of the list with shaders
+	int trackList;
+	int overlayList;
+	TrackBuffers trackBuffers;
+
+	//Mailbox for the newest generated track, the render thread takes it when it is ready to compile it
+	_Atomic(TrackMesh*) pendingMesh;
+};
+
+
+void getDefaultCoasterSettings(CoasterSettings* settings)
+{
+	memset(settings, 0, sizeof(CoasterSettings));
+	settings->undoMemoryLimit = DEFAULT_UNDO_MEMORY;
+	settings->proceduralSeed = 1;
+	settings->numberOfCars = 1;
+	settings->numberOfTrains = 1;
+}
 
+Coaster* createCoaster(const CoasterSettings* settings)
+{
+	Coaster* coaster = calloc(1, sizeof(Coaster));
+	coaster->settings = *settings;
+	coaster->trackState = settings->startFinished ? Generating : Constructing;
+	coaster->selectedPoint = -1;
+	coaster->editVersion = 1;
+	atomic_init(&(coaster->pendingMesh), NULL);
 
-Vector3 up;
+	//Until there is a track, the coaster faces forward and upright
+	resetTrain(&(coaster->train), NULL, settings->numberOfCars);
 
-Vector3 coasterPosition;
-float coasterVelocity = COASTER_START_SPEED;
+	generateControlPoints(coaster);
 
-//Coaster Movement globals
-float t = 1;
-int currentTrackIndex = 0;
-int currentSubSectionIndex = 0;
-Vector3 startPos;
-Vector3 endPos;
+	return coaster;
+}
 
-Vector3 getCoasterPosition()
+/* Frees the coaster along with its display lists, so it must be called from the render thread */
+void freeCoaster(Coaster* coaster)
 {
-	return coasterPosition;
+	TrackMesh* mesh = atomic_exchange(&(coaster->pendingMesh), NULL);
+	if(mesh != NULL)
+		freeTrackMesh(mesh);
+
+	if(coaster->trackList != 0)
+		glDeleteLists(coaster->trackList, 1);
+	if(coaster->overlayList != 0)
+		glDeleteLists(coaster->overlayList, 1);
+	freeTrackBuffers(&(coaster->trackBuffers));
+
+	freeControlPointBuffer(&(coaster->controlPoints));
+	freeHistory(&(coaster->history));
+	free(coaster->selection);
+	if(coaster->operated)
+		freeOperation(&(coaster->operation));
+	freeTrack(&(coaster->track));
+	freeBvh(coaster->controlPointBvh);
+	freeClearanceReport(coaster->clearanceReport);
+	freeRideAnalytics(coaster->rideAnalytics);
+
+	free(coaster);
 }
 
-void initRollerCoaster()
+/* Moves the whole coaster around the park, the control points themselves don't change */
+void setCoasterOrigin(Coaster* coaster, const Vector3* origin)
 {
-	up.x = 0;
-	up.z = 0;
-	up.y = 1;
-
-	leftRail.topVerts = NULL;
-	leftRail.bottomVerts = NULL;
-	rightRail.topVerts = NULL;
-	rightRail.bottomVerts = NULL;
-
-	generateControlPoints();
+	coaster->origin = *origin;
+	coaster->editVersion++;
 }
 
-static void generateControlPoints()
+/*	A box around the control points, relative to the coaster's origin. The spline never leaves it
+ *	Exact for a new track, after edits it may still reach out to where points used to be
+ */
+void getCoasterBounds(Coaster* coaster, Vector3* min, Vector3* max)
 {
-	numberOfControlPoints = 0;
-	allocatedControlPoints = DEFAULT_NUMBER_OF_POINTS;
-	controlPoints = calloc(allocatedControlPoints, sizeof(ControlPoint));
-
-	defaultCoaster();
-
+	*min = coaster->boundsMin;
+	*max = coaster->boundsMax;
 }
 
-static void defaultCoaster()
+/* The train the camera rides and the player boosts */
+static const Train* getRiddenTrain(const Coaster* coaster)
 {
-	controlPoints[0].position.x = 0;
-	controlPoints[0].position.y = 4;
-	controlPoints[0].position.z = 10;
-	controlPoints[0].isChain = 1;
-
-	controlPoints[1].position.x = -12;
-	controlPoints[1].position.y = 5;
-	controlPoints[1].position.z = 10;
-	controlPoints[1].isChain = 1;
-
-	controlPoints[2].position.x = -16;
-	controlPoints[2].position.y = 6;
-	controlPoints[2].position.z = 2;
-	controlPoints[2].isChain = 1;
+	if(coaster->operated)
+		return &(coaster->operation.trains[0].train);
+	return &(coaster->train);
+}
 
-	controlPoints[3].position.x = -16;
-	controlPoints[3].position.y = 7;
-	controlPoints[3].position.z = -4;
-	controlPoints[3].isChain = 1;
+Vector3 getCoasterPosition(const Coaster* coaster)
+{
+	return addVector3(&(coaster->origin), &(getRiddenTrain(coaster)->position));
+}
 
-	controlPoints[4].position.x = -16;
-	controlPoints[4].position.y = 8;
-	controlPoints[4].position.z = -12;
-	controlPoints[4].isChain = 1;
+TrackFrame getCoasterFrame(const Coaster* coaster)
+{
+	return getRiddenTrain(coaster)->frame;
+}
 
-	controlPoints[5].position.x = -10;
-	controlPoints[5].position.y = 9;
-	controlPoints[5].position.z = -18;
-	controlPoints[5].isChain = 1;
+/*	Fingerprints the simulation state, two runs fed the same input must end with the same checksum
+ *	Coasters are chained by passing in the last one's hash, starting from HASH_SEED
+ */
+unsigned long long checksumRollerCoaster(Coaster* coaster, unsigned long long hash)
+{
+	hash = hashBytes(hash, &(coaster->trackState), sizeof(coaster->trackState));
+	hash = hashBytes(hash, &(coaster->selectedPoint), sizeof(coaster->selectedPoint));
+	hash = hashBytes(hash, coaster->selection, coaster->selectionCount * sizeof(int));
+	hash = hashBytes(hash, compactControlPoints(&(coaster->controlPoints)), coaster->numberOfControlPoints * sizeof(ControlPoint));
+	hash = hashBytes(hash, &(getRiddenTrain(coaster)->position), sizeof(Vector3));
+	hash = hashBytes(hash, &(getRiddenTrain(coaster)->velocity), sizeof(float));
+
+	for(int i = 1; coaster->operated && i < coaster->operation.numberOfTrains; i++) {
+		hash = hashBytes(hash, &(coaster->operation.trains[i].train.position), sizeof(Vector3));
+		hash = hashBytes(hash, &(coaster->operation.trains[i].status), sizeof(TrainStatus));
+	}
 
-	controlPoints[6].position.x = -6;
-	controlPoints[6].position.y = 9.5;
-	controlPoints[6].position.z = -18;
+	return hash;
+}
 
-	controlPoints[6].position.x = 0;
-	controlPoints[6].position.y = 9.5;
-	controlPoints[6].position.z = -18;
+static void generateControlPoints(Coaster* coaster)
+{
+	initControlPointBuffer(&(coaster->controlPoints), DEFAULT_NUMBER_OF_POINTS);
 
+	if(!loadCoaster(coaster) && !proceduralCoaster(coaster))
+		defaultCoaster(coaster);
+	initHistory(&(coaster->history), &(coaster->controlPoints), coaster->selectedPoint, coaster->settings.undoMemoryLimit);
 
-	controlPoints[7].position.x = 10;
-	controlPoints[7].position.y = 7.5;
-	controlPoints[7].position.z = -18;
+	measureCoasterBounds(coaster);
+	logPointEdit(coaster, 0, coaster->numberOfControlPoints);
 
-	controlPoints[8].position.x = 16;
-	controlPoints[8].position.y = 7;
-	controlPoints[8].position.z = -12;
+}
 
-	controlPoints[9].position.x = 10;
-	controlPoints[9].position.y = 6;
-	controlPoints[9].position.z = -6;
+/* Loads the control points from the track file, returns 0 if there isn't one to load */
+static int loadCoaster(Coaster* coaster)
+{
+	if(coaster->settings.trackPath == NULL)
+		return 0;
+
+	int count;
+	ControlPoint* points = loadTrackFile(coaster->settings.trackPath, &count);
+	if(points == NULL) {
+		printf("Could not load %s, starting from a new track\n", coaster->settings.trackPath);
+		return 0;
+	}
 
-	controlPoints[10].position.x = 4;
-	controlPoints[10].position.y = 7;
-	controlPoints[10].position.z = -14;
+	memcpy(appendControlPoints(&(coaster->controlPoints), count), points, count * sizeof(ControlPoint));
+	coaster->numberOfControlPoints = count;
 
-	controlPoints[11].position.x = -10;
-	controlPoints[11].position.y = 5.5;
-	controlPoints[11].position.z = -12;
+	free(points);
+	return 1;
+}
 
-	controlPoints[12].position.x = -2;
-	controlPoints[12].position.y = 5;
-	controlPoints[12].position.z = -8;
+/* Generates the starting track if one was asked for, returns 0 if not */
+static int proceduralCoaster(Coaster* coaster)
+{
+	if(coaster->settings.proceduralPoints == 0)
+		return 0;
 
-	controlPoints[12].position.x = 4;
-	controlPoints[12].position.y = 4.5;
-	controlPoints[12].position.z = -4;
+	if(coaster->settings.proceduralPoints < MIN_PROCEDURAL_POINTS) {
+		printf("Generated tracks need at least %d points, starting from the default track\n", MIN_PROCEDURAL_POINTS);
+		return 0;
+	}
 
-	controlPoints[13].position.x = 10;
-	controlPoints[13].position.y = 4;
-	controlPoints[13].position.z = 2;
+	generateProceduralTrack(appendControlPoints(&(coaster->controlPoints), coaster->settings.proceduralPoints), coaster->settings.proceduralPoints, coaster->settings.proceduralSeed);
 
-	controlPoints[14].position.x = 10;
-	controlPoints[14].position.y = 4;
-	controlPoints[14].position.z = 10;
+	coaster->numberOfControlPoints = coaster->settings.proceduralPoints;
+	return 1;
+}
 
-	numberOfControlPoints = 15;
+static void defaultCoaster(Coaster* coaster)
+{
+	getDefaultCoaster(appendControlPoints(&(coaster->controlPoints), DEFAULT_COASTER_POINTS));
+	coaster->numberOfControlPoints = DEFAULT_COASTER_POINTS;
 }
 
-void updateRollerCoaster()
+/*	Steps the coaster by one tick. Only the coaster taking input may touch input[], the rest can be
+ *	updated in parallel with it and each other
+ */
+void updateRollerCoaster(Coaster* coaster, int takesInput)
 {
-	if(trackState == Constructing)
-		takeInput();
+	if(takesInput && input[Overlay])
+	{
+		input[Overlay]--;
+		coaster->showOverlay = !coaster->showOverlay;
+	}
+
+	if(coaster->trackState == Constructing && takesInput)
+		takeInput(coaster);
 
-	else if(trackState == Generating)
-		generateTrack();
+	else if(coaster->trackState == Generating)
+		finishTrack(coaster);
 
-	else if (trackState == Ready)
+	else if (coaster->trackState == Ready)
 	{
-		moveCoaster();
-		if(input[FinishTrack])
+		moveCoaster(coaster, takesInput);
+		if(takesInput && input[FinishTrack])
 		{
-			input[FinishTrack] = 0;
-			trackState = Constructing;
+			input[FinishTrack]--;
+			coaster->trackState = Constructing;
 		}
 	}
 }
 
-static void generateTrack()
+/* Generates the track from the control points, hands its mesh to the renderer and puts the train at the start */
+static void finishTrack(Coaster* coaster)
 {
-	if(trackSections == NULL)
-		trackSections = calloc(numberOfControlPoints, sizeof(TrackSection));
-	else
-		trackSections = realloc(trackSections, sizeof(TrackSection) * numberOfControlPoints);
+	generateTrack(&(coaster->track), compactControlPoints(&(coaster->controlPoints)), coaster->numberOfControlPoints);
 
-	Vector3 first;
+	if(coaster->settings.trackPath != NULL && !saveTrackFile(coaster->settings.trackPath, coaster->track.points, coaster->track.numberOfPoints))
+		printf("Could not save the track to %s\n", coaster->settings.trackPath);
 
-	//=====TRACK SECTION GENERATION
+	freeClearanceReport(coaster->clearanceReport);
+	coaster->clearanceReport = checkTrackClearance(&(coaster->track), TRACK_CLEARANCE, TRACK_CLEARANCE_NEIGHBOUR_LENGTH);
+	reportClearance(coaster);
 
-	for(int k = 0; k < numberOfControlPoints; k++)
-	{
-		trackSections[k].isChain = controlPoints[k].isChain;
+	freeRideAnalytics(coaster->rideAnalytics);
+	coaster->rideAnalytics = analyzeRide(&(coaster->track));
+	reportRideAnalytics(coaster);
 
-		int subSectionIndex = 0;
-		for(float u = 0.0f; u < 1; u += (1.0 / NUMBER_OF_SUB_SECTIONS))
-		{
-			//Calculate new point
-			Vector3 newPoint = qFunction(u, k);
+	//Hand the rail geometry over to the render thread, dropping any mesh it never got around to
+	TrackMesh* oldMesh = atomic_exchange(&(coaster->pendingMesh), generateTrackMesh(coaster));
+	if(oldMesh != NULL)
+		freeTrackMesh(oldMesh);
 
-			//Save first point for later
-			if(k == 0 && subSectionIndex == 0)
-				first = newPoint;
+	resetTrain(&(coaster->train), &(coaster->track), coaster->settings.numberOfCars);
 
-			//Assign as start of section
-			trackSections[k].subSections[subSectionIndex].subSectionStart = newPoint;
+	if(coaster->operated)
+		freeOperation(&(coaster->operation));
+	coaster->operated = 0;
 
-			//Assign this point as the end of the previous section and calculate the length
-			if(subSectionIndex - 1 >= 0){
-				trackSections[k].subSections[subSectionIndex - 1].subSectionEnd = newPoint;
-				calculateSubSectionLength(&(trackSections[k].subSections[subSectionIndex - 1]));
-			}
-			else if (k - 1 >= 0){
-				trackSections[k - 1].subSections[NUMBER_OF_SUB_SECTIONS - 1].subSectionEnd = newPoint;
-				calculateSubSectionLength(&(trackSections[k - 1].subSections[NUMBER_OF_SUB_SECTIONS - 1]));
-			}
+	if(coaster->settings.numberOfTrains > 1)
+	{
+		OperationSettings operationSettings;
+		getDefaultOperationSettings(&operationSettings);
+		operationSettings.numberOfTrains = coaster->settings.numberOfTrains;
+		operationSettings.numberOfCars = coaster->settings.numberOfCars;
+		operationSettings.seed = coaster->settings.proceduralSeed;
 
-			subSectionIndex++;
-		}
+		coaster->operated = initOperation(&(coaster->operation), &(coaster->track), &operationSettings);
 	}
 
-	//Assign first point as the last point and calculate length
-	trackSections[numberOfControlPoints - 1].subSections[NUMBER_OF_SUB_SECTIONS - 1].subSectionEnd = first;
-	calculateSubSectionLength(&(trackSections[numberOfControlPoints - 1].subSections[NUMBER_OF_SUB_SECTIONS - 1]));
+	coaster->trackState = Ready;
+}
 
-	//=====END TRACK SECTION GENERATION
 
+/*	Finds the closest point on the generated track within maxDistance, both in park space
+ *	Returns the index of the subsection it lies on, or -1 if there's no track that close
+ */
+int findClosestTrackPoint(const Coaster* coaster, const Vector3* point, float maxDistance, Vector3* closest)
+{
+	if(coaster->track.bvh == NULL || coaster->trackState != Ready)
+		return -1;
 
+	Vector3 localPoint = minusVector3(point, &(coaster->origin));
+	int subSection = bvhClosestPoint(coaster->track.bvh, &localPoint, maxDistance, closest, NULL);
 
-	//=====RAIL VERTEX GENERATION
-	float vertexsNeeded = numberOfControlPoints * NUMBER_OF_SUB_SECTIONS * 2;
-	if(leftRail.topVerts == NULL)
-		leftRail.topVerts = calloc(vertexsNeeded, sizeof(Vector3));
-	else
-		leftRail.topVerts = realloc(leftRail.topVerts, vertexsNeeded * sizeof(Vector3));
+	if(subSection != -1 && closest != NULL)
+		*closest = addVector3(closest, &(coaster->origin));
 
-	if(leftRail.bottomVerts == NULL)
-		leftRail.bottomVerts = calloc(vertexsNeeded, sizeof(Vector3));
-	else
-		leftRail.bottomVerts = realloc(leftRail.bottomVerts, vertexsNeeded * sizeof(Vector3));
+	return subSection;
+}
 
-	if(rightRail.topVerts == NULL)
-		rightRail.topVerts = calloc(vertexsNeeded, sizeof(Vector3));
-	else
-		rightRail.topVerts = realloc(rightRail.topVerts, vertexsNeeded * sizeof(Vector3));
 
-	if(rightRail.bottomVerts == NULL)
-		rightRail.bottomVerts = calloc(vertexsNeeded, sizeof(Vector3));
-	else
-		rightRail.bottomVerts = realloc(rightRail.bottomVerts, vertexsNeeded * sizeof(Vector3));
+static int compareClearancePairs(const void* a, const void* b)
+{
+	const ClearancePair* first = a;
+	const ClearancePair* second = b;
 
+	if(first->first != second->first)
+		return first->first - second->first;
+	return first->second - second->second;
+}
 
-	int vertIndex = 0;
-	for(int i = 0; i < numberOfControlPoints; i++)
-	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
-		{
-			
-			//Calculate forward
-			Vector3 currentPoint = trackSections[i].subSections[j].subSectionStart;
-			Vector3 nextPoint = trackSections[i].subSections[j].subSectionEnd;
-			Vector3 forward = minusVector3(&nextPoint, &currentPoint);
+/* Prints the track sections that are too close, merging the subsection pairs found between each two sections */
+static void reportClearance(Coaster* coaster)
+{
+	if(coaster->clearanceReport->numberOfPairs == 0) {
+		printf("Track clearance ok (%.1f ms)\n", coaster->clearanceReport->seconds * 1000);
+		return;
+	}
 
-			Vector3 right = crossProductVector3(&forward, &up);
-			right = NormalizeVector3(&right);
-			right = multiplyVector3(&right, 0.25);
-			
+	ClearancePair* sectionPairs = malloc(coaster->clearanceReport->numberOfPairs * sizeof(ClearancePair));
+	for(int i = 0; i < coaster->clearanceReport->numberOfPairs; i++)
+	{
+		sectionPairs[i] = coaster->clearanceReport->pairs[i];
+		sectionPairs[i].first /= NUMBER_OF_SUB_SECTIONS;
+		sectionPairs[i].second /= NUMBER_OF_SUB_SECTIONS;
+	}
+	qsort(sectionPairs, coaster->clearanceReport->numberOfPairs, sizeof(ClearancePair), compareClearancePairs);
 
-			Vector3 rightRailCenter;
-			Vector3 leftRailCenter;
+	int numberOfSectionPairs = 0;
+	for(int i = 0; i < coaster->clearanceReport->numberOfPairs; i++)
+	{
+		ClearancePair* last = &sectionPairs[numberOfSectionPairs - 1];
 
+		if(numberOfSectionPairs > 0 && compareClearancePairs(last, &sectionPairs[i]) == 0) {
+			if(sectionPairs[i].distance < last->distance)
+				last->distance = sectionPairs[i].distance;
+		}
+		else
+			sectionPairs[numberOfSectionPairs++] = sectionPairs[i];
+	}
 
-			rightRailCenter = addVector3(&currentPoint, &right);
-			leftRailCenter = minusVector3(&currentPoint, &right);
-			
-			
+	printf("Track clearance: %d pairs of sections closer than %.2f (%.1f ms)\n", numberOfSectionPairs, TRACK_CLEARANCE, coaster->clearanceReport->seconds * 1000);
 
-			right = multiplyVector3(&right, 0.2);
-			Vector3 left = multiplyVector3(&right, -1);
+	for(int i = 0; i < numberOfSectionPairs && i < MAX_REPORTED_CLEARANCE_PAIRS; i++)
+		printf("  sections %d and %d are %.2f apart\n", sectionPairs[i].first, sectionPairs[i].second, sectionPairs[i].distance);
 
+	if(numberOfSectionPairs > MAX_REPORTED_CLEARANCE_PAIRS)
+		printf("  and %d more\n", numberOfSectionPairs - MAX_REPORTED_CLEARANCE_PAIRS);
 
-		
-			leftRail.topVerts[vertIndex] = addVector3(&leftRailCenter, &left);
-			rightRail.topVerts[vertIndex] = addVector3(&rightRailCenter, &left);
+	free(sectionPairs);
+}
 
-			vertIndex++;
 
-			leftRail.topVerts[vertIndex] = addVector3(&leftRailCenter, &right);
-			rightRail.topVerts[vertIndex] = addVector3(&rightRailCenter, &right);
-			
-			Vector3 down;
-			down.x = 0;
-			down.z = 0;
-			down.y = -0.1f;
+/* Prints a summary of the ride and writes the full analysis out if asked to */
+static void reportRideAnalytics(Coaster* coaster)
+{
+	printf("Ride: vertical %.2f to %.2f g, lateral %.2f g, jerk %.1f g/s, %d airtime regions totalling %.1f s (%.1f ms)\n",
+		coaster->rideAnalytics->minVerticalG, coaster->rideAnalytics->maxVerticalG, coaster->rideAnalytics->maxLateralG, coaster->rideAnalytics->maxJerk,
+		coaster->rideAnalytics->numberOfAirtimeRegions, coaster->rideAnalytics->airtime, coaster->rideAnalytics->seconds * 1000);
 
-			leftRail.bottomVerts[vertIndex - 1] = addVector3(&(leftRail.topVerts[vertIndex - 1]), &down);
-			rightRail.bottomVerts[vertIndex - 1] = addVector3(&(rightRail.topVerts[vertIndex - 1]), &down);
+	if(coaster->settings.analyticsPath != NULL && !writeRideAnalytics(coaster->rideAnalytics, coaster->settings.analyticsPath))
+		printf("Could not write ride analytics to %s\n", coaster->settings.analyticsPath);
+}
 
-			leftRail.bottomVerts[vertIndex] = addVector3(&(leftRail.topVerts[vertIndex]), &down);
-			rightRail.bottomVerts[vertIndex] = addVector3(&(rightRail.topVerts[vertIndex]), &down);
+/* Blue under 0g where riders float, green at 1g, red from OVERLAY_MAX_G up */
+static Vector3 gForceColour(float verticalG)
+{
+	Vector3 colour;
 
-			vertIndex++;
+	if(verticalG < 0) {
+		colour.x = 0;
+		colour.y = 0.3f;
+		colour.z = 1;
+	}
+	else if(verticalG < 1) {
+		colour.x = 0;
+		colour.y = 0.3f + (0.7f * verticalG);
+		colour.z = 1 - verticalG;
+	}
+	else {
+		float amount = (verticalG - 1) / (OVERLAY_MAX_G - 1);
+		if(amount > 1)
+			amount = 1;
+
+		colour.x = amount;
+		colour.y = 1 - amount;
+		colour.z = 0;
+	}
 
-		}
+	return colour;
+}
 
+/* Samples the rails and copies the section data needed to draw the finished track */
+static TrackMesh* generateTrackMesh(Coaster* coaster)
+{
+	TrackMesh* mesh = malloc(sizeof(TrackMesh));
+	mesh->numberOfSections = coaster->track.numberOfPoints;
+	mesh->isChain = malloc(coaster->track.numberOfPoints * sizeof(int));
+	mesh->centerline = malloc(coaster->track.numberOfPoints * NUMBER_OF_SUB_SECTIONS * sizeof(Vector3));
+	mesh->supportBottoms = malloc(coaster->track.numberOfPoints * sizeof(float));
+	mesh->tooClose = calloc(coaster->track.numberOfPoints * NUMBER_OF_SUB_SECTIONS, 1);
+	mesh->overlayColours = malloc(coaster->track.numberOfPoints * NUMBER_OF_SUB_SECTIONS * sizeof(Vector3));
+
+	for(int i = 0; i < coaster->rideAnalytics->numberOfSamples; i++)
+		mesh->overlayColours[i] = gForceColour(coaster->rideAnalytics->verticalG[i]);
+
+	for(int i = 0; i < coaster->clearanceReport->numberOfPairs; i++)
+	{
+		mesh->tooClose[coaster->clearanceReport->pairs[i].first] = 1;
+		mesh->tooClose[coaster->clearanceReport->pairs[i].second] = 1;
 	}
 
+	for(int i = 0; i < coaster->track.numberOfPoints; i++)
+	{
+		mesh->isChain[i] = coaster->track.sections[i].isChain;
 
+		for(int j = 0; j < NUMBER_OF_SUB_SECTIONS; j++)
+			mesh->centerline[(i * NUMBER_OF_SUB_SECTIONS) + j] = coaster->track.sections[i].subSections[j].subSectionStart;
+
+		//Supports stand on the ground under them, which is in park space
+		mesh->supportBottoms[i] = SUPPORT_BOTTOM;
+		if(coaster->settings.heightmap != NULL)
+		{
+			const Vector3* start = &(mesh->centerline[i * NUMBER_OF_SUB_SECTIONS]);
+			mesh->supportBottoms[i] = getHeightmapHeight(coaster->settings.heightmap, coaster->origin.x + start->x, coaster->origin.z + start->z) - coaster->origin.y;
+		}
+	}
 
-	//=====END RAIL VERTEX GENERATION
 
-	coasterPosition = trackSections[0].subSections[0].subSectionStart;
-	trackState = Ready;
+	//One sample past the end closes the loop for the shaders
+	int numberOfSubSections = coaster->track.numberOfPoints * NUMBER_OF_SUB_SECTIONS;
+	mesh->railSamples = malloc((numberOfSubSections + 1) * sizeof(RailSample));
 
-	t = 1;
-	currentTrackIndex = 0;
-	currentSubSectionIndex = 0;
+	for(int i = 0; i <= numberOfSubSections; i++)
+	{
+		const TrackSubSection* subSection = &(coaster->track.sections[(i % numberOfSubSections) / NUMBER_OF_SUB_SECTIONS].subSections[i % NUMBER_OF_SUB_SECTIONS]);
+		RailSample* sample = &(mesh->railSamples[i]);
 
-	coasterVelocity = COASTER_START_SPEED;
+		sample->position = subSection->subSectionStart;
+		sample->tangent = subSection->frame.tangent;
+		sample->normal = subSection->frame.normal;
+		sample->overlayColour = mesh->overlayColours[i % numberOfSubSections];
+	}
 
-	generateTrackDisplayList();
+	return mesh;
 }
 
-static void generateTrackDisplayList()
+static void freeTrackMesh(TrackMesh* mesh)
 {
-	trackList = glGenLists(1);
-
-	glNewList(trackList, GL_COMPILE);
+	free(mesh->isChain);
+	free(mesh->centerline);
+	free(mesh->supportBottoms);
+	free(mesh->tooClose);
+	free(mesh->overlayColours);
 
-	drawFinishedTrack();
+	free(mesh->railSamples);
 
-	glEndList();
+	free(mesh);
 }
 
-/* Calculates the length of a subsection of track */
-static void calculateSubSectionLength(TrackSubSection* subSection)
+/*	Compiles the track and its overlay into display lists, must be called from the render thread
+ *	With shaders the rails and supports are uploaded for them to extrude instead, the overlay along with them
+ */
+static void generateTrackDisplayList(Coaster* coaster, TrackMesh* mesh)
 {
-	Vector3 difference = minusVector3(&(subSection->subSectionEnd), &(subSection->subSectionStart));
-	float length = magnitudeVector3(&difference);
+	if(coaster->trackList != 0)
+		glDeleteLists(coaster->trackList, 1);
+	if(coaster->overlayList != 0)
+		glDeleteLists(coaster->overlayList, 1);
+	coaster->overlayList = 0;
 
-	subSection->subSectionLength = length;
-}
+	coaster->trackList = glGenLists(1);
 
+	glNewList(coaster->trackList, GL_COMPILE);
 
-/* Moves the coaster and handles physics */
-static void moveCoaster()
-{
-	if(input[Boost])
-		coasterVelocity += BOOST_STRENGTH;
+	drawFinishedTrack(mesh);
 
-	if(trackSections[currentTrackIndex].isChain)
-		if(coasterVelocity < CHAIN_LIFT_SPEED)
-			coasterVelocity = CHAIN_LIFT_SPEED;
+	glEndList();
 
+	if(hasTrackShaders())
+	{
+		uploadTrackBuffers(&(coaster->trackBuffers), mesh->railSamples, mesh->numberOfSections * NUMBER_OF_SUB_SECTIONS,
+			mesh->supportBottoms, NUMBER_OF_SUB_SECTIONS);
+		return;
+	}
 
-	float deltaT = (0.016 * coasterVelocity) / trackSections[currentTrackIndex].subSections[currentSubSectionIndex].subSectionLength;
+	coaster->overlayList = glGenLists(1);
 
-	t += deltaT;
+	glNewList(coaster->overlayList, GL_COMPILE);
 
-	while(t < 0 || t >= 1)
-	{
-		if (t >= 1)
-		{
-			//Select next track piece
-			currentSubSectionIndex++;
-			if (currentSubSectionIndex >= NUMBER_OF_SUB_SECTIONS)
-			{
-				currentSubSectionIndex = 0;
-				currentTrackIndex++;
+	drawOverlay(mesh);
 
-				if(currentTrackIndex >= numberOfControlPoints)
-					currentTrackIndex = 0;
-			}
+	glEndList();
+}
 
-			//Update lerp start position
-			startPos = trackSections[currentTrackIndex].subSections[currentSubSectionIndex].subSectionStart;
-			endPos = trackSections[currentTrackIndex].subSections[currentSubSectionIndex].subSectionEnd;
 
-			//Update t and account for section switch in movement
-			t -= 1;
-			float percentOfTimeOnNextPiece = t / deltaT;
+/* Moves the coaster and handles physics */
+static void moveCoaster(Coaster* coaster, int takesInput)
+{
+	int boost = takesInput ? input[Boost] : 0;
 
-			deltaT = (0.016 * coasterVelocity) / trackSections[currentTrackIndex].subSections[currentSubSectionIndex].subSectionLength;
-			t = deltaT * percentOfTimeOnNextPiece;
-		}
-		else if(t < 0)
-		{
-			//Select previous track piece
-			currentSubSectionIndex--;
-			if (currentSubSectionIndex < 0)
-			{
-				currentSubSectionIndex = NUMBER_OF_SUB_SECTIONS - 1;
-				currentTrackIndex--;
+	if(coaster->operated)
+		stepOperation(&(coaster->operation), boost);
+	else
+		stepTrain(&(coaster->train), &(coaster->track), boost);
 
-				if(currentTrackIndex < 0)
-					currentTrackIndex = numberOfControlPoints - 1;
-			}
+	//Telemetry follows the coaster being ridden
+	if(takesInput && isTelemetryActive())
+		recordCoasterTelemetry(coaster, boost);
+}
 
-			//Update lerp positions
-			startPos = trackSections[currentTrackIndex].subSections[currentSubSectionIndex].subSectionStart;
-			endPos = trackSections[currentTrackIndex].subSections[currentSubSectionIndex].subSectionEnd;
+static void recordCoasterTelemetry(Coaster* coaster, int boost)
+{
+	TelemetrySample sample;
+	const Train* train = getRiddenTrain(coaster);
+
+	sample.tick = getInputTick();
+	sample.trackIndex = train->sectionIndex;
+	sample.subSectionIndex = train->subSectionIndex;
+	sample.flags = 0;
+	if(coaster->track.sections[train->sectionIndex].isChain)
+		sample.flags |= TELEMETRY_CHAIN;
+	if(boost)
+		sample.flags |= TELEMETRY_BOOST;
+
+	sample.distance = train->distance;
+	sample.position = train->position;
+	sample.velocity = train->velocity;
+
+	recordTelemetry(&sample);
+}
 
-			//Update t and account for section switch in movement
-			t += 1;
-			float percentOfTimeOnNextPiece = (1 - t) / deltaT;
+/* Copies the coaster state the renderer needs, called from the simulation thread */
+void snapshotRollerCoaster(Coaster* coaster, CoasterSnapshot* snapshot)
+{
+	snapshot->trackState = coaster->trackState;
+	snapshot->selectedPoint = coaster->selectedPoint;
+	//Trains still waiting to be added to the track aren't drawn
+	snapshot->numberOfTrains = 0;
+	for(int i = 0; i < (coaster->operated ? coaster->operation.numberOfTrains : 1); i++)
+	{
+		const Train* train = coaster->operated ? &(coaster->operation.trains[i].train) : &(coaster->train);
+		if(coaster->operated && coaster->operation.trains[i].status == TrainStored)
+			continue;
 
-			deltaT = (0.016 * coasterVelocity) / trackSections[currentTrackIndex].subSections[currentSubSectionIndex].subSectionLength;
-			t = 1 - (deltaT * percentOfTimeOnNextPiece);
+		for(int j = 0; j < train->numberOfCars; j++)
+		{
+			snapshot->carPositions[snapshot->numberOfTrains][j] = train->cars[j].position;
+			snapshot->carFrames[snapshot->numberOfTrains][j] = train->cars[j].frame;
 		}
+		snapshot->numberOfCars = train->numberOfCars;
+		snapshot->numberOfTrains++;
 	}
+	snapshot->coasterVelocity = getRiddenTrain(coaster)->velocity;
+	snapshot->showOverlay = coaster->showOverlay;
 
+	snapshot->boxSelecting = coaster->boxSelecting;
+	snapshot->boxStartX = coaster->boxStartX;
+	snapshot->boxStartY = coaster->boxStartY;
+	snapshot->boxEndX = input[CursorX];
+	snapshot->boxEndY = input[CursorY];
 
+	if(snapshot->editVersion == coaster->editVersion)
+		return;
 
-	//Move Coaster
-	float u = (t / NUMBER_OF_SUB_SECTIONS) + currentSubSectionIndex * (1.0 / NUMBER_OF_SUB_SECTIONS);
-
-	coasterPosition = qFunction(u, currentTrackIndex);
-	
+	if(snapshot->allocatedSelection < coaster->selectionCount)
+	{
+		snapshot->allocatedSelection = coaster->allocatedSelection;
+		snapshot->selection = realloc(snapshot->selection, coaster->allocatedSelection * sizeof(int));
+	}
 
-	
+	if(coaster->selectionCount > 0)
+		memcpy(snapshot->selection, coaster->selection, coaster->selectionCount * sizeof(int));
+	snapshot->selectionCount = coaster->selectionCount;
 
-	//Physics
-	//Determine the slope of the current track section and use it to apply gravity
-	Vector3 subSectionVector = minusVector3(&endPos, &startPos);
+	if(snapshot->allocatedControlPoints < coaster->numberOfControlPoints)
+	{
+		snapshot->allocatedControlPoints = coaster->controlPoints.capacity;
+		snapshot->controlPoints = realloc(snapshot->controlPoints, coaster->controlPoints.capacity * sizeof(ControlPoint));
+	}
 
-	float hypotenuse = trackSections[currentTrackIndex].subSections[currentSubSectionIndex].subSectionLength;
-	float opposite = subSectionVector.y;
+	//Only the points edited since this snapshot last caught up, unless it is too far behind to know which
+	int copyStart = 0;
+	int copyEnd = coaster->numberOfControlPoints;
+	if(coaster->pointVersion - snapshot->pointVersion <= POINT_EDIT_LOG_SIZE)
+	{
+		copyStart = copyEnd;
+		copyEnd = 0;
+		for(unsigned int version = snapshot->pointVersion + 1; version != coaster->pointVersion + 1; version++)
+		{
+			if(coaster->editedStarts[version % POINT_EDIT_LOG_SIZE] < copyStart)
+				copyStart = coaster->editedStarts[version % POINT_EDIT_LOG_SIZE];
+			if(coaster->editedEnds[version % POINT_EDIT_LOG_SIZE] > copyEnd)
+				copyEnd = coaster->editedEnds[version % POINT_EDIT_LOG_SIZE];
+		}
+		if(copyEnd > coaster->numberOfControlPoints)
+			copyEnd = coaster->numberOfControlPoints;
+	}
 
-	float angle = asin( opposite / hypotenuse);
-	float slopeStrength = sin(angle);
+	copyControlPoints(&(coaster->controlPoints), copyStart, copyEnd, snapshot->controlPoints);
+	snapshot->numberOfControlPoints = coaster->numberOfControlPoints;
+	snapshot->editVersion = coaster->editVersion;
+	snapshot->pointVersion = coaster->pointVersion;
+
+	//The spline stays inside the box its control points span, so only the rails, train and supports need adding
+	Vector3 margin = {TRACK_BOUNDS_MARGIN, TRACK_BOUNDS_MARGIN, TRACK_BOUNDS_MARGIN};
+	getCoasterBounds(coaster, &(snapshot->boundsMin), &(snapshot->boundsMax));
+	snapshot->boundsMin = minusVector3(&(snapshot->boundsMin), &margin);
+	snapshot->boundsMax = addVector3(&(snapshot->boundsMax), &margin);
+	float supportBottom = SUPPORT_BOTTOM;
+	if(coaster->settings.heightmap != NULL)
+		supportBottom = coaster->settings.heightmap->minHeight - coaster->origin.y;
+	if(snapshot->boundsMin.y > supportBottom)
+		snapshot->boundsMin.y = supportBottom;
+
+	snapshot->origin = coaster->origin;
+	snapshot->boundsMin = addVector3(&(snapshot->boundsMin), &(coaster->origin));
+	snapshot->boundsMax = addVector3(&(snapshot->boundsMax), &(coaster->origin));
+}
 
-	float deltaV = 0.016 * (GRAVITY * slopeStrength);
-	coasterVelocity += deltaV;
+/*	Draws a snapshot of the coaster, called from the render thread
+ *	Nothing is drawn if the coaster is entirely outside the frustum, pass NULL to always draw it
+ */
+void drawRollerCoaster(Coaster* coaster, const CoasterSnapshot* snapshot, const Frustum* frustum)
+{
+	//Compile any newly generated track before drawing, even if it can't be seen yet
+	TrackMesh* mesh = atomic_exchange(&(coaster->pendingMesh), NULL);
+	if(mesh != NULL)
+	{
+		generateTrackDisplayList(coaster, mesh);
+		freeTrackMesh(mesh);
+	}
 
+	if(snapshot->trackState == Constructing && snapshot->boxSelecting)
+	{
+		beginRenderPass(PassHud);
+		drawSelectionBox(snapshot);
+		endRenderPass();
+	}
 
-	//A super simple friction model
-	coasterVelocity = coasterVelocity * (1 - FRICTION_COEFFICIENT);
-}
+	if(frustum != NULL && !isBoxInFrustum(frustum, &(snapshot->boundsMin), &(snapshot->boundsMax)))
+		return;
 
-void drawRollerCoaster()
-{
-	if (trackState == Constructing)
-		drawControlPoints();
+	glPushMatrix();
+	glTranslateVector3(&(snapshot->origin));
 
-	else if (trackState == Ready)
+	if (snapshot->trackState == Constructing)
+	{
+		beginRenderPass(PassPreview);
+		drawControlPoints(snapshot);
+		endRenderPass();
+	}
+	else if (snapshot->trackState == Ready && coaster->trackList != 0)
 	{
-		drawTrain();
-		glCallList(trackList);
-		//drawFinishedTrack();
+		beginRenderPass(PassTrain);
+		for(int i = 0; i < snapshot->numberOfTrains; i++)
+			drawTrain(snapshot, i);
+		endRenderPass();
+
+		beginRenderPass(PassTrack);
+		drawTrackRails(&(coaster->trackBuffers), 0);
+		drawTrackSupports(&(coaster->trackBuffers));
+		glCallList(coaster->trackList);
+
+		if(snapshot->showOverlay && coaster->overlayList != 0)
+			glCallList(coaster->overlayList);
+		else if(snapshot->showOverlay)
+			drawTrackRails(&(coaster->trackBuffers), 1);
+		endRenderPass();
 	}
+
+	glPopMatrix();
 }
 
 
-static void drawControlPoints()
+static void drawControlPoints(const CoasterSnapshot* snapshot)
 {
+	const ControlPoint* controlPoints = snapshot->controlPoints;
+	int numberOfControlPoints = snapshot->numberOfControlPoints;
+
 	for(int i = 0; i < numberOfControlPoints; i++)
 	{
 		glPushMatrix();
 
 		glTranslateVector3(&(controlPoints[i].position));
 
-		if (selectedPoint == i)
+		if (snapshot->selectedPoint == i)
 			drawSquare(0.5);
 		else
 			drawSquare(0.22);
@@ -523,6 +832,18 @@ static void drawControlPoints()
 		glPopMatrix();
 	}
 
+	//The rest of the selection is drawn over the top, a little smaller than the main selected point
+	for(int i = 0; i < snapshot->selectionCount; i++)
+	{
+		if(snapshot->selection[i] == snapshot->selectedPoint)
+			continue;
+
+		glPushMatrix();
+		glTranslateVector3(&(controlPoints[snapshot->selection[i]].position));
+		drawSquare(0.4);
+		glPopMatrix();
+	}
+
 	for(int i =0; i < numberOfControlPoints; i++)
 	{
 		glBegin(GL_LINES);
@@ -551,7 +872,7 @@ static void drawControlPoints()
 
 		for(float u = 0.0f; u < 1; u += 0.25f)
 		{
-			Vector3 point = qFunction(u, k);
+			Vector3 point = qFunction(controlPoints, numberOfControlPoints, u, k);
 			glVertexVector3(&point);
 		}	
 	}
@@ -560,353 +881,447 @@ static void drawControlPoints()
 
 }
 
-static void drawTrain()
+/* Outlines the box being dragged out, in window pixels over the top of the scene */
+static void drawSelectionBox(const CoasterSnapshot* snapshot)
 {
+	if(!snapshot->boxSelecting)
+		return;
+
+	int viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glMatrixMode(GL_PROJECTION);
 	glPushMatrix();
-		glTranslateVector3(&coasterPosition);
-		glColor3f(0.0f, 0.2f, 0.75f);
-		glutSolidSphere(0.25, 5, 5);
+	glLoadIdentity();
+	gluOrtho2D(0, viewport[2], viewport[3], 0);
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glDisable(GL_DEPTH_TEST);
+	glColor3f(1, 1, 1);
+	glBegin(GL_LINE_LOOP);
+		glVertex2i(snapshot->boxStartX, snapshot->boxStartY);
+		glVertex2i(snapshot->boxEndX, snapshot->boxStartY);
+		glVertex2i(snapshot->boxEndX, snapshot->boxEndY);
+		glVertex2i(snapshot->boxStartX, snapshot->boxEndY);
+	glEnd();
+	glEnable(GL_DEPTH_TEST);
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
 	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
 }
 
-static void drawFinishedTrack()
+/* Draws each car with a coupling back to the car behind it */
+static void drawTrain(const CoasterSnapshot* snapshot, int trainIndex)
 {
-	glColor3f(1.0f, 0.0f, 1.0f);
-	glLineWidth(2);
+	const Vector3* carPositions = snapshot->carPositions[trainIndex];
+	const TrackFrame* carFrames = snapshot->carFrames[trainIndex];
 
+	for(int i = 0; i < snapshot->numberOfCars; i++)
+		drawCar(&(carPositions[i]), &(carFrames[i]));
 
-	// RAILS ================================================
-	//TOP LEFT
-	glBegin(GL_QUAD_STRIP);
-	glColor3f(0.8f, 0.8f , 0.8f);
-	int vertIndex = 0;
-	for(int i = 0; i < numberOfControlPoints; i++)
+	glLineWidth(3);
+	glColor3f(0.2f, 0.2f, 0.2f);
+	glBegin(GL_LINES);
+	for(int i = 1; i < snapshot->numberOfCars; i++)
 	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
-		{
-			glVertexVector3(&(leftRail.topVerts[vertIndex]));
-			vertIndex++;
-			glVertexVector3(&(leftRail.topVerts[vertIndex]));
-			vertIndex++;
-		}
-	}
-
-	glVertexVector3(&(leftRail.topVerts[0]));
-	glVertexVector3(&(leftRail.topVerts[1]));
+		Vector3 front = multiplyVector3(&(carFrames[i].tangent), CAR_LENGTH / 2);
+		Vector3 back = multiplyVector3(&(carFrames[i - 1].tangent), -CAR_LENGTH / 2);
 
+		Vector3 coupling = addVector3(&(carPositions[i - 1]), &back);
+		glVertexVector3(&coupling);
+		coupling = addVector3(&(carPositions[i]), &front);
+		glVertexVector3(&coupling);
+	}
 	glEnd();
+}
 
+static void drawCar(const Vector3* position, const TrackFrame* frame)
+{
+	Vector3 right = getFrameBinormal(frame);
 
-	//TOP RIGHT
-	glBegin(GL_QUAD_STRIP);
-
-	vertIndex = 0;
-	for(int i = 0; i < numberOfControlPoints; i++)
-	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
-		{
-			glVertexVector3(&(rightRail.topVerts[vertIndex]));
-			vertIndex++;
-			glVertexVector3(&(rightRail.topVerts[vertIndex]));
-			vertIndex++;
-		}
-	}
-
-	glVertexVector3(&(rightRail.topVerts[0]));
-	glVertexVector3(&(rightRail.topVerts[1]));
+	//Columns are the car's right, up and forward axes
+	GLfloat orientation[16] = {
+		right.x, right.y, right.z, 0,
+		frame->normal.x, frame->normal.y, frame->normal.z, 0,
+		frame->tangent.x, frame->tangent.y, frame->tangent.z, 0,
+		0, 0, 0, 1
+	};
 
-	glEnd();
+	glPushMatrix();
+		glTranslateVector3(position);
+		glMultMatrixf(orientation);
+		glTranslatef(0, 0.15f, 0);
+		glScalef(0.5f, 0.25f, CAR_LENGTH);
+		glColor3f(0.0f, 0.2f, 0.75f);
+		drawUnitCube();
+	glPopMatrix();
+}
 
+static void drawFinishedTrack(const TrackMesh* mesh)
+{
+	int numberOfControlPoints = mesh->numberOfSections;
 
+	//Left to the shaders unless there are none
+	if(!hasTrackShaders())
+		drawRails(mesh);
 
-	//BOTTOM LEFT
-	glBegin(GL_QUAD_STRIP);
-	glColor3f(0.45f, 0.45f , 0.45f);
-	vertIndex = 0;
-	for(int i = 0; i < numberOfControlPoints; i++)
+	// CHAIN LIFT ==================
+	glLineWidth(1);
+	glColor3f(0,0,0);
+	for(int i=0; i<numberOfControlPoints; i++)
 	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
+		if(mesh->isChain[i])
 		{
-			glVertexVector3(&(leftRail.bottomVerts[vertIndex]));
-			vertIndex++;
-			glVertexVector3(&(leftRail.bottomVerts[vertIndex]));
-			vertIndex++;
+			glBegin(GL_LINE_STRIP);
+			for(int j=0; j < NUMBER_OF_SUB_SECTIONS; j++)
+			{
+				Vector3 point = mesh->centerline[(i * NUMBER_OF_SUB_SECTIONS) + j];
+				point.y -= 0.1;
+				glVertexVector3(&point);	
+			}
+			glEnd();
 		}
 	}
 
-	glVertexVector3(&(leftRail.bottomVerts[0]));
-	glVertexVector3(&(leftRail.bottomVerts[1]));
-
-	glEnd();
-
-
-	//BOTTOM RIGHT
-	glBegin(GL_QUAD_STRIP);
 
-	vertIndex = 0;
-	for(int i = 0; i < numberOfControlPoints; i++)
+	// CLEARANCE ==================
+	glLineWidth(6);
+	glColor3f(1, 0, 0);
+	glBegin(GL_LINES);
+	int numberOfSubSections = numberOfControlPoints * NUMBER_OF_SUB_SECTIONS;
+	for(int i = 0; i < numberOfSubSections; i++)
 	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
+		if(mesh->tooClose[i])
 		{
-			glVertexVector3(&(rightRail.bottomVerts[vertIndex]));
-			vertIndex++;
-			glVertexVector3(&(rightRail.bottomVerts[vertIndex]));
-			vertIndex++;
+			glVertexVector3(&(mesh->centerline[i]));
+			glVertexVector3(&(mesh->centerline[(i + 1) % numberOfSubSections]));
 		}
 	}
-
-	glVertexVector3(&(rightRail.bottomVerts[0]));
-	glVertexVector3(&(rightRail.bottomVerts[1]));
-
 	glEnd();
 
 
+}
 
+/* The rails as indexed meshes and the supports as lines, for drivers without shaders */
+static void drawRails(const TrackMesh* mesh)
+{
+	const RailProfile* profile = getRailProfile();
 
-	//LEFT LEFT
-	glBegin(GL_QUAD_STRIP);
-	glColor3f(0.65f, 0.65f , 0.65f);
-	vertIndex = 0;
-	for(int i = 0; i < numberOfControlPoints; i++)
-	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
-		{
-			glVertexVector3(&(leftRail.bottomVerts[vertIndex]));
-			glVertexVector3(&(leftRail.topVerts[vertIndex]));
-			vertIndex += 2;
-		}
-	}
-
-	glVertexVector3(&(leftRail.bottomVerts[0]));
-	glVertexVector3(&(leftRail.topVerts[0]));
+	// RAILS ================================================
+	drawRailStretches(mesh, 0);
 
-	glEnd();
 
+	// SUPPORTS ==========================
 
-	//LEFT RIGHT
-	glBegin(GL_QUAD_STRIP);
 	glColor3f(0.65f, 0.65f , 0.65f);
-	vertIndex = 0;
-	for(int i = 0; i < numberOfControlPoints; i++)
+	glLineWidth(8);
+	glBegin(GL_LINES);
+	for(int i = 0; i < mesh->numberOfSections; i++)
 	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
-		{
-			glVertexVector3(&(rightRail.bottomVerts[vertIndex]));
-			glVertexVector3(&(rightRail.topVerts[vertIndex]));
-			vertIndex += 2;
-		}
-	}
+		const RailSample* sample = &(mesh->railSamples[i * NUMBER_OF_SUB_SECTIONS]);
+		Vector3 binormal = crossProductVector3(&(sample->tangent), &(sample->normal));
+		Vector3 up = multiplyVector3(&(sample->normal), profile->supportUp);
 
-	glVertexVector3(&(rightRail.bottomVerts[0]));
-	glVertexVector3(&(rightRail.topVerts[0]));
+		//Main pillar
+		Vector3 point = sample->position;
+		point.y -= 0.5;
 
-	glEnd();
+		glVertexVector3(&point);
+		point.y = fminf(point.y, mesh->supportBottoms[i]);
+		glVertexVector3(&point);
 
+		point.y = sample->position.y - 0.5;
 
-	//RIGHT LEFT
-	glBegin(GL_QUAD_STRIP);
-	glColor3f(0.65f, 0.65f , 0.65f);
-	vertIndex = 1;
-	for(int i = 0; i < numberOfControlPoints; i++)
-	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
+		//A strut to each rail
+		for(int side = -1; side <= 1; side += 2)
 		{
-			glVertexVector3(&(leftRail.bottomVerts[vertIndex]));
-			glVertexVector3(&(leftRail.topVerts[vertIndex]));
-			vertIndex += 2;
+			Vector3 across = multiplyVector3(&binormal, side * profile->supportAcross);
+			Vector3 rail = addVector3(&(sample->position), &across);
+			rail = addVector3(&rail, &up);
+
+			glVertexVector3(&point);
+			glVertexVector3(&rail);
 		}
 	}
-
-	glVertexVector3(&(leftRail.bottomVerts[1]));
-	glVertexVector3(&(leftRail.topVerts[1]));
-
 	glEnd();
+}
 
+/* Redraws the top of the rails coloured by the vertical g felt at each subsection */
+static void drawOverlay(const TrackMesh* mesh)
+{
+	//Lies exactly on top of the plain rails
+	glDepthFunc(GL_LEQUAL);
+	drawRailStretches(mesh, 1);
+	glDepthFunc(GL_LESS);
+}
 
-	//RIGHT RIGHT
-	glBegin(GL_QUAD_STRIP);
-	glColor3f(0.65f, 0.65f , 0.65f);
-	vertIndex = 1;
-	for(int i = 0; i < numberOfControlPoints; i++)
-	{
-		for(int j =0; j < NUMBER_OF_SUB_SECTIONS; j++)
-		{
-			glVertexVector3(&(rightRail.bottomVerts[vertIndex]));
-			glVertexVector3(&(rightRail.topVerts[vertIndex]));
-			vertIndex += 2;
-		}
-	}
-
-	glVertexVector3(&(rightRail.bottomVerts[1]));
-	glVertexVector3(&(rightRail.topVerts[1]));
+/*	Sweeps the rails a stretch at a time and draws each one, only their tops with overlay
+ *	Only called while compiling a display list, which keeps its own copy of every stretch
+ */
+static void drawRailStretches(const TrackMesh* mesh, int overlay)
+{
+	const RailProfile* profile = getRailProfile();
+	int numberOfSubSections = mesh->numberOfSections * NUMBER_OF_SUB_SECTIONS;
 
-	glEnd();
-	
+	RailMesh rails;
+	initRailMesh(&rails, profile);
 
-	// SUPPORTS ==========================
-	
-	glLineWidth(8);
-	for(int i = 0; i < numberOfControlPoints; i++)
-	{		
-		glBegin(GL_LINES);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(Vector3), rails.positions);
+	glColorPointer(3, GL_FLOAT, sizeof(Vector3), rails.colours);
 
-			//Main pillar
-			Vector3 point = trackSections[i].subSections[0].subSectionStart;
-			point.y -= 0.5;
+	for(int start = 0; start < numberOfSubSections; start += RAIL_MESH_SUBSECTIONS)
+	{
+		int length = numberOfSubSections - start;
+		if(length > RAIL_MESH_SUBSECTIONS)
+			length = RAIL_MESH_SUBSECTIONS;
 
+		sweepRails(&rails, profile, &(mesh->railSamples[start]), length, overlay);
+		glDrawElements(GL_TRIANGLES, overlay ? rails.numberOfTopIndices : rails.numberOfIndices, GL_UNSIGNED_INT, rails.indices);
+	}
 
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
 
-			glVertexVector3(&point);
-			point.y = -1;
-			glVertexVector3(&point);
-		
+	freeRailMesh(&rails);
+}
 
-			glLineWidth(4);
+//================INPUT FUNCTIONS=================
 
+static void takeInput(Coaster* coaster)
+{
+	if(input[FinishTrack]) {
+		input[FinishTrack]--;
+		coaster->trackState = Generating;
+		return;
+	}
 
-			point = trackSections[i].subSections[0].subSectionStart;
-			point.y -= 0.5;
+	addPoint(coaster);
+	removePoint(coaster);
 
-			//Left rail connection
-			glVertexVector3(&point);
-			glVertexVector3(&(leftRail.topVerts[(i * NUMBER_OF_SUB_SECTIONS * 2)+1]));
+	selectionInput(coaster);
+	pickInput(coaster);
+	editControlPoint(coaster);
+	historyInput(coaster);
+}
 
-			//Right rail connection
-			glVertexVector3(&point);
-			glVertexVector3(&(rightRail.topVerts[(i * NUMBER_OF_SUB_SECTIONS * 2)]));
+static void addPoint(Coaster* coaster)
+{
+	if(input[Add] == 0 || coaster->selectedPoint == -1)
+		return;
+	input[Add]--;
+
+	//The new point starts as a copy of the selected one, just after it
+	insertControlPoint(&(coaster->controlPoints), coaster->selectedPoint + 1, getControlPoint(&(coaster->controlPoints), coaster->selectedPoint));
+	historyInsertPoint(&(coaster->history), coaster->selectedPoint + 1, getControlPoint(&(coaster->controlPoints), coaster->selectedPoint + 1));
+	coaster->historyPending = 1;
+
+	coaster->selectedPoint++;
+	coaster->numberOfControlPoints++;
+	logPointEdit(coaster, coaster->selectedPoint, coaster->numberOfControlPoints);
+	selectSingle(coaster, coaster->selectedPoint);
+	invalidateControlPointBvh(coaster);
+}
 
-		glEnd();		
+static void removePoint(Coaster* coaster)
+{
+	if(input[Remove] == 0 || coaster->selectedPoint == -1 || coaster->numberOfControlPoints <= 3)
+		return;
+	input[Remove]--;
+
+	removeControlPoint(&(coaster->controlPoints), coaster->selectedPoint);
+	historyRemovePoint(&(coaster->history), coaster->selectedPoint);
+	coaster->historyPending = 1;
+
+	coaster->numberOfControlPoints--;
+	logPointEdit(coaster, coaster->selectedPoint, coaster->numberOfControlPoints);
+	if(coaster->selectedPoint >= coaster->numberOfControlPoints)
+		coaster->selectedPoint = coaster->numberOfControlPoints - 1;
+	selectSingle(coaster, coaster->selectedPoint);
+	invalidateControlPointBvh(coaster);
+}
 
+static void selectionInput(Coaster* coaster)
+{
+	if (input[Next])
+	{
+		input[Next]--;
+		coaster->selectedPoint++;
 	}
 
-
-	// CHAIN LIFT ==================
-	glLineWidth(1);
-	glColor3f(0,0,0);
-	for(int i=0; i<numberOfControlPoints; i++)
+	else if (input[Prev])
 	{
-		if(controlPoints[i].isChain)
-		{
-			glBegin(GL_LINE_STRIP);
-			for(int j=0; j < NUMBER_OF_SUB_SECTIONS; j++)
-			{
-				Vector3 point = trackSections[i].subSections[j].subSectionStart;
-				point.y -= 0.1;
-				glVertexVector3(&point);	
-			}
-			glEnd();
-		}
+		input[Prev]--;
+		coaster->selectedPoint--;
 	}
+	else
+		return;
 
 
-}
+	//Clamp selected point top valid numbers
+	if (coaster->selectedPoint < 0)
+		coaster->selectedPoint = coaster->numberOfControlPoints - 1;
 
-//================INPUT FUNCTIONS=================
+	else if (coaster->selectedPoint >= coaster->numberOfControlPoints)
+		coaster->selectedPoint = 0;
+
+	selectSingle(coaster, coaster->selectedPoint);
+}
 
-static void takeInput()
+/* Replaces the selection with just the given point, or clears it for -1 */
+static void selectSingle(Coaster* coaster, int index)
 {
-	if(input[FinishTrack]) {
-		input[FinishTrack] = 0;
-		trackState = Generating;
-		return;
+	if(coaster->allocatedSelection < 1)
+	{
+		coaster->allocatedSelection = DEFAULT_NUMBER_OF_POINTS;
+		coaster->selection = malloc(coaster->allocatedSelection * sizeof(int));
 	}
 
-	addPoint();
-	removePoint();
+	coaster->selectedPoint = index;
+	coaster->selection[0] = index;
+	coaster->selectionCount = index == -1 ? 0 : 1;
+	coaster->editVersion++;
+}
+
+static int isSelected(Coaster* coaster, int index)
+{
+	for(int i = 0; i < coaster->selectionCount; i++)
+		if(coaster->selection[i] == index)
+			return 1;
 
-	selectionInput();
-	editControlPoint();
+	return 0;
 }
 
-static void addPoint()
+/*	Clicking casts a ray through the cursor into the control points. A hit grabs that point, and the rest of the
+ *	selection if it was already part of it, so dragging moves them together. A miss starts a box selection instead.
+ */
+static void pickInput(Coaster* coaster)
 {
-	if(input[Add] == 0 || selectedPoint == -1)
-		return;
-	input[Add] = 0;
+	int clicking = input[Click] != 0;
 
-	if(numberOfControlPoints + 1 > allocatedControlPoints)
-		allocateMoreControlPoints();
+	if(clicking && !coaster->wasClicking)
+		beginPick(coaster);
 
-	//Shift everything at and past the new point, up one index
-	for(int i = numberOfControlPoints; i > selectedPoint; i--){
-		controlPoints[i].position = controlPoints[i-1].position;
-		controlPoints[i].isChain = controlPoints[i-1].isChain;
-	}
+	else if(!clicking && coaster->wasClicking && coaster->boxSelecting)
+		finishBoxSelection(coaster);
 
-	selectedPoint++;
-	numberOfControlPoints++;
+	//The box's end follows the cursor, the snapshot picks it up every tick
+	coaster->wasClicking = clicking;
 }
 
-static void removePoint()
+static void beginPick(Coaster* coaster)
 {
-	if(input[Remove] == 0 || selectedPoint == -1 || numberOfControlPoints <= 3)
+	if(input[ViewWidth] <= 0 || input[ViewHeight] <= 0)
 		return;
-	input[Remove] = 0;
 
-	//Shift all control points following the one to be removed, down one index
-	for(int i = selectedPoint; i < numberOfControlPoints - 1; i++)
+	Vector3 origin;
+	Vector3 direction = getCameraRay(input[CursorX], input[CursorY], input[ViewWidth], input[ViewHeight], &origin);
+	origin = minusVector3(&origin, &(coaster->origin));
+
+	int hit = bvhRaycast(getControlPointBvh(coaster), &origin, &direction, FAR_PLANE, NULL);
+
+	if(hit == -1)
 	{
-			controlPoints[i].position = controlPoints[i+1].position;
-			controlPoints[i].isChain = controlPoints[i+1].isChain;
+		coaster->boxSelecting = 1;
+		coaster->boxStartX = input[CursorX];
+		coaster->boxStartY = input[CursorY];
+		return;
 	}
 
-	numberOfControlPoints--;
+	if(isSelected(coaster, hit)) {
+		coaster->selectedPoint = hit;
+		coaster->editVersion++;
+	}
+	else
+		selectSingle(coaster, hit);
 }
 
-static void allocateMoreControlPoints()
+/* Selects every control point inside the pyramid the box cuts out of the view */
+static void finishBoxSelection(Coaster* coaster)
 {
-	allocatedControlPoints = allocatedControlPoints * 1.5;
+	coaster->boxSelecting = 0;
 
-	controlPoints = realloc(controlPoints, sizeof(Vector3) * allocatedControlPoints);
+	int x0 = coaster->boxStartX < input[CursorX] ? coaster->boxStartX : input[CursorX];
+	int x1 = coaster->boxStartX < input[CursorX] ? input[CursorX] : coaster->boxStartX;
+	int y0 = coaster->boxStartY < input[CursorY] ? coaster->boxStartY : input[CursorY];
+	int y1 = coaster->boxStartY < input[CursorY] ? input[CursorY] : coaster->boxStartY;
 
-}
-
-static void selectionInput()
-{
-	if (input[Next])
+	//Clicking empty space without dragging deselects everything
+	if(x1 - x0 < MIN_BOX_SELECT_SIZE && y1 - y0 < MIN_BOX_SELECT_SIZE)
 	{
-		input[Next] = 0;
-		selectedPoint++;
+		selectSingle(coaster, -1);
+		return;
 	}
 
-	else if (input[Prev])
+	//Corner rays in order around the box, each side plane passes through the eye and two neighbouring corners
+	int width = input[ViewWidth], height = input[ViewHeight];
+	Vector3 eye;
+	Vector3 corners[4];
+	corners[0] = getCameraRay(x0, y0, width, height, &eye);
+	corners[1] = getCameraRay(x1, y0, width, height, &eye);
+	corners[2] = getCameraRay(x1, y1, width, height, &eye);
+	corners[3] = getCameraRay(x0, y1, width, height, &eye);
+	Vector3 center = getCameraRay((x0 + x1) / 2.0f, (y0 + y1) / 2.0f, width, height, &eye);
+	eye = minusVector3(&eye, &(coaster->origin));
+
+	Vector3 normals[4];
+	float distances[4];
+	for(int i = 0; i < 4; i++)
 	{
-		input[Prev] = 0;
-		selectedPoint--;
-	}
-	else
-		return;
+		normals[i] = crossProductVector3(&corners[i], &corners[(i + 1) % 4]);
+		normals[i] = NormalizeVector3(&normals[i]);
 
+		//Point the planes inwards
+		if(dotProductVector3(&normals[i], &center) < 0)
+			normals[i] = multiplyVector3(&normals[i], -1);
 
-	//Clamp selected point top valid numbers
-	if (selectedPoint < 0)
-		selectedPoint = numberOfControlPoints - 1;
+		distances[i] = -dotProductVector3(&normals[i], &eye);
+	}
+
+	if(coaster->allocatedSelection < coaster->numberOfControlPoints)
+	{
+		coaster->allocatedSelection = coaster->controlPoints.capacity;
+		coaster->selection = realloc(coaster->selection, coaster->allocatedSelection * sizeof(int));
+	}
 
-	else if (selectedPoint >= numberOfControlPoints)
-		selectedPoint = 0;
+	coaster->selectionCount = bvhPlanesQuery(getControlPointBvh(coaster), normals, distances, 4, coaster->selection, coaster->allocatedSelection);
+	coaster->selectedPoint = coaster->selectionCount > 0 ? coaster->selection[0] : -1;
+	coaster->editVersion++;
 }
 
-static void editControlPoint()
+static void editControlPoint(Coaster* coaster)
 {
-	if (selectedPoint == -1)
+	if (coaster->selectedPoint == -1)
 		return;
 
 	//Toggle Chain
 	if(input[ChainLift])
 	{
-		input[ChainLift] = 0;
-		if(controlPoints[selectedPoint].isChain)
-			controlPoints[selectedPoint].isChain = 0;
+		input[ChainLift]--;
+		ControlPoint* point = getControlPoint(&(coaster->controlPoints), coaster->selectedPoint);
+		if(point->isChain)
+			point->isChain = 0;
 		else
-			controlPoints[selectedPoint].isChain = 1;
+			point->isChain = 1;
+		coaster->editVersion++;
+		controlPointChanged(coaster, coaster->selectedPoint);
 	}
 	//Adjust height
 	if(input[Height])
 	{
-		controlPoints[selectedPoint].position.y += input[Height] * CONTROL_POINT_HEIGHT_STEP;
+		getControlPoint(&(coaster->controlPoints), coaster->selectedPoint)->position.y += input[Height] * CONTROL_POINT_HEIGHT_STEP;
 		input[Height] = 0;
+		coaster->editVersion++;
+		controlPointChanged(coaster, coaster->selectedPoint);
 	}
-	if(input[Click] == 0)
+	//Dragging moves the whole selection, but not while a box is being drawn
+	if(input[Click] == 0 || coaster->boxSelecting || (input[MouseX] == 0 && input[MouseY] == 0))
 		return;
 
 	Transform* freeCamera = getFreeCameraTransform();
@@ -926,68 +1341,151 @@ static void editControlPoint()
 	forward = multiplyVector3(&forward, -input[MouseY] * CONTROL_POINT_MOVEMENT_SPEED);
 	right = multiplyVector3(&right, input[MouseX] * CONTROL_POINT_MOVEMENT_SPEED);
 
-	//Apply these vectors to the control point
-	controlPoints[selectedPoint].position = addVector3(&(controlPoints[selectedPoint].position), &forward);
-	controlPoints[selectedPoint].position = addVector3(&(controlPoints[selectedPoint].position), &right);
+	//Apply these vectors to every selected control point as one edit
+	Vector3 offset = addVector3(&forward, &right);
+	for(int i = 0; i < coaster->selectionCount; i++)
+	{
+		ControlPoint* point = getControlPoint(&(coaster->controlPoints), coaster->selection[i]);
+		point->position = addVector3(&(point->position), &offset);
+		controlPointChanged(coaster, coaster->selection[i]);
+	}
+	coaster->editVersion++;
 
-	
 
 	consumeMouseInput();
 }
 
 
+/* Keeps the index and the undo history in step with a point that was edited */
+static void controlPointChanged(Coaster* coaster, int index)
+{
+	refitControlPoint(coaster, index);
+	historySetPoint(&(coaster->history), index, getControlPoint(&(coaster->controlPoints), index));
+	coaster->historyPending = 1;
 
+	logPointEdit(coaster, index, index + 1);
+	widenCoasterBounds(coaster, index, index + 1);
+}
 
-
-/* Implementation of the q function provided in the lecture slides */
-static Vector3 qFunction(float u, int i)
+/* Remembers that the points in [start, end) changed, for the snapshots to catch up on */
+static void logPointEdit(Coaster* coaster, int start, int end)
 {
-	float t = u;
-	float sixth = (1.0 / 6.0);
-
-	float tSquared = pow(t, 2);
-	float tCubed   = pow(t, 3);
+	coaster->pointVersion++;
+	coaster->editedStarts[coaster->pointVersion % POINT_EDIT_LOG_SIZE] = start;
+	coaster->editedEnds[coaster->pointVersion % POINT_EDIT_LOG_SIZE] = end;
+	coaster->editVersion++;
+}
 
+/* Grows the bounds to take in the points in [start, end) */
+static void widenCoasterBounds(Coaster* coaster, int start, int end)
+{
+	for(int i = start; i < end; i++)
+	{
+		const Vector3* position = &(getControlPoint(&(coaster->controlPoints), i)->position);
+
+		coaster->boundsMin.x = fminf(coaster->boundsMin.x, position->x);
+		coaster->boundsMin.y = fminf(coaster->boundsMin.y, position->y);
+		coaster->boundsMin.z = fminf(coaster->boundsMin.z, position->z);
+		coaster->boundsMax.x = fmaxf(coaster->boundsMax.x, position->x);
+		coaster->boundsMax.y = fmaxf(coaster->boundsMax.y, position->y);
+		coaster->boundsMax.z = fmaxf(coaster->boundsMax.z, position->z);
+	}
+}
 
-	float r0 = sixth * tCubed;
-	float r1 = sixth * ( (-3 * tCubed) + (3 * tSquared) + (3 * t) + 1 );
-	float r2 = sixth * ( (3 * tCubed) - (6 * tSquared) + 4 );
-	float r3 = sixth * pow((1 - t), 3);
+static void measureCoasterBounds(Coaster* coaster)
+{
+	coaster->boundsMin = getControlPoint(&(coaster->controlPoints), 0)->position;
+	coaster->boundsMax = coaster->boundsMin;
+	widenCoasterBounds(coaster, 1, coaster->numberOfControlPoints);
+}
 
-	Vector3 r3Vec;
-	Vector3 r2Vec;
-	Vector3 r1Vec;
-	Vector3 r0Vec;
+static void historyInput(Coaster* coaster)
+{
+	//Hold off while a drag is still going so the whole drag is undone in one go
+	if(input[Click])
+		return;
 
-	if (i - 1 >= 0)
-		r3Vec = multiplyVector3(&(controlPoints[i - 1].position), r3);
-	else
-		r3Vec = multiplyVector3(&(controlPoints[numberOfControlPoints + (i-1)].position), r3);
+	if(coaster->historyPending) {
+		commitHistory(&(coaster->history), coaster->selectedPoint);
+		coaster->historyPending = 0;
+	}
 
-	r2Vec = multiplyVector3(&(controlPoints[i].position), r2);
+	HistoryChange change;
+	if(input[Undo])
+	{
+		input[Undo]--;
+		if(undoHistory(&(coaster->history), &(coaster->controlPoints), &change))
+			applyHistoryChange(coaster, &change);
+	}
+	else if(input[Redo])
+	{
+		input[Redo]--;
+		if(redoHistory(&(coaster->history), &(coaster->controlPoints), &change))
+			applyHistoryChange(coaster, &change);
+	}
+}
 
+/* Refreshes whatever depends on the points an undo or redo replaced */
+static void applyHistoryChange(Coaster* coaster, const HistoryChange* change)
+{
+	coaster->numberOfControlPoints = countControlPoints(&(coaster->controlPoints));
 
-	if (i + 1 < numberOfControlPoints)
-		r1Vec = multiplyVector3(&(controlPoints[i + 1].position), r1);
-	else
-		r1Vec = multiplyVector3(&(controlPoints[0 + (i + 1 - numberOfControlPoints)].position), r1);
+	//Points only moved in place can be refit, otherwise the indexes after them have shifted
+	if(change->oldEnd == change->newEnd) {
+		for(int i = change->start; i < change->newEnd; i++)
+			refitControlPoint(coaster, i);
+		logPointEdit(coaster, change->start, change->newEnd);
+	}
+	else {
+		invalidateControlPointBvh(coaster);
+		logPointEdit(coaster, change->start, coaster->numberOfControlPoints);
+	}
+	widenCoasterBounds(coaster, change->start, change->newEnd);
 
-	if(i + 2 < numberOfControlPoints)
-		r0Vec = multiplyVector3(&(controlPoints[i + 2].position), r0);
+	if(change->selectedPoint < coaster->numberOfControlPoints)
+		selectSingle(coaster, change->selectedPoint);
 	else
-		r0Vec = multiplyVector3(&(controlPoints[0 + (i + 2 - numberOfControlPoints)].position), r0);
-
-	Vector3 finalVector;
-	finalVector = addVector3(&r3Vec, &r2Vec);
-	finalVector = addVector3(&finalVector, &r1Vec);
-	finalVector = addVector3(&finalVector, &r0Vec);
-
-	return finalVector;
+		selectSingle(coaster, coaster->numberOfControlPoints - 1);
 }
 
+/* Returns the control point index, building it first if points were added or removed since it was last used */
+static Bvh* getControlPointBvh(Coaster* coaster)
+{
+	if(coaster->controlPointBvh != NULL)
+		return coaster->controlPointBvh;
 
+	Vector3* positions = malloc(coaster->numberOfControlPoints * sizeof(Vector3));
+	for(int i = 0; i < coaster->numberOfControlPoints; i++)
+		positions[i] = getControlPoint(&(coaster->controlPoints), i)->position;
 
+	coaster->controlPointBvh = buildBvh(positions, positions, coaster->numberOfControlPoints, CONTROL_POINT_QUERY_RADIUS);
+	free(positions);
 
+	return coaster->controlPointBvh;
+}
 
+/* Keeps the control point index in step with a point that moved */
+static void refitControlPoint(Coaster* coaster, int index)
+{
+	if(coaster->controlPointBvh == NULL)
+		return;
 
+	const Vector3* position = &(getControlPoint(&(coaster->controlPoints), index)->position);
+	refitBvhPrimitive(coaster->controlPointBvh, index, position, position);
+}
 
+/* Adding or removing points shifts every index after them, so the index has to be rebuilt */
+static void invalidateControlPointBvh(Coaster* coaster)
+{
+	freeBvh(coaster->controlPointBvh);
+	coaster->controlPointBvh = NULL;
+}
+
+/*	Finds the control point closest to the given point within maxDistance
+ *	Returns its index, or -1 if none are that close
+ */
+int findClosestControlPoint(Coaster* coaster, const Vector3* point, float maxDistance)
+{
+	Vector3 localPoint = minusVector3(point, &(coaster->origin));
+	return bvhClosestPoint(getControlPointBvh(coaster), &localPoint, maxDistance, NULL, NULL);
+}
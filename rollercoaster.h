@@ -1,5 +1,94 @@
-void initRollerCoaster(void);
-void updateRollerCoaster(void);
-void drawRollerCoaster(void);
+#ifndef ROLLERCOASTER_H
+#define ROLLERCOASTER_H
 
-Vector3 getCoasterPosition(void);
\ No newline at end of file
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+#include "track.h"
+#include "operation.h"
+#include "heightmap.h"
+#include "camera.h"
+
+typedef enum { Constructing, Generating, Ready } TrackState;
+
+/*	One coaster in the park, everything about it lives in here so any number can run side by side */
+typedef struct Coaster Coaster;
+
+/*	How a coaster starts out, fill in the defaults with getDefaultCoasterSettings() first
+ *	Only one coaster at a time should be given a track file, it is saved over whenever that track is finished
+ */
+typedef struct {
+	size_t undoMemoryLimit;
+	const char* analyticsPath;
+	const char* trackPath;
+
+	//Generated track to start with instead of the default one, when proceduralPoints isn't 0
+	int proceduralPoints;
+	uint64_t proceduralSeed;
+
+	int numberOfCars;
+
+	//More than one train runs the track in blocks, with the first one the one being ridden
+	int numberOfTrains;
+
+	//Starts generating the track straight away instead of waiting to be edited
+	int startFinished;
+
+	//Ground the supports stand on, flat below the track when NULL
+	const Heightmap* heightmap;
+} CoasterSettings;
+
+/*	The coaster state the renderer needs, copied out by the simulation thread each tick
+ *	The control points are only recopied when editVersion says they changed
+ */
+typedef struct {
+	int trackState;
+	int selectedPoint;
+
+	//Points picked with the mouse, including selectedPoint, and the box being dragged out in window pixels
+	int* selection;
+	int selectionCount;
+	int allocatedSelection;
+	int boxSelecting;
+	int boxStartX, boxStartY, boxEndX, boxEndY;
+
+	//Where the coaster sits in the park, everything else in the snapshot is relative to it
+	Vector3 origin;
+
+	//Trains on the track, the ridden one first and the lead car of each first
+	int numberOfTrains;
+	int numberOfCars;
+	Vector3 carPositions[MAX_OPERATED_TRAINS][MAX_TRAIN_CARS];
+	TrackFrame carFrames[MAX_OPERATED_TRAINS][MAX_TRAIN_CARS];
+	float coasterVelocity;
+	int showOverlay;
+
+	unsigned int editVersion;
+	unsigned int pointVersion;
+	int numberOfControlPoints;
+	int allocatedControlPoints;
+	ControlPoint* controlPoints;
+
+	//Box around everything drawn for the coaster in park space, recomputed along with the control points
+	Vector3 boundsMin;
+	Vector3 boundsMax;
+} CoasterSnapshot;
+
+void getDefaultCoasterSettings(CoasterSettings* settings);
+Coaster* createCoaster(const CoasterSettings* settings);
+void freeCoaster(Coaster* coaster);
+
+void updateRollerCoaster(Coaster* coaster, int takesInput);
+void snapshotRollerCoaster(Coaster* coaster, CoasterSnapshot* snapshot);
+void drawRollerCoaster(Coaster* coaster, const CoasterSnapshot* snapshot, const Frustum* frustum);
+
+void setCoasterOrigin(Coaster* coaster, const Vector3* origin);
+void getCoasterBounds(Coaster* coaster, Vector3* min, Vector3* max);
+Vector3 getCoasterPosition(const Coaster* coaster);
+TrackFrame getCoasterFrame(const Coaster* coaster);
+
+int findClosestTrackPoint(const Coaster* coaster, const Vector3* point, float maxDistance, Vector3* closest);
+int findClosestControlPoint(Coaster* coaster, const Vector3* point, float maxDistance);
+unsigned long long checksumRollerCoaster(Coaster* coaster, unsigned long long hash);
+
+#endif
@@ -0,0 +1,511 @@
+/*	Scenery.c
+ *	This module draws the trees, buildings and queue lines placed around the park
+ *
+ *	Placements are grouped into square cells that are culled against the view as a whole. Each type's instances
+ *	are sorted by cell, so a run of neighbouring visible cells is one contiguous range of the instance buffer and
+ *	goes to the driver as a single instanced draw. Drivers without instancing draw the same cells an object at a time.
+ */
+#include "gpu.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "scenery.h"
+
+//Position and colour of each vertex
+#define MESH_VERTEX_FLOATS 6
+
+//Position, yaw and scale of each instance
+#define INSTANCE_FLOATS 5
+
+//Cells are numbered in 31 bits each way so a cell id stays positive, anything further out shares the last cell
+#define MAX_CELL_COORDINATE 0x7FFFFFFFLL
+
+#define ATTRIBUTE_POSITION 0
+#define ATTRIBUTE_COLOUR 1
+#define ATTRIBUTE_PLACEMENT 2
+#define ATTRIBUTE_SCALE 3
+
+typedef struct {
+	float* floats;
+	int length;
+	int capacity;
+} MeshBuilder;
+
+static const char* sceneryVertexShader =
+	"#version 120\n"
+	"attribute vec3 position;\n"
+	"attribute vec3 colour;\n"
+	"attribute vec4 placement;\n"
+	"attribute float scale;\n"
+	"varying vec3 vertexColour;\n"
+	"void main() {\n"
+	"	float c = cos(placement.w);\n"
+	"	float s = sin(placement.w);\n"
+	"	vec3 p = position * scale;\n"
+	"	vec3 world = vec3(c * p.x + s * p.z, p.y, -s * p.x + c * p.z) + placement.xyz;\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(world, 1.0);\n"
+	"	vertexColour = colour;\n"
+	"}\n";
+
+static const char* sceneryFragmentShader =
+	"#version 120\n"
+	"varying vec3 vertexColour;\n"
+	"void main() {\n"
+	"	gl_FragColor = vec4(vertexColour, 1.0);\n"
+	"}\n";
+
+static const char* const sceneryAttributes[] = { "position", "colour", "placement", "scale" };
+
+static void buildMeshes(Scenery* scenery, MeshBuilder* builder);
+static void addTriangle(MeshBuilder* builder, const Vector3* a, const Vector3* b, const Vector3* c, const Vector3* colour);
+static void addBox(MeshBuilder* builder, Vector3 min, Vector3 max, Vector3 colour);
+static void addCone(MeshBuilder* builder, int segments, float radiusX, float radiusZ, float bottom, float top, float angle,
+	Vector3 colour);
+static void sortIntoCells(Scenery* scenery, const SceneryPlacement* placements, int numberOfPlacements);
+static long long getCellCoordinate(float position, float min);
+static int compareCellIds(const void* a, const void* b);
+static int findCell(const long long* cellIds, int numberOfCells, long long cellId);
+static void drawInstancedRun(Scenery* scenery, int type, int start, int count);
+static void drawInstancesSeparately(Scenery* scenery, int type, int start, int count);
+
+
+/* Sets up the meshes and instance buffers, must be called with the render context current */
+Scenery* createScenery(const SceneryPlacement* placements, int numberOfPlacements)
+{
+	Scenery* scenery = calloc(1, sizeof(Scenery));
+
+	MeshBuilder builder = { NULL, 0, 0 };
+	buildMeshes(scenery, &builder);
+	sortIntoCells(scenery, placements, numberOfPlacements);
+
+#ifdef GPU_EXTENSIONS
+	if(hasGlVersion(3, 3))
+		scenery->program = buildShaderProgram("scenery", sceneryVertexShader, sceneryFragmentShader, sceneryAttributes, 4);
+
+	if(scenery->program != 0)
+	{
+		scenery->instanced = 1;
+
+		glGenBuffers(1, &(scenery->meshBuffer));
+		glBindBuffer(GL_ARRAY_BUFFER, scenery->meshBuffer);
+		glBufferData(GL_ARRAY_BUFFER, builder.length * sizeof(float), builder.floats, GL_STATIC_DRAW);
+
+		glGenBuffers(1, &(scenery->instanceBuffer));
+		glBindBuffer(GL_ARRAY_BUFFER, scenery->instanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, scenery->numberOfInstances * INSTANCE_FLOATS * sizeof(float), scenery->instances,
+			GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+#endif
+
+	if(!scenery->instanced)
+	{
+		for(int type = 0; type < NUMBER_OF_SCENERY_TYPES; type++)
+		{
+			scenery->lists[type] = glGenLists(1);
+			glNewList(scenery->lists[type], GL_COMPILE);
+
+			glBegin(GL_TRIANGLES);
+			for(int i = 0; i < scenery->meshCount[type]; i++)
+			{
+				const float* vertex = builder.floats + ((scenery->meshFirst[type] + i) * MESH_VERTEX_FLOATS);
+				glColor3fv(vertex + 3);
+				glVertex3fv(vertex);
+			}
+			glEnd();
+
+			glEndList();
+		}
+	}
+
+	free(builder.floats);
+
+	return scenery;
+}
+
+/* Must be called from the render thread */
+void freeScenery(Scenery* scenery)
+{
+#ifdef GPU_EXTENSIONS
+	if(scenery->instanced)
+	{
+		glDeleteBuffers(1, &(scenery->meshBuffer));
+		glDeleteBuffers(1, &(scenery->instanceBuffer));
+		glDeleteProgram(scenery->program);
+	}
+#endif
+
+	for(int type = 0; type < NUMBER_OF_SCENERY_TYPES; type++)
+	{
+		if(scenery->lists[type] != 0)
+			glDeleteLists(scenery->lists[type], 1);
+	}
+
+	free(scenery->instances);
+	free(scenery->cells);
+	free(scenery);
+}
+
+/*	Draws every cell that can be seen, or all of them when there is no frustum
+ *	Runs of visible cells are drawn together, so an open view costs a few draws per type rather than one per cell
+ */
+void drawScenery(Scenery* scenery, const Frustum* frustum)
+{
+	int runStart[NUMBER_OF_SCENERY_TYPES];
+	int runCount[NUMBER_OF_SCENERY_TYPES] = { 0 };
+
+	void (*drawRun)(Scenery*, int, int, int) = scenery->instanced ? drawInstancedRun : drawInstancesSeparately;
+
+	scenery->drawCalls = 0;
+	scenery->drawnInstances = 0;
+
+#ifdef GPU_EXTENSIONS
+	if(scenery->instanced)
+	{
+		glUseProgram(scenery->program);
+
+		glBindBuffer(GL_ARRAY_BUFFER, scenery->meshBuffer);
+		glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+		glEnableVertexAttribArray(ATTRIBUTE_COLOUR);
+		glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, MESH_VERTEX_FLOATS * sizeof(float), (void*) 0);
+		glVertexAttribPointer(ATTRIBUTE_COLOUR, 3, GL_FLOAT, GL_FALSE, MESH_VERTEX_FLOATS * sizeof(float),
+			(void*) (3 * sizeof(float)));
+
+		glBindBuffer(GL_ARRAY_BUFFER, scenery->instanceBuffer);
+		glEnableVertexAttribArray(ATTRIBUTE_PLACEMENT);
+		glEnableVertexAttribArray(ATTRIBUTE_SCALE);
+		glVertexAttribDivisor(ATTRIBUTE_PLACEMENT, 1);
+		glVertexAttribDivisor(ATTRIBUTE_SCALE, 1);
+	}
+#endif
+
+	for(int i = 0; i < scenery->numberOfCells; i++)
+	{
+		const SceneryCell* cell = &(scenery->cells[i]);
+
+		if(frustum != NULL && !isBoxInFrustum(frustum, &(cell->boundsMin), &(cell->boundsMax)))
+		{
+			//Whatever was being gathered can't run on past a hidden cell
+			for(int type = 0; type < NUMBER_OF_SCENERY_TYPES; type++)
+			{
+				if(runCount[type] > 0)
+					drawRun(scenery, type, runStart[type], runCount[type]);
+				runCount[type] = 0;
+			}
+			continue;
+		}
+
+		for(int type = 0; type < NUMBER_OF_SCENERY_TYPES; type++)
+		{
+			if(runCount[type] == 0)
+				runStart[type] = cell->start[type];
+			runCount[type] += cell->count[type];
+		}
+	}
+
+	for(int type = 0; type < NUMBER_OF_SCENERY_TYPES; type++)
+	{
+		if(runCount[type] > 0)
+			drawRun(scenery, type, runStart[type], runCount[type]);
+	}
+
+#ifdef GPU_EXTENSIONS
+	if(scenery->instanced)
+	{
+		//Put the attributes back how the fixed function drawing expects them
+		glVertexAttribDivisor(ATTRIBUTE_PLACEMENT, 0);
+		glVertexAttribDivisor(ATTRIBUTE_SCALE, 0);
+		glDisableVertexAttribArray(ATTRIBUTE_POSITION);
+		glDisableVertexAttribArray(ATTRIBUTE_COLOUR);
+		glDisableVertexAttribArray(ATTRIBUTE_PLACEMENT);
+		glDisableVertexAttribArray(ATTRIBUTE_SCALE);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glUseProgram(0);
+	}
+#endif
+}
+
+static void drawInstancedRun(Scenery* scenery, int type, int start, int count)
+{
+#ifdef GPU_EXTENSIONS
+	size_t offset = start * INSTANCE_FLOATS * sizeof(float);
+
+	glVertexAttribPointer(ATTRIBUTE_PLACEMENT, 4, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS * sizeof(float), (void*) offset);
+	glVertexAttribPointer(ATTRIBUTE_SCALE, 1, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS * sizeof(float),
+		(void*) (offset + (4 * sizeof(float))));
+
+	glDrawArraysInstanced(GL_TRIANGLES, scenery->meshFirst[type], scenery->meshCount[type], count);
+
+	scenery->drawCalls++;
+	scenery->drawnInstances += count;
+#endif
+}
+
+static void drawInstancesSeparately(Scenery* scenery, int type, int start, int count)
+{
+	for(int i = start; i < start + count; i++)
+	{
+		const float* instance = scenery->instances + (i * INSTANCE_FLOATS);
+
+		glPushMatrix();
+		glTranslatef(instance[0], instance[1], instance[2]);
+		glRotatef(instance[3] * (180.0f / (float) M_PI), 0, 1, 0);
+		glScalef(instance[4], instance[4], instance[4]);
+		glCallList(scenery->lists[type]);
+		glPopMatrix();
+	}
+
+	scenery->drawCalls += count;
+	scenery->drawnInstances += count;
+}
+
+//=====MESHES
+
+/* Builds every type's triangles into one list, each standing on the origin facing +z */
+static void buildMeshes(Scenery* scenery, MeshBuilder* builder)
+{
+	for(int type = 0; type < NUMBER_OF_SCENERY_TYPES; type++)
+	{
+		int first = builder->length;
+
+		switch(type)
+		{
+			case SceneryTree:
+				addBox(builder, (Vector3) { -0.25f, 0, -0.25f }, (Vector3) { 0.25f, 2.0f, 0.25f }, (Vector3) { 0.45f, 0.3f, 0.15f });
+				addCone(builder, 8, 2.0f, 2.0f, 1.5f, 7.0f, 0, (Vector3) { 0.15f, 0.5f, 0.2f });
+				break;
+
+			case SceneryBuilding:
+				addBox(builder, (Vector3) { -4.0f, 0, -3.0f }, (Vector3) { 4.0f, 5.0f, 3.0f }, (Vector3) { 0.85f, 0.8f, 0.65f });
+				addBox(builder, (Vector3) { -1.0f, 0, 3.0f }, (Vector3) { 1.0f, 2.5f, 3.05f }, (Vector3) { 0.35f, 0.25f, 0.2f });
+				addCone(builder, 4, 4.3f * (float) M_SQRT2, 3.3f * (float) M_SQRT2, 5.0f, 7.5f, (float) M_PI_4,
+					(Vector3) { 0.7f, 0.2f, 0.15f });
+				break;
+
+			case SceneryQueueLine:
+				//One 2m length of fence, segments laid end to end share their posts
+				addBox(builder, (Vector3) { -1.05f, 0, -0.05f }, (Vector3) { -0.95f, 1.0f, 0.05f }, (Vector3) { 0.4f, 0.4f, 0.45f });
+				addBox(builder, (Vector3) { 0.95f, 0, -0.05f }, (Vector3) { 1.05f, 1.0f, 0.05f }, (Vector3) { 0.4f, 0.4f, 0.45f });
+				addBox(builder, (Vector3) { -1.0f, 0.85f, -0.03f }, (Vector3) { 1.0f, 0.95f, 0.03f }, (Vector3) { 0.75f, 0.75f, 0.8f });
+				addBox(builder, (Vector3) { -1.0f, 0.45f, -0.03f }, (Vector3) { 1.0f, 0.55f, 0.03f }, (Vector3) { 0.75f, 0.75f, 0.8f });
+				break;
+		}
+
+		scenery->meshFirst[type] = first / MESH_VERTEX_FLOATS;
+		scenery->meshCount[type] = (builder->length - first) / MESH_VERTEX_FLOATS;
+
+		for(int i = first; i < builder->length; i += MESH_VERTEX_FLOATS)
+		{
+			const float* vertex = builder->floats + i;
+			scenery->meshRadius[type] = fmaxf(scenery->meshRadius[type], sqrtf((vertex[0] * vertex[0]) + (vertex[2] * vertex[2])));
+			scenery->meshHeight[type] = fmaxf(scenery->meshHeight[type], vertex[1]);
+		}
+	}
+}
+
+/* Adds a triangle facing the side its corners go anticlockwise around, shaded by how much it faces the sun */
+static void addTriangle(MeshBuilder* builder, const Vector3* a, const Vector3* b, const Vector3* c, const Vector3* colour)
+{
+	if(builder->length + (3 * MESH_VERTEX_FLOATS) > builder->capacity)
+	{
+		builder->capacity = builder->capacity > 0 ? builder->capacity * 2 : 1024;
+		builder->floats = realloc(builder->floats, builder->capacity * sizeof(float));
+	}
+
+	static const Vector3 sun = { 0.35f, 0.87f, 0.35f };
+
+	Vector3 ab = minusVector3(b, a);
+	Vector3 ac = minusVector3(c, a);
+	Vector3 cross = crossProductVector3(&ab, &ac);
+	Vector3 normal = NormalizeVector3(&cross);
+	float shade = 0.6f + (0.4f * fmaxf(0, (normal.x * sun.x) + (normal.y * sun.y) + (normal.z * sun.z)));
+
+	const Vector3* corners[3] = { a, b, c };
+	for(int i = 0; i < 3; i++)
+	{
+		float* vertex = builder->floats + builder->length;
+		vertex[0] = corners[i]->x;
+		vertex[1] = corners[i]->y;
+		vertex[2] = corners[i]->z;
+		vertex[3] = colour->x * shade;
+		vertex[4] = colour->y * shade;
+		vertex[5] = colour->z * shade;
+		builder->length += MESH_VERTEX_FLOATS;
+	}
+}
+
+static void addBox(MeshBuilder* builder, Vector3 min, Vector3 max, Vector3 colour)
+{
+	//Each face's corners anticlockwise seen from outside
+	Vector3 faces[6][4] = {
+		{ { min.x, max.y, min.z }, { min.x, max.y, max.z }, { max.x, max.y, max.z }, { max.x, max.y, min.z } },
+		{ { min.x, min.y, min.z }, { max.x, min.y, min.z }, { max.x, min.y, max.z }, { min.x, min.y, max.z } },
+		{ { max.x, min.y, min.z }, { max.x, max.y, min.z }, { max.x, max.y, max.z }, { max.x, min.y, max.z } },
+		{ { min.x, min.y, min.z }, { min.x, min.y, max.z }, { min.x, max.y, max.z }, { min.x, max.y, min.z } },
+		{ { min.x, min.y, max.z }, { max.x, min.y, max.z }, { max.x, max.y, max.z }, { min.x, max.y, max.z } },
+		{ { min.x, min.y, min.z }, { min.x, max.y, min.z }, { max.x, max.y, min.z }, { max.x, min.y, min.z } }
+	};
+
+	for(int i = 0; i < 6; i++)
+	{
+		addTriangle(builder, &faces[i][0], &faces[i][1], &faces[i][2], &colour);
+		addTriangle(builder, &faces[i][0], &faces[i][2], &faces[i][3], &colour);
+	}
+}
+
+/* A closed cone, or pyramid with few segments, around y starting at the given angle from +x */
+static void addCone(MeshBuilder* builder, int segments, float radiusX, float radiusZ, float bottom, float top, float angle,
+	Vector3 colour)
+{
+	Vector3 apex = { 0, top, 0 };
+	Vector3 centre = { 0, bottom, 0 };
+
+	for(int i = 0; i < segments; i++)
+	{
+		float startAngle = angle + ((2.0f * (float) M_PI * i) / segments);
+		float endAngle = angle + ((2.0f * (float) M_PI * (i + 1)) / segments);
+		Vector3 start = { radiusX * cosf(startAngle), bottom, radiusZ * sinf(startAngle) };
+		Vector3 end = { radiusX * cosf(endAngle), bottom, radiusZ * sinf(endAngle) };
+
+		addTriangle(builder, &start, &apex, &end, &colour);
+		addTriangle(builder, &centre, &start, &end, &colour);
+	}
+}
+
+//=====CELLS
+
+/*	Sorts the placements into instances grouped by type, then by cell in row order
+ *	Only the cells with something in them are kept, so a sparse park over a wide area stays small
+ */
+static void sortIntoCells(Scenery* scenery, const SceneryPlacement* placements, int numberOfPlacements)
+{
+	scenery->instances = malloc((numberOfPlacements > 0 ? numberOfPlacements : 1) * INSTANCE_FLOATS * sizeof(float));
+	scenery->numberOfInstances = numberOfPlacements;
+
+	if(numberOfPlacements == 0)
+		return;
+
+	float minX = placements[0].position.x;
+	float minZ = placements[0].position.z;
+	for(int i = 1; i < numberOfPlacements; i++)
+	{
+		minX = fminf(minX, placements[i].position.x);
+		minZ = fminf(minZ, placements[i].position.z);
+	}
+
+	//Which cell each placement is in, then the distinct ones in row order
+	long long* placementCells = malloc(numberOfPlacements * sizeof(long long));
+	long long* cellIds = malloc(numberOfPlacements * sizeof(long long));
+
+	for(int i = 0; i < numberOfPlacements; i++)
+	{
+		long long cellX = getCellCoordinate(placements[i].position.x, minX);
+		long long cellZ = getCellCoordinate(placements[i].position.z, minZ);
+		placementCells[i] = (cellZ << 32) | cellX;
+		cellIds[i] = placementCells[i];
+	}
+
+	qsort(cellIds, numberOfPlacements, sizeof(long long), compareCellIds);
+
+	int numberOfCells = 0;
+	for(int i = 0; i < numberOfPlacements; i++)
+	{
+		if(numberOfCells == 0 || cellIds[numberOfCells - 1] != cellIds[i])
+			cellIds[numberOfCells++] = cellIds[i];
+	}
+
+	scenery->cells = calloc(numberOfCells, sizeof(SceneryCell));
+	scenery->numberOfCells = numberOfCells;
+
+	//A counting sort on type then cell, so each type's cells follow one another in the instance list
+	int numberOfBuckets = NUMBER_OF_SCENERY_TYPES * numberOfCells;
+	int* bucketStarts = calloc(numberOfBuckets + 1, sizeof(int));
+	int* placementCellIndices = malloc(numberOfPlacements * sizeof(int));
+
+	for(int i = 0; i < numberOfPlacements; i++)
+	{
+		placementCellIndices[i] = findCell(cellIds, numberOfCells, placementCells[i]);
+		bucketStarts[(placements[i].type * numberOfCells) + placementCellIndices[i] + 1]++;
+	}
+
+	for(int i = 0; i < numberOfBuckets; i++)
+		bucketStarts[i + 1] += bucketStarts[i];
+
+	for(int i = 0; i < numberOfCells; i++)
+	{
+		SceneryCell* cell = &(scenery->cells[i]);
+		cell->boundsMin = (Vector3) { INFINITY, INFINITY, INFINITY };
+		cell->boundsMax = (Vector3) { -INFINITY, -INFINITY, -INFINITY };
+
+		for(int type = 0; type < NUMBER_OF_SCENERY_TYPES; type++)
+			cell->start[type] = bucketStarts[(type * numberOfCells) + i];
+	}
+
+	for(int i = 0; i < numberOfPlacements; i++)
+	{
+		const SceneryPlacement* placement = &placements[i];
+		SceneryCell* cell = &(scenery->cells[placementCellIndices[i]]);
+
+		float* instance = scenery->instances + ((cell->start[placement->type] + cell->count[placement->type]) * INSTANCE_FLOATS);
+		instance[0] = placement->position.x;
+		instance[1] = placement->position.y;
+		instance[2] = placement->position.z;
+		instance[3] = placement->yaw * ((2.0f * (float) M_PI) / 256.0f);
+		instance[4] = placement->scale / 256.0f;
+		cell->count[placement->type]++;
+
+		//Yaw can turn the mesh any way, so the bounds allow for its full reach all round
+		float radius = scenery->meshRadius[placement->type] * instance[4];
+		float height = scenery->meshHeight[placement->type] * instance[4];
+
+		cell->boundsMin.x = fminf(cell->boundsMin.x, placement->position.x - radius);
+		cell->boundsMin.y = fminf(cell->boundsMin.y, placement->position.y);
+		cell->boundsMin.z = fminf(cell->boundsMin.z, placement->position.z - radius);
+		cell->boundsMax.x = fmaxf(cell->boundsMax.x, placement->position.x + radius);
+		cell->boundsMax.y = fmaxf(cell->boundsMax.y, placement->position.y + height);
+		cell->boundsMax.z = fmaxf(cell->boundsMax.z, placement->position.z + radius);
+	}
+
+	free(placementCells);
+	free(cellIds);
+	free(bucketStarts);
+	free(placementCellIndices);
+}
+
+/* Which cell along one axis a position falls in, counting from the cell min is in */
+static long long getCellCoordinate(float position, float min)
+{
+	//In double the distance can't overflow, however far apart two finite positions are
+	double cell = ((double) position - min) / SCENERY_CELL_SIZE;
+	if(cell > MAX_CELL_COORDINATE)
+		return MAX_CELL_COORDINATE;
+
+	return (long long) cell;
+}
+
+static int compareCellIds(const void* a, const void* b)
+{
+	long long first = *(const long long*) a;
+	long long second = *(const long long*) b;
+
+	return (first > second) - (first < second);
+}
+
+static int findCell(const long long* cellIds, int numberOfCells, long long cellId)
+{
+	int low = 0;
+	int high = numberOfCells - 1;
+
+	while(low < high)
+	{
+		int middle = (low + high) / 2;
+		if(cellIds[middle] < cellId)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
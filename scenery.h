@@ -0,0 +1,56 @@
+#ifndef SCENERY_H
+#define SCENERY_H
+
+#include "engine.h"
+#include "camera.h"
+#include "sceneryfile.h"
+
+//Width of the square cells placements are grouped into for culling
+#define SCENERY_CELL_SIZE 32.0f
+
+/*	The placements standing in one cell, as a run of each type's instances
+ *	Bounds cover the whole of every mesh in the cell, not just where they stand
+ */
+typedef struct {
+	Vector3 boundsMin;
+	Vector3 boundsMax;
+	int start[NUMBER_OF_SCENERY_TYPES];
+	int count[NUMBER_OF_SCENERY_TYPES];
+} SceneryCell;
+
+/*	Every object in the park, sorted by type and then cell so neighbouring visible cells draw as one run
+ *	Belongs to the render thread
+ */
+typedef struct {
+	//x, y, z, yaw in radians and scale for each instance
+	float* instances;
+	int numberOfInstances;
+
+	//Only cells with something in them, in row order
+	SceneryCell* cells;
+	int numberOfCells;
+
+	//Where each type's triangles start in the mesh buffer, and how far they reach from where they stand
+	int meshFirst[NUMBER_OF_SCENERY_TYPES];
+	int meshCount[NUMBER_OF_SCENERY_TYPES];
+	float meshRadius[NUMBER_OF_SCENERY_TYPES];
+	float meshHeight[NUMBER_OF_SCENERY_TYPES];
+
+	//Drawn with one instanced call per run of visible cells when the driver can, otherwise a display list per object
+	int instanced;
+	unsigned int program;
+	unsigned int meshBuffer;
+	unsigned int instanceBuffer;
+	unsigned int lists[NUMBER_OF_SCENERY_TYPES];
+
+	//What the last draw submitted
+	int drawCalls;
+	int drawnInstances;
+} Scenery;
+
+Scenery* createScenery(const SceneryPlacement* placements, int numberOfPlacements);
+void freeScenery(Scenery* scenery);
+
+void drawScenery(Scenery* scenery, const Frustum* frustum);
+
+#endif
@@ -0,0 +1,132 @@
+/*	SceneryFile.c
+ *	This module saves and loads the objects placed around the park
+ *
+ *	File layout, after the "RCSC" magic and a version byte, is a varint placement count followed by one record each:
+ *		x, y, z as little endian 32 bit floats, type byte, yaw byte, little endian 16 bit scale
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "encoding.h"
+#include "sceneryfile.h"
+
+#define SCENERY_FILE_MAGIC "RCSC"
+#define SCENERY_FILE_VERSION 1
+
+#define PLACEMENT_RECORD_SIZE 16
+
+//Placements are converted this many at a time so huge parks don't need a second copy in memory
+#define PLACEMENTS_PER_BLOCK 4096
+
+
+/* Returns 0 if the file couldn't be written */
+int saveSceneryFile(const char* path, const SceneryPlacement* placements, int numberOfPlacements)
+{
+	FILE* file = fopen(path, "wb");
+	if(file == NULL)
+		return 0;
+
+	unsigned char header[5 + MAX_VARINT_BYTES];
+	memcpy(header, SCENERY_FILE_MAGIC, 4);
+	header[4] = SCENERY_FILE_VERSION;
+	int headerLength = 5 + writeVarint(header + 5, numberOfPlacements);
+	fwrite(header, 1, headerLength, file);
+
+	unsigned char* block = malloc(PLACEMENTS_PER_BLOCK * PLACEMENT_RECORD_SIZE);
+
+	for(int start = 0; start < numberOfPlacements; start += PLACEMENTS_PER_BLOCK)
+	{
+		int count = numberOfPlacements - start < PLACEMENTS_PER_BLOCK ? numberOfPlacements - start : PLACEMENTS_PER_BLOCK;
+
+		for(int i = 0; i < count; i++)
+		{
+			const SceneryPlacement* placement = &placements[start + i];
+			unsigned char* record = block + (i * PLACEMENT_RECORD_SIZE);
+
+			writeFloat(record, placement->position.x);
+			writeFloat(record + 4, placement->position.y);
+			writeFloat(record + 8, placement->position.z);
+			record[12] = placement->type;
+			record[13] = placement->yaw;
+			record[14] = placement->scale & 0xFF;
+			record[15] = placement->scale >> 8;
+		}
+
+		fwrite(block, PLACEMENT_RECORD_SIZE, count, file);
+	}
+
+	free(block);
+
+	int failed = ferror(file);
+	if(fclose(file) != 0)
+		failed = 1;
+
+	return !failed;
+}
+
+/*	Loads a scenery file into a newly allocated array of placements
+ *	Returns NULL if the file can't be read or isn't a scenery file. Placements of unknown types are dropped,
+ *	as are ones that aren't at a finite position
+ */
+SceneryPlacement* loadSceneryFile(const char* path, int* numberOfPlacements)
+{
+	FILE* file = fopen(path, "rb");
+	if(file == NULL)
+		return NULL;
+
+	unsigned char header[5 + MAX_VARINT_BYTES];
+	size_t headerLength = fread(header, 1, sizeof(header), file);
+
+	if(headerLength < 6 || memcmp(header, SCENERY_FILE_MAGIC, 4) != 0 || header[4] != SCENERY_FILE_VERSION) {
+		fclose(file);
+		return NULL;
+	}
+
+	const unsigned char* cursor = header + 5;
+	uint64_t count = readVarint(&cursor, header + headerLength);
+
+	//Go back to the first record, the header read may have run into it
+	if(count > INT32_MAX || fseek(file, cursor - header, SEEK_SET) != 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	SceneryPlacement* placements = malloc((count > 0 ? count : 1) * sizeof(SceneryPlacement));
+	unsigned char* block = malloc(PLACEMENTS_PER_BLOCK * PLACEMENT_RECORD_SIZE);
+	int loaded = 0;
+
+	for(uint64_t start = 0; start < count && placements != NULL; start += PLACEMENTS_PER_BLOCK)
+	{
+		size_t blockCount = count - start < PLACEMENTS_PER_BLOCK ? count - start : PLACEMENTS_PER_BLOCK;
+
+		if(fread(block, PLACEMENT_RECORD_SIZE, blockCount, file) != blockCount) {
+			free(placements);
+			placements = NULL;
+			break;
+		}
+
+		for(size_t i = 0; i < blockCount; i++)
+		{
+			const unsigned char* record = block + (i * PLACEMENT_RECORD_SIZE);
+			Vector3 position = { readFloat(record), readFloat(record + 4), readFloat(record + 8) };
+			if(record[12] >= NUMBER_OF_SCENERY_TYPES || !isfinite(position.x) || !isfinite(position.y) || !isfinite(position.z))
+				continue;
+
+			SceneryPlacement* placement = &placements[loaded++];
+			placement->position = position;
+			placement->type = record[12];
+			placement->yaw = record[13];
+			placement->scale = record[14] | (record[15] << 8);
+		}
+	}
+
+	free(block);
+	fclose(file);
+
+	if(placements != NULL)
+		*numberOfPlacements = loaded;
+
+	return placements;
+}
@@ -0,0 +1,23 @@
+#ifndef SCENERYFILE_H
+#define SCENERYFILE_H
+
+#include "engine.h"
+
+#define SCENERY_FILE_EXTENSION ".rcsc"
+
+typedef enum { SceneryTree, SceneryBuilding, SceneryQueueLine, NUMBER_OF_SCENERY_TYPES } SceneryType;
+
+/*	One object standing in the park, 16 bytes both in memory and on disk
+ *	Yaw is in 256ths of a turn about y and scale is in 256ths
+ */
+typedef struct {
+	Vector3 position;
+	unsigned char type;
+	unsigned char yaw;
+	unsigned short scale;
+} SceneryPlacement;
+
+int saveSceneryFile(const char* path, const SceneryPlacement* placements, int numberOfPlacements);
+SceneryPlacement* loadSceneryFile(const char* path, int* numberOfPlacements);
+
+#endif
@@ -0,0 +1,144 @@
+/*	SceneryGen.c
+ *	Writes a scenery file of trees and buildings scattered around the park
+ *
+ *	Usage: scenerygen [--seed n] [--radius r] [--clear r] [--terrain map.rchm] count output.rcsc
+ *	Objects are spread evenly over the ring between the clear radius, left empty for the coasters, and the outer
+ *	radius. Most are trees, the rest buildings with a queue line leading out of their door. Given a heightmap,
+ *	everything stands on its ground rather than at 0.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "engine.h"
+#include "heightmap.h"
+#include "sceneryfile.h"
+
+#define DEFAULT_SCENERY_RADIUS 400.0f
+#define DEFAULT_CLEAR_RADIUS 60.0f
+
+//One object in this many is a building
+#define BUILDING_FREQUENCY 20
+
+#define MIN_QUEUE_SEGMENTS 4
+#define MAX_QUEUE_SEGMENTS 8
+
+//Length of one queue line mesh, and how far in front of a building's centre its door is
+#define QUEUE_SEGMENT_LENGTH 2.0f
+#define BUILDING_DOOR_DISTANCE 4.0f
+
+static float getGroundHeight(const Heightmap* heightmap, float x, float z)
+{
+	return heightmap != NULL ? getHeightmapHeight(heightmap, x, z) : 0;
+}
+
+static SceneryPlacement makePlacement(const Heightmap* heightmap, SceneryType type, float x, float z, int yaw, float scale)
+{
+	SceneryPlacement placement;
+	placement.position = (Vector3) { x, getGroundHeight(heightmap, x, z), z };
+	placement.type = type;
+	placement.yaw = yaw & 0xFF;
+	placement.scale = (unsigned short) (scale * 256.0f);
+
+	return placement;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t seed = 1;
+	float radius = DEFAULT_SCENERY_RADIUS;
+	float clearRadius = DEFAULT_CLEAR_RADIUS;
+	const char* terrainPath = NULL;
+	int count = 0;
+	const char* outputPath = NULL;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "--radius") == 0 && i + 1 < argc)
+			radius = atof(argv[++i]);
+		else if(strcmp(argv[i], "--clear") == 0 && i + 1 < argc)
+			clearRadius = atof(argv[++i]);
+		else if(strcmp(argv[i], "--terrain") == 0 && i + 1 < argc)
+			terrainPath = argv[++i];
+		else if(count == 0)
+			count = atoi(argv[i]);
+		else if(outputPath == NULL)
+			outputPath = argv[i];
+		else
+			outputPath = NULL;
+	}
+
+	if(outputPath == NULL || count < 1 || clearRadius < 0 || radius <= clearRadius) {
+		printf("Usage: %s [--seed n] [--radius r] [--clear r] [--terrain map%s] count output%s\n", argv[0],
+			HEIGHTMAP_FILE_EXTENSION, SCENERY_FILE_EXTENSION);
+		return 1;
+	}
+
+	Heightmap* heightmap = NULL;
+	if(terrainPath != NULL)
+	{
+		heightmap = openHeightmap(terrainPath);
+		if(heightmap == NULL) {
+			printf("Could not open %s\n", terrainPath);
+			return 1;
+		}
+	}
+
+	Random random;
+	seedRandom(&random, seed);
+
+	//Each building brings its queue line with it
+	SceneryPlacement* placements = malloc(count * (1 + MAX_QUEUE_SEGMENTS) * sizeof(SceneryPlacement));
+	int numberOfPlacements = 0;
+	int numberOfObjects = 0;
+
+	for(int i = 0; i < count; i++)
+	{
+		//Even over the area of the ring, not bunched towards the middle
+		float distance = sqrtf(randomRange(&random, clearRadius * clearRadius, radius * radius));
+		float angle = randomRange(&random, 0, 2 * M_PI);
+		float x = distance * cosf(angle);
+		float z = distance * sinf(angle);
+		int yaw = nextRandom(&random) & 0xFF;
+
+		if(i % BUILDING_FREQUENCY != BUILDING_FREQUENCY - 1)
+		{
+			placements[numberOfPlacements++] = makePlacement(heightmap, SceneryTree, x, z, yaw, randomRange(&random, 0.7, 1.4));
+			numberOfObjects++;
+			continue;
+		}
+
+		placements[numberOfPlacements++] = makePlacement(heightmap, SceneryBuilding, x, z, yaw, 1.0f);
+		numberOfObjects++;
+
+		//Meshes face +z before being turned, so the door and the queue leading away from it are along the turned +z
+		float yawAngle = yaw * ((2 * M_PI) / 256.0);
+		float forwardX = sinf(yawAngle);
+		float forwardZ = cosf(yawAngle);
+
+		//The queue runs across its segments' x axis, a quarter turn from the building
+		int segments = MIN_QUEUE_SEGMENTS + (nextRandom(&random) % (MAX_QUEUE_SEGMENTS - MIN_QUEUE_SEGMENTS + 1));
+		for(int segment = 0; segment < segments; segment++)
+		{
+			float along = BUILDING_DOOR_DISTANCE + ((segment + 0.5f) * QUEUE_SEGMENT_LENGTH);
+			placements[numberOfPlacements++] = makePlacement(heightmap, SceneryQueueLine, x + (forwardX * along),
+				z + (forwardZ * along), yaw + 64, 1.0f);
+		}
+	}
+
+	int saved = saveSceneryFile(outputPath, placements, numberOfPlacements);
+
+	free(placements);
+	if(heightmap != NULL)
+		closeHeightmap(heightmap);
+
+	if(!saved) {
+		printf("Could not write %s\n", outputPath);
+		return 1;
+	}
+
+	printf("Wrote %d objects, %d placements with their queue lines, to %s\n", numberOfObjects, numberOfPlacements, outputPath);
+	return 0;
+}
@@ -0,0 +1,43 @@
+/*	Snapshot.c
+ *	This module hands simulation state from the simulation thread to the render thread
+ *
+ *	It is a lock-free triple buffer: the simulation always owns one buffer to write into, the renderer
+ *	always owns one buffer to read from, and the third sits in the middle waiting to be swapped.
+ *	Neither side ever waits on the other, the renderer just picks up the newest finished snapshot.
+ */
+#include <stdatomic.h>
+#include "snapshot.h"
+
+#define INDEX_MASK 3
+#define FRESH_FLAG 4
+
+static SimSnapshot buffers[3];
+
+static int writeIndex = 0;
+static int readIndex = 1;
+static atomic_int middleIndex = 2;
+
+/* Returns the buffer the simulation thread may fill, only valid until the next publishSnapshot() */
+SimSnapshot* beginSnapshotWrite()
+{
+	return &buffers[writeIndex];
+}
+
+/* Makes the written buffer the newest snapshot and takes the old middle buffer to write into next */
+void publishSnapshot()
+{
+	int previous = atomic_exchange_explicit(&middleIndex, writeIndex | FRESH_FLAG, memory_order_acq_rel);
+	writeIndex = previous & INDEX_MASK;
+}
+
+/* Returns the newest published snapshot, or the last one read if nothing new has been published */
+const SimSnapshot* acquireSnapshot()
+{
+	if(atomic_load_explicit(&middleIndex, memory_order_relaxed) & FRESH_FLAG)
+	{
+		int previous = atomic_exchange_explicit(&middleIndex, readIndex, memory_order_acq_rel);
+		readIndex = previous & INDEX_MASK;
+	}
+
+	return &buffers[readIndex];
+}
@@ -0,0 +1,21 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "engine.h"
+#include "camera.h"
+#include "park.h"
+
+/*	Everything the renderer needs to draw one frame, published by the simulation thread */
+typedef struct {
+	unsigned long tick;
+	int paused;
+
+	CameraSnapshot camera;
+	ParkSnapshot park;
+} SimSnapshot;
+
+SimSnapshot* beginSnapshotWrite(void);
+void publishSnapshot(void);
+const SimSnapshot* acquireSnapshot(void);
+
+#endif
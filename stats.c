@@ -0,0 +1,179 @@
+/*	Stats.c
+ *	This module publishes live statistics into a POSIX shared memory segment for external monitors
+ *
+ *	The segment is protected by a seqlock: the single writer bumps the sequence to odd, writes, then bumps it back to
+ *	even. Readers copy the whole struct and retry if the sequence was odd or changed under them, so the writer never
+ *	waits on a reader and a slow reader can never stall the render thread.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+static LiveStats* stats = NULL;
+static char statsName[256];
+
+
+//==============WRITING=======================
+
+#ifndef _WIN32
+
+int startStats(const char* name)
+{
+	int descriptor = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if(descriptor < 0 || ftruncate(descriptor, sizeof(LiveStats)) != 0) {
+		printf("Could not create shared memory stats %s\n", name);
+		return 0;
+	}
+
+	stats = mmap(NULL, sizeof(LiveStats), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	close(descriptor);
+
+	if(stats == MAP_FAILED) {
+		stats = NULL;
+		return 0;
+	}
+
+	snprintf(statsName, sizeof(statsName), "%s", name);
+
+	memset(stats, 0, sizeof(LiveStats));
+	stats->version = STATS_VERSION;
+	stats->size = sizeof(LiveStats);
+	stats->pid = getpid();
+
+	//Readers check the magic last, so it only appears once the header is complete
+	atomic_thread_fence(memory_order_release);
+	stats->magic = STATS_MAGIC;
+
+	return 1;
+}
+
+void stopStats()
+{
+	if(stats == NULL)
+		return;
+
+	munmap(stats, sizeof(LiveStats));
+	shm_unlink(statsName);
+	stats = NULL;
+}
+
+#else
+
+int startStats(const char* name)
+{
+	printf("Shared memory stats are not supported on this platform\n");
+	return 0;
+}
+
+void stopStats()
+{
+}
+
+#endif
+
+/* Returns the stats to fill in, or NULL if stats aren't being published. Must be followed by endStatsUpdate() */
+LiveStats* beginStatsUpdate()
+{
+	if(stats == NULL)
+		return NULL;
+
+	atomic_fetch_add_explicit(&(stats->sequence), 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	return stats;
+}
+
+void endStatsUpdate()
+{
+	atomic_fetch_add_explicit(&(stats->sequence), 1, memory_order_release);
+}
+
+/* Reads the process' memory use, this costs a file read so don't call it every frame */
+void readMemoryUsage(uint64_t* resident, uint64_t* peakResident)
+{
+	*resident = 0;
+	*peakResident = 0;
+
+#ifndef _WIN32
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if(statm != NULL)
+	{
+		unsigned long size, pages;
+		if(fscanf(statm, "%lu %lu", &size, &pages) == 2)
+			*resident = (uint64_t) pages * sysconf(_SC_PAGESIZE);
+		fclose(statm);
+	}
+
+	//ru_maxrss is in kilobytes on Linux
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) == 0)
+		*peakResident = (uint64_t) usage.ru_maxrss * 1024;
+#endif
+}
+
+
+//==============READING=======================
+
+#ifndef _WIN32
+
+const LiveStats* openStats(const char* name)
+{
+	int descriptor = shm_open(name, O_RDONLY, 0);
+	if(descriptor < 0)
+		return NULL;
+
+	const LiveStats* shared = mmap(NULL, sizeof(LiveStats), PROT_READ, MAP_SHARED, descriptor, 0);
+	close(descriptor);
+
+	if(shared == MAP_FAILED)
+		return NULL;
+
+	return shared;
+}
+
+void closeStats(const LiveStats* shared)
+{
+	munmap((void*) shared, sizeof(LiveStats));
+}
+
+#else
+
+const LiveStats* openStats(const char* name)
+{
+	return NULL;
+}
+
+void closeStats(const LiveStats* shared)
+{
+}
+
+#endif
+
+/* Takes a consistent copy of the stats, returns 0 if the segment isn't a compatible stats segment */
+int readStats(const LiveStats* shared, LiveStats* copy)
+{
+	if(shared->magic != STATS_MAGIC || shared->version != STATS_VERSION || shared->size != sizeof(LiveStats))
+		return 0;
+
+	for(;;)
+	{
+		unsigned int before = atomic_load_explicit(&(shared->sequence), memory_order_acquire);
+
+		if((before & 1) == 0)
+		{
+			memcpy(copy, (const void*) shared, sizeof(LiveStats));
+			atomic_thread_fence(memory_order_acquire);
+
+			if(atomic_load_explicit(&(shared->sequence), memory_order_relaxed) == before)
+				return 1;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "rendertimer.h"
+
+#define STATS_DEFAULT_NAME "/rollercoaster-stats"
+#define STATS_MAGIC 0x52435354
+#define STATS_VERSION 2
+
+/*	The layout of the shared memory segment, readers must check magic, version and size before trusting the rest
+ *	sequence is odd while the writer is part way through an update
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t pid;
+	atomic_uint sequence;
+
+	uint64_t frame;
+	double frameTime;
+	double averageFrameTime;
+	double maxFrameTime;
+
+	uint64_t simulationTick;
+	double simulationRate;
+	uint32_t paused;
+
+	uint32_t trainCount;
+	uint32_t controlPoints;
+	uint32_t trackSubSections;
+
+	uint64_t residentBytes;
+	uint64_t peakResidentBytes;
+
+	//Seconds per render pass, the GPU times trail the CPU times by a couple of frames
+	double passCpuTimes[NUMBER_OF_RENDER_PASSES];
+	double passGpuTimes[NUMBER_OF_RENDER_PASSES];
+	uint32_t passGpuTimed;
+} LiveStats;
+
+//Writing, from the render thread
+int startStats(const char* name);
+void stopStats(void);
+LiveStats* beginStatsUpdate(void);
+void endStatsUpdate(void);
+void readMemoryUsage(uint64_t* resident, uint64_t* peakResident);
+
+//Reading
+const LiveStats* openStats(const char* name);
+int readStats(const LiveStats* shared, LiveStats* copy);
+void closeStats(const LiveStats* shared);
+
+#endif
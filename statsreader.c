@@ -0,0 +1,84 @@
+/*	StatsReader.c
+ *	Tails the live stats a running rollercoaster publishes with --stats
+ *
+ *	Usage: statsreader [--name segment] [--interval milliseconds] [--once]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+static void printStats(const LiveStats* stats)
+{
+	printf("pid %u  frame %llu  %.2f ms (avg %.2f, max %.2f)  sim tick %llu at %.1f Hz%s  trains %u  points %u  subsections %u  rss %.1f MB (peak %.1f MB)\n",
+		stats->pid, (unsigned long long) stats->frame,
+		stats->frameTime * 1000.0, stats->averageFrameTime * 1000.0, stats->maxFrameTime * 1000.0,
+		(unsigned long long) stats->simulationTick, stats->simulationRate, stats->paused ? " (paused)" : "",
+		stats->trainCount, stats->controlPoints, stats->trackSubSections,
+		stats->residentBytes / (1024.0 * 1024.0), stats->peakResidentBytes / (1024.0 * 1024.0));
+
+	static const char* const passNames[] = RENDER_PASS_NAMES;
+
+	printf("  passes cpu/gpu ms:");
+	for(int i = 0; i < NUMBER_OF_RENDER_PASSES; i++)
+	{
+		if(stats->passGpuTimed)
+			printf("  %s %.2f/%.2f", passNames[i], stats->passCpuTimes[i] * 1000.0, stats->passGpuTimes[i] * 1000.0);
+		else
+			printf("  %s %.2f/-", passNames[i], stats->passCpuTimes[i] * 1000.0);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	const char* name = STATS_DEFAULT_NAME;
+	int interval = 500;
+	int once = 0;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+			name = argv[++i];
+		else if(strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+			interval = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--once") == 0)
+			once = 1;
+		else {
+			printf("Usage: %s [--name segment] [--interval milliseconds] [--once]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	const LiveStats* shared = openStats(name);
+	if(shared == NULL) {
+		printf("No stats published under %s, is rollercoaster running with --stats?\n", name);
+		return 1;
+	}
+
+	LiveStats stats;
+	unsigned long long lastFrame = ~0ULL;
+
+	for(;;)
+	{
+		if(!readStats(shared, &stats)) {
+			printf("%s is not a compatible stats segment\n", name);
+			return 1;
+		}
+
+		if(stats.frame != lastFrame)
+			printStats(&stats);
+		lastFrame = stats.frame;
+
+		if(once)
+			break;
+
+		struct timespec wait = { interval / 1000, (interval % 1000) * 1000000L };
+		nanosleep(&wait, NULL);
+	}
+
+	closeStats(shared);
+	return 0;
+}
@@ -0,0 +1,365 @@
+/*	Telemetry.c
+ *	This module streams the train's state to disk every tick for offline analysis
+ *
+ *	The simulation thread only ever copies a sample into a preallocated ring of blocks. A background writer thread
+ *	picks up full blocks, encodes them and writes them out, so the simulation never waits on the disk.
+ *	If the writer falls a whole ring behind, samples are dropped and counted rather than stalling the simulation.
+ *
+ *	Each block is encoded independently. Values are quantized to fixed point, then continuous values (distance,
+ *	position, velocity) are stored as second differences and discrete ones as first differences, all as zigzag
+ *	varints. A smooth ride turns into mostly single byte values.
+ *
+ *	File layout, after the "RCTM" magic and a version byte, is one entry per block:
+ *		varint sample count, varint encoded length, encoded samples
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "encoding.h"
+#include "telemetry.h"
+
+#define TELEMETRY_MAGIC "RCTM"
+#define TELEMETRY_VERSION 1
+
+//Must be a power of 2
+#define NUMBER_OF_BLOCKS 16
+
+//Quantization step of distance, position and velocity
+#define TELEMETRY_SCALE 10000.0
+
+#define CONTINUOUS_FIELDS 5
+#define DISCRETE_FIELDS 4
+#define MAX_BYTES_PER_SAMPLE ((CONTINUOUS_FIELDS + DISCRETE_FIELDS) * MAX_VARINT_BYTES)
+
+typedef struct {
+	int count;
+	TelemetrySample samples[TELEMETRY_SAMPLES_PER_BLOCK];
+} TelemetryBlock;
+
+struct TelemetryReader {
+	FILE* file;
+	unsigned char* buffer;
+};
+
+static void* writerLoop(void* arg);
+static void finishSample(void);
+static void writeBlock(const TelemetryBlock* block);
+static int encodeBlock(const TelemetrySample* samples, int count, unsigned char* buffer);
+static void decodeBlock(const unsigned char* buffer, const unsigned char* end, TelemetrySample* samples, int count);
+
+static FILE* telemetryFile = NULL;
+static TelemetryBlock* blocks = NULL;
+static unsigned char* encodeBuffer = NULL;
+
+//Blocks are filled by the simulation thread and flushed by the writer thread, both only ever count up
+static atomic_uint filledBlocks = 0;
+static atomic_uint flushedBlocks = 0;
+static atomic_uint droppedSamples = 0;
+
+static atomic_int active = 0;
+static atomic_int sampling = 0;
+static int stopping = 0;
+
+static pthread_t writerThread;
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writerWake = PTHREAD_COND_INITIALIZER;
+
+
+//==============WRITING=======================
+
+int startTelemetry(const char* path)
+{
+	telemetryFile = fopen(path, "wb");
+	if(telemetryFile == NULL) {
+		printf("Could not open %s for telemetry\n", path);
+		return 0;
+	}
+
+	fwrite(TELEMETRY_MAGIC, 1, 4, telemetryFile);
+	fputc(TELEMETRY_VERSION, telemetryFile);
+
+	blocks = calloc(NUMBER_OF_BLOCKS, sizeof(TelemetryBlock));
+	encodeBuffer = malloc(TELEMETRY_SAMPLES_PER_BLOCK * MAX_BYTES_PER_SAMPLE);
+
+	pthread_create(&writerThread, NULL, writerLoop, NULL);
+	atomic_store(&active, 1);
+
+	return 1;
+}
+
+int isTelemetryActive()
+{
+	return atomic_load_explicit(&active, memory_order_relaxed);
+}
+
+/* Called from the simulation thread, copies the sample into the current block */
+void recordTelemetry(const TelemetrySample* sample)
+{
+	atomic_store(&sampling, 1);
+
+	if(!atomic_load(&active)) {
+		finishSample();
+		return;
+	}
+
+	unsigned int filled = atomic_load_explicit(&filledBlocks, memory_order_relaxed);
+	unsigned int flushed = atomic_load_explicit(&flushedBlocks, memory_order_acquire);
+
+	if(filled - flushed >= NUMBER_OF_BLOCKS) {
+		atomic_fetch_add_explicit(&droppedSamples, 1, memory_order_relaxed);
+		finishSample();
+		return;
+	}
+
+	TelemetryBlock* block = &blocks[filled & (NUMBER_OF_BLOCKS - 1)];
+	block->samples[block->count++] = *sample;
+
+	//Hand full blocks to the writer
+	if(block->count == TELEMETRY_SAMPLES_PER_BLOCK)
+	{
+		pthread_mutex_lock(&writerLock);
+		atomic_store_explicit(&filledBlocks, filled + 1, memory_order_release);
+		pthread_cond_broadcast(&writerWake);
+		pthread_mutex_unlock(&writerLock);
+	}
+
+	finishSample();
+}
+
+/*	Wakes stopTelemetry if it is waiting for this sample to finish
+ *	Either the sample sees active cleared here or stopTelemetry sees sampling cleared, so no wake is missed
+ */
+static void finishSample()
+{
+	atomic_store(&sampling, 0);
+
+	if(!atomic_load(&active))
+	{
+		pthread_mutex_lock(&writerLock);
+		pthread_cond_broadcast(&writerWake);
+		pthread_mutex_unlock(&writerLock);
+	}
+}
+
+/* Flushes everything recorded so far and closes the file, safe to call from any thread */
+void stopTelemetry()
+{
+	if(!atomic_exchange(&active, 0))
+		return;
+
+	//Sleep through a sample that is being recorded right now, the writer shares the wake so both are woken
+	pthread_mutex_lock(&writerLock);
+	while(atomic_load(&sampling))
+		pthread_cond_wait(&writerWake, &writerLock);
+
+	stopping = 1;
+	pthread_cond_broadcast(&writerWake);
+	pthread_mutex_unlock(&writerLock);
+
+	pthread_join(writerThread, NULL);
+
+	//The writer has flushed every full block, only the partial one is left
+	TelemetryBlock* partial = &blocks[atomic_load(&filledBlocks) & (NUMBER_OF_BLOCKS - 1)];
+	if(partial->count > 0)
+		writeBlock(partial);
+
+	fclose(telemetryFile);
+	telemetryFile = NULL;
+
+	if(atomic_load(&droppedSamples) > 0)
+		printf("Telemetry dropped %u samples\n", atomic_load(&droppedSamples));
+
+	free(blocks);
+	free(encodeBuffer);
+}
+
+static void* writerLoop(void* arg)
+{
+	for(;;)
+	{
+		pthread_mutex_lock(&writerLock);
+		while(atomic_load(&flushedBlocks) == atomic_load(&filledBlocks) && !stopping)
+			pthread_cond_wait(&writerWake, &writerLock);
+		int stop = stopping;
+		pthread_mutex_unlock(&writerLock);
+
+		unsigned int filled = atomic_load_explicit(&filledBlocks, memory_order_acquire);
+		unsigned int flushed = atomic_load_explicit(&flushedBlocks, memory_order_relaxed);
+
+		while(flushed != filled)
+		{
+			TelemetryBlock* block = &blocks[flushed & (NUMBER_OF_BLOCKS - 1)];
+			writeBlock(block);
+			block->count = 0;
+
+			flushed++;
+			atomic_store_explicit(&flushedBlocks, flushed, memory_order_release);
+		}
+
+		if(stop)
+			return NULL;
+	}
+}
+
+static void writeBlock(const TelemetryBlock* block)
+{
+	unsigned char header[2 * MAX_VARINT_BYTES];
+	int length = encodeBlock(block->samples, block->count, encodeBuffer);
+
+	int headerLength = writeVarint(header, block->count);
+	headerLength += writeVarint(header + headerLength, length);
+
+	fwrite(header, 1, headerLength, telemetryFile);
+	fwrite(encodeBuffer, 1, length, telemetryFile);
+}
+
+
+//==============ENCODING======================
+
+static void quantizeSample(const TelemetrySample* sample, int64_t* continuous, int64_t* discrete)
+{
+	continuous[0] = llround(sample->distance * TELEMETRY_SCALE);
+	continuous[1] = llround(sample->position.x * TELEMETRY_SCALE);
+	continuous[2] = llround(sample->position.y * TELEMETRY_SCALE);
+	continuous[3] = llround(sample->position.z * TELEMETRY_SCALE);
+	continuous[4] = llround(sample->velocity * TELEMETRY_SCALE);
+
+	discrete[0] = sample->tick;
+	discrete[1] = sample->trackIndex;
+	discrete[2] = sample->subSectionIndex;
+	discrete[3] = sample->flags;
+}
+
+static int encodeBlock(const TelemetrySample* samples, int count, unsigned char* buffer)
+{
+	int64_t previous[CONTINUOUS_FIELDS] = {0};
+	int64_t previousDelta[CONTINUOUS_FIELDS] = {0};
+	int64_t previousDiscrete[DISCRETE_FIELDS] = {0};
+	int length = 0;
+
+	for(int i = 0; i < count; i++)
+	{
+		int64_t continuous[CONTINUOUS_FIELDS];
+		int64_t discrete[DISCRETE_FIELDS];
+		quantizeSample(&samples[i], continuous, discrete);
+
+		for(int f = 0; f < DISCRETE_FIELDS; f++)
+		{
+			length += writeVarint(buffer + length, zigzagEncode(discrete[f] - previousDiscrete[f]));
+			previousDiscrete[f] = discrete[f];
+		}
+
+		for(int f = 0; f < CONTINUOUS_FIELDS; f++)
+		{
+			int64_t delta = continuous[f] - previous[f];
+			length += writeVarint(buffer + length, zigzagEncode(delta - previousDelta[f]));
+
+			previous[f] = continuous[f];
+			previousDelta[f] = delta;
+		}
+	}
+
+	return length;
+}
+
+static void decodeBlock(const unsigned char* buffer, const unsigned char* end, TelemetrySample* samples, int count)
+{
+	int64_t previous[CONTINUOUS_FIELDS] = {0};
+	int64_t previousDelta[CONTINUOUS_FIELDS] = {0};
+	int64_t previousDiscrete[DISCRETE_FIELDS] = {0};
+
+	for(int i = 0; i < count; i++)
+	{
+		for(int f = 0; f < DISCRETE_FIELDS; f++)
+			previousDiscrete[f] += zigzagDecode(readVarint(&buffer, end));
+
+		for(int f = 0; f < CONTINUOUS_FIELDS; f++)
+		{
+			previousDelta[f] += zigzagDecode(readVarint(&buffer, end));
+			previous[f] += previousDelta[f];
+		}
+
+		samples[i].tick = (uint32_t) previousDiscrete[0];
+		samples[i].trackIndex = (int32_t) previousDiscrete[1];
+		samples[i].subSectionIndex = (int32_t) previousDiscrete[2];
+		samples[i].flags = (uint32_t) previousDiscrete[3];
+
+		samples[i].distance = previous[0] / TELEMETRY_SCALE;
+		samples[i].position.x = previous[1] / TELEMETRY_SCALE;
+		samples[i].position.y = previous[2] / TELEMETRY_SCALE;
+		samples[i].position.z = previous[3] / TELEMETRY_SCALE;
+		samples[i].velocity = previous[4] / TELEMETRY_SCALE;
+	}
+}
+
+
+//==============READING=======================
+
+TelemetryReader* openTelemetry(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if(file == NULL)
+		return NULL;
+
+	unsigned char header[5];
+	if(fread(header, 1, 5, file) != 5 || memcmp(header, TELEMETRY_MAGIC, 4) != 0 || header[4] != TELEMETRY_VERSION) {
+		fclose(file);
+		return NULL;
+	}
+
+	TelemetryReader* reader = malloc(sizeof(TelemetryReader));
+	reader->file = file;
+	reader->buffer = malloc(TELEMETRY_SAMPLES_PER_BLOCK * MAX_BYTES_PER_SAMPLE);
+
+	return reader;
+}
+
+static int readFileVarint(FILE* file, uint64_t* value)
+{
+	unsigned char bytes[MAX_VARINT_BYTES];
+	int length = 0;
+	int c;
+
+	do {
+		c = fgetc(file);
+		if(c == EOF)
+			return 0;
+		bytes[length++] = (unsigned char) c;
+	} while((c & 0x80) && length < MAX_VARINT_BYTES);
+
+	const unsigned char* cursor = bytes;
+	*value = readVarint(&cursor, bytes + length);
+
+	return 1;
+}
+
+/* Decodes the next block into samples, which must hold TELEMETRY_SAMPLES_PER_BLOCK
+ * Returns the number of samples read, 0 at the end of the file
+ */
+int readTelemetryBlock(TelemetryReader* reader, TelemetrySample* samples)
+{
+	uint64_t count, length;
+
+	if(!readFileVarint(reader->file, &count) || !readFileVarint(reader->file, &length))
+		return 0;
+
+	if(count > TELEMETRY_SAMPLES_PER_BLOCK || length > TELEMETRY_SAMPLES_PER_BLOCK * MAX_BYTES_PER_SAMPLE)
+		return 0;
+
+	if(fread(reader->buffer, 1, length, reader->file) != length)
+		return 0;
+
+	decodeBlock(reader->buffer, reader->buffer + length, samples, (int) count);
+
+	return (int) count;
+}
+
+void closeTelemetry(TelemetryReader* reader)
+{
+	fclose(reader->file);
+	free(reader->buffer);
+	free(reader);
+}
@@ -0,0 +1,36 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "engine.h"
+
+#define TELEMETRY_CHAIN 1
+#define TELEMETRY_BOOST 2
+
+#define TELEMETRY_SAMPLES_PER_BLOCK 1024
+
+typedef struct {
+	uint32_t tick;
+	int32_t trackIndex;
+	int32_t subSectionIndex;
+	uint32_t flags;
+
+	double distance;
+	Vector3 position;
+	float velocity;
+} TelemetrySample;
+
+//Writing, from the simulation thread
+int startTelemetry(const char* path);
+int isTelemetryActive(void);
+void recordTelemetry(const TelemetrySample* sample);
+void stopTelemetry(void);
+
+//Reading
+typedef struct TelemetryReader TelemetryReader;
+
+TelemetryReader* openTelemetry(const char* path);
+int readTelemetryBlock(TelemetryReader* reader, TelemetrySample* samples);
+void closeTelemetry(TelemetryReader* reader);
+
+#endif
@@ -0,0 +1,59 @@
+/*	TelemetryDump.c
+ *	Converts a telemetry file recorded with --telemetry into CSV
+ *
+ *	Usage: telemetrydump telemetry.rctm [output.csv]
+ *	Writes to stdout when no output file is given
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include "telemetry.h"
+
+int main(int argc, char *argv[])
+{
+	if(argc < 2) {
+		printf("Usage: %s telemetry-file [output.csv]\n", argv[0]);
+		return 1;
+	}
+
+	TelemetryReader* reader = openTelemetry(argv[1]);
+	if(reader == NULL) {
+		printf("%s is not a telemetry file\n", argv[1]);
+		return 1;
+	}
+
+	FILE* output = stdout;
+	if(argc > 2)
+		output = fopen(argv[2], "w");
+
+	if(output == NULL) {
+		printf("Could not open %s\n", argv[2]);
+		return 1;
+	}
+
+	TelemetrySample* samples = malloc(TELEMETRY_SAMPLES_PER_BLOCK * sizeof(TelemetrySample));
+	int count;
+
+	fprintf(output, "tick,distance,x,y,z,velocity,section,subsection,chain,boost\n");
+
+	while((count = readTelemetryBlock(reader, samples)) > 0)
+	{
+		for(int i = 0; i < count; i++)
+		{
+			TelemetrySample* sample = &samples[i];
+
+			fprintf(output, "%u,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%d,%d,%d\n",
+				sample->tick, sample->distance,
+				sample->position.x, sample->position.y, sample->position.z,
+				sample->velocity, sample->trackIndex, sample->subSectionIndex,
+				(sample->flags & TELEMETRY_CHAIN) != 0, (sample->flags & TELEMETRY_BOOST) != 0);
+		}
+	}
+
+	closeTelemetry(reader);
+	free(samples);
+
+	if(output != stdout)
+		fclose(output);
+
+	return 0;
+}
@@ -0,0 +1,411 @@
+/*	Terrain.c
+ *	This module draws the ground from a heightmap, streaming it in around the camera
+ *
+ *	A background thread turns heightmap tiles into chunk meshes, coarser the further they are from the camera,
+ *	into a fixed set of slots that are recycled least recently used first. The render thread only compiles finished
+ *	meshes into display lists and hands evicted tiles' pages back to the system, so memory stays the same however
+ *	big the map is.
+ */
+#include <stdlib.h>
+#include <math.h>
+#include <GL/glut.h>
+#include "terrain.h"
+
+//Finished meshes compiled per frame, so a burst of them arriving doesn't stall the frame
+#define TERRAIN_UPLOADS_PER_FRAME 4
+
+static void* streamLoop(void* arg);
+static void buildChunk(const Terrain* terrain, TerrainChunk* chunk);
+static int getEdgeIndex(int samplesPerSide, int edge, int i);
+static int findChunk(const Terrain* terrain, int tileX, int tileZ, int lod);
+static void requestChunk(Terrain* terrain, int tileX, int tileZ, int lod);
+static int claimChunk(Terrain* terrain);
+static int isTileNeeded(const Terrain* terrain, int tileX, int tileZ);
+static void compileChunk(TerrainChunk* chunk);
+
+
+/* Starts streaming a heightmap, which must stay open until the terrain is freed */
+Terrain* createTerrain(const Heightmap* heightmap)
+{
+	Terrain* terrain = calloc(1, sizeof(Terrain));
+	terrain->heightmap = heightmap;
+
+	//Every slot is sized for the most detailed mesh up front and never grows
+	int maxSamples = HEIGHTMAP_TILE_SAMPLES + 1;
+	int maxVertices = (maxSamples * maxSamples) + (4 * maxSamples);
+
+	for(int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+	{
+		atomic_init(&(terrain->chunks[i].state), ChunkFree);
+		terrain->chunks[i].vertices = malloc(maxVertices * sizeof(Vector3));
+		terrain->chunks[i].colours = malloc(maxVertices * sizeof(Vector3));
+	}
+
+	pthread_mutex_init(&(terrain->lock), NULL);
+	pthread_cond_init(&(terrain->wake), NULL);
+	pthread_create(&(terrain->thread), NULL, streamLoop, terrain);
+
+	return terrain;
+}
+
+/* Stops streaming and frees the meshes, must be called from the render thread */
+void freeTerrain(Terrain* terrain)
+{
+	pthread_mutex_lock(&(terrain->lock));
+	terrain->stopping = 1;
+	pthread_cond_signal(&(terrain->wake));
+	pthread_mutex_unlock(&(terrain->lock));
+	pthread_join(terrain->thread, NULL);
+
+	for(int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+	{
+		if(terrain->chunks[i].list != 0)
+			glDeleteLists(terrain->chunks[i].list, 1);
+
+		free(terrain->chunks[i].vertices);
+		free(terrain->chunks[i].colours);
+	}
+
+	pthread_mutex_destroy(&(terrain->lock));
+	pthread_cond_destroy(&(terrain->wake));
+	free(terrain);
+}
+
+
+//==============STREAMING=====================
+
+/*	Asks for the chunks around the camera, nearest first, and compiles any that have finished
+ *	A tile keeps drawing at whatever detail it has until the detail it should have is ready
+ */
+void updateTerrain(Terrain* terrain, const Vector3* eye)
+{
+	terrain->frame++;
+
+	float tileSize = HEIGHTMAP_TILE_SAMPLES * terrain->heightmap->spacing;
+	int centreX = (int) floorf((eye->x - terrain->heightmap->originX) / tileSize);
+	int centreZ = (int) floorf((eye->z - terrain->heightmap->originZ) / tileSize);
+
+	int radius = (int) ceilf(FAR_PLANE / tileSize);
+	if(radius > TERRAIN_MAX_RADIUS)
+		radius = TERRAIN_MAX_RADIUS;
+
+	//Everything in use is marked before anything is requested, so requests never evict a chunk still being drawn
+	int missing[TERRAIN_MAX_CHUNKS][3];
+	int numberOfMissing = 0;
+
+	for(int ring = 0; ring <= radius; ring++)
+	{
+		int lod = ring < TERRAIN_LOD_LEVELS ? ring : TERRAIN_LOD_LEVELS - 1;
+
+		for(int tileZ = centreZ - ring; tileZ <= centreZ + ring; tileZ++)
+		{
+			for(int tileX = centreX - ring; tileX <= centreX + ring; tileX++)
+			{
+				int onRing = abs(tileX - centreX) == ring || abs(tileZ - centreZ) == ring;
+				if(!onRing || tileX < 0 || tileZ < 0 || tileX >= terrain->heightmap->tilesX || tileZ >= terrain->heightmap->tilesZ)
+					continue;
+
+				int wanted = findChunk(terrain, tileX, tileZ, lod);
+				if(wanted != -1)
+					terrain->chunks[wanted].lastUsed = terrain->frame;
+				else if(numberOfMissing < TERRAIN_MAX_CHUNKS) {
+					missing[numberOfMissing][0] = tileX;
+					missing[numberOfMissing][1] = tileZ;
+					missing[numberOfMissing][2] = lod;
+					numberOfMissing++;
+				}
+
+				if(wanted != -1 && atomic_load(&(terrain->chunks[wanted].state)) == ChunkReady)
+					continue;
+
+				//Fall back to the closest detail already compiled
+				for(int offset = 1; offset < TERRAIN_LOD_LEVELS; offset++)
+				{
+					int coarser = findChunk(terrain, tileX, tileZ, lod + offset);
+					int finer = findChunk(terrain, tileX, tileZ, lod - offset);
+
+					if(coarser != -1 && atomic_load(&(terrain->chunks[coarser].state)) == ChunkReady) {
+						terrain->chunks[coarser].lastUsed = terrain->frame;
+						break;
+					}
+					if(finer != -1 && atomic_load(&(terrain->chunks[finer].state)) == ChunkReady) {
+						terrain->chunks[finer].lastUsed = terrain->frame;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	for(int i = 0; i < numberOfMissing; i++)
+		requestChunk(terrain, missing[i][0], missing[i][1], missing[i][2]);
+
+	int uploads = 0;
+	for(int i = 0; i < TERRAIN_MAX_CHUNKS && uploads < TERRAIN_UPLOADS_PER_FRAME; i++)
+	{
+		if(atomic_load(&(terrain->chunks[i].state)) == ChunkBuilt) {
+			compileChunk(&(terrain->chunks[i]));
+			uploads++;
+		}
+	}
+}
+
+/* Finds the slot holding a tile at a level of detail, whatever state it's in */
+static int findChunk(const Terrain* terrain, int tileX, int tileZ, int lod)
+{
+	if(lod < 0 || lod >= TERRAIN_LOD_LEVELS)
+		return -1;
+
+	for(int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+	{
+		const TerrainChunk* chunk = &(terrain->chunks[i]);
+		if(atomic_load(&(chunk->state)) != ChunkFree && chunk->tileX == tileX && chunk->tileZ == tileZ && chunk->lod == lod)
+			return i;
+	}
+
+	return -1;
+}
+
+/* Queues a tile to be meshed, unless every slot is still in use this frame */
+static void requestChunk(Terrain* terrain, int tileX, int tileZ, int lod)
+{
+	int slot = claimChunk(terrain);
+	if(slot == -1)
+		return;
+
+	TerrainChunk* chunk = &(terrain->chunks[slot]);
+	chunk->tileX = tileX;
+	chunk->tileZ = tileZ;
+	chunk->lod = lod;
+	chunk->lastUsed = terrain->frame;
+
+	adviseHeightmapTile(terrain->heightmap, tileX, tileZ, 1);
+
+	pthread_mutex_lock(&(terrain->lock));
+	atomic_store(&(chunk->state), ChunkQueued);
+	terrain->queue[(terrain->queueStart + terrain->queueLength) % TERRAIN_MAX_CHUNKS] = slot;
+	terrain->queueLength++;
+	pthread_cond_signal(&(terrain->wake));
+	pthread_mutex_unlock(&(terrain->lock));
+}
+
+/*	Finds a free slot, or frees the compiled one used longest ago
+ *	Slots used this frame and slots the streaming thread has are never taken
+ */
+static int claimChunk(Terrain* terrain)
+{
+	int oldest = -1;
+
+	for(int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+	{
+		TerrainChunk* chunk = &(terrain->chunks[i]);
+		ChunkState state = atomic_load(&(chunk->state));
+
+		if(state == ChunkFree)
+			return i;
+
+		if(state == ChunkReady && chunk->lastUsed != terrain->frame && (oldest == -1 || chunk->lastUsed < terrain->chunks[oldest].lastUsed))
+			oldest = i;
+	}
+
+	if(oldest == -1)
+		return -1;
+
+	TerrainChunk* chunk = &(terrain->chunks[oldest]);
+	glDeleteLists(chunk->list, 1);
+	chunk->list = 0;
+	atomic_store(&(chunk->state), ChunkFree);
+
+	//Give back the pages of the tile and of the neighbours its edges read into, unless another chunk still needs them
+	for(int tileZ = chunk->tileZ - 1; tileZ <= chunk->tileZ + 1; tileZ++)
+	{
+		for(int tileX = chunk->tileX - 1; tileX <= chunk->tileX + 1; tileX++)
+		{
+			if(tileX < 0 || tileZ < 0 || tileX >= terrain->heightmap->tilesX || tileZ >= terrain->heightmap->tilesZ)
+				continue;
+
+			if(!isTileNeeded(terrain, tileX, tileZ))
+				adviseHeightmapTile(terrain->heightmap, tileX, tileZ, 0);
+		}
+	}
+
+	return oldest;
+}
+
+/* Whether any chunk holds the tile or one next to it, so meshing it could still read the tile's samples */
+static int isTileNeeded(const Terrain* terrain, int tileX, int tileZ)
+{
+	for(int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+	{
+		const TerrainChunk* chunk = &(terrain->chunks[i]);
+		if(atomic_load(&(chunk->state)) != ChunkFree && abs(chunk->tileX - tileX) <= 1 && abs(chunk->tileZ - tileZ) <= 1)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Meshes queued chunks one at a time until the terrain is closed */
+static void* streamLoop(void* arg)
+{
+	Terrain* terrain = arg;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&(terrain->lock));
+		while(terrain->queueLength == 0 && !terrain->stopping)
+			pthread_cond_wait(&(terrain->wake), &(terrain->lock));
+
+		if(terrain->stopping) {
+			pthread_mutex_unlock(&(terrain->lock));
+			return NULL;
+		}
+
+		int slot = terrain->queue[terrain->queueStart];
+		terrain->queueStart = (terrain->queueStart + 1) % TERRAIN_MAX_CHUNKS;
+		terrain->queueLength--;
+		pthread_mutex_unlock(&(terrain->lock));
+
+		buildChunk(terrain, &(terrain->chunks[slot]));
+		atomic_store(&(terrain->chunks[slot].state), ChunkBuilt);
+	}
+}
+
+
+//==============MESHES========================
+
+/*	Meshes one tile, reaching one sample into its neighbours so chunks meet without gaps
+ *	Colours are shaded by slope since the rest of the scene is drawn unlit
+ */
+static void buildChunk(const Terrain* terrain, TerrainChunk* chunk)
+{
+	int step = 1 << chunk->lod;
+	int samplesPerSide = (HEIGHTMAP_TILE_SAMPLES / step) + 1;
+	int firstX = chunk->tileX * HEIGHTMAP_TILE_SAMPLES;
+	int firstZ = chunk->tileZ * HEIGHTMAP_TILE_SAMPLES;
+
+	Vector3 light = {0.4f, 1.0f, 0.3f};
+	light = NormalizeVector3(&light);
+
+	float lowest = terrain->heightmap->maxHeight;
+	float highest = terrain->heightmap->minHeight;
+
+	for(int j = 0; j < samplesPerSide; j++)
+	{
+		for(int i = 0; i < samplesPerSide; i++)
+		{
+			int x = firstX + (i * step);
+			int z = firstZ + (j * step);
+			float height = getHeightmapSample(terrain->heightmap, x, z);
+
+			Vector3* vertex = &(chunk->vertices[(j * samplesPerSide) + i]);
+			vertex->x = terrain->heightmap->originX + (x * terrain->heightmap->spacing);
+			vertex->y = height;
+			vertex->z = terrain->heightmap->originZ + (z * terrain->heightmap->spacing);
+
+			Vector3 normal;
+			normal.x = getHeightmapSample(terrain->heightmap, x - step, z) - getHeightmapSample(terrain->heightmap, x + step, z);
+			normal.y = 2 * step * terrain->heightmap->spacing;
+			normal.z = getHeightmapSample(terrain->heightmap, x, z - step) - getHeightmapSample(terrain->heightmap, x, z + step);
+			normal = NormalizeVector3(&normal);
+
+			float shade = 0.55f + (0.45f * fmaxf(0, dotProductVector3(&normal, &light)));
+			Vector3 colour = {0.3f * shade, 0.9f * shade, 0.3f * shade};
+			chunk->colours[(j * samplesPerSide) + i] = colour;
+
+			lowest = fminf(lowest, height);
+			highest = fmaxf(highest, height);
+		}
+	}
+
+	//Skirts hang down to the lowest point of the chunk, deep enough to cover any crack along the edge
+	int skirt = samplesPerSide * samplesPerSide;
+	for(int edge = 0; edge < 4; edge++)
+	{
+		for(int i = 0; i < samplesPerSide; i++)
+		{
+			int top = getEdgeIndex(samplesPerSide, edge, i);
+			int bottom = skirt + (edge * samplesPerSide) + i;
+
+			chunk->vertices[bottom] = chunk->vertices[top];
+			chunk->vertices[bottom].y = lowest - terrain->heightmap->spacing;
+			chunk->colours[bottom] = chunk->colours[top];
+		}
+	}
+
+	chunk->samplesPerSide = samplesPerSide;
+	chunk->boundsMin = chunk->vertices[0];
+	chunk->boundsMax = chunk->vertices[(samplesPerSide * samplesPerSide) - 1];
+	chunk->boundsMin.y = lowest - terrain->heightmap->spacing;
+	chunk->boundsMax.y = highest;
+}
+
+/* The grid vertex i along one of the four edges of a chunk */
+static int getEdgeIndex(int samplesPerSide, int edge, int i)
+{
+	switch(edge)
+	{
+		case 0: return i;
+		case 1: return ((samplesPerSide - 1) * samplesPerSide) + i;
+		case 2: return i * samplesPerSide;
+		default: return (i * samplesPerSide) + samplesPerSide - 1;
+	}
+}
+
+/* Compiles a finished mesh into a display list, called from the render thread */
+static void compileChunk(TerrainChunk* chunk)
+{
+	int samplesPerSide = chunk->samplesPerSide;
+	int skirt = samplesPerSide * samplesPerSide;
+
+	chunk->list = glGenLists(1);
+	glNewList(chunk->list, GL_COMPILE);
+
+	for(int j = 0; j + 1 < samplesPerSide; j++)
+	{
+		glBegin(GL_TRIANGLE_STRIP);
+		for(int i = 0; i < samplesPerSide; i++)
+		{
+			for(int row = j; row <= j + 1; row++)
+			{
+				int index = (row * samplesPerSide) + i;
+				glColor3f(chunk->colours[index].x, chunk->colours[index].y, chunk->colours[index].z);
+				glVertexVector3(&(chunk->vertices[index]));
+			}
+		}
+		glEnd();
+	}
+
+	//Each skirt runs along one edge, top vertices are the edge of the grid
+	for(int edge = 0; edge < 4; edge++)
+	{
+		glBegin(GL_TRIANGLE_STRIP);
+		for(int i = 0; i < samplesPerSide; i++)
+		{
+			int top = getEdgeIndex(samplesPerSide, edge, i);
+			int bottom = skirt + (edge * samplesPerSide) + i;
+
+			glColor3f(chunk->colours[top].x, chunk->colours[top].y, chunk->colours[top].z);
+			glVertexVector3(&(chunk->vertices[top]));
+			glVertexVector3(&(chunk->vertices[bottom]));
+		}
+		glEnd();
+	}
+
+	glEndList();
+	atomic_store(&(chunk->state), ChunkReady);
+}
+
+/* Draws every chunk in use this frame that can be seen */
+void drawTerrain(Terrain* terrain, const Frustum* frustum)
+{
+	for(int i = 0; i < TERRAIN_MAX_CHUNKS; i++)
+	{
+		TerrainChunk* chunk = &(terrain->chunks[i]);
+		if(atomic_load(&(chunk->state)) != ChunkReady || chunk->lastUsed != terrain->frame)
+			continue;
+
+		if(frustum == NULL || isBoxInFrustum(frustum, &(chunk->boundsMin), &(chunk->boundsMax)))
+			glCallList(chunk->list);
+	}
+}
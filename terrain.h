@@ -0,0 +1,62 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "engine.h"
+#include "camera.h"
+#include "heightmap.h"
+
+//Chunks further away are meshed with every 2nd, 4th, then 8th sample
+#define TERRAIN_LOD_LEVELS 4
+
+//Meshes kept at once, whatever the size of the map. The chunks in view never need more than this
+#define TERRAIN_MAX_CHUNKS 64
+#define TERRAIN_MAX_RADIUS 3
+
+typedef enum { ChunkFree, ChunkQueued, ChunkBuilt, ChunkReady } ChunkState;
+
+/*	One heightmap tile meshed at one level of detail
+ *	The render thread owns every slot except while it is queued, then the streaming thread fills in the mesh
+ */
+typedef struct {
+	_Atomic(ChunkState) state;
+	int tileX, tileZ;
+	int lod;
+
+	//Rows of triangle strips with a skirt hanging down from each edge to hide cracks between levels of detail
+	int samplesPerSide;
+	Vector3* vertices;
+	Vector3* colours;
+	Vector3 boundsMin;
+	Vector3 boundsMax;
+
+	unsigned int list;
+	unsigned long lastUsed;
+} TerrainChunk;
+
+/*	The ground drawn from a heightmap, with chunk meshes streamed in around the camera
+ *	Everything here belongs to the render thread apart from the slots being meshed
+ */
+typedef struct {
+	const Heightmap* heightmap;
+
+	TerrainChunk chunks[TERRAIN_MAX_CHUNKS];
+	unsigned long frame;
+
+	//Slots waiting for the streaming thread, in the order they were asked for
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int queue[TERRAIN_MAX_CHUNKS];
+	int queueStart, queueLength;
+	int stopping;
+} Terrain;
+
+Terrain* createTerrain(const Heightmap* heightmap);
+void freeTerrain(Terrain* terrain);
+
+void updateTerrain(Terrain* terrain, const Vector3* eye);
+void drawTerrain(Terrain* terrain, const Frustum* frustum);
+
+#endif
@@ -0,0 +1,191 @@
+/*	TerrainGen.c
+ *	Writes a generated heightmap file for the park to sit on
+ *
+ *	Usage: terraingen [--seed n] [--height h] [--spacing s] [--flat radius] tiles output.rchm
+ *	The map is tiles by tiles tiles centred on the origin, rolling hills up to height either side of 0 with the
+ *	ground flattened out to 0 within radius of the origin where the coasters are. Tiles are generated and written
+ *	one at a time, so maps far bigger than memory can be made.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "engine.h"
+#include "heightmap.h"
+
+#define DEFAULT_TERRAIN_HEIGHT 20.0f
+#define DEFAULT_TERRAIN_SPACING 1.0f
+#define DEFAULT_FLAT_RADIUS 60.0f
+
+//Widest hills in samples, each octave halves it
+#define NOISE_WAVELENGTH 256.0f
+#define NOISE_OCTAVES 5
+
+//Distance over which the flat ground blends into the hills
+#define FLAT_BLEND 40.0f
+
+/* A repeatable value between -1 and 1 for each lattice point */
+static float latticeValue(int x, int z, int octave, uint64_t seed)
+{
+	uint64_t hash = seed ^ ((uint64_t) (uint32_t) x * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t) (uint32_t) z * 0xC2B2AE3D27D4EB4FULL) ^ ((uint64_t) octave << 56);
+	hash ^= hash >> 30;
+	hash *= 0xBF58476D1CE4E5B9ULL;
+	hash ^= hash >> 27;
+	hash *= 0x94D049BB133111EBULL;
+	hash ^= hash >> 31;
+
+	return ((hash >> 40) / (float) (1 << 23)) - 1.0f;
+}
+
+static float smoothStep(float t)
+{
+	return t * t * (3 - (2 * t));
+}
+
+/* Layered value noise, between -1 and 1 */
+static float getNoise(float x, float z, uint64_t seed)
+{
+	float total = 0;
+	float amplitude = 0.5f;
+	float wavelength = NOISE_WAVELENGTH;
+
+	for(int octave = 0; octave < NOISE_OCTAVES; octave++)
+	{
+		float cellX = x / wavelength;
+		float cellZ = z / wavelength;
+		int x0 = (int) floorf(cellX);
+		int z0 = (int) floorf(cellZ);
+		float tx = smoothStep(cellX - x0);
+		float tz = smoothStep(cellZ - z0);
+
+		float front = latticeValue(x0, z0, octave, seed) + ((latticeValue(x0 + 1, z0, octave, seed) - latticeValue(x0, z0, octave, seed)) * tx);
+		float back = latticeValue(x0, z0 + 1, octave, seed) + ((latticeValue(x0 + 1, z0 + 1, octave, seed) - latticeValue(x0, z0 + 1, octave, seed)) * tx);
+		total += (front + ((back - front) * tz)) * amplitude;
+
+		amplitude *= 0.5f;
+		wavelength *= 0.5f;
+	}
+
+	return total;
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t seed = 1;
+	float height = DEFAULT_TERRAIN_HEIGHT;
+	float spacing = DEFAULT_TERRAIN_SPACING;
+	float flatRadius = DEFAULT_FLAT_RADIUS;
+	int tiles = 0;
+	const char* outputPath = NULL;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+			height = atof(argv[++i]);
+		else if(strcmp(argv[i], "--spacing") == 0 && i + 1 < argc)
+			spacing = atof(argv[++i]);
+		else if(strcmp(argv[i], "--flat") == 0 && i + 1 < argc)
+			flatRadius = atof(argv[++i]);
+		else if(tiles == 0)
+			tiles = atoi(argv[i]);
+		else if(outputPath == NULL)
+			outputPath = argv[i];
+		else
+			outputPath = NULL;
+	}
+
+	if(outputPath == NULL || tiles < 1 || height <= 0 || spacing <= 0) {
+		printf("Usage: %s [--seed n] [--height h] [--spacing s] [--flat radius] tiles output%s\n", argv[0], HEIGHTMAP_FILE_EXTENSION);
+		printf("Each tile is %d samples across\n", HEIGHTMAP_TILE_SAMPLES);
+		return 1;
+	}
+
+	FILE* file = fopen(outputPath, "wb");
+	if(file == NULL) {
+		printf("Could not write %s\n", outputPath);
+		return 1;
+	}
+
+	Heightmap heightmap;
+	memset(&heightmap, 0, sizeof(Heightmap));
+	heightmap.tilesX = tiles;
+	heightmap.tilesZ = tiles;
+	heightmap.spacing = spacing;
+	heightmap.baseHeight = -height;
+	heightmap.heightScale = (2 * height) / 65535.0f;
+	heightmap.originX = -0.5f * tiles * HEIGHTMAP_TILE_SAMPLES * spacing;
+	heightmap.originZ = heightmap.originX;
+
+	float baseHeight = heightmap.baseHeight;
+	float heightScale = heightmap.heightScale;
+	float origin = heightmap.originX;
+
+	//The real height range is only known at the end, so the header is written again then
+	unsigned char* header = malloc(HEIGHTMAP_HEADER_SIZE);
+	int headerLength = writeHeightmapHeader(header, &heightmap);
+	fwrite(header, 1, headerLength, file);
+
+	unsigned char* tile = malloc(HEIGHTMAP_TILE_BYTES);
+	float minHeight = height;
+	float maxHeight = -height;
+	double startTime = getTimeSeconds();
+
+	for(int tileZ = 0; tileZ < tiles; tileZ++)
+	{
+		for(int tileX = 0; tileX < tiles; tileX++)
+		{
+			for(int j = 0; j < HEIGHTMAP_TILE_SAMPLES; j++)
+			{
+				for(int i = 0; i < HEIGHTMAP_TILE_SAMPLES; i++)
+				{
+					int sampleX = (tileX * HEIGHTMAP_TILE_SAMPLES) + i;
+					int sampleZ = (tileZ * HEIGHTMAP_TILE_SAMPLES) + j;
+					float x = origin + (sampleX * spacing);
+					float z = origin + (sampleZ * spacing);
+
+					float value = getNoise(sampleX, sampleZ, seed) * height;
+
+					float distance = sqrtf((x * x) + (z * z));
+					if(distance < flatRadius + FLAT_BLEND)
+					{
+						float blend = distance <= flatRadius ? 0 : smoothStep((distance - flatRadius) / FLAT_BLEND);
+						value *= blend;
+					}
+
+					int sample = (int) lroundf((value - baseHeight) / heightScale);
+					sample = sample < 0 ? 0 : (sample > 65535 ? 65535 : sample);
+
+					float stored = baseHeight + (sample * heightScale);
+					minHeight = fminf(minHeight, stored);
+					maxHeight = fmaxf(maxHeight, stored);
+
+					unsigned char* bytes = tile + (((j * HEIGHTMAP_TILE_SAMPLES) + i) * 2);
+					bytes[0] = sample & 0xFF;
+					bytes[1] = sample >> 8;
+				}
+			}
+
+			fwrite(tile, 1, HEIGHTMAP_TILE_BYTES, file);
+		}
+	}
+
+	heightmap.minHeight = minHeight;
+	heightmap.maxHeight = maxHeight;
+	writeHeightmapHeader(header, &heightmap);
+	fseek(file, 0, SEEK_SET);
+	fwrite(header, 1, headerLength, file);
+
+	int failed = ferror(file);
+	if(fclose(file) != 0 || failed) {
+		printf("Could not write %s\n", outputPath);
+		return 1;
+	}
+
+	printf("Generated %d by %d tiles, heights %.1f to %.1f, in %.2f s\n", tiles, tiles, minHeight, maxHeight, getTimeSeconds() - startTime);
+
+	free(header);
+	free(tile);
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*	ThreadPool.c
+ *	This module spreads loops across a pool of worker threads
+ *
+ *	The workers are started on first use and sleep between jobs. A job is handed out in chunks from an atomic counter
+ *	so uneven chunks balance themselves out, and the calling thread takes chunks too instead of sitting idle.
+ *	Only one job runs at a time, a parallelFor() started while the pool is busy, or from inside a job, runs serially.
+ */
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "threadpool.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define MAX_WORKERS 64
+
+static void startPool(void);
+static void* workerLoop(void* arg);
+static void runChunks(int worker);
+
+static pthread_once_t poolStarted = PTHREAD_ONCE_INIT;
+static pthread_t workers[MAX_WORKERS];
+static int numberOfWorkers = 1;
+
+//Held by the thread running the current job
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobDone = PTHREAD_COND_INITIALIZER;
+static unsigned long jobGeneration = 0;
+static int busyWorkers = 0;
+
+//The current job
+static ParallelBody jobBody;
+static void* jobContext;
+static int jobCount;
+static int jobGrain;
+static atomic_int nextChunk;
+
+static _Thread_local int insideJob = 0;
+
+
+int getNumberOfWorkers()
+{
+	pthread_once(&poolStarted, startPool);
+	return numberOfWorkers;
+}
+
+void parallelFor(int count, int grain, ParallelBody body, void* context)
+{
+	if(count <= 0)
+		return;
+
+	if(grain < 1)
+		grain = 1;
+
+	pthread_once(&poolStarted, startPool);
+
+	if(numberOfWorkers == 1 || count <= grain || insideJob || pthread_mutex_trylock(&jobLock) != 0) {
+		body(0, count, 0, context);
+		return;
+	}
+
+	jobBody = body;
+	jobContext = context;
+	jobCount = count;
+	jobGrain = grain;
+	atomic_store(&nextChunk, 0);
+
+	pthread_mutex_lock(&poolLock);
+	busyWorkers = numberOfWorkers - 1;
+	jobGeneration++;
+	pthread_cond_broadcast(&jobReady);
+	pthread_mutex_unlock(&poolLock);
+
+	runChunks(0);
+
+	pthread_mutex_lock(&poolLock);
+	while(busyWorkers > 0)
+		pthread_cond_wait(&jobDone, &poolLock);
+	pthread_mutex_unlock(&poolLock);
+
+	pthread_mutex_unlock(&jobLock);
+}
+
+static void startPool()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long processors = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	long processors = 4;
+#endif
+
+	if(processors < 1)
+		processors = 1;
+	if(processors > MAX_WORKERS)
+		processors = MAX_WORKERS;
+
+	//The thread calling parallelFor() is worker 0
+	numberOfWorkers = 1;
+	for(long i = 1; i < processors; i++)
+	{
+		if(pthread_create(&workers[i], NULL, workerLoop, (void*) i) != 0)
+			break;
+		numberOfWorkers++;
+	}
+}
+
+static void* workerLoop(void* arg)
+{
+	int worker = (int) (long) arg;
+	unsigned long seenGeneration = 0;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&poolLock);
+		while(jobGeneration == seenGeneration)
+			pthread_cond_wait(&jobReady, &poolLock);
+		seenGeneration = jobGeneration;
+		pthread_mutex_unlock(&poolLock);
+
+		runChunks(worker);
+
+		pthread_mutex_lock(&poolLock);
+		if(--busyWorkers == 0)
+			pthread_cond_signal(&jobDone);
+		pthread_mutex_unlock(&poolLock);
+	}
+
+	return NULL;
+}
+
+static void runChunks(int worker)
+{
+	insideJob = 1;
+
+	for(;;)
+	{
+		int start = atomic_fetch_add(&nextChunk, jobGrain);
+		if(start >= jobCount)
+			break;
+
+		int end = start + jobGrain < jobCount ? start + jobGrain : jobCount;
+		jobBody(start, end, worker, jobContext);
+	}
+
+	insideJob = 0;
+}
@@ -0,0 +1,12 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/*	Runs body over [start, end) chunks of [0, count) in parallel
+ *	worker identifies the thread running the chunk, below getNumberOfWorkers(), so each can keep its own results
+ */
+typedef void (*ParallelBody)(int start, int end, int worker, void* context);
+
+void parallelFor(int count, int grain, ParallelBody body, void* context);
+int getNumberOfWorkers(void);
+
+#endif
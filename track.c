@@ -0,0 +1,606 @@
+/*	Track.c
+ *	This module builds the track from the control points and moves trains along it
+ *
+ *	Nothing in here touches input, the editor or OpenGL, so tracks can be generated and ridden headlessly.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "track.h"
+
+#define BOOST_STRENGTH 0.25
+
+//Radius used for spatial queries against the track
+#define TRACK_QUERY_RADIUS 0.3
+
+static void generateTrackFrames(Track* track);
+static void buildTrackBvh(Track* track);
+static void calculateSubSectionLength(TrackSubSection* subSection);
+static void placeCars(Train* train, const Track* track);
+static float getSubSectionSlope(const Track* track, int sectionIndex, int subSectionIndex);
+
+static const Vector3 up = { 0, 1, 0 };
+
+
+//==============GENERATION====================
+
+/* Builds the track's sections, frames and spatial index from a copy of the control points */
+void generateTrack(Track* track, const ControlPoint* points, int numberOfPoints)
+{
+	track->points = realloc(track->points, numberOfPoints * sizeof(ControlPoint));
+	memcpy(track->points, points, numberOfPoints * sizeof(ControlPoint));
+	track->numberOfPoints = numberOfPoints;
+	points = track->points;
+
+	if(track->allocatedSections < numberOfPoints)
+	{
+		track->allocatedSections = numberOfPoints;
+		track->sections = realloc(track->sections, numberOfPoints * sizeof(TrackSection));
+	}
+
+	Vector3 first;
+
+	//=====TRACK SECTION GENERATION
+
+	for(int k = 0; k < numberOfPoints; k++)
+	{
+		track->sections[k].isChain = points[k].isChain;
+
+		int subSectionIndex = 0;
+		for(float u = 0.0f; u < 1; u += (1.0 / NUMBER_OF_SUB_SECTIONS))
+		{
+			//Calculate new point
+			Vector3 newPoint = qFunction(points, numberOfPoints, u, k);
+
+			//Save first point for later
+			if(k == 0 && subSectionIndex == 0)
+				first = newPoint;
+
+			//Assign as start of section
+			track->sections[k].subSections[subSectionIndex].subSectionStart = newPoint;
+
+			//Assign this point as the end of the previous section and calculate the length
+			if(subSectionIndex - 1 >= 0){
+				track->sections[k].subSections[subSectionIndex - 1].subSectionEnd = newPoint;
+				calculateSubSectionLength(&(track->sections[k].subSections[subSectionIndex - 1]));
+			}
+			else if (k - 1 >= 0){
+				track->sections[k - 1].subSections[NUMBER_OF_SUB_SECTIONS - 1].subSectionEnd = newPoint;
+				calculateSubSectionLength(&(track->sections[k - 1].subSections[NUMBER_OF_SUB_SECTIONS - 1]));
+			}
+
+			subSectionIndex++;
+		}
+	}
+
+	//Assign first point as the last point and calculate length
+	track->sections[numberOfPoints - 1].subSections[NUMBER_OF_SUB_SECTIONS - 1].subSectionEnd = first;
+	calculateSubSectionLength(&(track->sections[numberOfPoints - 1].subSections[NUMBER_OF_SUB_SECTIONS - 1]));
+
+	//=====END TRACK SECTION GENERATION
+
+	generateTrackFrames(track);
+	buildTrackBvh(track);
+}
+
+void freeTrack(Track* track)
+{
+	free(track->points);
+	free(track->sections);
+	freeBvh(track->bvh);
+
+	memset(track, 0, sizeof(Track));
+}
+
+int getNumberOfSubSections(const Track* track)
+{
+	return track->numberOfPoints * NUMBER_OF_SUB_SECTIONS;
+}
+
+/* Returns a subsection by its index along the whole track */
+TrackSubSection* getSubSection(const Track* track, int index)
+{
+	return &(track->sections[index / NUMBER_OF_SUB_SECTIONS].subSections[index % NUMBER_OF_SUB_SECTIONS]);
+}
+
+Vector3 getFrameBinormal(const TrackFrame* frame)
+{
+	return crossProductVector3(&(frame->tangent), &(frame->normal));
+}
+
+static void generateTrackFrames(Track* track)
+{
+	int numberOfSubSections = getNumberOfSubSections(track);
+
+	for(int i = 0; i < numberOfSubSections; i++)
+	{
+		TrackSubSection* subSection = getSubSection(track, i);
+		Vector3 forward = minusVector3(&(subSection->subSectionEnd), &(subSection->subSectionStart));
+		subSection->frame.tangent = NormalizeVector3(&forward);
+	}
+
+	//Start as close to world up as the first tangent allows
+	TrackFrame* first = &(getSubSection(track, 0)->frame);
+	Vector3 normal = multiplyVector3(&(first->tangent), -dotProductVector3(&up, &(first->tangent)));
+	normal = addVector3(&up, &normal);
+	if(magnitudeVector3(&normal) < 0.001) {
+		normal.x = 1;
+		normal.y = 0;
+		normal.z = 0;
+	}
+	first->normal = NormalizeVector3(&normal);
+
+	//Transporting one step past the end brings the normal back around to the first subsection
+	Vector3 closingNormal;
+	for(int i = 0; i < numberOfSubSections; i++)
+	{
+		TrackSubSection* current = getSubSection(track, i);
+		TrackSubSection* next = getSubSection(track, (i + 1) % numberOfSubSections);
+
+		Vector3 v1 = minusVector3(&(next->subSectionStart), &(current->subSectionStart));
+		float c1 = dotProductVector3(&v1, &v1);
+
+		Vector3 reflectedNormal = current->frame.normal;
+		Vector3 reflectedTangent = current->frame.tangent;
+		if(c1 > 0)
+		{
+			Vector3 offset = multiplyVector3(&v1, (2.0 / c1) * dotProductVector3(&v1, &reflectedNormal));
+			reflectedNormal = minusVector3(&reflectedNormal, &offset);
+
+			offset = multiplyVector3(&v1, (2.0 / c1) * dotProductVector3(&v1, &reflectedTangent));
+			reflectedTangent = minusVector3(&reflectedTangent, &offset);
+		}
+
+		Vector3 v2 = minusVector3(&(next->frame.tangent), &reflectedTangent);
+		float c2 = dotProductVector3(&v2, &v2);
+
+		Vector3 nextNormal = reflectedNormal;
+		if(c2 > 0)
+		{
+			Vector3 offset = multiplyVector3(&v2, (2.0 / c2) * dotProductVector3(&v2, &reflectedNormal));
+			nextNormal = minusVector3(&reflectedNormal, &offset);
+		}
+		nextNormal = NormalizeVector3(&nextNormal);
+
+		if(i + 1 < numberOfSubSections)
+			next->frame.normal = nextNormal;
+		else
+			closingNormal = nextNormal;
+	}
+
+	//Signed angle the transported normal came back twisted by, undone a little more at each subsection
+	Vector3 firstBinormal = getFrameBinormal(first);
+	float closingTwist = atan2(dotProductVector3(&closingNormal, &firstBinormal), dotProductVector3(&closingNormal, &(first->normal)));
+
+	for(int i = 0; i < numberOfSubSections; i++)
+	{
+		TrackSubSection* subSection = getSubSection(track, i);
+		int k = i / NUMBER_OF_SUB_SECTIONS;
+		float u = (i % NUMBER_OF_SUB_SECTIONS) / (float) NUMBER_OF_SUB_SECTIONS;
+
+		float startBank = track->points[k].bank;
+		float endBank = track->points[(k + 1) % track->numberOfPoints].bank;
+		float bank = startBank + (endBank - startBank) * u;
+		float twist = -closingTwist * (i / (float) numberOfSubSections);
+
+		subSection->frame.normal = rotateVector3(&(subSection->frame.normal), &(subSection->frame.tangent), bank + twist);
+	}
+}
+
+/* Indexes every subsection of the track, a primitive's index is its index along the whole track */
+static void buildTrackBvh(Track* track)
+{
+	int numberOfSubSections = getNumberOfSubSections(track);
+	Vector3* starts = malloc(numberOfSubSections * sizeof(Vector3));
+	Vector3* ends = malloc(numberOfSubSections * sizeof(Vector3));
+
+	for(int i = 0; i < numberOfSubSections; i++)
+	{
+		starts[i] = getSubSection(track, i)->subSectionStart;
+		ends[i] = getSubSection(track, i)->subSectionEnd;
+	}
+
+	freeBvh(track->bvh);
+	track->bvh = buildBvh(starts, ends, numberOfSubSections, TRACK_QUERY_RADIUS);
+
+	free(starts);
+	free(ends);
+}
+
+/* Finds the parts of the track that come closer than clearance to each other */
+ClearanceReport* checkTrackClearance(const Track* track, float clearance, float neighbourLength)
+{
+	int numberOfSubSections = getNumberOfSubSections(track);
+	Vector3* starts = malloc(numberOfSubSections * sizeof(Vector3));
+	Vector3* ends = malloc(numberOfSubSections * sizeof(Vector3));
+
+	for(int i = 0; i < numberOfSubSections; i++)
+	{
+		starts[i] = getSubSection(track, i)->subSectionStart;
+		ends[i] = getSubSection(track, i)->subSectionEnd;
+	}
+
+	ClearanceReport* report = checkClearance(starts, ends, numberOfSubSections, clearance, neighbourLength);
+
+	free(starts);
+	free(ends);
+
+	return report;
+}
+
+/* Blends the frames at either end of the subsection, t being how far along it */
+TrackFrame interpolateTrackFrame(const Track* track, int sectionIndex, int subSectionIndex, float t)
+{
+	int index = (sectionIndex * NUMBER_OF_SUB_SECTIONS) + subSectionIndex;
+	int nextIndex = (index + 1) % getNumberOfSubSections(track);
+
+	const TrackFrame* start = &(getSubSection(track, index)->frame);
+	const TrackFrame* end = &(getSubSection(track, nextIndex)->frame);
+
+	TrackFrame frame;
+	frame.tangent = lerpVector3(&(start->tangent), &(end->tangent), t);
+	frame.tangent = NormalizeVector3(&(frame.tangent));
+
+	//Keep the normal perpendicular to the blended tangent
+	Vector3 normal = lerpVector3(&(start->normal), &(end->normal), t);
+	Vector3 along = multiplyVector3(&(frame.tangent), dotProductVector3(&normal, &(frame.tangent)));
+	normal = minusVector3(&normal, &along);
+	frame.normal = NormalizeVector3(&normal);
+
+	return frame;
+}
+
+/* Calculates the length of a subsection of track */
+static void calculateSubSectionLength(TrackSubSection* subSection)
+{
+	Vector3 difference = minusVector3(&(subSection->subSectionEnd), &(subSection->subSectionStart));
+	float length = magnitudeVector3(&difference);
+
+	subSection->subSectionLength = length;
+}
+
+
+//==============TRAINS========================
+
+/*	Puts the train at the start of the track, or facing forward and upright at the origin if there's no track yet
+ *	The cars behind the lead start out trailing back over the end of the track
+ */
+void resetTrain(Train* train, const Track* track, int numberOfCars)
+{
+	memset(train, 0, sizeof(Train));
+
+	if(numberOfCars < 1)
+		numberOfCars = 1;
+	else if(numberOfCars > MAX_TRAIN_CARS)
+		numberOfCars = MAX_TRAIN_CARS;
+
+	train->numberOfCars = numberOfCars;
+	for(int i = 0; i < numberOfCars; i++)
+		train->cars[i].mass = CAR_MASS;
+
+	if(track == NULL || track->numberOfPoints == 0)
+	{
+		train->frame.tangent.z = -1;
+		train->frame.normal = up;
+	}
+	else
+	{
+		train->position = track->sections[0].subSections[0].subSectionStart;
+		train->frame = track->sections[0].subSections[0].frame;
+	}
+
+	train->t = 1;
+	train->velocity = COASTER_START_SPEED;
+
+	//Without a track every car just sits on the lead
+	if(track == NULL || track->numberOfPoints == 0)
+	{
+		for(int i = 0; i < numberOfCars; i++) {
+			train->cars[i].position = train->position;
+			train->cars[i].frame = train->frame;
+		}
+	}
+	else
+		placeCars(train, track);
+}
+
+/*	Puts the lead car at the start of a subsection moving at the given speed, with the rest of the train behind it
+ *	The train keeps its number of cars
+ */
+void placeTrain(Train* train, const Track* track, int sectionIndex, int subSectionIndex, float velocity)
+{
+	resetTrain(train, track, train->numberOfCars);
+
+	train->sectionIndex = sectionIndex;
+	train->subSectionIndex = subSectionIndex;
+	train->t = 0;
+	train->velocity = velocity;
+
+	float u = subSectionIndex * (1.0 / NUMBER_OF_SUB_SECTIONS);
+	train->position = qFunction(track->points, track->numberOfPoints, u, sectionIndex);
+	train->frame = interpolateTrackFrame(track, sectionIndex, subSectionIndex, 0);
+
+	train->startPos = track->sections[sectionIndex].subSections[subSectionIndex].subSectionStart;
+	train->endPos = track->sections[sectionIndex].subSections[subSectionIndex].subSectionEnd;
+
+	placeCars(train, track);
+}
+
+/* Advances the train one tick along the track, applying gravity, friction, chain lifts and the boost */
+void stepTrain(Train* train, const Track* track, int boost)
+{
+	if(boost)
+		train->velocity += BOOST_STRENGTH;
+
+	//The chain keeps pulling as long as any car is still on it
+	for(int i = 0; i < train->numberOfCars; i++)
+	{
+		if(track->sections[train->cars[i].sectionIndex].isChain) {
+			if(train->velocity < CHAIN_LIFT_SPEED)
+				train->velocity = CHAIN_LIFT_SPEED;
+			break;
+		}
+	}
+
+
+	float deltaT = (TRAIN_TICK_LENGTH * train->velocity) / track->sections[train->sectionIndex].subSections[train->subSectionIndex].subSectionLength;
+
+	train->t += deltaT;
+	train->distance += TRAIN_TICK_LENGTH * train->velocity;
+
+	while(train->t < 0 || train->t >= 1)
+	{
+		if (train->t >= 1)
+		{
+			//Select next track piece
+			train->subSectionIndex++;
+			if (train->subSectionIndex >= NUMBER_OF_SUB_SECTIONS)
+			{
+				train->subSectionIndex = 0;
+				train->sectionIndex++;
+
+				if(train->sectionIndex >= track->numberOfPoints)
+					train->sectionIndex = 0;
+			}
+
+			//Update lerp start position
+			train->startPos = track->sections[train->sectionIndex].subSections[train->subSectionIndex].subSectionStart;
+			train->endPos = track->sections[train->sectionIndex].subSections[train->subSectionIndex].subSectionEnd;
+
+			//Update t and account for section switch in movement
+			train->t -= 1;
+			float percentOfTimeOnNextPiece = train->t / deltaT;
+
+			deltaT = (TRAIN_TICK_LENGTH * train->velocity) / track->sections[train->sectionIndex].subSections[train->subSectionIndex].subSectionLength;
+			train->t = deltaT * percentOfTimeOnNextPiece;
+		}
+		else if(train->t < 0)
+		{
+			//Select previous track piece
+			train->subSectionIndex--;
+			if (train->subSectionIndex < 0)
+			{
+				train->subSectionIndex = NUMBER_OF_SUB_SECTIONS - 1;
+				train->sectionIndex--;
+
+				if(train->sectionIndex < 0)
+					train->sectionIndex = track->numberOfPoints - 1;
+			}
+
+			//Update lerp positions
+			train->startPos = track->sections[train->sectionIndex].subSections[train->subSectionIndex].subSectionStart;
+			train->endPos = track->sections[train->sectionIndex].subSections[train->subSectionIndex].subSectionEnd;
+
+			//Update t and account for section switch in movement
+			train->t += 1;
+			float percentOfTimeOnNextPiece = (1 - train->t) / deltaT;
+
+			deltaT = (TRAIN_TICK_LENGTH * train->velocity) / track->sections[train->sectionIndex].subSections[train->subSectionIndex].subSectionLength;
+			train->t = 1 - (deltaT * percentOfTimeOnNextPiece);
+		}
+	}
+
+
+
+	//Move Coaster
+	float u = (train->t / NUMBER_OF_SUB_SECTIONS) + train->subSectionIndex * (1.0 / NUMBER_OF_SUB_SECTIONS);
+
+	train->position = qFunction(track->points, track->numberOfPoints, u, train->sectionIndex);
+	train->frame = interpolateTrackFrame(track, train->sectionIndex, train->subSectionIndex, train->t);
+
+	placeCars(train, track);
+
+
+	//Physics
+	//Gravity pulls on the whole train, so average the slope under each car weighted by the car's mass
+	float weightedSlope = 0;
+	float totalMass = 0;
+	for(int i = 0; i < train->numberOfCars; i++)
+	{
+		const TrainCar* car = &(train->cars[i]);
+
+		weightedSlope += car->mass * getSubSectionSlope(track, car->sectionIndex, car->subSectionIndex);
+		totalMass += car->mass;
+	}
+
+	float slopeStrength = weightedSlope / totalMass;
+
+	float deltaV = TRAIN_TICK_LENGTH * (GRAVITY * slopeStrength);
+	train->velocity += deltaV;
+
+
+	//A super simple friction model
+	train->velocity = train->velocity * (1 - FRICTION_COEFFICIENT);
+
+}
+
+/*	Places the cars behind the lead car, walking one cursor back along the track for the whole train
+ *	Distances are measured along the subsections, the same way the train moves along them
+ */
+static void placeCars(Train* train, const Track* track)
+{
+	train->cars[0].sectionIndex = train->sectionIndex;
+	train->cars[0].subSectionIndex = train->subSectionIndex;
+	train->cars[0].t = train->t;
+	train->cars[0].position = train->position;
+	train->cars[0].frame = train->frame;
+
+	int sectionIndex = train->sectionIndex;
+	int subSectionIndex = train->subSectionIndex;
+	float length = track->sections[sectionIndex].subSections[subSectionIndex].subSectionLength;
+
+	//How far into the cursor's subsection the next car sits
+	float along = train->t * length;
+
+	for(int i = 1; i < train->numberOfCars; i++)
+	{
+		along -= CAR_SPACING;
+
+		while(along < 0)
+		{
+			subSectionIndex--;
+			if(subSectionIndex < 0)
+			{
+				subSectionIndex = NUMBER_OF_SUB_SECTIONS - 1;
+				sectionIndex--;
+
+				if(sectionIndex < 0)
+					sectionIndex = track->numberOfPoints - 1;
+			}
+
+			length = track->sections[sectionIndex].subSections[subSectionIndex].subSectionLength;
+			along += length;
+		}
+
+		TrainCar* car = &(train->cars[i]);
+		car->sectionIndex = sectionIndex;
+		car->subSectionIndex = subSectionIndex;
+		car->t = along / length;
+
+		float u = (car->t / NUMBER_OF_SUB_SECTIONS) + subSectionIndex * (1.0 / NUMBER_OF_SUB_SECTIONS);
+		car->position = qFunction(track->points, track->numberOfPoints, u, sectionIndex);
+		car->frame = interpolateTrackFrame(track, sectionIndex, subSectionIndex, car->t);
+	}
+}
+
+/* The sine of the subsection's slope, how much of gravity pulls along it */
+static float getSubSectionSlope(const Track* track, int sectionIndex, int subSectionIndex)
+{
+	const TrackSubSection* subSection = &(track->sections[sectionIndex].subSections[subSectionIndex]);
+
+	float hypotenuse = subSection->subSectionLength;
+	float opposite = subSection->subSectionEnd.y - subSection->subSectionStart.y;
+
+	float angle = asin( opposite / hypotenuse);
+	return sin(angle);
+}
+
+Vector3 qFunction(const ControlPoint* controlPoints, int numberOfControlPoints, float u, int i)
+{
+	float t = u;
+	float sixth = (1.0 / 6.0);
+
+	float tSquared = pow(t, 2);
+	float tCubed   = pow(t, 3);
+
+
+	float r0 = sixth * tCubed;
+	float r1 = sixth * ( (-3 * tCubed) + (3 * tSquared) + (3 * t) + 1 );
+	float r2 = sixth * ( (3 * tCubed) - (6 * tSquared) + 4 );
+	float r3 = sixth * pow((1 - t), 3);
+
+	//Neighbours wrap round the loop, whatever size it is
+	int n = numberOfControlPoints;
+	Vector3 r3Vec = multiplyVector3(&(controlPoints[(i + n - 1) % n].position), r3);
+	Vector3 r2Vec = multiplyVector3(&(controlPoints[i % n].position), r2);
+	Vector3 r1Vec = multiplyVector3(&(controlPoints[(i + 1) % n].position), r1);
+	Vector3 r0Vec = multiplyVector3(&(controlPoints[(i + 2) % n].position), r0);
+
+	Vector3 finalVector;
+	finalVector = addVector3(&r3Vec, &r2Vec);
+	finalVector = addVector3(&finalVector, &r1Vec);
+	finalVector = addVector3(&finalVector, &r0Vec);
+
+	return finalVector;
+}
+
+/* Fills points, which must hold DEFAULT_COASTER_POINTS, with the track the game starts with */
+void getDefaultCoaster(ControlPoint* points)
+{
+	memset(points, 0, DEFAULT_COASTER_POINTS * sizeof(ControlPoint));
+
+	points[0].position.x = 0;
+	points[0].position.y = 4;
+	points[0].position.z = 10;
+	points[0].isChain = 1;
+
+	points[1].position.x = -12;
+	points[1].position.y = 5;
+	points[1].position.z = 10;
+	points[1].isChain = 1;
+
+	points[2].position.x = -16;
+	points[2].position.y = 6;
+	points[2].position.z = 2;
+	points[2].isChain = 1;
+
+	points[3].position.x = -16;
+	points[3].position.y = 7;
+	points[3].position.z = -4;
+	points[3].isChain = 1;
+
+	points[4].position.x = -16;
+	points[4].position.y = 8;
+	points[4].position.z = -12;
+	points[4].isChain = 1;
+
+	points[5].position.x = -10;
+	points[5].position.y = 9;
+	points[5].position.z = -18;
+	points[5].isChain = 1;
+
+	points[6].position.x = -6;
+	points[6].position.y = 9.5;
+	points[6].position.z = -18;
+
+	points[6].position.x = 0;
+	points[6].position.y = 9.5;
+	points[6].position.z = -18;
+
+
+	points[7].position.x = 10;
+	points[7].position.y = 7.5;
+	points[7].position.z = -18;
+
+	points[8].position.x = 16;
+	points[8].position.y = 7;
+	points[8].position.z = -12;
+
+	points[9].position.x = 10;
+	points[9].position.y = 6;
+	points[9].position.z = -6;
+
+	points[10].position.x = 4;
+	points[10].position.y = 7;
+	points[10].position.z = -14;
+
+	points[11].position.x = -10;
+	points[11].position.y = 5.5;
+	points[11].position.z = -12;
+
+	points[12].position.x = -2;
+	points[12].position.y = 5;
+	points[12].position.z = -8;
+
+	points[12].position.x = 4;
+	points[12].position.y = 4.5;
+	points[12].position.z = -4;
+
+	points[13].position.x = 10;
+	points[13].position.y = 4;
+	points[13].position.z = 2;
+
+	points[14].position.x = 10;
+	points[14].position.y = 4;
+	points[14].position.z = 10;
+}
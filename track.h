@@ -0,0 +1,119 @@
+#ifndef TRACK_H
+#define TRACK_H
+
+#include "engine.h"
+#include "bvh.h"
+#include "clearance.h"
+
+#define NUMBER_OF_SUB_SECTIONS 10
+
+//Length of one simulation tick in seconds
+#define TRAIN_TICK_LENGTH 0.016
+
+#define COASTER_START_SPEED 2.5
+
+//Physics the train runs on, anything planning ahead for the train has to agree with these
+#define GRAVITY -9.81
+#define FRICTION_COEFFICIENT 0.001
+#define CHAIN_LIFT_SPEED 1.5
+
+#define DEFAULT_COASTER_POINTS 15
+
+//Trains are made of up to MAX_TRAIN_CARS cars, each CAR_SPACING behind the one in front along the track
+#define MAX_TRAIN_CARS 16
+#define CAR_SPACING 1.0f
+#define CAR_MASS 1.0f
+
+//Closest two parts of the track may come to each other, and how far apart along the track they must be to count
+#define TRACK_CLEARANCE 1.0
+#define TRACK_CLEARANCE_NEIGHBOUR_LENGTH 2.0
+
+typedef struct {
+	Vector3 position;
+	int isChain;
+	float bank;
+} ControlPoint;
+
+/*	An orientation along the track, the binormal (pointing right) is the cross product of the two */
+typedef struct {
+	Vector3 tangent;
+	Vector3 normal;
+} TrackFrame;
+
+typedef struct {
+	float subSectionLength;
+
+	Vector3 subSectionStart;
+	Vector3 subSectionEnd;
+
+	//Rotation minimizing frame at the start of the subsection, banking included
+	TrackFrame frame;
+} TrackSubSection;
+
+typedef struct {
+	TrackSubSection subSections[NUMBER_OF_SUB_SECTIONS];
+	int isChain;
+} TrackSection;
+
+/*	A generated track, everything a train needs to run on it without the editor or the renderer
+ *	There is one section per control point, and the track keeps its own copy of the points it was built from
+ */
+typedef struct {
+	ControlPoint* points;
+	int numberOfPoints;
+
+	TrackSection* sections;
+	int allocatedSections;
+
+	Bvh* bvh;
+} Track;
+
+/*	One car of a train, placed by how far it sits behind the lead car along the track */
+typedef struct {
+	int sectionIndex;
+	int subSectionIndex;
+	float t;
+
+	Vector3 position;
+	TrackFrame frame;
+	float mass;
+} TrainCar;
+
+/*	Where a train is along a track and how fast it's going
+ *	The train's own position is the lead car's, cars[0] is a copy of it and the rest follow behind
+ */
+typedef struct {
+	int sectionIndex;
+	int subSectionIndex;
+	float t;
+
+	Vector3 startPos;
+	Vector3 endPos;
+
+	Vector3 position;
+	TrackFrame frame;
+	float velocity;
+	double distance;
+
+	int numberOfCars;
+	TrainCar cars[MAX_TRAIN_CARS];
+} Train;
+
+void generateTrack(Track* track, const ControlPoint* points, int numberOfPoints);
+void freeTrack(Track* track);
+
+int getNumberOfSubSections(const Track* track);
+TrackSubSection* getSubSection(const Track* track, int index);
+TrackFrame interpolateTrackFrame(const Track* track, int sectionIndex, int subSectionIndex, float t);
+Vector3 getFrameBinormal(const TrackFrame* frame);
+ClearanceReport* checkTrackClearance(const Track* track, float clearance, float neighbourLength);
+
+void resetTrain(Train* train, const Track* track, int numberOfCars);
+void placeTrain(Train* train, const Track* track, int sectionIndex, int subSectionIndex, float velocity);
+void stepTrain(Train* train, const Track* track, int boost);
+
+void getDefaultCoaster(ControlPoint* points);
+
+Vector3 qFunction(const ControlPoint* points, int count, float u, int i);
+
+#endif
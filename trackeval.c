@@ -0,0 +1,253 @@
+/*	TrackEval.c
+ *	Evaluates every track file in a directory and writes one report
+ *
+ *	Usage: trackeval [--laps n] [--json] directory [output]
+ *	Each track is generated and run for a number of laps headlessly, tracks are spread over all cores.
+ *	Writes CSV to stdout when no output file is given.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include "engine.h"
+#include "threadpool.h"
+#include "trackfile.h"
+#include "evaluate.h"
+
+#define DEFAULT_LAPS 3
+
+typedef struct {
+	char* path;
+	int loaded;
+	TrackEvaluation evaluation;
+} TrackResult;
+
+typedef struct {
+	TrackResult* results;
+	int laps;
+} EvaluationJob;
+
+static int compareNames(const void* a, const void* b)
+{
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/* Lists the track files in a directory, sorted so reports come out in the same order every run */
+static char** findTrackFiles(const char* directory, int* numberOfFiles)
+{
+	DIR* dir = opendir(directory);
+	if(dir == NULL)
+		return NULL;
+
+	int count = 0;
+	int allocated = 64;
+	char** names = malloc(allocated * sizeof(char*));
+
+	size_t extensionLength = strlen(TRACK_FILE_EXTENSION);
+	struct dirent* entry;
+
+	while((entry = readdir(dir)) != NULL)
+	{
+		size_t length = strlen(entry->d_name);
+		if(length <= extensionLength || strcmp(entry->d_name + length - extensionLength, TRACK_FILE_EXTENSION) != 0)
+			continue;
+
+		if(count == allocated) {
+			allocated *= 2;
+			names = realloc(names, allocated * sizeof(char*));
+		}
+
+		names[count] = malloc(strlen(directory) + length + 2);
+		sprintf(names[count], "%s/%s", directory, entry->d_name);
+		count++;
+	}
+
+	closedir(dir);
+
+	qsort(names, count, sizeof(char*), compareNames);
+	*numberOfFiles = count;
+
+	return names;
+}
+
+static void evaluateFiles(int start, int end, int worker, void* context)
+{
+	EvaluationJob* job = context;
+
+	for(int i = start; i < end; i++)
+	{
+		TrackResult* result = &(job->results[i]);
+
+		int numberOfPoints;
+		ControlPoint* points = loadTrackFile(result->path, &numberOfPoints);
+		if(points == NULL)
+			continue;
+
+		evaluateTrack(points, numberOfPoints, job->laps, &(result->evaluation));
+		result->loaded = 1;
+
+		free(points);
+	}
+}
+
+/* Writes a CSV field in quotes, doubling any quotes in it, so commas and newlines in paths stay in one field */
+static void writeCsvString(FILE* output, const char* string)
+{
+	fputc('"', output);
+
+	for(; *string != '\0'; string++)
+	{
+		if(*string == '"')
+			fputc('"', output);
+		fputc(*string, output);
+	}
+
+	fputc('"', output);
+}
+
+static void writeCsv(FILE* output, const TrackResult* results, int count)
+{
+	fprintf(output, "file,points,length,laps,first_lap_time,average_lap_time,max_speed,min_speed,stalled,stall_section,stall_distance,generation_ms,simulation_ms\n");
+
+	for(int i = 0; i < count; i++)
+	{
+		const TrackEvaluation* evaluation = &(results[i].evaluation);
+
+		writeCsvString(output, results[i].path);
+
+		if(!results[i].loaded) {
+			fprintf(output, ",,,,,,,,,,,,\n");
+			continue;
+		}
+
+		fprintf(output, ",%d,%.3f,%d,%.3f,%.3f,%.3f,%.3f,%d,%d,%.3f,%.3f,%.3f\n",
+			evaluation->numberOfPoints, evaluation->length, evaluation->lapsCompleted,
+			evaluation->firstLapTime, evaluation->averageLapTime, evaluation->maxSpeed, evaluation->minSpeed,
+			evaluation->stalled, evaluation->stalled ? evaluation->stallSection : -1, evaluation->stallDistance,
+			evaluation->generationSeconds * 1000, evaluation->simulationSeconds * 1000);
+	}
+}
+
+/* Writes a JSON string, escaping the characters JSON doesn't allow as is */
+static void writeJsonString(FILE* output, const char* string)
+{
+	fputc('"', output);
+
+	for(; *string != '\0'; string++)
+	{
+		if(*string == '"' || *string == '\\')
+			fprintf(output, "\\%c", *string);
+		else if((unsigned char) *string < 0x20)
+			fprintf(output, "\\u%04x", *string);
+		else
+			fputc(*string, output);
+	}
+
+	fputc('"', output);
+}
+
+static void writeJson(FILE* output, const TrackResult* results, int count)
+{
+	fprintf(output, "[\n");
+
+	for(int i = 0; i < count; i++)
+	{
+		const TrackEvaluation* evaluation = &(results[i].evaluation);
+
+		fprintf(output, "  {\"file\": ");
+		writeJsonString(output, results[i].path);
+
+		if(!results[i].loaded)
+			fprintf(output, ", \"error\": \"not a track file\"}");
+		else
+		{
+			fprintf(output, ", \"points\": %d, \"length\": %.3f, \"laps\": %d, \"first_lap_time\": %.3f, \"average_lap_time\": %.3f",
+				evaluation->numberOfPoints, evaluation->length, evaluation->lapsCompleted,
+				evaluation->firstLapTime, evaluation->averageLapTime);
+			fprintf(output, ", \"max_speed\": %.3f, \"min_speed\": %.3f, \"stalled\": %s",
+				evaluation->maxSpeed, evaluation->minSpeed, evaluation->stalled ? "true" : "false");
+
+			if(evaluation->stalled)
+				fprintf(output, ", \"stall_section\": %d, \"stall_distance\": %.3f", evaluation->stallSection, evaluation->stallDistance);
+
+			fprintf(output, ", \"generation_ms\": %.3f, \"simulation_ms\": %.3f}",
+				evaluation->generationSeconds * 1000, evaluation->simulationSeconds * 1000);
+		}
+
+		fprintf(output, "%s\n", i + 1 < count ? "," : "");
+	}
+
+	fprintf(output, "]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int laps = DEFAULT_LAPS;
+	int json = 0;
+	const char* directory = NULL;
+	const char* outputPath = NULL;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--laps") == 0 && i + 1 < argc)
+			laps = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--json") == 0)
+			json = 1;
+		else if(directory == NULL)
+			directory = argv[i];
+		else if(outputPath == NULL)
+			outputPath = argv[i];
+		else
+			directory = NULL;
+	}
+
+	if(directory == NULL || laps < 1) {
+		printf("Usage: %s [--laps n] [--json] directory [output]\n", argv[0]);
+		return 1;
+	}
+
+	int numberOfFiles;
+	char** paths = findTrackFiles(directory, &numberOfFiles);
+	if(paths == NULL) {
+		printf("Could not open %s\n", directory);
+		return 1;
+	}
+
+	FILE* output = stdout;
+	if(outputPath != NULL)
+		output = fopen(outputPath, "w");
+
+	if(output == NULL) {
+		printf("Could not open %s\n", outputPath);
+		return 1;
+	}
+
+	EvaluationJob job;
+	job.laps = laps;
+	job.results = calloc(numberOfFiles, sizeof(TrackResult));
+	for(int i = 0; i < numberOfFiles; i++)
+		job.results[i].path = paths[i];
+
+	//One track per chunk, their sizes can differ wildly
+	double startTime = getTimeSeconds();
+	parallelFor(numberOfFiles, 1, evaluateFiles, &job);
+	double seconds = getTimeSeconds() - startTime;
+
+	if(json)
+		writeJson(output, job.results, numberOfFiles);
+	else
+		writeCsv(output, job.results, numberOfFiles);
+
+	if(output != stdout)
+	{
+		fclose(output);
+		printf("Evaluated %d tracks on %d threads in %.2f s\n", numberOfFiles, getNumberOfWorkers(), seconds);
+	}
+
+	for(int i = 0; i < numberOfFiles; i++)
+		free(paths[i]);
+	free(paths);
+	free(job.results);
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+/*	TrackFile.c
+ *	This module saves and loads the control points a track is built from
+ *
+ *	Floats are stored as their exact bits so a loaded track generates exactly the same as the one that was saved.
+ *
+ *	File layout, after the "RCTK" magic and a version byte, is a varint point count followed by one record per point:
+ *		x, y, z, bank as little endian 32 bit floats, flags byte
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "encoding.h"
+#include "trackfile.h"
+#include "coastersim.h"
+
+#define TRACK_FILE_MAGIC "RCTK"
+#define TRACK_FILE_VERSION 1
+
+#define POINT_RECORD_SIZE 17
+#define POINT_CHAIN 1
+
+//Points are converted this many at a time so huge tracks don't need a second copy in memory
+#define POINTS_PER_BLOCK 4096
+
+
+//==============WRITING=======================
+
+/* Returns 0 if the file couldn't be written */
+int saveTrackFile(const char* path, const ControlPoint* points, int numberOfPoints)
+{
+	FILE* file = fopen(path, "wb");
+	if(file == NULL)
+		return 0;
+
+	unsigned char header[5 + MAX_VARINT_BYTES];
+	memcpy(header, TRACK_FILE_MAGIC, 4);
+	header[4] = TRACK_FILE_VERSION;
+	int headerLength = 5 + writeVarint(header + 5, numberOfPoints);
+	fwrite(header, 1, headerLength, file);
+
+	int failed = !writeTrackPoints(file, points, numberOfPoints);
+	if(fclose(file) != 0)
+		failed = 1;
+
+	return !failed;
+}
+
+/* Writes just the point records, for files that embed tracks in their own format */
+int writeTrackPoints(FILE* file, const ControlPoint* points, int numberOfPoints)
+{
+	unsigned char* block = malloc(POINTS_PER_BLOCK * POINT_RECORD_SIZE);
+
+	for(int start = 0; start < numberOfPoints; start += POINTS_PER_BLOCK)
+	{
+		int count = numberOfPoints - start < POINTS_PER_BLOCK ? numberOfPoints - start : POINTS_PER_BLOCK;
+
+		for(int i = 0; i < count; i++)
+		{
+			const ControlPoint* point = &points[start + i];
+			unsigned char* record = block + (i * POINT_RECORD_SIZE);
+
+			writeFloat(record, point->position.x);
+			writeFloat(record + 4, point->position.y);
+			writeFloat(record + 8, point->position.z);
+			writeFloat(record + 12, point->bank);
+			record[16] = point->isChain ? POINT_CHAIN : 0;
+		}
+
+		fwrite(block, POINT_RECORD_SIZE, count, file);
+	}
+
+	free(block);
+
+	return !ferror(file);
+}
+
+
+//==============READING=======================
+
+/*	Loads a track file into a newly allocated array of points
+ *	Returns NULL if the file can't be read or isn't a track file
+ */
+ControlPoint* loadTrackFile(const char* path, int* numberOfPoints)
+{
+	FILE* file = fopen(path, "rb");
+	if(file == NULL)
+		return NULL;
+
+	unsigned char header[5 + MAX_VARINT_BYTES];
+	size_t headerLength = fread(header, 1, sizeof(header), file);
+
+	if(headerLength < 6 || memcmp(header, TRACK_FILE_MAGIC, 4) != 0 || header[4] != TRACK_FILE_VERSION) {
+		fclose(file);
+		return NULL;
+	}
+
+	const unsigned char* cursor = header + 5;
+	uint64_t count = readVarint(&cursor, header + headerLength);
+
+	//Too few points to make a loop are rejected, then go back to the first record, the header read may have run into it
+	if(count < COASTER_SIM_MIN_POINTS || count > INT32_MAX || fseek(file, cursor - header, SEEK_SET) != 0) {
+		fclose(file);
+		return NULL;
+	}
+
+	ControlPoint* points = malloc(count * sizeof(ControlPoint));
+
+	if(points != NULL && !readTrackPoints(file, points, (int) count)) {
+		free(points);
+		points = NULL;
+	}
+
+	fclose(file);
+
+	if(points != NULL)
+		*numberOfPoints = (int) count;
+
+	return points;
+}
+
+/* Reads numberOfPoints point records, returns 0 if the file ends first */
+int readTrackPoints(FILE* file, ControlPoint* points, int numberOfPoints)
+{
+	unsigned char* block = malloc(POINTS_PER_BLOCK * POINT_RECORD_SIZE);
+	int complete = 1;
+
+	for(int start = 0; start < numberOfPoints; start += POINTS_PER_BLOCK)
+	{
+		size_t count = numberOfPoints - start < POINTS_PER_BLOCK ? numberOfPoints - start : POINTS_PER_BLOCK;
+
+		if(fread(block, POINT_RECORD_SIZE, count, file) != count) {
+			complete = 0;
+			break;
+		}
+
+		for(size_t i = 0; i < count; i++)
+		{
+			ControlPoint* point = &points[start + i];
+			const unsigned char* record = block + (i * POINT_RECORD_SIZE);
+
+			point->position.x = readFloat(record);
+			point->position.y = readFloat(record + 4);
+			point->position.z = readFloat(record + 8);
+			point->bank = readFloat(record + 12);
+			point->isChain = (record[16] & POINT_CHAIN) != 0;
+		}
+	}
+
+	free(block);
+
+	return complete;
+}
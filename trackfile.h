@@ -0,0 +1,15 @@
+#ifndef TRACKFILE_H
+#define TRACKFILE_H
+
+#include <stdio.h>
+#include "track.h"
+
+#define TRACK_FILE_EXTENSION ".rctk"
+
+int saveTrackFile(const char* path, const ControlPoint* points, int numberOfPoints);
+ControlPoint* loadTrackFile(const char* path, int* numberOfPoints);
+
+int writeTrackPoints(FILE* file, const ControlPoint* points, int numberOfPoints);
+int readTrackPoints(FILE* file, ControlPoint* points, int numberOfPoints);
+
+#endif
@@ -0,0 +1,56 @@
+/*	TrackGen.c
+ *	Writes a procedurally generated track to a track file
+ *
+ *	Usage: trackgen [--seed n] points output.rctk
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "engine.h"
+#include "trackfile.h"
+#include "procedural.h"
+
+int main(int argc, char *argv[])
+{
+	uint64_t seed = 1;
+	int numberOfPoints = 0;
+	const char* outputPath = NULL;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = strtoull(argv[++i], NULL, 10);
+		else if(numberOfPoints == 0)
+			numberOfPoints = atoi(argv[i]);
+		else if(outputPath == NULL)
+			outputPath = argv[i];
+		else
+			outputPath = NULL;
+	}
+
+	if(outputPath == NULL || numberOfPoints < MIN_PROCEDURAL_POINTS) {
+		printf("Usage: %s [--seed n] points output%s\n", argv[0], TRACK_FILE_EXTENSION);
+		printf("Tracks need at least %d points\n", MIN_PROCEDURAL_POINTS);
+		return 1;
+	}
+
+	ControlPoint* points = malloc((size_t) numberOfPoints * sizeof(ControlPoint));
+	if(points == NULL) {
+		printf("Not enough memory for %d points\n", numberOfPoints);
+		return 1;
+	}
+
+	double startTime = getTimeSeconds();
+	generateProceduralTrack(points, numberOfPoints, seed);
+	double seconds = getTimeSeconds() - startTime;
+
+	if(!saveTrackFile(outputPath, points, numberOfPoints)) {
+		printf("Could not write %s\n", outputPath);
+		return 1;
+	}
+
+	printf("Generated %d points in %.2f s\n", numberOfPoints, seconds);
+
+	free(points);
+	return 0;
+}
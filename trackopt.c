@@ -0,0 +1,486 @@
+/*	TrackOpt.c
+ *	Searches for better track designs by randomly perturbing a starting track and keeping the best results
+ *
+ *	Usage: trackopt [--objective lap-time|thrill|chain] [--seed n] [--generations n] [--candidates n] [--keep n]
+ *	                [--start file] [--checkpoint file] [--output directory]
+ *
+ *	Every generation each kept design spawns perturbed candidates, which are generated and simulated headlessly
+ *	across all cores. Candidates that stall or pass too close to themselves are thrown away, the rest compete with
+ *	the kept designs for a place in the next generation.
+ *
+ *	Each candidate seeds its own generator from the run seed, the generation and its index, so a run gives the same
+ *	designs however many threads it's spread over and a run resumed from a checkpoint carries on exactly.
+ *
+ *	Checkpoint layout, after the "RCOP" magic and a version byte:
+ *		varint seed, varint objective, varint generation, varint points per design, varint number of designs,
+ *		then the designs' points as in a track file
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "engine.h"
+#include "encoding.h"
+#include "threadpool.h"
+#include "trackfile.h"
+#include "evaluate.h"
+#include "analytics.h"
+
+#define CHECKPOINT_MAGIC "RCOP"
+#define CHECKPOINT_VERSION 1
+
+#define DEFAULT_GENERATIONS 100
+#define DEFAULT_CANDIDATES 256
+#define DEFAULT_KEEP 8
+
+#define CANDIDATE_GRAIN 4
+#define CHECKPOINT_SECONDS 10.0
+
+//Perturbation of a candidate
+#define MAX_MUTATIONS 3
+#define HEIGHT_STEP 1.0
+#define POSITION_STEP 1.0
+#define CHAIN_FLIP_CHANCE 0.15
+#define MIN_HEIGHT 1.0
+#define MAX_HEIGHT 40.0
+
+//Thrill score, top speed plus a bonus per second of airtime, rejecting rides that would hurt
+#define AIRTIME_WEIGHT 5.0
+#define LATERAL_G_LIMIT 1.8
+#define LATERAL_G_PENALTY 2.0
+#define MIN_VERTICAL_G -1.5
+#define MAX_VERTICAL_G 5.0
+
+enum Objective { LapTime, Thrill, ChainLength, NUMBER_OF_OBJECTIVES };
+static const char* objectiveNames[NUMBER_OF_OBJECTIVES] = { "lap-time", "thrill", "chain" };
+
+/*	A design and how it scored, higher scores are always better */
+typedef struct {
+	float score;
+	int index;
+
+	TrackEvaluation evaluation;
+	float chainLength;
+	float airtime;
+} DesignScore;
+
+typedef struct {
+	uint64_t seed;
+	int objective;
+	int generation;
+	int numberOfPoints;
+
+	//Kept designs, each numberOfPoints long
+	ControlPoint* kept;
+	DesignScore* keptScores;
+	int numberOfKept;
+	int maxKept;
+
+	ControlPoint* candidates;
+	DesignScore* candidateScores;
+	int numberOfCandidates;
+} Optimizer;
+
+static void evaluateCandidates(int start, int end, int worker, void* context);
+static void perturbDesign(ControlPoint* points, int numberOfPoints, Random* random);
+static void scoreDesign(const Optimizer* optimizer, const ControlPoint* points, DesignScore* score);
+static void keepBest(Optimizer* optimizer);
+static int saveCheckpoint(const Optimizer* optimizer, const char* path);
+static int loadCheckpoint(Optimizer* optimizer, const char* path);
+static void reportDesigns(const Optimizer* optimizer, const char* outputDirectory);
+
+
+//==============SEARCH========================
+
+static void evaluateCandidates(int start, int end, int worker, void* context)
+{
+	Optimizer* optimizer = context;
+	int n = optimizer->numberOfPoints;
+
+	for(int i = start; i < end; i++)
+	{
+		Random random;
+		seedRandom(&random, optimizer->seed ^ (((uint64_t) optimizer->generation << 32) | (uint64_t) i));
+
+		ControlPoint* points = &(optimizer->candidates[(size_t) i * n]);
+		memcpy(points, &(optimizer->kept[(size_t) (i % optimizer->numberOfKept) * n]), n * sizeof(ControlPoint));
+
+		perturbDesign(points, n, &random);
+		scoreDesign(optimizer, points, &(optimizer->candidateScores[i]));
+		optimizer->candidateScores[i].index = i;
+	}
+}
+
+/* Nudges the height or position of a few points, or flips whether they're part of a chain lift */
+static void perturbDesign(ControlPoint* points, int numberOfPoints, Random* random)
+{
+	int mutations = 1 + (int) (nextRandom(random) % MAX_MUTATIONS);
+
+	for(int m = 0; m < mutations; m++)
+	{
+		ControlPoint* point = &points[nextRandom(random) % numberOfPoints];
+		double kind = randomRange(random, 0, 1);
+
+		if(kind < CHAIN_FLIP_CHANCE)
+			point->isChain = !point->isChain;
+		else if(kind < 0.5 + (CHAIN_FLIP_CHANCE / 2))
+		{
+			point->position.y += randomRange(random, -HEIGHT_STEP, HEIGHT_STEP);
+			point->position.y = fminf(fmaxf(point->position.y, MIN_HEIGHT), MAX_HEIGHT);
+		}
+		else
+		{
+			point->position.x += randomRange(random, -POSITION_STEP, POSITION_STEP);
+			point->position.z += randomRange(random, -POSITION_STEP, POSITION_STEP);
+		}
+	}
+}
+
+static void scoreDesign(const Optimizer* optimizer, const ControlPoint* points, DesignScore* score)
+{
+	Track track;
+	memset(&track, 0, sizeof(Track));
+	memset(score, 0, sizeof(DesignScore));
+	score->score = -INFINITY;
+
+	generateTrack(&track, points, optimizer->numberOfPoints);
+	simulateLaps(&track, 1, &(score->evaluation));
+
+	for(int i = 0; i < track.numberOfPoints; i++)
+	{
+		if(!track.sections[i].isChain)
+			continue;
+
+		for(int j = 0; j < NUMBER_OF_SUB_SECTIONS; j++)
+			score->chainLength += track.sections[i].subSections[j].subSectionLength;
+	}
+
+	ClearanceReport* clearance = NULL;
+	if(score->evaluation.lapsCompleted > 0)
+		clearance = checkTrackClearance(&track, TRACK_CLEARANCE, TRACK_CLEARANCE_NEIGHBOUR_LENGTH);
+
+	if(clearance != NULL && clearance->numberOfPairs == 0)
+	{
+		if(optimizer->objective == LapTime)
+			score->score = -score->evaluation.averageLapTime;
+
+		else if(optimizer->objective == ChainLength)
+			score->score = -score->chainLength;
+
+		else if(optimizer->objective == Thrill)
+		{
+			RideAnalytics* analytics = analyzeRide(&track);
+			score->airtime = analytics->airtime;
+
+			if(analytics->minVerticalG >= MIN_VERTICAL_G && analytics->maxVerticalG <= MAX_VERTICAL_G)
+			{
+				score->score = score->evaluation.maxSpeed + (AIRTIME_WEIGHT * analytics->airtime);
+				score->score -= LATERAL_G_PENALTY * fmaxf(0, analytics->maxLateralG - LATERAL_G_LIMIT);
+			}
+
+			freeRideAnalytics(analytics);
+		}
+	}
+
+	freeClearanceReport(clearance);
+	freeTrack(&track);
+}
+
+/* Best first, ties go to the design found first so results don't depend on sort order */
+static int compareScores(const void* a, const void* b)
+{
+	const DesignScore* first = a;
+	const DesignScore* second = b;
+
+	if(first->score != second->score)
+		return first->score < second->score ? 1 : -1;
+	return first->index - second->index;
+}
+
+/* Merges the candidates that survived into the kept designs, kept designs win ties against new ones */
+static void keepBest(Optimizer* optimizer)
+{
+	int n = optimizer->numberOfPoints;
+	int total = optimizer->numberOfKept + optimizer->numberOfCandidates;
+
+	DesignScore* pool = malloc(total * sizeof(DesignScore));
+	int poolSize = 0;
+
+	for(int i = 0; i < optimizer->numberOfKept; i++)
+	{
+		pool[poolSize] = optimizer->keptScores[i];
+		pool[poolSize++].index = i;
+	}
+
+	for(int i = 0; i < optimizer->numberOfCandidates; i++)
+	{
+		if(optimizer->candidateScores[i].score == -INFINITY)
+			continue;
+
+		pool[poolSize] = optimizer->candidateScores[i];
+		pool[poolSize++].index = optimizer->numberOfKept + i;
+	}
+
+	qsort(pool, poolSize, sizeof(DesignScore), compareScores);
+	if(poolSize > optimizer->maxKept)
+		poolSize = optimizer->maxKept;
+
+	ControlPoint* kept = malloc((size_t) optimizer->maxKept * n * sizeof(ControlPoint));
+
+	for(int i = 0; i < poolSize; i++)
+	{
+		const ControlPoint* source;
+		if(pool[i].index < optimizer->numberOfKept)
+			source = &(optimizer->kept[(size_t) pool[i].index * n]);
+		else
+			source = &(optimizer->candidates[(size_t) (pool[i].index - optimizer->numberOfKept) * n]);
+
+		memcpy(&kept[(size_t) i * n], source, n * sizeof(ControlPoint));
+		optimizer->keptScores[i] = pool[i];
+	}
+
+	free(optimizer->kept);
+	optimizer->kept = kept;
+	optimizer->numberOfKept = poolSize;
+
+	free(pool);
+}
+
+
+//==============CHECKPOINTS===================
+
+/* Writes to a temporary file first so an interrupted save never clobbers the last good checkpoint */
+static int saveCheckpoint(const Optimizer* optimizer, const char* path)
+{
+	char* temporaryPath = malloc(strlen(path) + 5);
+	sprintf(temporaryPath, "%s.tmp", path);
+
+	FILE* file = fopen(temporaryPath, "wb");
+	if(file == NULL) {
+		free(temporaryPath);
+		return 0;
+	}
+
+	unsigned char header[5 + (5 * MAX_VARINT_BYTES)];
+	memcpy(header, CHECKPOINT_MAGIC, 4);
+	header[4] = CHECKPOINT_VERSION;
+
+	int length = 5;
+	length += writeVarint(header + length, optimizer->seed);
+	length += writeVarint(header + length, optimizer->objective);
+	length += writeVarint(header + length, optimizer->generation);
+	length += writeVarint(header + length, optimizer->numberOfPoints);
+	length += writeVarint(header + length, optimizer->numberOfKept);
+	fwrite(header, 1, length, file);
+
+	int failed = !writeTrackPoints(file, optimizer->kept, optimizer->numberOfKept * optimizer->numberOfPoints);
+	if(fclose(file) != 0 || failed || rename(temporaryPath, path) != 0) {
+		remove(temporaryPath);
+		failed = 1;
+	}
+
+	free(temporaryPath);
+	return !failed;
+}
+
+static int readFileVarint(FILE* file, uint64_t* value)
+{
+	unsigned char bytes[MAX_VARINT_BYTES];
+	int length = 0;
+	int c;
+
+	do {
+		c = fgetc(file);
+		if(c == EOF)
+			return 0;
+		bytes[length++] = (unsigned char) c;
+	} while((c & 0x80) && length < MAX_VARINT_BYTES);
+
+	const unsigned char* cursor = bytes;
+	*value = readVarint(&cursor, bytes + length);
+
+	return 1;
+}
+
+/* Restores the kept designs and where the search got to, returns 0 if there is no usable checkpoint */
+static int loadCheckpoint(Optimizer* optimizer, const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if(file == NULL)
+		return 0;
+
+	unsigned char header[5];
+	uint64_t seed, objective, generation, numberOfPoints, numberOfKept;
+
+	if(fread(header, 1, 5, file) != 5 || memcmp(header, CHECKPOINT_MAGIC, 4) != 0 || header[4] != CHECKPOINT_VERSION
+		|| !readFileVarint(file, &seed) || !readFileVarint(file, &objective) || !readFileVarint(file, &generation)
+		|| !readFileVarint(file, &numberOfPoints) || !readFileVarint(file, &numberOfKept)
+		|| objective >= NUMBER_OF_OBJECTIVES || numberOfPoints == 0 || numberOfPoints > INT32_MAX
+		|| numberOfKept == 0 || numberOfKept > (uint64_t) optimizer->maxKept)
+	{
+		fclose(file);
+		return 0;
+	}
+
+	ControlPoint* kept = malloc((size_t) optimizer->maxKept * numberOfPoints * sizeof(ControlPoint));
+	if(!readTrackPoints(file, kept, (int) (numberOfKept * numberOfPoints))) {
+		free(kept);
+		fclose(file);
+		return 0;
+	}
+
+	fclose(file);
+
+	free(optimizer->kept);
+	optimizer->kept = kept;
+	optimizer->seed = seed;
+	optimizer->objective = (int) objective;
+	optimizer->generation = (int) generation;
+	optimizer->numberOfPoints = (int) numberOfPoints;
+	optimizer->numberOfKept = (int) numberOfKept;
+
+	return 1;
+}
+
+
+//==============REPORTING=====================
+
+static void reportDesigns(const Optimizer* optimizer, const char* outputDirectory)
+{
+	printf("\nBest designs for %s after %d generations:\n", objectiveNames[optimizer->objective], optimizer->generation);
+	printf("rank     score  lap time  max speed  chain length  airtime\n");
+
+	for(int i = 0; i < optimizer->numberOfKept; i++)
+	{
+		const DesignScore* score = &(optimizer->keptScores[i]);
+
+		printf("%4d %9.3f %9.2f %10.2f %13.2f %8.2f\n", i, score->score, score->evaluation.averageLapTime,
+			score->evaluation.maxSpeed, score->chainLength, score->airtime);
+
+		if(outputDirectory != NULL)
+		{
+			char path[4096];
+			snprintf(path, sizeof(path), "%s/best-%02d%s", outputDirectory, i, TRACK_FILE_EXTENSION);
+
+			if(!saveTrackFile(path, &(optimizer->kept[(size_t) i * optimizer->numberOfPoints]), optimizer->numberOfPoints))
+				printf("Could not write %s\n", path);
+		}
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	Optimizer optimizer;
+	memset(&optimizer, 0, sizeof(Optimizer));
+	optimizer.seed = 1;
+	optimizer.objective = LapTime;
+	optimizer.maxKept = DEFAULT_KEEP;
+	optimizer.numberOfCandidates = DEFAULT_CANDIDATES;
+
+	int generations = DEFAULT_GENERATIONS;
+	const char* startPath = NULL;
+	const char* checkpointPath = NULL;
+	const char* outputDirectory = NULL;
+	int valid = 1;
+
+	for(int i = 1; i < argc && valid; i++)
+	{
+		if(strcmp(argv[i], "--objective") == 0 && i + 1 < argc)
+		{
+			i++;
+			optimizer.objective = NUMBER_OF_OBJECTIVES;
+			for(int o = 0; o < NUMBER_OF_OBJECTIVES; o++)
+				if(strcmp(argv[i], objectiveNames[o]) == 0)
+					optimizer.objective = o;
+			valid = optimizer.objective != NUMBER_OF_OBJECTIVES;
+		}
+		else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			optimizer.seed = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "--generations") == 0 && i + 1 < argc)
+			generations = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--candidates") == 0 && i + 1 < argc)
+			optimizer.numberOfCandidates = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--keep") == 0 && i + 1 < argc)
+			optimizer.maxKept = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--start") == 0 && i + 1 < argc)
+			startPath = argv[++i];
+		else if(strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+			checkpointPath = argv[++i];
+		else if(strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			outputDirectory = argv[++i];
+		else
+			valid = 0;
+	}
+
+	if(!valid || optimizer.numberOfCandidates < 1 || optimizer.maxKept < 1) {
+		printf("Usage: %s [--objective lap-time|thrill|chain] [--seed n] [--generations n] [--candidates n] [--keep n]\n", argv[0]);
+		printf("       [--start file] [--checkpoint file] [--output directory]\n");
+		return 1;
+	}
+
+	optimizer.keptScores = malloc(optimizer.maxKept * sizeof(DesignScore));
+
+	if(checkpointPath != NULL && loadCheckpoint(&optimizer, checkpointPath))
+		printf("Resuming %s from generation %d of %s\n", objectiveNames[optimizer.objective], optimizer.generation, checkpointPath);
+
+	else if(startPath != NULL)
+	{
+		optimizer.kept = loadTrackFile(startPath, &(optimizer.numberOfPoints));
+		if(optimizer.kept == NULL) {
+			printf("%s is not a track file\n", startPath);
+			return 1;
+		}
+		optimizer.numberOfKept = 1;
+	}
+	else
+	{
+		optimizer.numberOfPoints = DEFAULT_COASTER_POINTS;
+		optimizer.kept = malloc(DEFAULT_COASTER_POINTS * sizeof(ControlPoint));
+		getDefaultCoaster(optimizer.kept);
+		optimizer.numberOfKept = 1;
+	}
+
+	//Scores aren't saved, they come out the same when the designs are run again
+	for(int i = 0; i < optimizer.numberOfKept; i++)
+	{
+		scoreDesign(&optimizer, &(optimizer.kept[(size_t) i * optimizer.numberOfPoints]), &(optimizer.keptScores[i]));
+		optimizer.keptScores[i].index = i;
+	}
+
+	optimizer.candidates = malloc((size_t) optimizer.numberOfCandidates * optimizer.numberOfPoints * sizeof(ControlPoint));
+	optimizer.candidateScores = malloc(optimizer.numberOfCandidates * sizeof(DesignScore));
+
+	double startTime = getTimeSeconds();
+	double lastCheckpoint = startTime;
+	long evaluated = 0;
+
+	while(optimizer.generation < generations)
+	{
+		parallelFor(optimizer.numberOfCandidates, CANDIDATE_GRAIN, evaluateCandidates, &optimizer);
+		keepBest(&optimizer);
+
+		optimizer.generation++;
+		evaluated += optimizer.numberOfCandidates;
+
+		double now = getTimeSeconds();
+		printf("Generation %d: best %.3f, %.0f candidates/s\n", optimizer.generation, optimizer.keptScores[0].score,
+			evaluated / (now - startTime));
+
+		if(checkpointPath != NULL && (now - lastCheckpoint >= CHECKPOINT_SECONDS || optimizer.generation == generations))
+		{
+			if(!saveCheckpoint(&optimizer, checkpointPath))
+				printf("Could not write checkpoint %s\n", checkpointPath);
+			lastCheckpoint = now;
+		}
+	}
+
+	reportDesigns(&optimizer, outputDirectory);
+
+	free(optimizer.kept);
+	free(optimizer.keptScores);
+	free(optimizer.candidates);
+	free(optimizer.candidateScores);
+
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*	TrackShader.c
+ *	This module draws finished track by extruding its rails and supports from the centerline on the GPU
+ *
+ *	Only one sample per subsection, its position and frame, is uploaded. The rails are the profile RailMesh.c
+ *	sweeps on the CPU, as a small indexed mesh of one subsection's length, drawn once per subsection as an
+ *	instance that reads the samples at both of its ends. Supports are drawn the same way from every section's
+ *	first sample. Nothing here needs more than GLSL 1.20 and instanced arrays, so it runs on Mesa's software
+ *	renderer as well as on hardware.
+ */
+#include "gpu.h"
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "trackshader.h"
+#include "railmesh.h"
+
+//Where supports meet the track below the centerline
+#define SUPPORT_DROP 0.5f
+#define SUPPORT_WIDTH 8
+
+//Across, up and which end of the subsection, then colour
+#define PROFILE_FLOATS 6
+
+//Across and up the frame, then down in the world and whether to stop at the ground
+#define SUPPORT_FLOATS 4
+#define SUPPORT_VERTICES 6
+
+enum { RailPoint, RailColour, RailStart, RailEnd = RailStart + 4, NUMBER_OF_RAIL_ATTRIBUTES = RailEnd + 4 };
+enum { SupportProfile, SupportPosition, SupportTangent, SupportNormal, SupportBottom, NUMBER_OF_SUPPORT_ATTRIBUTES };
+
+static const char* railVertexShader =
+	"#version 120\n"
+	"attribute vec3 profile;\n"
+	"attribute vec3 colour;\n"
+	"attribute vec3 startPosition, startTangent, startNormal, startOverlay;\n"
+	"attribute vec3 endPosition, endTangent, endNormal, endOverlay;\n"
+	"uniform float overlay;\n"
+	"varying vec3 vertexColour;\n"
+	"invariant gl_Position;\n"
+	"void main() {\n"
+	"	vec3 position = mix(startPosition, endPosition, profile.z);\n"
+	"	vec3 normal = mix(startNormal, endNormal, profile.z);\n"
+	"	vec3 binormal = cross(mix(startTangent, endTangent, profile.z), normal);\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(position + (binormal * profile.x) + (normal * profile.y), 1.0);\n"
+	"	vertexColour = mix(colour, mix(startOverlay, endOverlay, profile.z), overlay);\n"
+	"}\n";
+
+static const char* supportVertexShader =
+	"#version 120\n"
+	"attribute vec4 profile;\n"
+	"attribute vec3 position;\n"
+	"attribute vec3 tangent;\n"
+	"attribute vec3 normal;\n"
+	"attribute float bottom;\n"
+	"varying vec3 vertexColour;\n"
+	"void main() {\n"
+	"	vec3 point = position + (cross(tangent, normal) * profile.x) + (normal * profile.y) - vec3(0.0, profile.z, 0.0);\n"
+	"	if(profile.w > 0.5)\n"
+	"		point.y = min(point.y, bottom);\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(point, 1.0);\n"
+	"	vertexColour = vec3(0.65);\n"
+	"}\n";
+
+static const char* trackFragmentShader =
+	"#version 120\n"
+	"varying vec3 vertexColour;\n"
+	"void main() {\n"
+	"	gl_FragColor = vec4(vertexColour, 1.0);\n"
+	"}\n";
+
+static const char* const railAttributes[NUMBER_OF_RAIL_ATTRIBUTES] = {
+	"profile", "colour",
+	"startPosition", "startTangent", "startNormal", "startOverlay",
+	"endPosition", "endTangent", "endNormal", "endOverlay"
+};
+
+static const char* const supportAttributes[NUMBER_OF_SUPPORT_ATTRIBUTES] = { "profile", "position", "tangent", "normal", "bottom" };
+
+static atomic_int available = 0;
+static unsigned int railProgram = 0;
+static unsigned int supportProgram = 0;
+static int overlayLocation;
+static unsigned int profileBuffer = 0;
+static unsigned int profileIndexBuffer = 0;
+static int numberOfProfileIndices;
+static int numberOfTopProfileIndices;
+static unsigned int supportProfileBuffer = 0;
+
+
+/*	Builds the shaders and the cross-section meshes every track shares
+ *	Returns 0 if the driver can't run them, in which case tracks are built on the CPU as before
+ */
+int initTrackShaders()
+{
+#ifdef GPU_EXTENSIONS
+	if(!hasGlVersion(3, 3))
+		return 0;
+
+	railProgram = buildShaderProgram("rail", railVertexShader, trackFragmentShader, railAttributes, NUMBER_OF_RAIL_ATTRIBUTES);
+	supportProgram = buildShaderProgram("support", supportVertexShader, trackFragmentShader, supportAttributes,
+		NUMBER_OF_SUPPORT_ATTRIBUTES);
+	if(railProgram == 0 || supportProgram == 0)
+		return 0;
+
+	overlayLocation = glGetUniformLocation(railProgram, "overlay");
+
+	//Two rings of the rail profile, one at each end of the subsection
+	const RailProfile* railProfile = getRailProfile();
+	float profile[2 * MAX_PROFILE_POINTS * PROFILE_FLOATS];
+	for(int end = 0; end < 2; end++)
+	{
+		for(int i = 0; i < railProfile->numberOfPoints; i++)
+		{
+			const ProfilePoint* point = &(railProfile->points[i]);
+			float* vertex = profile + (((end * railProfile->numberOfPoints) + i) * PROFILE_FLOATS);
+			vertex[0] = point->across;
+			vertex[1] = point->up;
+			vertex[2] = end;
+			vertex[3] = point->shade;
+			vertex[4] = point->shade;
+			vertex[5] = point->shade;
+		}
+	}
+
+	numberOfProfileIndices = getRailIndexCount(railProfile, 2);
+	unsigned int* profileIndices = malloc(numberOfProfileIndices * sizeof(unsigned int));
+	numberOfTopProfileIndices = buildRailIndices(railProfile, 2, profileIndices);
+
+	//The pillar down to the ground, then a strut up to each rail
+	const float supportProfile[SUPPORT_VERTICES * SUPPORT_FLOATS] = {
+		0, 0, SUPPORT_DROP, 0,	0, 0, SUPPORT_DROP, 1,
+		0, 0, SUPPORT_DROP, 0,	-railProfile->supportAcross, railProfile->supportUp, 0, 0,
+		0, 0, SUPPORT_DROP, 0,	railProfile->supportAcross, railProfile->supportUp, 0, 0
+	};
+
+	glGenBuffers(1, &profileBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, profileBuffer);
+	glBufferData(GL_ARRAY_BUFFER, 2 * railProfile->numberOfPoints * PROFILE_FLOATS * sizeof(float), profile, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &profileIndexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, profileIndexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numberOfProfileIndices * sizeof(unsigned int), profileIndices, GL_STATIC_DRAW);
+	free(profileIndices);
+
+	glGenBuffers(1, &supportProfileBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, supportProfileBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(supportProfile), supportProfile, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	atomic_store(&available, 1);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/* Whether tracks should be built for the shaders, safe from any thread */
+int hasTrackShaders()
+{
+	return atomic_load(&available);
+}
+
+/*	Uploads a track's samples, numberOfSubSections + 1 of them, and the ground height under each support
+ *	Replaces whatever the buffers held before
+ */
+void uploadTrackBuffers(TrackBuffers* buffers, const RailSample* samples, int numberOfSubSections,
+	const float* supportBottoms, int subSectionsPerSupport)
+{
+#ifdef GPU_EXTENSIONS
+	if(buffers->sampleBuffer == 0) {
+		glGenBuffers(1, &(buffers->sampleBuffer));
+		glGenBuffers(1, &(buffers->supportBuffer));
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffers->sampleBuffer);
+	glBufferData(GL_ARRAY_BUFFER, (numberOfSubSections + 1) * sizeof(RailSample), samples, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffers->supportBuffer);
+	glBufferData(GL_ARRAY_BUFFER, (numberOfSubSections / subSectionsPerSupport) * sizeof(float), supportBottoms, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	buffers->numberOfSubSections = numberOfSubSections;
+	buffers->subSectionsPerSupport = subSectionsPerSupport;
+#endif
+}
+
+void freeTrackBuffers(TrackBuffers* buffers)
+{
+#ifdef GPU_EXTENSIONS
+	if(buffers->sampleBuffer != 0) {
+		glDeleteBuffers(1, &(buffers->sampleBuffer));
+		glDeleteBuffers(1, &(buffers->supportBuffer));
+	}
+#endif
+
+	buffers->sampleBuffer = 0;
+	buffers->supportBuffer = 0;
+	buffers->numberOfSubSections = 0;
+}
+
+/*	Draws every face of both rails, or with overlay just their tops coloured by g over the rails already drawn
+ *	The overlay runs through the same shader so it lands on exactly the same depths
+ */
+void drawTrackRails(const TrackBuffers* buffers, int overlay)
+{
+#ifdef GPU_EXTENSIONS
+	if(buffers->numberOfSubSections == 0)
+		return;
+
+	glUseProgram(railProgram);
+	glUniform1f(overlayLocation, overlay ? 1.0f : 0.0f);
+
+	glBindBuffer(GL_ARRAY_BUFFER, profileBuffer);
+	glEnableVertexAttribArray(RailPoint);
+	glEnableVertexAttribArray(RailColour);
+	glVertexAttribPointer(RailPoint, 3, GL_FLOAT, GL_FALSE, PROFILE_FLOATS * sizeof(float), (void*) 0);
+	glVertexAttribPointer(RailColour, 3, GL_FLOAT, GL_FALSE, PROFILE_FLOATS * sizeof(float), (void*) (3 * sizeof(float)));
+
+	//Each instance reads its own sample and the next one along
+	glBindBuffer(GL_ARRAY_BUFFER, buffers->sampleBuffer);
+	for(int i = 0; i < 4; i++)
+	{
+		size_t offset = i * sizeof(Vector3);
+
+		glEnableVertexAttribArray(RailStart + i);
+		glEnableVertexAttribArray(RailEnd + i);
+		glVertexAttribPointer(RailStart + i, 3, GL_FLOAT, GL_FALSE, sizeof(RailSample), (void*) offset);
+		glVertexAttribPointer(RailEnd + i, 3, GL_FLOAT, GL_FALSE, sizeof(RailSample), (void*) (offset + sizeof(RailSample)));
+		glVertexAttribDivisor(RailStart + i, 1);
+		glVertexAttribDivisor(RailEnd + i, 1);
+	}
+
+	if(overlay)
+		glDepthFunc(GL_LEQUAL);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, profileIndexBuffer);
+	glDrawElementsInstanced(GL_TRIANGLES, overlay ? numberOfTopProfileIndices : numberOfProfileIndices, GL_UNSIGNED_INT, (void*) 0,
+		buffers->numberOfSubSections);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	if(overlay)
+		glDepthFunc(GL_LESS);
+
+	for(int i = 0; i < NUMBER_OF_RAIL_ATTRIBUTES; i++)
+	{
+		glVertexAttribDivisor(i, 0);
+		glDisableVertexAttribArray(i);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(0);
+#endif
+}
+
+void drawTrackSupports(const TrackBuffers* buffers)
+{
+#ifdef GPU_EXTENSIONS
+	if(buffers->numberOfSubSections == 0)
+		return;
+
+	glUseProgram(supportProgram);
+	glLineWidth(SUPPORT_WIDTH);
+
+	glBindBuffer(GL_ARRAY_BUFFER, supportProfileBuffer);
+	glEnableVertexAttribArray(SupportProfile);
+	glVertexAttribPointer(SupportProfile, SUPPORT_FLOATS, GL_FLOAT, GL_FALSE, SUPPORT_FLOATS * sizeof(float), (void*) 0);
+
+	//Supports stand under the first sample of each section
+	glBindBuffer(GL_ARRAY_BUFFER, buffers->sampleBuffer);
+	GLsizei stride = buffers->subSectionsPerSupport * sizeof(RailSample);
+	for(int i = 0; i < 3; i++)
+	{
+		glEnableVertexAttribArray(SupportPosition + i);
+		glVertexAttribPointer(SupportPosition + i, 3, GL_FLOAT, GL_FALSE, stride, (void*) (i * sizeof(Vector3)));
+		glVertexAttribDivisor(SupportPosition + i, 1);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffers->supportBuffer);
+	glEnableVertexAttribArray(SupportBottom);
+	glVertexAttribPointer(SupportBottom, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*) 0);
+	glVertexAttribDivisor(SupportBottom, 1);
+
+	glDrawArraysInstanced(GL_LINES, 0, SUPPORT_VERTICES, buffers->numberOfSubSections / buffers->subSectionsPerSupport);
+
+	for(int i = 0; i < NUMBER_OF_SUPPORT_ATTRIBUTES; i++)
+	{
+		glVertexAttribDivisor(i, 0);
+		glDisableVertexAttribArray(i);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(0);
+#endif
+}
@@ -0,0 +1,35 @@
+#ifndef TRACKSHADER_H
+#define TRACKSHADER_H
+
+#include "engine.h"
+
+/*	One subsection as the track shaders read it, everything else about the rails is extruded from this
+ *	A track's samples run one past its last subsection, back round to the first, to close the loop
+ */
+typedef struct {
+	Vector3 position;
+	Vector3 tangent;
+	Vector3 normal;
+	Vector3 overlayColour;
+} RailSample;
+
+/*	A finished track on the GPU, owned by the render thread */
+typedef struct {
+	unsigned int sampleBuffer;
+	unsigned int supportBuffer;
+	int numberOfSubSections;
+	int subSectionsPerSupport;
+} TrackBuffers;
+
+//From the render thread, apart from hasTrackShaders()
+int initTrackShaders(void);
+int hasTrackShaders(void);
+
+void uploadTrackBuffers(TrackBuffers* buffers, const RailSample* samples, int numberOfSubSections,
+	const float* supportBottoms, int subSectionsPerSupport);
+void freeTrackBuffers(TrackBuffers* buffers);
+
+void drawTrackRails(const TrackBuffers* buffers, int overlay);
+void drawTrackSupports(const TrackBuffers* buffers);
+
+#endif